@@ -0,0 +1,635 @@
+/* atomic.c
+ * Collapse the atomic saves of the editors into a single event
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "queue.h"
+#include "atomic.h"
+
+/* an event held */
+typedef struct atomic_event_s
+{
+    struct inotify_event *event;
+    char *directory;
+    int match;
+} ATOMIC_EVENT;
+
+enum
+{
+    ATOMIC_TEMPORARY, /* a temporary file, that could be renamed over a file */
+    ATOMIC_REPLACED   /* a file renamed to its backup, that could be written again */
+};
+
+/* a save in progress */
+typedef struct atomic_save_s
+{
+    int kind;
+    char *directory;  /* with the trailing slash */
+    char *name;       /* the temporary file, or the file replaced */
+    char *backup;     /* ATOMIC_REPLACED: the backup of the file */
+    int created;      /* ATOMIC_TEMPORARY: the file has been created within the window */
+    int written;      /* ATOMIC_REPLACED: the file has been written again */
+    int wd;           /* ATOMIC_REPLACED: watch of the file, for the event that replaces the save */
+    int match;        /* ATOMIC_REPLACED: the file matches --include */
+    uint64_t expires; /* milliseconds, CLOCK_MONOTONIC */
+    Queue *events;    /* queue of ATOMIC_EVENT, in the order they came */
+} ATOMIC_SAVE;
+
+static int timer_fd = -1;
+static uint32_t save_mask = 0;
+static atomic_forward_t forward = NULL;
+static Queue *saves = NULL;          /* queue of ATOMIC_SAVE */
+static ATOMIC_EVENT *move = NULL;    /* IN_MOVED_FROM waiting for its IN_MOVED_TO */
+static uint64_t move_expires = 0;
+
+static uint64_t now_ms()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static int ends_with(const char *name, const char *suffix)
+{
+    size_t name_len = strlen(name), suffix_len = strlen(suffix);
+
+    return name_len > suffix_len && strcmp(name + name_len - suffix_len, suffix) == 0;
+}
+
+/* the length chars after name are letters and digits, up to the end */
+static int random_suffix(const char *name, size_t length)
+{
+    size_t i;
+    for (i = 0; i < length; ++i)
+    {
+        if (!isalnum((unsigned char)name[i]) && name[i] != '_')
+            return 0;
+    }
+
+    return name[length] == '\0';
+}
+
+/* as random_suffix, with at least two of lowercase, uppercase and digits
+ * as mkstemp gives, so that a word (.bashrc.backup) is not taken for it
+ */
+static int mixed_suffix(const char *name, size_t length)
+{
+    int lower = 0, upper = 0, digit = 0;
+    size_t i;
+
+    if (!random_suffix(name, length))
+        return 0;
+
+    for (i = 0; i < length; ++i)
+    {
+        lower |= islower((unsigned char)name[i]) ? 1 : 0;
+        upper |= isupper((unsigned char)name[i]) ? 1 : 0;
+        digit |= isdigit((unsigned char)name[i]) ? 1 : 0;
+    }
+
+    return lower + upper + digit >= 2;
+}
+
+/* the chars after name are letters and digits, at least one */
+static int number_suffix(const char *name)
+{
+    size_t length = strlen(name);
+
+    return length > 0 && random_suffix(name, length);
+}
+
+static void set_target(char *target, size_t size, const char *name, size_t length)
+{
+    if (length >= size)
+        length = size - 1;
+
+    memcpy(target, name, length);
+    target[length] = '\0';
+}
+
+int atomic_temporary(const char *name, char *target, size_t size)
+{
+    size_t length = strlen(name);
+    const char *found;
+
+    target[0] = '\0';
+
+    /* file~ */
+    if (ends_with(name, "~"))
+    {
+        set_target(target, size, name, length - 1);
+        return 1;
+    }
+
+    /* file___jb_tmp___, file___jb_old___ */
+    if (ends_with(name, "___jb_tmp___") || ends_with(name, "___jb_old___"))
+    {
+        set_target(target, size, name, length - strlen("___jb_tmp___"));
+        return 1;
+    }
+
+    /* .file.swp, .file.swx */
+    if (name[0] == '.' && (ends_with(name, ".swp") || ends_with(name, ".swx")) && length > 5)
+    {
+        set_target(target, size, name + 1, length - 5);
+        return 1;
+    }
+
+    /* file.tmp, file.tmp.1234, file.tmp-1234, with .tmp last */
+    for (found = strstr(name, ".tmp"); found != NULL; found = strstr(found + 1, ".tmp"))
+    {
+        if (found != name && (found[4] == '\0' || ((found[4] == '.' || found[4] == '-') && number_suffix(found + 5))))
+        {
+            set_target(target, size, name, found - name);
+            return 1;
+        }
+    }
+
+    /* 4913 of vim, .goutputstream-XXXXXX of gedit, sedXXXXXX, tmpXXXXXXXX of python */
+    if (strcmp(name, "4913") == 0 || strncmp(name, ".goutputstream-", 15) == 0 ||
+        (strncmp(name, "sed", 3) == 0 && random_suffix(name + 3, 6)) ||
+        (strncmp(name, "tmp", 3) == 0 && random_suffix(name + 3, 8)))
+        return 1;
+
+    /* .file.XXXXXX of rsync */
+    found = strrchr(name, '.');
+    if (name[0] == '.' && found != NULL && found - name > 1 && mixed_suffix(found + 1, 6))
+    {
+        set_target(target, size, name + 1, found - name - 1);
+        return 1;
+    }
+
+    return 0;
+}
+
+static ATOMIC_EVENT *copy_event(const struct inotify_event *event, const char *directory, int match)
+{
+    ATOMIC_EVENT *copy = (ATOMIC_EVENT *)malloc(sizeof(ATOMIC_EVENT));
+    if (copy == NULL)
+        return NULL;
+
+    size_t size = sizeof(struct inotify_event) + event->len;
+    copy->event = (struct inotify_event *)malloc(size);
+    copy->directory = strdup(directory);
+    copy->match = match;
+
+    if (copy->event == NULL || copy->directory == NULL)
+    {
+        free(copy->event);
+        free(copy->directory);
+        free(copy);
+        return NULL;
+    }
+    memcpy(copy->event, event, size);
+
+    return copy;
+}
+
+static void free_event(ATOMIC_EVENT *held)
+{
+    free(held->event);
+    free(held->directory);
+    free(held);
+}
+
+static void release_event(ATOMIC_EVENT *held)
+{
+    forward(held->event, held->directory, held->match);
+    free_event(held);
+}
+
+/* forwards an event that replaces a save */
+static void emit(uint32_t mask, int wd, const char *directory, const char *name, int match)
+{
+    union
+    {
+        struct inotify_event event;
+        char buffer[sizeof(struct inotify_event) + NAME_MAX + 1];
+    } record;
+
+    if (strlen(name) > NAME_MAX)
+        return;
+
+    record.event.wd = wd;
+    record.event.mask = mask;
+    record.event.cookie = 0;
+    record.event.len = strlen(name) + 1;
+    strcpy(record.event.name, name);
+
+    forward(&record.event, (char *)directory, match);
+}
+
+static QueueElement *find_save(int kind, const char *directory, const char *name)
+{
+    QueueElement *element;
+    for (element = saves->first; element != NULL; element = element->next)
+    {
+        ATOMIC_SAVE *save = (ATOMIC_SAVE *)element->data;
+        if (save->kind == kind && strcmp(save->name, name) == 0 && strcmp(save->directory, directory) == 0)
+            return element;
+    }
+
+    return NULL;
+}
+
+static QueueElement *find_backup(const char *directory, const char *name)
+{
+    QueueElement *element;
+    for (element = saves->first; element != NULL; element = element->next)
+    {
+        ATOMIC_SAVE *save = (ATOMIC_SAVE *)element->data;
+        if (save->kind == ATOMIC_REPLACED && strcmp(save->backup, name) == 0 && strcmp(save->directory, directory) == 0)
+            return element;
+    }
+
+    return NULL;
+}
+
+static ATOMIC_SAVE *new_save(int kind, const char *directory, const char *name)
+{
+    ATOMIC_SAVE *save = (ATOMIC_SAVE *)calloc(1, sizeof(ATOMIC_SAVE));
+    if (save == NULL)
+        return NULL;
+
+    save->kind = kind;
+    save->directory = strdup(directory);
+    save->name = strdup(name);
+    save->events = queue_init();
+
+    if (save->directory == NULL || save->name == NULL || save->events == NULL || queue_enqueue(saves, save) == NULL)
+    {
+        free(save->directory);
+        free(save->name);
+        queue_free(save->events);
+        free(save);
+        return NULL;
+    }
+
+    return save;
+}
+
+static void append(ATOMIC_SAVE *save, ATOMIC_EVENT *held)
+{
+    if (held == NULL)
+        return;
+
+    queue_enqueue(save->events, held);
+    save->expires = now_ms() + ATOMIC_WINDOW_MS;
+}
+
+/* ends a save, releasing or dropping its events */
+static void close_save(QueueElement *element, int release)
+{
+    ATOMIC_SAVE *save = (ATOMIC_SAVE *)element->data;
+    ATOMIC_EVENT *held;
+
+    queue_remove(saves, element);
+
+    while ((held = (ATOMIC_EVENT *)queue_dequeue(save->events)))
+    {
+        if (release)
+            release_event(held);
+        else
+            free_event(held);
+    }
+
+    queue_free(save->events);
+    free(save->directory);
+    free(save->name);
+    free(save->backup);
+    free(save);
+}
+
+/* the file replaced by its backup has been written again */
+static void complete_replaced(QueueElement *element)
+{
+    ATOMIC_SAVE *save = (ATOMIC_SAVE *)element->data;
+
+    emit(save_mask, save->wd, save->directory, save->name, save->match);
+    close_save(element, 0);
+}
+
+/* an event not recognized goes to its save, if any */
+static void route(ATOMIC_EVENT *held)
+{
+    const char *name = held->event->name;
+    QueueElement *element = find_save(ATOMIC_TEMPORARY, held->directory, name);
+
+    if (element == NULL)
+        element = find_save(ATOMIC_REPLACED, held->directory, name);
+    if (element == NULL)
+        element = find_backup(held->directory, name);
+
+    if (element != NULL)
+        append((ATOMIC_SAVE *)element->data, held);
+    else
+        release_event(held);
+}
+
+static void arm()
+{
+    struct itimerspec timer;
+    uint64_t expires = (move != NULL) ? move_expires : 0;
+
+    QueueElement *element;
+    for (element = saves->first; element != NULL; element = element->next)
+    {
+        ATOMIC_SAVE *save = (ATOMIC_SAVE *)element->data;
+        if (expires == 0 || save->expires < expires)
+            expires = save->expires;
+    }
+
+    /* a zero value disarms the timer */
+    memset(&timer, 0, sizeof(timer));
+    timer.it_value.tv_sec = expires / 1000;
+    timer.it_value.tv_nsec = (expires % 1000) * 1000000;
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &timer, NULL);
+}
+
+/* a rename, returns 1 if it is a step of a save */
+static int renamed(ATOMIC_EVENT *from, const struct inotify_event *to, const char *directory, int match)
+{
+    char target[NAME_MAX + 1];
+    char to_target[NAME_MAX + 1];
+    const char *from_name = from->event->name;
+
+    int from_temporary = atomic_temporary(from_name, target, sizeof(target));
+    int to_temporary = atomic_temporary(to->name, to_target, sizeof(to_target));
+
+    /* a temporary file written within the window, renamed over the file
+     * saved in the same directory */
+    QueueElement *element = NULL;
+    if (from_temporary && !to_temporary && strcmp(from->directory, directory) == 0)
+        element = find_save(ATOMIC_TEMPORARY, directory, from_name);
+
+    if (element != NULL)
+    {
+        close_save(element, 0);
+        free_event(from);
+
+        /* the file has been renamed to its backup before (JetBrains) */
+        element = find_save(ATOMIC_REPLACED, directory, to->name);
+        if (element != NULL)
+            ((ATOMIC_SAVE *)element->data)->written = 1;
+        else
+            emit(save_mask, to->wd, directory, to->name, match);
+
+        return 1;
+    }
+
+    /* a file renamed to its backup, it is going to be written again */
+    if (!from_temporary && to_temporary && strcmp(from_name, to_target) == 0 && strcmp(from->directory, directory) == 0 &&
+        find_save(ATOMIC_REPLACED, directory, from_name) == NULL)
+    {
+        ATOMIC_SAVE *save = new_save(ATOMIC_REPLACED, directory, from_name);
+        if (save != NULL && (save->backup = strdup(to->name)) != NULL)
+        {
+            save->wd = from->event->wd;
+            save->match = from->match;
+            append(save, from);
+            append(save, copy_event(to, directory, match));
+            return 1;
+        }
+
+        if (save != NULL)
+            close_save(find_save(ATOMIC_REPLACED, directory, from_name), 0);
+    }
+
+    route(from);
+    return 0;
+}
+
+int atomic_start(uint32_t mask, atomic_forward_t forward_to)
+{
+    if (timer_fd != -1)
+        return timer_fd;
+
+    if ((saves = queue_init()) == NULL)
+        return -1;
+
+    if ((timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) == -1)
+    {
+        queue_free(saves);
+        saves = NULL;
+        return -1;
+    }
+
+    save_mask = mask;
+    forward = forward_to;
+
+    return timer_fd;
+}
+
+int atomic_descriptor()
+{
+    return timer_fd;
+}
+
+int atomic_hold(const struct inotify_event *event, const char *directory, int match)
+{
+    char target[NAME_MAX + 1];
+
+    if (timer_fd == -1)
+        return 0;
+
+    /* the IN_MOVED_TO of a rename comes right after its IN_MOVED_FROM */
+    if (move != NULL)
+    {
+        ATOMIC_EVENT *from = move;
+        move = NULL;
+
+        if ((event->mask & IN_MOVED_TO) && event->len > 0 && !(event->mask & IN_ISDIR) && event->cookie == from->event->cookie)
+        {
+            if (renamed(from, event, directory, match))
+            {
+                arm();
+                return 1;
+            }
+        }
+        else
+        {
+            route(from);
+        }
+    }
+
+    if (event->len == 0 || (event->mask & IN_ISDIR))
+    {
+        arm();
+        return 0;
+    }
+
+    if (event->mask & IN_MOVED_FROM)
+    {
+        if ((move = copy_event(event, directory, match)) == NULL)
+            return 0;
+
+        move_expires = now_ms() + ATOMIC_WINDOW_MS;
+        arm();
+        return 1;
+    }
+
+    QueueElement *element;
+    const char *name = event->name;
+
+    /* the file renamed to its backup is written again */
+    if ((element = find_save(ATOMIC_REPLACED, directory, name)) != NULL)
+    {
+        ATOMIC_SAVE *save = (ATOMIC_SAVE *)element->data;
+        if (event->mask & (IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO))
+            save->written = 1;
+        append(save, copy_event(event, directory, match));
+        arm();
+        return 1;
+    }
+
+    /* the backup is deleted at the end of the save */
+    if ((element = find_backup(directory, name)) != NULL)
+    {
+        ATOMIC_SAVE *save = (ATOMIC_SAVE *)element->data;
+        append(save, copy_event(event, directory, match));
+        if (event->mask & IN_DELETE)
+        {
+            if (save->written)
+                complete_replaced(element);
+            else
+                close_save(element, 1);
+        }
+        arm();
+        return 1;
+    }
+
+    if (!atomic_temporary(name, target, sizeof(target)))
+    {
+        arm();
+        return 0;
+    }
+
+    if ((element = find_save(ATOMIC_TEMPORARY, directory, name)) == NULL)
+    {
+        /* only the temporary files written within the window */
+        ATOMIC_SAVE *save;
+        if (!(event->mask & (IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE)) || (save = new_save(ATOMIC_TEMPORARY, directory, name)) == NULL)
+        {
+            arm();
+            return 0;
+        }
+
+        save->created = (event->mask & IN_CREATE) ? 1 : 0;
+        element = find_save(ATOMIC_TEMPORARY, directory, name);
+    }
+
+    ATOMIC_SAVE *save = (ATOMIC_SAVE *)element->data;
+    append(save, copy_event(event, directory, match));
+
+    /* created and deleted within the window: nothing happened */
+    if (event->mask & IN_DELETE)
+        close_save(element, save->created == 0);
+
+    arm();
+    return 1;
+}
+
+void atomic_expire()
+{
+    uint64_t expirations;
+
+    if (timer_fd == -1)
+        return;
+
+    if (read(timer_fd, &expirations, sizeof(expirations)) == -1)
+        expirations = 0;
+
+    uint64_t now = now_ms();
+
+    /* a file moved out of the tree */
+    if (move != NULL && move_expires <= now)
+    {
+        ATOMIC_EVENT *from = move;
+        move = NULL;
+        route(from);
+    }
+
+    QueueElement *element = saves->first;
+    while (element != NULL)
+    {
+        QueueElement *next = element->next;
+        ATOMIC_SAVE *save = (ATOMIC_SAVE *)element->data;
+
+        if (save->expires <= now)
+        {
+            /* a backup that is kept (vim with 'backup') */
+            if (save->kind == ATOMIC_REPLACED && save->written)
+            {
+                emit(save_mask, save->wd, save->directory, save->name, save->match);
+                emit(IN_CREATE, save->wd, save->directory, save->backup, save->match);
+                close_save(element, 0);
+            }
+            else
+            {
+                close_save(element, 1);
+            }
+        }
+
+        element = next;
+    }
+
+    arm();
+}
+
+int atomic_in_progress()
+{
+    if (saves == NULL)
+        return 0;
+
+    return queue_size(saves) + ((move != NULL) ? 1 : 0);
+}
+
+void atomic_stop()
+{
+    if (timer_fd == -1)
+        return;
+
+    if (move != NULL)
+        free_event(move);
+    move = NULL;
+
+    while (saves->first != NULL)
+        close_save(saves->first, 0);
+    queue_free(saves);
+    saves = NULL;
+
+    close(timer_fd);
+    timer_fd = -1;
+}
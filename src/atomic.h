@@ -0,0 +1,111 @@
+/* atomic.h
+ * Collapse the atomic saves of the editors into a single event
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#ifndef __ATOMIC_H
+#define __ATOMIC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/inotify.h>
+
+/* Many editors and tools save a file without writing it in place:
+ *
+ *   - write a temporary file, then rename it over the file
+ *     (file.tmp.1234, .goutputstream-XXXXXX, sedXXXXXX, tmpXXXXXXXX)
+ *   - rename the file to a backup, write the file again, delete the
+ *     backup (file~, vim)
+ *   - both of them (file___jb_tmp___ and file___jb_old___, JetBrains)
+ *
+ * With --atomic-saves the events of the temporary files and of the
+ * backups are held for ATOMIC_WINDOW_MS. When the sequence of a save is
+ * recognized, by the names and by the cookies of the renames, all its
+ * events are replaced by a single event of the file saved. Otherwise the
+ * events are released as they came once the window is over.
+ *
+ * A temporary file created and deleted within the window (as the 4913
+ * of vim) is not reported at all. The events of the other files are not
+ * held, so they can be reported before the ones of a save in progress.
+ */
+#define ATOMIC_WINDOW_MS 500
+
+/* events needed to recognize a save */
+#define ATOMIC_EVENTS (IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE | IN_MOVE)
+
+/* called with the events released and with the ones that replace a save
+ *
+ * @param struct inotify_event * : the event
+ * @param char *                 : directory of the event, with the trailing slash
+ * @param int                    : the event matches --include
+ */
+typedef void (*atomic_forward_t)(struct inotify_event *, char *, int);
+
+/* starts the recognizer
+ *
+ * @param  uint32_t         : mask of the event that replaces a save
+ * @param  atomic_forward_t : where the events go
+ * @return int              : the descriptor that becomes readable when a
+ *                            window is over, -1 on error
+ */
+int atomic_start(uint32_t, atomic_forward_t);
+
+/* returns the descriptor that becomes readable when a window is over
+ *
+ * @return int : -1 if the recognizer is not started
+ */
+int atomic_descriptor();
+
+/* gives an event to the recognizer, that can release the events held
+ * before it
+ *
+ * @param  const struct inotify_event * : the event
+ * @param  const char *                 : directory of the event, with the trailing slash
+ * @param  int                          : the event matches --include
+ * @return int                          : 1 if the event is held, 0 if it has to be forwarded
+ */
+int atomic_hold(const struct inotify_event *, const char *, int);
+
+/* releases the events whose window is over */
+void atomic_expire();
+
+/* returns the number of saves in progress
+ *
+ * @return int
+ */
+int atomic_in_progress();
+
+/* tells whether a name is the one of a temporary file or of a backup
+ *
+ * @param  const char * : name of the file
+ * @param  char *       : where to store the name of the file saved,
+ *                        "" when it is not known by the name
+ * @param  size_t       : size of the buffer
+ * @return int          : 1 if it is a temporary file or a backup, 0 otherwise
+ */
+int atomic_temporary(const char *, char *, size_t);
+
+/* stops the recognizer, the events held are dropped */
+void atomic_stop();
+
+#endif /* !__ATOMIC_H */
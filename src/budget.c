@@ -0,0 +1,198 @@
+/* budget.c
+ * Keep the number of inotify watches within the limit of the user
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/param.h>
+
+#include "budget.h"
+
+int read_max_user_watches()
+{
+    FILE *file = fopen(MAX_USER_WATCHES_PATH, "r");
+    if (file == NULL)
+        return -1;
+
+    int max_user_watches = -1;
+    if (fscanf(file, "%d", &max_user_watches) != 1)
+        max_user_watches = -1;
+
+    fclose(file);
+    return max_user_watches;
+}
+
+/* counts the "inotify wd:" lines of the fdinfo of an inotify descriptor */
+static int count_watches_of(const char *fdinfo_path)
+{
+    FILE *file = fopen(fdinfo_path, "r");
+    if (file == NULL)
+        return 0;
+
+    int watches = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        if (strncmp(line, "inotify wd:", 11) == 0)
+            ++watches;
+    }
+
+    fclose(file);
+    return watches;
+}
+
+int count_user_watches()
+{
+    DIR *proc = opendir("/proc");
+    if (proc == NULL)
+        return 0;
+
+    int watches = 0;
+    char path[MAXPATHLEN];
+    char target[64];
+    struct dirent *process;
+
+    /* NOTE: only the processes of the same user are readable, that is
+     *       exactly what the kernel accounts in max_user_watches
+     */
+    while ((process = readdir(proc)))
+    {
+        if (!isdigit((unsigned char)process->d_name[0]))
+            continue;
+
+        snprintf(path, sizeof(path), "/proc/%s/fd", process->d_name);
+        DIR *fds = opendir(path);
+        if (fds == NULL)
+            continue;
+
+        struct dirent *fd;
+        while ((fd = readdir(fds)))
+        {
+            if (!isdigit((unsigned char)fd->d_name[0]))
+                continue;
+
+            snprintf(path, sizeof(path), "/proc/%s/fd/%s", process->d_name, fd->d_name);
+            ssize_t length = readlink(path, target, sizeof(target) - 1);
+            if (length == -1)
+                continue;
+
+            target[length] = '\0';
+            if (strcmp(target, "anon_inode:inotify") != 0)
+                continue;
+
+            snprintf(path, sizeof(path), "/proc/%s/fdinfo/%s", process->d_name, fd->d_name);
+            watches += count_watches_of(path);
+        }
+        closedir(fds);
+    }
+    closedir(proc);
+
+    return watches;
+}
+
+void watch_budget_init(WATCH_BUDGET *budget, int user_limit)
+{
+    budget->used = 0;
+    budget->limit = 0;
+    budget->candidates = NULL;
+    budget->candidate_depths = 0;
+    budget->deepest = 0;
+
+    int max_user_watches = read_max_user_watches();
+    if (max_user_watches > 0)
+    {
+        budget->limit = max_user_watches - count_user_watches() - WATCH_BUDGET_RESERVE;
+        if (budget->limit < 1)
+            budget->limit = 1;
+    }
+
+    if (user_limit > 0 && (budget->limit == 0 || user_limit < budget->limit))
+        budget->limit = user_limit;
+}
+
+int watch_budget_available(const WATCH_BUDGET *budget)
+{
+    return (budget->limit == 0 || budget->used < budget->limit) ? 1 : 0;
+}
+
+QueueElement *watch_candidate_add(WATCH_BUDGET *budget, int depth, void *candidate)
+{
+    if (depth >= budget->candidate_depths)
+    {
+        int depths = MAX(depth + 1, 2 * budget->candidate_depths);
+        Queue **candidates = (Queue **)realloc(budget->candidates, depths * sizeof(Queue *));
+        if (candidates == NULL)
+            return NULL;
+
+        memset(candidates + budget->candidate_depths, 0, (depths - budget->candidate_depths) * sizeof(Queue *));
+        budget->candidates = candidates;
+        budget->candidate_depths = depths;
+    }
+
+    if (budget->candidates[depth] == NULL && (budget->candidates[depth] = queue_init()) == NULL)
+        return NULL;
+
+    QueueElement *element = queue_enqueue(budget->candidates[depth], candidate);
+    if (element != NULL && depth >= budget->deepest)
+        budget->deepest = depth + 1;
+
+    return element;
+}
+
+void watch_candidate_remove(WATCH_BUDGET *budget, int depth, QueueElement *element)
+{
+    queue_remove(budget->candidates[depth], element);
+}
+
+void *watch_candidate_first(WATCH_BUDGET *budget, int *depth)
+{
+    /* NOTE: the deepest depth only moves up when it is emptied, once per candidate at most */
+    while (budget->deepest > 0)
+    {
+        Queue *candidates = budget->candidates[budget->deepest - 1];
+        if (candidates != NULL && candidates->first != NULL)
+        {
+            *depth = budget->deepest - 1;
+            return candidates->first->data;
+        }
+        --budget->deepest;
+    }
+
+    return NULL;
+}
+
+void watch_candidates_free(WATCH_BUDGET *budget)
+{
+    int i;
+    for (i = 0; i < budget->candidate_depths; ++i)
+        queue_free(budget->candidates[i]);
+
+    free(budget->candidates);
+    budget->candidates = NULL;
+    budget->candidate_depths = 0;
+    budget->deepest = 0;
+}
@@ -0,0 +1,104 @@
+/* budget.h
+ * Keep the number of inotify watches within the limit of the user
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __BUDGET_H
+#define __BUDGET_H
+
+#include "queue.h"
+
+#define MAX_USER_WATCHES_PATH "/proc/sys/fs/inotify/max_user_watches"
+
+/* watches left free for the other processes of the user */
+#define WATCH_BUDGET_RESERVE 128
+
+typedef struct watch_budget_s
+{
+    int limit;            /* number of watches that cwatch can use, 0 means unlimited */
+    int used;             /* number of watches currently used by cwatch */
+    Queue **candidates;   /* watches that can give way to a shallower directory, by depth */
+    int candidate_depths; /* size of candidates */
+    int deepest;          /* one more than the deepest depth with candidates, 0 if none */
+} WATCH_BUDGET;
+
+/* returns the max number of inotify watches of a user
+ *
+ * @return int : the limit, -1 if it is not available
+ */
+int read_max_user_watches();
+
+/* returns the number of inotify watches currently used by all the
+ * processes of the user (looking at /proc/<pid>/fdinfo)
+ *
+ * @return int
+ */
+int count_user_watches();
+
+/* computes the budget of watches that cwatch can use
+ *
+ * @param WATCH_BUDGET * : budget to initialize
+ * @param int            : upper bound given by the user, 0 for none
+ */
+void watch_budget_init(WATCH_BUDGET *, int);
+
+/* returns 1 if there is room for another watch, 0 otherwise
+ *
+ * @param  const WATCH_BUDGET * : budget
+ * @return int
+ */
+int watch_budget_available(const WATCH_BUDGET *);
+
+/* adds a candidate to give way to a shallower directory. The
+ * candidates of a depth are kept from the least recently active, so
+ * an active candidate has to be added again, once removed
+ *
+ * @param  WATCH_BUDGET * : budget
+ * @param  int            : depth of the candidate, greater than 0
+ * @param  void *         : the candidate
+ * @return QueueElement * : to remove the candidate, NULL on error
+ */
+QueueElement *watch_candidate_add(WATCH_BUDGET *, int, void *);
+
+/* removes a candidate
+ *
+ * @param WATCH_BUDGET * : budget
+ * @param int            : depth of the candidate
+ * @param QueueElement * : as returned by watch_candidate_add
+ */
+void watch_candidate_remove(WATCH_BUDGET *, int, QueueElement *);
+
+/* returns the deepest candidate, the least recently active of its depth
+ *
+ * @param  WATCH_BUDGET * : budget
+ * @param  int *          : where to store the depth of the candidate
+ * @return void *         : the candidate, NULL if there are none
+ */
+void *watch_candidate_first(WATCH_BUDGET *, int *);
+
+/* deallocates the candidates
+ *
+ * @param WATCH_BUDGET * : budget
+ */
+void watch_candidates_free(WATCH_BUDGET *);
+
+#endif /* !__BUDGET_H */
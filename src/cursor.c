@@ -0,0 +1,354 @@
+/* cursor.c
+ * Serve the events since a sequence number to the consumers
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "bstrlib.h"
+#include "journal.h"
+#include "cursor.h"
+
+/* bytes of an answer written at once */
+#define CURSOR_CHUNK (64 * 1024)
+
+/* events copied at once out of the ring, the lock is not held while they are written */
+#define CURSOR_COPY 1024
+
+/* milliseconds a consumer has to write its request */
+#define CURSOR_REQUEST_TIMEOUT 1000
+
+/* seconds a consumer has to read a part of an answer */
+#define CURSOR_SEND_TIMEOUT 5
+
+typedef struct cursor_event_s
+{
+    uint64_t sequence;
+    uint32_t mask;
+    uint32_t cookie;
+    char *path;
+} CURSOR_EVENT;
+
+static pthread_mutex_t cursor_mutex = PTHREAD_MUTEX_INITIALIZER;
+static CURSOR_EVENT *ring = NULL;
+static uint64_t first_sequence = 1; /* oldest event kept */
+static uint64_t last_sequence = 0;  /* newest event kept */
+static char *journal_directory = NULL;
+static int server_fd = -1;
+static pthread_t server;
+static int serving = 0;
+
+void cursor_append_escaped(bstring line, const char *path)
+{
+    for (; *path != '\0'; ++path)
+    {
+        if (*path == '\n')
+            bcatcstr(line, "\\n");
+        else if (*path == '\\')
+            bcatcstr(line, "\\\\");
+        else
+            bconchar(line, *path);
+    }
+}
+
+static void append_line(bstring answer, uint64_t sequence, uint32_t mask, uint32_t cookie, const char *path)
+{
+    bformata(answer, "%" PRIu64 " 0x%08x %u ", sequence, mask, cookie);
+    cursor_append_escaped(answer, path);
+    bconchar(answer, '\n');
+}
+
+/* writes a part of an answer, once it is big enough */
+static int flush(bstring answer, int fd, int force)
+{
+    if (!force && blength(answer) < CURSOR_CHUNK)
+        return 0;
+
+    int written = 0;
+    while (written < blength(answer))
+    {
+        ssize_t length = send(fd, answer->data + written, blength(answer) - written, MSG_NOSIGNAL);
+        if (length == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        written += length;
+    }
+    btrunc(answer, 0);
+
+    return 0;
+}
+
+/* copies the events kept in memory, from a sequence number on */
+static cursor_status_t since_ring(uint64_t *next, bstring answer, int fd)
+{
+    CURSOR_EVENT copied[CURSOR_COPY];
+    uint64_t last = 0;
+    int qty, i;
+
+    pthread_mutex_lock(&cursor_mutex);
+    last = last_sequence;
+    pthread_mutex_unlock(&cursor_mutex);
+
+    do
+    {
+        pthread_mutex_lock(&cursor_mutex);
+
+        /* NOTE: the ring can wrap while a part is written */
+        if (*next < first_sequence)
+        {
+            bformata(answer, "GAP %" PRIu64 "\n", first_sequence);
+            pthread_mutex_unlock(&cursor_mutex);
+            return CURSOR_GAP;
+        }
+
+        for (qty = 0; qty < CURSOR_COPY && *next + qty <= last; ++qty)
+        {
+            copied[qty] = ring[(*next + qty) % CURSOR_RING_SIZE];
+            if ((copied[qty].path = strdup(copied[qty].path)) == NULL)
+                break;
+        }
+
+        pthread_mutex_unlock(&cursor_mutex);
+
+        for (i = 0; i < qty; ++i)
+        {
+            append_line(answer, copied[i].sequence, copied[i].mask, copied[i].cookie, copied[i].path);
+            free(copied[i].path);
+        }
+        *next += qty;
+    } while (qty == CURSOR_COPY && flush(answer, fd, 0) == 0);
+
+    bformata(answer, "END %" PRIu64 "\n", *next - 1);
+    return CURSOR_END;
+}
+
+/* copies the events of the journal older than the ones kept in memory */
+static cursor_status_t since_journal(uint64_t *next, bstring answer, int fd)
+{
+    JOURNAL_READER *reader = journal_reader_open(journal_directory, *next);
+    if (reader == NULL)
+        return CURSOR_END;
+
+    const JOURNAL_RECORD *record;
+    while ((record = journal_reader_next(reader)) != NULL)
+    {
+        /* NOTE: an event dropped by the journal can not be given */
+        if (record->sequence != *next)
+            break;
+
+        append_line(answer, record->sequence, record->mask, record->cookie, JOURNAL_PATH(record));
+        ++(*next);
+
+        pthread_mutex_lock(&cursor_mutex);
+        uint64_t oldest = first_sequence;
+        pthread_mutex_unlock(&cursor_mutex);
+
+        /* the rest is in memory */
+        if (*next >= oldest || flush(answer, fd, 0) == -1)
+            break;
+    }
+    journal_reader_close(reader);
+
+    return CURSOR_END;
+}
+
+cursor_status_t cursor_since(uint64_t since, int fd)
+{
+    bstring answer = bfromcstr("");
+    uint64_t next = since + 1;
+    cursor_status_t status;
+
+    pthread_mutex_lock(&cursor_mutex);
+    uint64_t last = last_sequence;
+    uint64_t oldest = first_sequence;
+    pthread_mutex_unlock(&cursor_mutex);
+
+    /* a sequence number never given, as the one of a previous run without journal */
+    if (since > last)
+    {
+        bformata(answer, "GAP %" PRIu64 "\n", oldest);
+        status = CURSOR_GAP;
+    }
+    else
+    {
+        if (next < oldest && journal_directory != NULL)
+            since_journal(&next, answer, fd);
+
+        status = since_ring(&next, answer, fd);
+    }
+
+    flush(answer, fd, 1);
+    bdestroy(answer);
+
+    return status;
+}
+
+void cursor_record(uint64_t sequence, uint32_t mask, uint32_t cookie, const char *directory, const char *name)
+{
+    if (ring == NULL)
+        return;
+
+    size_t directory_len = strlen(directory);
+    char *path = (char *)malloc(directory_len + strlen(name) + 1);
+    if (path == NULL)
+        return;
+
+    strcpy(path, directory);
+    strcpy(path + directory_len, name);
+
+    pthread_mutex_lock(&cursor_mutex);
+
+    CURSOR_EVENT *event = &ring[sequence % CURSOR_RING_SIZE];
+    free(event->path);
+    event->sequence = sequence;
+    event->mask = mask;
+    event->cookie = cookie;
+    event->path = path;
+
+    last_sequence = sequence;
+    if (last_sequence >= first_sequence + CURSOR_RING_SIZE)
+        first_sequence = last_sequence - CURSOR_RING_SIZE + 1;
+
+    pthread_mutex_unlock(&cursor_mutex);
+}
+
+static void *cursor_server(void *arg)
+{
+    char request[CURSOR_REQUEST_MAX];
+
+    while (1)
+    {
+        int client_fd = accept(server_fd, NULL, NULL);
+        if (client_fd == -1)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;
+        }
+
+        /* a consumer that stops writing or reading is left behind */
+        struct timeval send_timeout = {CURSOR_SEND_TIMEOUT, 0};
+        setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+
+        /* a request fits in a single line */
+        struct pollfd pfd = {client_fd, POLLIN, 0};
+        ssize_t length = 0;
+        if (poll(&pfd, 1, CURSOR_REQUEST_TIMEOUT) == 1)
+            length = read(client_fd, request, sizeof(request) - 1);
+
+        if (length > 0)
+        {
+            request[length] = '\0';
+
+            uint64_t since;
+            if (sscanf(request, "SINCE %" SCNu64, &since) == 1)
+                cursor_since(since, client_fd);
+            else if (send(client_fd, "ERROR\n", 6, MSG_NOSIGNAL) == -1)
+                ;
+        }
+
+        close(client_fd);
+    }
+
+    return NULL;
+}
+
+int cursor_start(const char *socket_path, const char *journal, uint64_t last)
+{
+    struct sockaddr_un address;
+
+    if (ring != NULL)
+        return 0;
+
+    if (strlen(socket_path) >= sizeof(address.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    if ((ring = (CURSOR_EVENT *)calloc(CURSOR_RING_SIZE, sizeof(CURSOR_EVENT))) == NULL)
+        return -1;
+
+    /* the events before the start are only in the journal */
+    last_sequence = last;
+    first_sequence = last + 1;
+    journal_directory = (journal != NULL) ? strdup(journal) : NULL;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
+    unlink(socket_path);
+
+    if ((server_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1 ||
+        bind(server_fd, (struct sockaddr *)&address, sizeof(address)) == -1 ||
+        listen(server_fd, 16) == -1 ||
+        (serving = (pthread_create(&server, NULL, cursor_server, NULL) == 0)) == 0)
+    {
+        int error = errno;
+        cursor_stop();
+        errno = error;
+        return -1;
+    }
+
+    return 0;
+}
+
+void cursor_stop()
+{
+    if (server_fd != -1)
+    {
+        /* wakes up the server from accept(), then waits for the last answer */
+        shutdown(server_fd, SHUT_RDWR);
+        if (serving)
+            pthread_join(server, NULL);
+        close(server_fd);
+        server_fd = -1;
+        serving = 0;
+    }
+
+    pthread_mutex_lock(&cursor_mutex);
+    if (ring != NULL)
+    {
+        int i;
+        for (i = 0; i < CURSOR_RING_SIZE; ++i)
+            free(ring[i].path);
+        free(ring);
+        ring = NULL;
+    }
+    free(journal_directory);
+    journal_directory = NULL;
+    pthread_mutex_unlock(&cursor_mutex);
+}
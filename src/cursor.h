@@ -0,0 +1,101 @@
+/* cursor.h
+ * Serve the events since a sequence number to the consumers
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#ifndef __CURSOR_H
+#define __CURSOR_H
+
+#include <stdint.h>
+
+#include "bstrlib.h"
+
+/* Each event reported by cwatch has a sequence number. The last
+ * CURSOR_RING_SIZE events are kept in memory and a consumer can ask,
+ * through a unix socket (--cursor-socket), for all the events after the
+ * last one it has seen. The older ones are read from the journal, if
+ * any (--journal). When some of the events asked are not available
+ * anymore, the consumer is told so and has to rescan.
+ *
+ * The protocol is line based. The consumer writes:
+ *
+ *   SINCE <sequence>
+ *
+ * and cwatch answers with a line for each event:
+ *
+ *   <sequence> <mask, hexadecimal> <cookie> <path>
+ *
+ * ending with "END <last sequence>", or with "GAP <first sequence
+ * available>" when the events can not be given. Newlines and
+ * backslashes in the paths are escaped as \n and \\.
+ */
+#define CURSOR_RING_SIZE 65536
+
+/* max bytes of a request */
+#define CURSOR_REQUEST_MAX 64
+
+/* status of an answer */
+typedef enum
+{
+    CURSOR_END,
+    CURSOR_GAP
+} cursor_status_t;
+
+/* starts serving the consumers
+ *
+ * @param  const char * : path of the unix socket, replaced if it exists
+ * @param  const char * : directory of the journal, NULL for none
+ * @param  uint64_t     : sequence number of the last event so far
+ * @return int          : 0 if success, -1 otherwise
+ */
+int cursor_start(const char *, const char *, uint64_t);
+
+/* keeps an event in memory
+ *
+ * @param uint64_t     : sequence number
+ * @param uint32_t     : event mask
+ * @param uint32_t     : cookie
+ * @param const char * : directory of the event
+ * @param const char * : name of the file or directory, "" for none
+ */
+void cursor_record(uint64_t, uint32_t, uint32_t, const char *, const char *);
+
+/* writes the answer to a SINCE request
+ *
+ * @param  uint64_t        : the last sequence number seen by the consumer
+ * @param  int             : socket where to write the answer
+ * @return cursor_status_t : CURSOR_GAP when the consumer has to rescan
+ */
+cursor_status_t cursor_since(uint64_t, int);
+
+/* appends a path to a line, escaping the newlines and the backslashes
+ *
+ * @param bstring      : the line
+ * @param const char * : the path
+ */
+void cursor_append_escaped(bstring, const char *);
+
+/* stops serving the consumers and deallocates the events kept */
+void cursor_stop();
+
+#endif /* !__CURSOR_H */
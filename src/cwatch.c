@@ -31,6 +31,7 @@ const_bstring COMMAND_PATTERN_FILE = (const_bstring) "%f";
 const_bstring COMMAND_PATTERN_EVENT = (const_bstring) "%e";
 const_bstring COMMAND_PATTERN_REGEX = (const_bstring) "%x";
 const_bstring COMMAND_PATTERN_COUNT = (const_bstring) "%n";
+const_bstring COMMAND_PATTERN_EVENTS = (const_bstring) "%c";
 
 char *root_path;
 bstring command;
@@ -40,20 +41,118 @@ struct bstrList *split_event;
 uint32_t event_mask;
 regex_t *exclude_regex;
 regex_t *user_catch_regex;
+PATHGLOB *include_glob;
 regmatch_t p_match[2];
 
 int exec_c;
 char exec_cstr[10];
 
+WATCH_BUDGET watch_budget;
+int max_depth = -1;
+int max_watches;
+int poll_interval = POLLER_DEFAULT_INTERVAL;
+int hot_threshold;
+int hot_cooldown = HOT_DEFAULT_COOLDOWN;
+int cooled_qty;
+int heavy_hitters;
+int heavy_interval = HEAVY_DEFAULT_INTERVAL;
+volatile sig_atomic_t heavy_signal;
+backend_t backend = BACKEND_INOTIFY;
+int shards = 1;
+bstring pending_events;
+char *ready_file;
+struct timespec started_at;
+char *state_file;
+STATE_SNAPSHOT *state_snapshot;
+uint64_t state_options = STATE_OPTIONS_INIT;
+static DEDUPE_SET dedupe_paths;
+DEDUPE_SET *dedupe_set = &dedupe_paths;
+volatile sig_atomic_t stop_signal;
+volatile sig_atomic_t monitoring;
+char *journal_directory;
+off_t journal_max_size = JOURNAL_DEFAULT_MAX_SIZE;
+int journal_max_age = JOURNAL_DEFAULT_MAX_AGE;
+journal_fsync_t journal_fsync = JOURNAL_FSYNC_BATCH;
+uint64_t event_sequence;
+char *cursor_socket;
+char *subscribe_socket;
+char *ring_socket;
+size_t ring_size = SHMRING_DEFAULT_SIZE;
+char *plugin_path;
+char *plugin_argument;
+char *mirror_destination;
+int mirror_workers = MIRROR_DEFAULT_WORKERS;
+struct inotify_event *dispatched_event;
+unsigned long dispatched_count = 1;
+int rollup_depth = -1;
+int rollup_window = ROLLUP_DEFAULT_WINDOW_MS;
+char *stats_file;
+int stats_interval = METRICS_DEFAULT_INTERVAL;
+char *metrics_socket;
+volatile sig_atomic_t metrics_signal;
+struct timespec read_at;
+
 bool_t nosymlink_flag;
 bool_t recursive_flag;
 bool_t verbose_flag;
 bool_t syslog_flag;
+bool_t priority_lane_flag;
+bool_t progressive_flag;
+bool_t ready_flag;
+bool_t state_changes_flag;
+bool_t skip_unchanged_flag;
+bool_t atomic_saves_flag;
+bool_t rollup_flag;
 
 int (*execute_command)(char *, char *, char *);
+void (*event_sink)(uint64_t, uint32_t, uint32_t, const char *, const char *);
 int (*watch_descriptor_from)(int, const char *, uint32_t);
 int (*remove_watch_descriptor)(int, int);
 
+/* the trackers of --heavy-hitters, and the start of their counts */
+static HEAVY *heavy_paths = NULL;
+static HEAVY *heavy_directories = NULL;
+static time_t heavy_since = 0;
+
+/* Command line options without a short form */
+enum
+{
+    OPT_MAX_DEPTH = 256,
+    OPT_MAX_WATCHES,
+    OPT_POLL_INTERVAL,
+    OPT_BACKEND,
+    OPT_SHARDS,
+    OPT_PRIORITY_LANE,
+    OPT_PROGRESSIVE,
+    OPT_READY_FILE,
+    OPT_STATE_FILE,
+    OPT_STATE_CHANGES,
+    OPT_JOURNAL,
+    OPT_JOURNAL_MAX_SIZE,
+    OPT_JOURNAL_MAX_AGE,
+    OPT_JOURNAL_FSYNC,
+    OPT_CURSOR_SOCKET,
+    OPT_SUBSCRIBE_SOCKET,
+    OPT_RING_SOCKET,
+    OPT_RING_SIZE,
+    OPT_PLUGIN,
+    OPT_PLUGIN_ARG,
+    OPT_MIRROR,
+    OPT_MIRROR_WORKERS,
+    OPT_SKIP_UNCHANGED,
+    OPT_ATOMIC_SAVES,
+    OPT_HOT_THRESHOLD,
+    OPT_HOT_COOLDOWN,
+    OPT_HEAVY_HITTERS,
+    OPT_HEAVY_INTERVAL,
+    OPT_ROLLUP_DEPTH,
+    OPT_ROLLUP_PREFIX,
+    OPT_ROLLUP_WINDOW,
+    OPT_STATS_FILE,
+    OPT_STATS_INTERVAL,
+    OPT_METRICS_SOCKET
+};
+
 /* Command line long options */
 static struct option long_options[] =
     {
@@ -64,6 +163,41 @@ static struct option long_options[] =
         {"events", required_argument, 0, 'e'},
         {"exclude", required_argument, 0, 'x'},
         {"regex-catch", required_argument, 0, 'X'}, /* catch a regex */
+        {"include", required_argument, 0, 'i'},
+        {"max-depth", required_argument, 0, OPT_MAX_DEPTH},
+        {"max-watches", required_argument, 0, OPT_MAX_WATCHES},
+        {"poll-interval", required_argument, 0, OPT_POLL_INTERVAL},
+        {"backend", required_argument, 0, OPT_BACKEND},
+        {"shards", required_argument, 0, OPT_SHARDS},
+        {"priority-lane", no_argument, 0, OPT_PRIORITY_LANE},
+        {"progressive", no_argument, 0, OPT_PROGRESSIVE},
+        {"ready-file", required_argument, 0, OPT_READY_FILE},
+        {"state-file", required_argument, 0, OPT_STATE_FILE},
+        {"state-changes", no_argument, 0, OPT_STATE_CHANGES},
+        {"journal", required_argument, 0, OPT_JOURNAL},
+        {"journal-max-size", required_argument, 0, OPT_JOURNAL_MAX_SIZE},
+        {"journal-max-age", required_argument, 0, OPT_JOURNAL_MAX_AGE},
+        {"journal-fsync", required_argument, 0, OPT_JOURNAL_FSYNC},
+        {"cursor-socket", required_argument, 0, OPT_CURSOR_SOCKET},
+        {"subscribe-socket", required_argument, 0, OPT_SUBSCRIBE_SOCKET},
+        {"ring-socket", required_argument, 0, OPT_RING_SOCKET},
+        {"ring-size", required_argument, 0, OPT_RING_SIZE},
+        {"plugin", required_argument, 0, OPT_PLUGIN},
+        {"plugin-arg", required_argument, 0, OPT_PLUGIN_ARG},
+        {"mirror", required_argument, 0, OPT_MIRROR},
+        {"mirror-workers", required_argument, 0, OPT_MIRROR_WORKERS},
+        {"skip-unchanged", no_argument, 0, OPT_SKIP_UNCHANGED},
+        {"atomic-saves", no_argument, 0, OPT_ATOMIC_SAVES},
+        {"hot-threshold", required_argument, 0, OPT_HOT_THRESHOLD},
+        {"hot-cooldown", required_argument, 0, OPT_HOT_COOLDOWN},
+        {"heavy-hitters", required_argument, 0, OPT_HEAVY_HITTERS},
+        {"heavy-interval", required_argument, 0, OPT_HEAVY_INTERVAL},
+        {"rollup-depth", required_argument, 0, OPT_ROLLUP_DEPTH},
+        {"rollup-prefix", required_argument, 0, OPT_ROLLUP_PREFIX},
+        {"rollup-window", required_argument, 0, OPT_ROLLUP_WINDOW},
+        {"stats-file", required_argument, 0, OPT_STATS_FILE},
+        {"stats-interval", required_argument, 0, OPT_STATS_INTERVAL},
+        {"metrics-socket", required_argument, 0, OPT_METRICS_SOCKET},
         {"no-symlink", no_argument, 0, 'n'},
         {"recursive", no_argument, 0, 'r'},
         {"verbose", no_argument, 0, 'v'},
@@ -152,7 +286,8 @@ void help(int error, char *message)
     printf("       %sf : the name of the file/directory that triggered the event\n", "%");
     printf("       %se : the type of the occured event (the the list below)\n", "%");
     printf("       %sx : the first occurence that match the regex given by -X option\n", "%");
-    printf("       %sn : the number of times the command is executed\n\n", "%");
+    printf("       %sn : the number of times the command is executed\n", "%");
+    printf("       %sc : the number of events rolled up (--rollup-depth), 1 otherwise\n\n", "%");
     printf("  -d  --directory DIRECTORY\n");
     printf("      The directory to monitor\n\n");
     printf("  *LIST OF OTHER OPTIONS*\n\n");
@@ -185,11 +320,135 @@ void help(int error, char *message)
     printf("  -x  --exclude <regex>\n");
     printf("      Do not process any events whose filename matches the specified POSIX REGEX\n");
     printf("      POSIX extended regular expression, case sensitive\n\n");
+    printf("  -i  --include <glob>\n");
+    printf("      Process only the events whose path, relative to DIRECTORY, matches the glob\n");
+    printf("      Supports *, ?, [...], {a,b} and ** (any number of directories)\n");
+    printf("      Directories that can never contain a match are not watched at all\n");
+    printf("      This option can be given more than once (e.g: -i 'src/**/*.{c,h}')\n\n");
     printf("  -X  --regex-catch <regex>\n");
     printf("      Match the parenthetical <regex> against the filename whose triggered the event,\n");
     printf("      The first matched occurrence will be available as %sx special character\n", "%");
     printf("      Usage note: %s will be triggered only if a match occurs!\n", PROGRAM_NAME);
     printf("      POSIX extended regular expression, case sensitive\n\n");
+    printf("  --max-depth N\n");
+    printf("      Do not watch directories more than N levels below DIRECTORY\n\n");
+    printf("  --max-watches N\n");
+    printf("      Use at most N inotify watches (default: what is left of\n");
+    printf("      /proc/sys/fs/inotify/max_user_watches). The deepest and least active\n");
+    printf("      directories beyond the limit are polled instead\n\n");
+    printf("  --poll-interval SECONDS\n");
+    printf("      Max seconds between two scans of the polled directories (default: %d).\n", POLLER_DEFAULT_INTERVAL);
+    printf("      After some activity the directories are scanned every second\n\n");
+    printf("  --backend inotify|poll|fanotify\n");
+    printf("      Where the events come from (default: inotify). Use poll for NFS, SMB,\n");
+    printf("      FUSE and the other filesystems where inotify does not see all the changes.\n");
+    printf("      Use fanotify to watch a huge tree with a single mark of its filesystem,\n");
+    printf("      it requires CAP_SYS_ADMIN and does not follow the symbolic links\n\n");
+    printf("  --shards N\n");
+    printf("      Spread the subtrees of DIRECTORY across N inotify instances (max %d),\n", SHARDS_MAX);
+    printf("      each one drained by its own thread, to sustain higher rates of events\n\n");
+    printf("  --hot-threshold N\n");
+    printf("      Cool down a directory that reports more than N events in a second: its\n");
+    printf("      events are dropped in the kernel for --hot-cooldown seconds, then it is\n");
+    printf("      rescanned and reported by a single modify event of the directory itself.\n");
+    printf("      It requires the inotify backend\n\n");
+    printf("  --hot-cooldown SECONDS\n");
+    printf("      How long a hot directory is cooled down (default: %d)\n\n", HOT_DEFAULT_COOLDOWN);
+    printf("  --heavy-hitters N\n");
+    printf("      Print on the standard error the N paths and the N directories with the\n");
+    printf("      most events, every --heavy-interval seconds and on SIGUSR2. They are\n");
+    printf("      counted in fixed memory, a count can be overestimated by its error\n\n");
+    printf("  --heavy-interval SECONDS\n");
+    printf("      Seconds counted by a report of --heavy-hitters (default: %d)\n\n", HEAVY_DEFAULT_INTERVAL);
+    printf("  --stats-file FILE\n");
+    printf("      Write the metrics (events read, excluded and reported, commands run and\n");
+    printf("      failed, overflows, watches, latency and duration of the commands) into\n");
+    printf("      FILE in the Prometheus text format, every --stats-interval seconds and\n");
+    printf("      on exit. They are printed on the standard error on SIGUSR1 too\n\n");
+    printf("  --stats-interval SECONDS\n");
+    printf("      Seconds between two writes of --stats-file (default: %d)\n\n", METRICS_DEFAULT_INTERVAL);
+    printf("  --metrics-socket PATH\n");
+    printf("      Serve the metrics on the unix socket PATH, to the clients that connect\n");
+    printf("      and to the HTTP requests (as the ones of Prometheus)\n\n");
+    printf("  --priority-lane\n");
+    printf("      Watch the creation, deletion and move of the entries through a dedicated\n");
+    printf("      inotify instance, read before any other event. It keeps the tree up to date\n");
+    printf("      during a storm of content events, using two watches for each directory\n\n");
+    printf("  --progressive\n");
+    printf("      Start monitoring as soon as DIRECTORY is watched, the directories below it\n");
+    printf("      are watched in background, level by level. The entries created below it\n");
+    printf("      before their directory is watched are reported as created\n\n");
+    printf("  --ready-file FILE\n");
+    printf("      Write into FILE the milliseconds taken to watch the whole tree, once done.\n");
+    printf("      FILE is removed at startup\n\n");
+    printf("  --state-file FILE\n");
+    printf("      Save the watched directories into FILE, every %d seconds and on exit.\n", STATE_SAVE_INTERVAL);
+    printf("      At the next start, only the directories changed since then are listed;\n");
+    printf("      a state saved with other -x, -i, -n, -r or --max-depth is not used\n\n");
+    printf("  --state-changes\n");
+    printf("      With --state-file, report the directories and the symbolic links created\n");
+    printf("      or deleted while %s was not running\n\n", PROGRAM_NAME);
+    printf("  --journal DIRECTORY\n");
+    printf("      Append each event reported, with its sequence number and time, to binary\n");
+    printf("      segment files in DIRECTORY, written by a dedicated thread\n\n");
+    printf("  --journal-max-size MB\n");
+    printf("      Start a new segment of the journal after MB megabytes (default: %d)\n\n", JOURNAL_DEFAULT_MAX_SIZE / (1024 * 1024));
+    printf("  --journal-max-age SECONDS\n");
+    printf("      Start a new segment of the journal after SECONDS seconds (default: %d)\n\n", JOURNAL_DEFAULT_MAX_AGE);
+    printf("  --journal-fsync none|batch|second\n");
+    printf("      Sync the journal to the disk never, after each batch of events written\n");
+    printf("      (default) or at most once per second\n\n");
+    printf("  --cursor-socket PATH\n");
+    printf("      Give the events after a sequence number to the consumers that connect to\n");
+    printf("      the unix socket PATH and write \"SINCE <sequence>\". The last %d events are\n", CURSOR_RING_SIZE);
+    printf("      kept in memory, the older ones are read from the --journal. The answer is\n");
+    printf("      \"GAP\" when some of them are lost, and the consumer has to rescan\n\n");
+    printf("  --subscribe-socket PATH\n");
+    printf("      Stream the events to the consumers that connect to the unix socket PATH\n");
+    printf("      and write \"SUBSCRIBE [events=LIST] [prefix=PATH] [include=GLOB]...\n");
+    printf("      [exclude=REGEX]\". A consumer receives only the events of -e --events\n");
+    printf("      that pass its filters, and is dropped when it falls behind. With this\n");
+    printf("      option -c --command is not required\n\n");
+    printf("  --ring-socket PATH\n");
+    printf("      Write the events into a ring of shared memory too. The consumers that\n");
+    printf("      connect to the unix socket PATH receive a read-only descriptor of the\n");
+    printf("      ring, see shmring.h. A consumer that falls behind is lapped, it is never\n");
+    printf("      waited for. With this option -c --command is not required\n\n");
+    printf("  --ring-size MB\n");
+    printf("      Size of the ring of --ring-socket (default: %d)\n\n", SHMRING_DEFAULT_SIZE / (1024 * 1024));
+    printf("  --plugin LIBRARY\n");
+    printf("      Handle the events with a shared library loaded into cwatch, instead of\n");
+    printf("      a command (see cwatch_plugin.h). The events are given in batches. A\n");
+    printf("      plugin that fails is disabled, cwatch goes on\n\n");
+    printf("  --plugin-arg ARGUMENT\n");
+    printf("      Argument given to the plugin when it starts\n\n");
+    printf("  --mirror DESTINATION\n");
+    printf("      Replicate the changes into the directory DESTINATION, instead of running\n");
+    printf("      a command: the files created or written are copied, the deletions and\n");
+    printf("      the renames are applied. DESTINATION has to start as a copy of the\n");
+    printf("      watched directory, outside of it\n\n");
+    printf("  --mirror-workers NUMBER\n");
+    printf("      Number of threads copying the files of --mirror (default: %d)\n\n", MIRROR_DEFAULT_WORKERS);
+    printf("  --skip-unchanged\n");
+    printf("      Drop the close_write events of a file whose content has not changed\n");
+    printf("      since its last event. The files are hashed in background, the events\n");
+    printf("      of the same path wait, so their order is kept. The first event of a\n");
+    printf("      file, and the events of the files over %d MB, are always reported\n\n", DIGEST_MAX_SIZE / (1024 * 1024));
+    printf("  --atomic-saves\n");
+    printf("      Report a single modify event (close_write without modify in -e) when a\n");
+    printf("      file is saved through a temporary file or a backup renamed, as vim,\n");
+    printf("      JetBrains, gedit, rsync and sed -i do. The events of the temporary files\n");
+    printf("      are held for %d milliseconds, then reported if no save is recognized\n\n", ATOMIC_WINDOW_MS);
+    printf("  --rollup-depth N\n");
+    printf("      Report a single event per directory at depth N below DIRECTORY (0 for\n");
+    printf("      DIRECTORY itself) and per --rollup-window, for all the events under it.\n");
+    printf("      %se lists the events merged, %sc counts them\n\n", "%", "%");
+    printf("  --rollup-prefix PREFIX\n");
+    printf("      Roll up the events under PREFIX, relative to DIRECTORY, into a single\n");
+    printf("      event of PREFIX. It can be repeated, the longest PREFIX wins. The events\n");
+    printf("      outside of them are rolled up as by --rollup-depth, or into DIRECTORY\n\n");
+    printf("  --rollup-window MILLISECONDS\n");
+    printf("      How long the events are rolled up, from the first one (default: %d)\n\n", ROLLUP_DEFAULT_WINDOW_MS);
     printf("  -v  --verbose\n");
     printf("      Verbose mode\n\n");
     printf("  -s  --syslog\n");
@@ -416,6 +675,14 @@ create_wd_data(char *real_path, int wd)
     wd_data->wd = wd;
     wd_data->path = real_path;
     wd_data->links = queue_init();
+    wd_data->mask = 0;
+    wd_data->depth = 0;
+    wd_data->last_event = 0;
+    wd_data->rate_since = 0;
+    wd_data->rate_count = 0;
+    wd_data->cooled_until = 0;
+    wd_data->include_state = 0;
+    wd_data->candidate = NULL;
 
     return wd_data;
 }
@@ -556,6 +823,33 @@ excluded(char *str)
     return FALSE;
 }
 
+pathglob_state_t
+include_state_of(const char *path)
+{
+    if (NULL == include_glob || is_child_of(root_path, path) == FALSE)
+        return 0;
+
+    return pathglob_walk(include_glob, pathglob_start(include_glob), path + strlen(root_path));
+}
+
+bool_t
+included(struct inotify_event *event, WD_DATA *wd_data, bool_t *match)
+{
+    *match = TRUE;
+
+    if (NULL == include_glob)
+        return TRUE;
+
+    pathglob_state_t state = wd_data->include_state;
+    if (event->len > 0)
+        state = pathglob_step(include_glob, state, event->name);
+
+    *match = pathglob_accepts(include_glob, state) ? TRUE : FALSE;
+
+    /* a directory is still needed if something below it can match */
+    return (*match == TRUE || ((event->mask & IN_ISDIR) && state != 0)) ? TRUE : FALSE;
+}
+
 bool_t
 regex_catch(char *str)
 {
@@ -607,16 +901,95 @@ format_command(char *command_format, char *event_p_path, char *file_name, char *
     bstring b_exec_cstr = bfromcstr(exec_cstr);
     bfindreplace(tmp_command, COMMAND_PATTERN_COUNT, b_exec_cstr, 0);
 
+    bstring b_events = bformat("%lu", dispatched_count);
+    bfindreplace(tmp_command, COMMAND_PATTERN_EVENTS, b_events, 0);
+
     bdestroy(b_root_path);
     bdestroy(b_event_p_path);
     bdestroy(b_file_name);
     bdestroy(b_event_name);
     bdestroy(b_regcat);
     bdestroy(b_exec_cstr);
+    bdestroy(b_events);
 
     return tmp_command;
 }
 
+uint32_t
+structural_mask()
+{
+    /* without -r there is no tree to maintain, and fanotify needs none */
+    if (recursive_flag == FALSE || backend == BACKEND_FANOTIFY)
+        return 0;
+
+    return STRUCTURAL_EVENTS;
+}
+
+uint32_t
+recognizer_mask()
+{
+    return (atomic_saves_flag == TRUE) ? ATOMIC_EVENTS : 0;
+}
+
+uint32_t
+kernel_mask_for(WD_DATA *wd_data)
+{
+    /* a hot directory is rescanned when it comes back (--hot-threshold) */
+    if (wd_data->cooled_until != 0)
+        return COOLED_EVENTS | IN_ONLYDIR | IN_EXCL_UNLINK;
+
+    uint32_t mask = structural_mask() | IN_ONLYDIR | IN_EXCL_UNLINK;
+
+    /* user events are useless where nothing can match the globs (-i option) */
+    if (NULL == include_glob || pathglob_accepts(include_glob, wd_data->include_state) || pathglob_accepts_child(include_glob, wd_data->include_state))
+        mask |= event_mask | recognizer_mask();
+
+    return mask;
+}
+
+void refresh_watch_mask(WD_DATA *wd_data, int fd)
+{
+    uint32_t mask = kernel_mask_for(wd_data);
+
+    if (mask == wd_data->mask)
+        return;
+
+    /* NOTE: without IN_MASK_ADD the kernel replaces the mask of the same wd */
+    wd_data->mask = mask;
+    register_watch(wd_data, fd, is_poller_wd(wd_data->wd) ? TRUE : FALSE);
+}
+
+uint32_t events_mask_of(const char *list)
+{
+    uint32_t mask = 0;
+    bstring b_list = bfromcstr(list);
+    struct bstrList *names = bsplit(b_list, ',');
+
+    int i;
+    for (i = 0; names != NULL && i < names->qty; ++i)
+    {
+        int j;
+        for (j = 0; j < (int)ARRAY_SIZE(events_lut); ++j)
+        {
+            if (events_lut[j].name != NULL && biseqcstr(names->entry[i], events_lut[j].name) == 1)
+            {
+                mask |= events_lut[j].mask;
+                break;
+            }
+        }
+
+        if (j == (int)ARRAY_SIZE(events_lut))
+        {
+            mask = 0;
+            break;
+        }
+    }
+
+    bstrListDestroy(names);
+    bdestroy(b_list);
+    return mask;
+}
+
 int parse_command_line(int argc, char *argv[])
 {
     if (argc == 1)
@@ -626,10 +999,13 @@ int parse_command_line(int argc, char *argv[])
 
     /* Handle command line options */
     /* TODO: Refactor the parse command line */
-    bstring b_optarg;
+    uint32_t mask;
+    char number[16];
+
+    state_options = STATE_OPTIONS_INIT;
 
     int c;
-    while ((c = getopt_long(argc, argv, "svnrVhe:c:F:d:x:X:", long_options, NULL)) != -1)
+    while ((c = getopt_long(argc, argv, "svnrVhe:c:F:d:x:X:i:", long_options, NULL)) != -1)
     {
         switch (c)
         {
@@ -637,6 +1013,12 @@ int parse_command_line(int argc, char *argv[])
             if (NULL != format)
                 help(EINVAL, "The option -c --command exclude the use of -F --format option.\n");
 
+            if (NULL != plugin_path)
+                help(EINVAL, "The option -c --command exclude the use of --plugin option.\n");
+
+            if (NULL != mirror_destination)
+                help(EINVAL, "The option -c --command exclude the use of --mirror option.\n");
+
             if (optarg == NULL || strcmp(optarg, "") == 0 || (command = bfromcstr(optarg)) == NULL)
             {
                 help(EINVAL, "The option -c --command requires a COMMAND.\n");
@@ -654,6 +1036,12 @@ int parse_command_line(int argc, char *argv[])
             if (NULL != command)
                 help(EINVAL, "The option -F --format exclude the use of -c --command option.\n");
 
+            if (NULL != plugin_path)
+                help(EINVAL, "The option -F --format exclude the use of --plugin option.\n");
+
+            if (NULL != mirror_destination)
+                help(EINVAL, "The option -F --format exclude the use of --mirror option.\n");
+
             format = bfromcstr(optarg);
 
             /* The command will be executed in embedded mode */
@@ -685,33 +1073,10 @@ int parse_command_line(int argc, char *argv[])
 
         case 'e': /* --events */
             /* Set inotify events mask */
-            b_optarg = bfromcstr(optarg);
-            split_event = bsplit(b_optarg, ',');
-
-            if (split_event != NULL)
-            {
-                int len_events_lut = ARRAY_SIZE(events_lut);
+            if ((mask = events_mask_of(optarg)) == 0)
+                help(EINVAL, "Unrecognized event or malformed list of events! Please see the help.\n");
 
-                int i;
-                for (i = 0; i < split_event->qty; ++i)
-                {
-                    int j;
-                    for (j = 0; j < len_events_lut; ++j)
-                    {
-                        bstring event_name = bfromcstr(events_lut[j].name);
-                        if (bstrcmp(split_event->entry[i], event_name) == 0)
-                        {
-                            event_mask |= events_lut[j].mask;
-                            break;
-                        }
-                        bdestroy(event_name);
-                    }
-                    if (j == len_events_lut)
-                        help(EINVAL, "Unrecognized event or malformed list of events! Please see the help.\n");
-                }
-                bdestroy(b_optarg);
-                bstrListDestroy(split_event);
-            }
+            event_mask |= mask;
             break;
 
         case 'x': /* --exclude */
@@ -726,6 +1091,7 @@ int parse_command_line(int argc, char *argv[])
                 help(EINVAL, "The specified regular expression provided for the -x --exclude option, is not valid.\n");
             }
 
+            state_options = state_hash(state_options, "-x", optarg);
             break;
 
         case 'X': /* --regex-catch */
@@ -742,6 +1108,214 @@ int parse_command_line(int argc, char *argv[])
 
             break;
 
+        case 'i': /* --include */
+            if (NULL == include_glob)
+                include_glob = pathglob_init();
+
+            if (pathglob_add(include_glob, optarg) == -1)
+                help(EINVAL, "The glob provided for the -i --include option is not valid or there are too many globs.\n");
+
+            state_options = state_hash(state_options, "-i", optarg);
+            break;
+
+        case OPT_MAX_DEPTH: /* --max-depth */
+            if ((max_depth = atoi(optarg)) < 0 || !isdigit((unsigned char)optarg[0]))
+                help(EINVAL, "The option --max-depth requires a number of directories.\n");
+            break;
+
+        case OPT_MAX_WATCHES: /* --max-watches */
+            if ((max_watches = atoi(optarg)) < 1)
+                help(EINVAL, "The option --max-watches requires a positive number of watches.\n");
+            break;
+
+        case OPT_POLL_INTERVAL: /* --poll-interval */
+            if ((poll_interval = atoi(optarg)) < 1)
+                help(EINVAL, "The option --poll-interval requires a positive number of seconds.\n");
+            break;
+
+        case OPT_BACKEND: /* --backend */
+            if (strcmp(optarg, "inotify") == 0)
+                backend = BACKEND_INOTIFY;
+            else if (strcmp(optarg, "poll") == 0)
+                backend = BACKEND_POLL;
+            else if (strcmp(optarg, "fanotify") == 0)
+                backend = BACKEND_FANOTIFY;
+            else
+                help(EINVAL, "The option --backend requires inotify, poll or fanotify.\n");
+            break;
+
+        case OPT_SHARDS: /* --shards */
+            if ((shards = atoi(optarg)) < 1 || shards > SHARDS_MAX)
+            {
+                char message[128];
+                snprintf(message, sizeof(message), "The option --shards requires a number of inotify instances between 1 and %d.\n", SHARDS_MAX);
+                help(EINVAL, message);
+            }
+            break;
+
+        case OPT_PRIORITY_LANE: /* --priority-lane */
+            priority_lane_flag = TRUE;
+            break;
+
+        case OPT_PROGRESSIVE: /* --progressive */
+            progressive_flag = TRUE;
+            break;
+
+        case OPT_SKIP_UNCHANGED: /* --skip-unchanged */
+            skip_unchanged_flag = TRUE;
+            break;
+
+        case OPT_ATOMIC_SAVES: /* --atomic-saves */
+            atomic_saves_flag = TRUE;
+            break;
+
+        case OPT_HOT_THRESHOLD: /* --hot-threshold */
+            if ((hot_threshold = atoi(optarg)) < 1)
+                help(EINVAL, "The option --hot-threshold requires a positive number of events.\n");
+            break;
+
+        case OPT_HOT_COOLDOWN: /* --hot-cooldown */
+            if ((hot_cooldown = atoi(optarg)) < 1)
+                help(EINVAL, "The option --hot-cooldown requires a positive number of seconds.\n");
+            break;
+
+        case OPT_HEAVY_HITTERS: /* --heavy-hitters */
+            if ((heavy_hitters = atoi(optarg)) < 1)
+                help(EINVAL, "The option --heavy-hitters requires a positive number of paths.\n");
+            break;
+
+        case OPT_ROLLUP_DEPTH: /* --rollup-depth */
+            if ((rollup_depth = atoi(optarg)) < 0 || !isdigit((unsigned char)optarg[0]))
+                help(EINVAL, "The option --rollup-depth requires a depth, 0 or more.\n");
+            rollup_flag = TRUE;
+            break;
+
+        case OPT_ROLLUP_PREFIX: /* --rollup-prefix */
+            if (rollup_add_prefix(optarg) == -1)
+                help(ENOMEM, "Unable to add the prefix of --rollup-prefix.\n");
+            rollup_flag = TRUE;
+            break;
+
+        case OPT_ROLLUP_WINDOW: /* --rollup-window */
+            if ((rollup_window = atoi(optarg)) < 1)
+                help(EINVAL, "The option --rollup-window requires a positive number of milliseconds.\n");
+            break;
+
+        case OPT_STATS_FILE: /* --stats-file */
+            stats_file = optarg;
+            break;
+
+        case OPT_STATS_INTERVAL: /* --stats-interval */
+            if ((stats_interval = atoi(optarg)) < 1)
+                help(EINVAL, "The option --stats-interval requires a positive number of seconds.\n");
+            break;
+
+        case OPT_METRICS_SOCKET: /* --metrics-socket */
+            metrics_socket = optarg;
+            break;
+
+        case OPT_HEAVY_INTERVAL: /* --heavy-interval */
+            if ((heavy_interval = atoi(optarg)) < 1)
+                help(EINVAL, "The option --heavy-interval requires a positive number of seconds.\n");
+            break;
+
+        case OPT_READY_FILE: /* --ready-file */
+            ready_file = optarg;
+            break;
+
+        case OPT_STATE_FILE: /* --state-file */
+            state_file = optarg;
+            break;
+
+        case OPT_STATE_CHANGES: /* --state-changes */
+            state_changes_flag = TRUE;
+            break;
+
+        case OPT_JOURNAL: /* --journal */
+            journal_directory = optarg;
+            break;
+
+        case OPT_JOURNAL_MAX_SIZE: /* --journal-max-size */
+            if ((journal_max_size = atoi(optarg)) < 1)
+                help(EINVAL, "The option --journal-max-size requires a positive number of megabytes.\n");
+            journal_max_size *= 1024 * 1024;
+            break;
+
+        case OPT_JOURNAL_MAX_AGE: /* --journal-max-age */
+            if ((journal_max_age = atoi(optarg)) < 1)
+                help(EINVAL, "The option --journal-max-age requires a positive number of seconds.\n");
+            break;
+
+        case OPT_JOURNAL_FSYNC: /* --journal-fsync */
+            if (strcmp(optarg, "none") == 0)
+                journal_fsync = JOURNAL_FSYNC_NONE;
+            else if (strcmp(optarg, "batch") == 0)
+                journal_fsync = JOURNAL_FSYNC_BATCH;
+            else if (strcmp(optarg, "second") == 0)
+                journal_fsync = JOURNAL_FSYNC_SECOND;
+            else
+                help(EINVAL, "The option --journal-fsync requires none, batch or second.\n");
+            break;
+
+        case OPT_CURSOR_SOCKET: /* --cursor-socket */
+            cursor_socket = optarg;
+            break;
+
+        case OPT_SUBSCRIBE_SOCKET: /* --subscribe-socket */
+            subscribe_socket = optarg;
+            break;
+
+        case OPT_RING_SOCKET: /* --ring-socket */
+            ring_socket = optarg;
+            break;
+
+        case OPT_PLUGIN: /* --plugin */
+            if (NULL != command || NULL != format)
+                help(EINVAL, "The option --plugin exclude the use of -c --command and -F --format options.\n");
+
+            if (NULL != mirror_destination)
+                help(EINVAL, "The option --plugin exclude the use of --mirror option.\n");
+
+            plugin_path = optarg;
+
+            /* The events will be handled in process */
+            execute_command = execute_command_plugin;
+            break;
+
+        case OPT_PLUGIN_ARG: /* --plugin-arg */
+            plugin_argument = optarg;
+            break;
+
+        case OPT_MIRROR: /* --mirror */
+            if (NULL != command || NULL != format || NULL != plugin_path)
+                help(EINVAL, "The option --mirror exclude the use of -c --command, -F --format and --plugin options.\n");
+
+            if (!is_dir(optarg))
+                help(ENOENT, "The option --mirror requires a valid DESTINATION.\n");
+
+            /* absolute, with the trailing slash */
+            if ((mirror_destination = resolve_real_path(optarg)) == NULL)
+                help(ENOENT, "The option --mirror requires a valid DESTINATION.\n");
+
+            /* The events will be applied to the destination */
+            execute_command = execute_command_mirror;
+            break;
+
+        case OPT_MIRROR_WORKERS: /* --mirror-workers */
+            if ((mirror_workers = atoi(optarg)) < 1 || mirror_workers > MIRROR_MAX_WORKERS)
+            {
+                char message[128];
+                snprintf(message, sizeof(message), "The option --mirror-workers requires a number of threads between 1 and %d.\n", MIRROR_MAX_WORKERS);
+                help(EINVAL, message);
+            }
+            break;
+
+        case OPT_RING_SIZE: /* --ring-size */
+            if (atoi(optarg) < 1)
+                help(EINVAL, "The option --ring-size requires a positive number of megabytes.\n");
+            ring_size = (size_t)atoi(optarg) * 1024 * 1024;
+            break;
+
         case 'v': /* --verbose */
             verbose_flag = TRUE;
             break;
@@ -769,20 +1343,77 @@ int parse_command_line(int argc, char *argv[])
         }
     }
 
-    if (root_path == NULL || command == format)
+    if (root_path == NULL || (command == format && plugin_path == NULL && mirror_destination == NULL && subscribe_socket == NULL && ring_socket == NULL))
     {
         help(EINVAL, "The options -c --command and -d --directory are required.\n");
     }
 
+    if (shards > 1 && backend != BACKEND_INOTIFY)
+    {
+        help(EINVAL, "The option --shards requires the inotify backend.\n");
+    }
+
+    if (hot_threshold > 0 && backend != BACKEND_INOTIFY)
+    {
+        help(EINVAL, "The option --hot-threshold requires the inotify backend.\n");
+    }
+
+    if (priority_lane_flag == TRUE && (shards > 1 || backend != BACKEND_INOTIFY))
+    {
+        help(EINVAL, "The option --priority-lane requires the inotify backend, without --shards.\n");
+    }
+
+    if (progressive_flag == TRUE && ingestible_in_background() == FALSE)
+    {
+        help(EINVAL, "The option --progressive requires the inotify backend, without --shards and --priority-lane.\n");
+    }
+
+    if (state_file != NULL && backend == BACKEND_FANOTIFY)
+    {
+        help(EINVAL, "The option --state-file requires the inotify or the poll backend.\n");
+    }
+
+    if (state_changes_flag == TRUE && state_file == NULL)
+    {
+        help(EINVAL, "The option --state-changes requires --state-file.\n");
+    }
+
+    if (mirror_destination != NULL && strncmp(mirror_destination, root_path, strlen(root_path)) == 0)
+    {
+        help(EINVAL, "The option --mirror requires a DESTINATION outside of the watched directory.\n");
+    }
+
+    if (rollup_flag == TRUE && mirror_destination != NULL)
+    {
+        help(EINVAL, "The options --rollup-depth and --rollup-prefix exclude the use of --mirror option.\n");
+    }
+
     if (event_mask == 0)
     {
         event_mask = IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVE;
     }
 
+    /* the mirror needs to know when a file is complete */
+    if (mirror_destination != NULL)
+    {
+        event_mask |= MIRROR_EVENTS;
+    }
+
+    /* a state saved with another tree is not restored (--state-file) */
+    snprintf(number, sizeof(number), "%d", max_depth);
+    state_options = state_hash(state_options, "--max-depth", number);
+    state_options = state_hash(state_options, "-n", (nosymlink_flag == TRUE) ? "1" : "0");
+    state_options = state_hash(state_options, "-r", (recursive_flag == TRUE) ? "1" : "0");
+
     return 0;
 }
 
 int watch_directory_tree(char *real_path, char *symlink, bool_t recursive, int fd, Queue *queue_wd)
+{
+    return walk_directory_tree(real_path, symlink, recursive, FALSE, fd, queue_wd);
+}
+
+int walk_directory_tree(char *real_path, char *symlink, bool_t recursive, bool_t synthesize, int fd, Queue *queue_wd)
 {
     /* Add initial path to the watch list */
     QueueElement *element = add_to_watch_list(real_path, symlink, fd, queue_wd);
@@ -794,340 +1425,1722 @@ int watch_directory_tree(char *real_path, char *symlink, bool_t recursive, int f
 
     /* Temporary queue to perform a BFS directory traversing */
     Queue *queue = queue_init();
-    queue_enqueue(queue, (void *)real_path);
+    queue_enqueue(queue, element->data);
 
-    DIR *dir_stream;
-    struct dirent *dir;
+    LISTING *listing;
+    char *name;
+    unsigned char type;
 
     while (queue->first != NULL)
     {
-        char *directory_to_watch = (char *)queue_dequeue(queue);
-        dir_stream = opendir(directory_to_watch);
+        WD_DATA *wd_data = (WD_DATA *)queue_dequeue(queue);
+        char *directory_to_watch = wd_data->path;
+        CWATCH_PROBE2(walk__directory, directory_to_watch, wd_data->depth);
+        listing = open_listing(directory_to_watch);
 
-        if (dir_stream == NULL)
+        /* NOTE: a new directory can be gone before it is visited */
+        if (listing == NULL)
         {
-            printf("UNABLE TO OPEN DIRECTORY:\t\"%s\" -> %d\n", directory_to_watch, errno);
-            exit(ENOENT);
+            log_message("UNABLE TO OPEN DIRECTORY:\t\"%s\" -> %d", directory_to_watch, errno);
+            continue;
         }
 
-        while ((dir = readdir(dir_stream)))
+        while (next_listing(listing, &name, &type))
         {
             /* Discard all file names that matches regular expression (-x option) */
-            if ((dir->d_type == DT_DIR) && excluded(dir->d_name))
+            if ((type == DT_DIR) && excluded(name))
+            {
+                continue;
+            }
+
+            if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+            {
+                continue;
+            }
+
+            /* The entry could be created before the watch of its directory */
+            if (synthesize == TRUE)
+            {
+                synthesize_create(wd_data, name, (type == DT_DIR) ? TRUE : FALSE);
+            }
+            /* The entry could be created while cwatch was not running (--state-changes) */
+            else if (listing->changed == TRUE && state_changes_flag == TRUE && (type == DT_DIR || type == DT_LNK) &&
+                     saved_in_state(directory_to_watch, name, type) == FALSE)
+            {
+                synthesize_create(wd_data, name, (type == DT_DIR) ? TRUE : FALSE);
+            }
+
+            /* Do not descend into directories that can never match the globs (-i option) */
+            pathglob_state_t include_state = 0;
+            if (NULL != include_glob && (type == DT_DIR || type == DT_LNK))
+            {
+                include_state = pathglob_step(include_glob, wd_data->include_state, name);
+                if (include_state == 0)
+                    continue;
+            }
+
+            /* Do not descend beyond the --max-depth option */
+            if (max_depth >= 0 && wd_data->depth >= max_depth)
             {
                 continue;
             }
 
-            if ((dir->d_type == DT_DIR) && strcmp(dir->d_name, ".") != 0 && strcmp(dir->d_name, "..") != 0)
+            if (type == DT_DIR)
             {
                 /* Absolute path to watch */
-                char *path_to_watch = append_dir(directory_to_watch, dir->d_name);
+                char *path_to_watch = append_dir(directory_to_watch, name);
 
                 /* Continue directory traversing */
-                add_to_watch_list(path_to_watch, NULL, fd, queue_wd);
-                queue_enqueue(queue, (void *)path_to_watch);
+                element = watch_resource(path_to_watch, NULL, wd_data->depth + 1, include_state, fd, queue_wd);
+                if (element != NULL)
+                    queue_enqueue(queue, element->data);
+                release_unwatched(path_to_watch, NULL, queue_wd);
             }
-            else if (dir->d_type == DT_LNK && nosymlink_flag == FALSE)
+            else if (type == DT_LNK && nosymlink_flag == FALSE)
             {
                 /* Resolve symbolic link */
-                char *symlink = append_file(directory_to_watch, dir->d_name);
+                char *symlink = append_file(directory_to_watch, name);
                 char *real_path = resolve_real_path(symlink);
 
-                if (is_dir(real_path))
+                /* Check if the symbolic link is already watched */
+                if (real_path != NULL && is_dir(real_path) && get_link_data_from_path(symlink, queue_wd) == NULL)
                 {
-                    /* Check if the symbolic link is already watched */
-                    if (get_link_data_from_path(symlink, queue_wd) != NULL)
-                    {
-                        continue;
-                    }
-
                     /* Continue directory traversing */
-                    add_to_watch_list(real_path, symlink, fd, queue_wd);
-                    queue_enqueue(queue, (void *)real_path);
+                    element = watch_resource(real_path, symlink, wd_data->depth + 1, include_state, fd, queue_wd);
+                    if (element != NULL)
+                        queue_enqueue(queue, element->data);
                 }
+                release_unwatched(real_path, symlink, queue_wd);
             }
         }
-        closedir(dir_stream);
+
+        /* The entries deleted while cwatch was not running (--state-changes) */
+        if (listing->changed == TRUE && state_changes_flag == TRUE)
+            report_deleted_entries(wd_data);
+
+        close_listing(listing);
     }
 
     queue_free(queue);
     return 0;
 }
 
-QueueElement *
-add_to_watch_list(char *real_path, char *symlink, int fd, Queue *queue_wd)
+LISTING *open_listing(const char *path)
 {
-    QueueElement *element = get_node_from_path(real_path, queue_wd);
-
-    /* if the resource is not watched yet, then add it into the watch_list */
-    if (NULL == element)
-    {
-        int wd = watch_descriptor_from(fd, real_path, event_mask);
+    LISTING *listing = (LISTING *)calloc(1, sizeof(LISTING));
+    if (listing == NULL)
+        return NULL;
 
-        /* INFO Check limit in: /proc/sys/fs/inotify/max_user_watches TODO: Extract from here */
-        if (wd == -1)
-        {
-            printf("AN ERROR OCCURRED WHILE ADDING PATH %s:\n", real_path);
-            printf("Please consider these possibilities:\n");
-            printf(" - Max number of watched resources reached! See /proc/sys/fs/inotify/max_user_watches\n");
-            printf(" - Resource is no more available!?\n");
-            return NULL;
-        }
+    listing->path = path;
+    listing->cursor = -1;
 
-        WD_DATA *wd_data = create_wd_data(real_path, wd);
+    /* a directory not changed since the state was saved is not listed again */
+    struct stat st;
+    if (NULL != state_snapshot && stat(path, &st) == 0)
+    {
+        if (state_unchanged(state_snapshot, path, &st))
+            return listing;
 
-        if (wd_data != NULL)
-        {
-            element = queue_enqueue(queue_wd, (void *)wd_data);
-            log_message("WATCHING: (fd:%d,wd:%d)\t\t\"%s\"", fd, wd_data->wd, real_path);
-        }
+        listing->changed = (state_find(state_snapshot, path) != NULL) ? TRUE : FALSE;
     }
 
-    /* append symbolic link to watched resources */
-    if (element != NULL && symlink != NULL)
+    if ((listing->stream = opendir(path)) == NULL)
     {
-        WD_DATA *wd_data = (WD_DATA *)element->data;
-        LINK_DATA *link_data = create_link_data(symlink, wd_data);
-
-        if (link_data != NULL)
-        {
-            queue_enqueue(wd_data->links, (void *)link_data);
-            log_message("ADDED SYMBOLIC LINK:\t\t\"%s\" -> \"%s\"", symlink, real_path);
-        }
+        free(listing);
+        return NULL;
     }
 
-    return element;
+    return listing;
 }
 
-void unwatch_path(char *absolute_path, int fd, Queue *queue_wd)
+int next_listing(LISTING *listing, char **name, unsigned char *type)
 {
-    QueueElement *element = get_node_from_path(absolute_path, queue_wd);
-    if (NULL == element)
-        return;
+    if (listing->stream == NULL)
+    {
+        if (!state_next_entry(state_snapshot, listing->path, &listing->cursor, listing->name, type))
+            return 0;
 
-    WD_DATA *wd_data = (WD_DATA *)element->data;
+        *name = listing->name;
+        return 1;
+    }
 
-    log_message("UNWATCHING: (fd:%d,wd:%d)\t\t\"%s\"", fd, wd_data->wd, absolute_path);
+    struct dirent *entry = readdir(listing->stream);
+    if (entry == NULL)
+        return 0;
 
-    remove_watch_descriptor(fd, wd_data->wd);
+    *name = entry->d_name;
+    *type = entry->d_type;
+    return 1;
+}
 
-    if (wd_data->links->first != NULL)
-        queue_free(wd_data->links);
+void close_listing(LISTING *listing)
+{
+    if (listing->stream != NULL)
+        closedir(listing->stream);
 
-    queue_remove(queue_wd, element);
+    free(listing);
 }
 
-void all_symlinks_contained_in(char *path, Queue *queue_wd, Queue *symlinks_found)
+bool_t
+saved_in_state(const char *directory, const char *name, unsigned char type)
 {
-    QueueElement *element = queue_wd->first;
+    char *path = (type == DT_DIR) ? append_dir(directory, name) : append_file(directory, name);
+    bool_t saved = (state_find(state_snapshot, path) != NULL) ? TRUE : FALSE;
+    free(path);
 
-    WD_DATA *wd_data = NULL;
-    while (element)
-    {
-        wd_data = (WD_DATA *)element->data;
+    return saved;
+}
 
-        symlinks_contained_in(path, wd_data->links, symlinks_found);
+void report_deleted_entries(WD_DATA *wd_data)
+{
+    int cursor = -1;
+    char name[NAME_MAX + 1];
+    unsigned char type;
+    struct stat st;
 
-        element = element->next;
+    while (state_next_entry(state_snapshot, wd_data->path, &cursor, name, &type))
+    {
+        char *path = append_file(wd_data->path, name);
+        if (lstat(path, &st) == -1 && errno == ENOENT)
+            synthesize_event(wd_data, name, IN_DELETE | ((type == DT_DIR) ? IN_ISDIR : 0));
+        free(path);
+    }
+}
+
+bool_t
+state_savable(int fd)
+{
+    int pending = 0;
+
+    /* NOTE: with events still to handle, the mtime of a directory could be
+     *       newer than its entries in the watch list
+     */
+    if (ingest_in_progress() > 0)
+        return FALSE;
+
+    if (ioctl(fd, FIONREAD, &pending) == 0 && pending > 0)
+        return FALSE;
+
+    if (lane_descriptor() != -1 && ioctl(lane_descriptor(), FIONREAD, &pending) == 0 && pending > 0)
+        return FALSE;
+
+    return TRUE;
+}
+
+int save_state(Queue *queue_wd)
+{
+    bstring records = bfromcstr("");
+    int qty = 0;
+
+    QueueElement *element;
+    for (element = queue_wd->first; element != NULL; element = element->next)
+    {
+        WD_DATA *wd_data = (WD_DATA *)element->data;
+
+        /* the poller could have not seen the last changes yet */
+        if (state_append(records, wd_data->path, DT_DIR, is_poller_wd(wd_data->wd)) == 0)
+            ++qty;
+
+        QueueElement *link_node;
+        for (link_node = wd_data->links->first; link_node != NULL; link_node = link_node->next)
+        {
+            state_append(records, ((LINK_DATA *)link_node->data)->path, DT_LNK, 0);
+            ++qty;
+        }
+    }
+
+    int result = state_save(state_file, records, qty, state_options);
+    if (result == -1)
+        log_message("UNABLE TO SAVE THE STATE:\t\"%s\" -> %d", state_file, errno);
+    else
+        log_message("STATE SAVED:\t\"%s\" (%d entries)", state_file, qty);
+
+    bdestroy(records);
+    return result;
+}
+
+bool_t
+ingestible_in_background()
+{
+    /* NOTE: the workers add the watches by themselves, only plain inotify is thread safe.
+     * A context of libcwatch (event_sink) walks the trees itself: the workers have a
+     * single inotify instance, and nobody collects them there */
+    return (backend == BACKEND_INOTIFY && shards == 1 && priority_lane_flag == FALSE && NULL == event_sink) ? TRUE : FALSE;
+}
+
+int ingest_directory_tree(char *real_path, int fd, Queue *queue_wd)
+{
+    if (ingestible_in_background() == FALSE || ingest_start(fd, watch_descriptor_from, accept_ingested) == -1)
+        return watch_directory_tree(real_path, NULL, TRUE, fd, queue_wd);
+
+    QueueElement *element = add_to_watch_list(real_path, NULL, fd, queue_wd);
+    if (element == NULL)
+        return -1;
+
+    WD_DATA *wd_data = (WD_DATA *)element->data;
+
+    /* a polled directory is visited in the usual way */
+    if (is_poller_wd(wd_data->wd))
+        return watch_directory_tree(wd_data->path, NULL, TRUE, fd, queue_wd);
+
+    INGEST_DIR *dir = (INGEST_DIR *)calloc(1, sizeof(INGEST_DIR));
+    if (dir == NULL || (dir->path = strdup(wd_data->path)) == NULL)
+    {
+        free(dir);
+        return -1;
+    }
+
+    dir->depth = wd_data->depth;
+    dir->include_state = wd_data->include_state;
+    dir->mask = wd_data->mask;
+    dir->wd = wd_data->wd;
+    clock_gettime(CLOCK_REALTIME_COARSE, &dir->since);
+
+    log_message("INGESTING: (fd:%d,wd:%d)\t\t\"%s\"", fd, wd_data->wd, wd_data->path);
+
+    return ingest_subtree(dir);
+}
+
+int accept_ingested(const INGEST_DIR *parent, const char *name, unsigned char type, INGEST_DIR *child)
+{
+    /* NOTE: it runs on the workers, the same rules of watch_directory_tree */
+    if (type == DT_DIR && excluded((char *)name))
+        return 0;
+
+    if (type == DT_LNK && nosymlink_flag == TRUE)
+        return 0;
+
+    pathglob_state_t include_state = 0;
+    if (NULL != include_glob)
+    {
+        include_state = pathglob_step(include_glob, parent->include_state, name);
+        if (include_state == 0)
+            return 0;
+    }
+
+    if (max_depth >= 0 && parent->depth >= max_depth)
+        return 0;
+
+    WD_DATA wd_data;
+    memset(&wd_data, 0, sizeof(wd_data));
+    wd_data.include_state = include_state;
+
+    child->depth = parent->depth + 1;
+    child->include_state = include_state;
+    child->mask = kernel_mask_for(&wd_data);
+
+    return 1;
+}
+
+void collect_ingested(int fd, Queue *queue_wd)
+{
+    static time_t last_progress = 0;
+    int left;
+    INGEST_DIR *dir;
+
+    Queue *collected = ingest_collect(INGEST_BATCH, &left);
+    while ((dir = (INGEST_DIR *)queue_dequeue(collected)))
+        register_ingested(dir, fd, queue_wd);
+    queue_free(collected);
+
+    /* the events of the directories just added, in the order they came */
+    if (NULL != pending_events && blength(pending_events) > 0)
+    {
+        bstring events = pending_events;
+        pending_events = bfromcstr("");
+        handle_events((char *)events->data, blength(events), fd, queue_wd);
+        bdestroy(events);
+    }
+
+    if (left == 0)
+    {
+        log_message("INGESTED: all the directories are watched");
+        report_ready();
+    }
+    else if (time(NULL) != last_progress)
+    {
+        last_progress = time(NULL);
+        log_message("INGESTING: %d directories left", left);
+    }
+}
+
+void register_ingested(INGEST_DIR *dir, int fd, Queue *queue_wd)
+{
+    if (dir->symlink != NULL)
+    {
+        char *real_path = resolve_real_path(dir->symlink);
+        if (real_path != NULL && is_dir(real_path) && get_link_data_from_path(dir->symlink, queue_wd) == NULL)
+            watch_directory_tree(real_path, strdup(dir->symlink), TRUE, fd, queue_wd);
+        else
+            free(real_path);
+
+        ingest_free(dir);
+        return;
+    }
+
+    /* the watch failed, out of watches or gone: leave it to the usual way */
+    if (dir->wd == -1)
+    {
+        if (is_dir(dir->path))
+        {
+            watch_directory_tree(dir->path, NULL, TRUE, fd, queue_wd);
+            dir->path = NULL;
+        }
+
+        ingest_free(dir);
+        return;
+    }
+
+    QueueElement *element = get_node_from_wd(dir->wd, queue_wd);
+    if (element != NULL)
+    {
+        WD_DATA *wd_data = (WD_DATA *)element->data;
+
+        /* the same directory under another path (a bind mount), linked as a symbolic link is */
+        if (strcmp(wd_data->path, dir->path) != 0 && is_dir(wd_data->path))
+        {
+            dir->path[strlen(dir->path) - 1] = '\0';
+            LINK_DATA *link_data = (get_link_data_from_path(dir->path, queue_wd) == NULL) ? create_link_data(dir->path, wd_data) : NULL;
+            if (link_data != NULL)
+            {
+                queue_enqueue(wd_data->links, (void *)link_data);
+                log_message("ADDED LINK:\t\t\"%s\" -> \"%s\"", dir->path, wd_data->path);
+                dir->path = NULL;
+            }
+        }
+        /* moved within the tree, the directory keeps its watch under the new path */
+        else if (strcmp(wd_data->path, dir->path) != 0)
+        {
+            free(wd_data->path);
+            wd_data->path = dir->path;
+            dir->path = NULL;
+            untrack_candidate(wd_data);
+            wd_data->depth = dir->depth;
+            wd_data->include_state = dir->include_state;
+            track_candidate(wd_data);
+        }
+
+        ingest_free(dir);
+        return;
+    }
+
+    WD_DATA *wd_data = create_wd_data(dir->path, dir->wd);
+    if (wd_data == NULL)
+    {
+        ingest_free(dir);
+        return;
+    }
+
+    wd_data->depth = dir->depth;
+    wd_data->include_state = dir->include_state;
+    wd_data->mask = dir->mask;
+    dir->path = NULL;
+
+    queue_enqueue(queue_wd, (void *)wd_data);
+    ++watch_budget.used;
+    count_watch(METRIC_WATCHES_ADDED);
+    track_candidate(wd_data);
+    CWATCH_PROBE2(watch__add, wd_data->wd, wd_data->path);
+
+    log_message("WATCHING: (fd:%d,wd:%d)\t\t\"%s\"", fd, wd_data->wd, wd_data->path);
+
+    /* the entries born before the watch, their real events are deferred until now */
+    char *name;
+    while (dir->created != NULL && (name = (char *)queue_dequeue(dir->created)))
+    {
+        size_t name_len = strlen(name);
+        bool_t is_directory = (name[name_len - 1] == '/') ? TRUE : FALSE;
+        if (is_directory == TRUE)
+            name[name_len - 1] = '\0';
+
+        synthesize_create(wd_data, name, is_directory);
+        free(name);
+    }
+
+    /* the workers do not honor the budget */
+    if (watch_budget.limit > 0 && watch_budget.used > watch_budget.limit)
+        demote_watch(wd_data, fd);
+
+    ingest_free(dir);
+}
+
+long elapsed_ms(const struct timespec *since)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - since->tv_sec) * 1000 + (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+uint64_t elapsed_us(const struct timespec *since)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)(now.tv_sec - since->tv_sec) * 1000000 + (now.tv_nsec - since->tv_nsec) / 1000;
+}
+
+void report_ready()
+{
+    if (ready_flag == TRUE)
+        return;
+
+    ready_flag = TRUE;
+    long time_to_ready = elapsed_ms(&started_at);
+
+    log_message("READY: the whole tree is watched in %d ms", (int)time_to_ready);
+
+    if (NULL == ready_file)
+        return;
+
+    /* NOTE: written aside and renamed, who waits for it never reads it half written */
+    bstring tmp_file = bformat("%s.tmp", ready_file);
+    FILE *file = fopen((char *)tmp_file->data, "w");
+    if (file != NULL)
+    {
+        fprintf(file, "%ld\n", time_to_ready);
+        fclose(file);
+
+        if (rename((char *)tmp_file->data, ready_file) == -1)
+            unlink((char *)tmp_file->data);
+    }
+    bdestroy(tmp_file);
+}
+
+QueueElement *
+add_to_watch_list(char *real_path, char *symlink, int fd, Queue *queue_wd)
+{
+    char *path = (symlink != NULL) ? symlink : real_path;
+    int depth = depth_of(path);
+
+    if (max_depth >= 0 && depth > max_depth)
+        return NULL;
+
+    return watch_resource(real_path, symlink, depth, include_state_of(path), fd, queue_wd);
+}
+
+QueueElement *
+watch_resource(char *real_path, char *symlink, int depth, pathglob_state_t include_state, int fd, Queue *queue_wd)
+{
+    QueueElement *element = get_node_from_path(real_path, queue_wd);
+
+    /* if the resource is not watched yet, then add it into the watch_list */
+    if (NULL == element)
+    {
+        WD_DATA *wd_data = create_wd_data(real_path, -1);
+        if (wd_data == NULL)
+            return NULL;
+
+        wd_data->depth = depth;
+        wd_data->include_state = include_state;
+        wd_data->mask = kernel_mask_for(wd_data);
+
+        if (attach_watch(wd_data, fd, queue_wd) == -1)
+        {
+            printf("AN ERROR OCCURRED WHILE ADDING PATH %s:\n", real_path);
+            printf("Please consider these possibilities:\n");
+            printf(" - Max number of watched resources reached! See /proc/sys/fs/inotify/max_user_watches\n");
+            printf(" - Resource is no more available!?\n");
+            queue_free(wd_data->links);
+            free(wd_data);
+            return NULL;
+        }
+
+        element = queue_enqueue(queue_wd, (void *)wd_data);
+        CWATCH_PROBE2(watch__add, wd_data->wd, wd_data->path);
+    }
+    else
+    {
+        WD_DATA *wd_data = (WD_DATA *)element->data;
+        if (depth < wd_data->depth)
+        {
+            untrack_candidate(wd_data);
+            wd_data->depth = depth;
+            track_candidate(wd_data);
+        }
+        wd_data->include_state |= include_state;
+        refresh_watch_mask(wd_data, fd);
+    }
+
+    /* append symbolic link to watched resources */
+    if (element != NULL && symlink != NULL)
+    {
+        WD_DATA *wd_data = (WD_DATA *)element->data;
+        LINK_DATA *link_data = create_link_data(symlink, wd_data);
+
+        if (link_data != NULL)
+        {
+            queue_enqueue(wd_data->links, (void *)link_data);
+            log_message("ADDED SYMBOLIC LINK:\t\t\"%s\" -> \"%s\"", symlink, real_path);
+        }
+    }
+
+    return element;
+}
+
+void release_unwatched(char *real_path, char *symlink, Queue *queue_wd)
+{
+    if (symlink != NULL)
+    {
+        LINK_DATA *link_data = get_link_data_from_path(symlink, queue_wd);
+        if (link_data == NULL || link_data->path != symlink)
+            free(symlink);
+    }
+
+    if (real_path != NULL)
+    {
+        QueueElement *element = get_node_from_path(real_path, queue_wd);
+        if (element == NULL || ((WD_DATA *)element->data)->path != real_path)
+            free(real_path);
+    }
+}
+
+int depth_of(const char *path)
+{
+    if (is_child_of(root_path, path) == FALSE)
+        return 0;
+
+    int depth = 0;
+    const char *cursor = path + strlen(root_path);
+    while (*cursor != '\0')
+    {
+        size_t length = strcspn(cursor, "/");
+        if (length > 0)
+            ++depth;
+        cursor += length + (cursor[length] == '/');
+    }
+
+    return depth;
+}
+
+int register_watch(WD_DATA *wd_data, int fd, bool_t polled)
+{
+    if (polled == TRUE)
+        return poller_add_watch(fd, wd_data->path, wd_data->mask);
+
+    return watch_descriptor_from(fd, wd_data->path, wd_data->mask);
+}
+
+int attach_watch(WD_DATA *wd_data, int fd, Queue *queue_wd)
+{
+    /* make room for shallow directories demoting a deeper one to the poller */
+    if (!watch_budget_available(&watch_budget))
+    {
+        WD_DATA *victim = watch_to_demote(wd_data->depth, 0, queue_wd);
+        if (victim != NULL)
+            demote_watch(victim, fd);
+    }
+
+    if (watch_budget_available(&watch_budget))
+    {
+        wd_data->wd = register_watch(wd_data, fd, FALSE);
+        if (wd_data->wd != -1)
+        {
+            ++watch_budget.used;
+            count_watch(METRIC_WATCHES_ADDED);
+            track_candidate(wd_data);
+            log_message("WATCHING: (fd:%d,wd:%d)\t\t\"%s\"", fd, wd_data->wd, wd_data->path);
+            return wd_data->wd;
+        }
+
+        if (errno != ENOSPC)
+            return -1;
+
+        /* the real limit is lower than expected, stop growing here */
+        watch_budget.limit = MAX(watch_budget.used, 1);
+    }
+
+    /* out of budget: degrade the directory to the poller */
+    if (poller_start(poll_interval) == -1)
+        return -1;
+
+    wd_data->wd = register_watch(wd_data, fd, TRUE);
+    if (wd_data->wd != -1)
+        log_message("POLLING: (wd:%d)\t\t\"%s\"", wd_data->wd, wd_data->path);
+
+    return wd_data->wd;
+}
+
+void release_watch(WD_DATA *wd_data, int fd)
+{
+    if (wd_data->cooled_until != 0)
+        --cooled_qty;
+
+    untrack_candidate(wd_data);
+
+    if (is_poller_wd(wd_data->wd))
+    {
+        poller_rm_watch(fd, wd_data->wd);
+        return;
+    }
+
+    remove_watch_descriptor(fd, wd_data->wd);
+    if (watch_budget.used > 0)
+        --watch_budget.used;
+    count_watch(METRIC_WATCHES_REMOVED);
+}
+
+void count_watch(metric_t metric)
+{
+    metrics_count(metric);
+    metrics_gauge(GAUGE_WATCHES, watch_budget.used);
+}
+
+void track_candidate(WD_DATA *wd_data)
+{
+    untrack_candidate(wd_data);
+
+    /* the root, and the polled directories, never give way */
+    if (wd_data->depth > 0 && wd_data->wd != -1 && !is_poller_wd(wd_data->wd))
+        wd_data->candidate = watch_candidate_add(&watch_budget, wd_data->depth, wd_data);
+}
+
+void untrack_candidate(WD_DATA *wd_data)
+{
+    if (wd_data->candidate == NULL)
+        return;
+
+    watch_candidate_remove(&watch_budget, wd_data->depth, wd_data->candidate);
+    wd_data->candidate = NULL;
+}
+
+void touch_watch(WD_DATA *wd_data, time_t now)
+{
+    /* NOTE: the order changes at most once a second, as the time of the last event */
+    if (wd_data->last_event == now)
+        return;
+
+    wd_data->last_event = now;
+    if (wd_data->candidate != NULL)
+        track_candidate(wd_data);
+}
+
+WD_DATA *
+watch_to_demote(int depth, time_t idle_since, Queue *queue_wd)
+{
+    int deepest;
+    WD_DATA *victim = (WD_DATA *)watch_candidate_first(&watch_budget, &deepest);
+
+    /* a directory is worth less if it is deeper, or as deep but idle */
+    if (victim == NULL || deepest < depth || (deepest == depth && victim->last_event >= idle_since))
+        return NULL;
+
+    return victim;
+}
+
+void demote_watch(WD_DATA *wd_data, int fd)
+{
+    if (poller_start(poll_interval) == -1)
+        return;
+
+    int wd = register_watch(wd_data, fd, TRUE);
+    if (wd == -1)
+        return;
+
+    release_watch(wd_data, fd);
+    wd_data->wd = wd;
+
+    log_message("POLLING: (wd:%d)\t\t\"%s\"", wd_data->wd, wd_data->path);
+}
+
+void promote_watch(WD_DATA *wd_data, int fd, Queue *queue_wd)
+{
+    /* nothing better than polling when it is the backend */
+    if (!is_poller_wd(wd_data->wd) || backend == BACKEND_POLL)
+        return;
+
+    /* swap with a deeper or idle directory when out of budget */
+    if (!watch_budget_available(&watch_budget))
+    {
+        WD_DATA *victim = watch_to_demote(wd_data->depth, time(NULL) - 2 * poll_interval, queue_wd);
+        if (victim == NULL)
+            return;
+        demote_watch(victim, fd);
+    }
+
+    int wd = register_watch(wd_data, fd, FALSE);
+    if (wd == -1)
+        return;
+
+    ++watch_budget.used;
+    count_watch(METRIC_WATCHES_ADDED);
+    poller_rm_watch(fd, wd_data->wd);
+    wd_data->wd = wd;
+    track_candidate(wd_data);
+
+    log_message("WATCHING: (fd:%d,wd:%d)\t\t\"%s\"", fd, wd_data->wd, wd_data->path);
+}
+
+bool_t
+track_rate(WD_DATA *wd_data)
+{
+    if (wd_data->rate_since != wd_data->last_event)
+    {
+        wd_data->rate_since = wd_data->last_event;
+        wd_data->rate_count = 0;
+    }
+
+    return (++wd_data->rate_count > hot_threshold) ? TRUE : FALSE;
+}
+
+void cool_watch(WD_DATA *wd_data, int fd)
+{
+    if (wd_data->cooled_until != 0 || is_poller_wd(wd_data->wd))
+        return;
+
+    wd_data->cooled_until = time(NULL) + hot_cooldown;
+    ++cooled_qty;
+    refresh_watch_mask(wd_data, fd);
+
+    log_message("COOLING: (wd:%d)\t\t\"%s\" for %d seconds", wd_data->wd, wd_data->path, hot_cooldown);
+}
+
+void rearm_cooled(int fd, Queue *queue_wd)
+{
+    time_t now = time(NULL);
+    Queue *due = queue_init();
+
+    /* NOTE: the rescans change the watch list, collect the paths first */
+    QueueElement *element;
+    for (element = queue_wd->first; element != NULL; element = element->next)
+    {
+        WD_DATA *wd_data = (WD_DATA *)element->data;
+        if (wd_data->cooled_until != 0 && wd_data->cooled_until <= now)
+            queue_enqueue(due, strdup(wd_data->path));
+    }
+
+    char *path;
+    while ((path = (char *)queue_dequeue(due)))
+    {
+        /* a cooled directory can be unwatched by the rescan of its parent */
+        element = get_node_from_path(path, queue_wd);
+        free(path);
+        if (element == NULL)
+            continue;
+
+        WD_DATA *wd_data = (WD_DATA *)element->data;
+        wd_data->cooled_until = 0;
+        wd_data->rate_count = 0;
+        --cooled_qty;
+        refresh_watch_mask(wd_data, fd);
+
+        log_message("REARMED: (wd:%d)\t\t\"%s\"", wd_data->wd, wd_data->path);
+
+        rescan_directory(wd_data, fd, queue_wd);
+        synthesize_event(wd_data, "", IN_MODIFY | IN_ISDIR);
+    }
+
+    queue_free(due);
+}
+
+void rescan_directory(WD_DATA *wd_data, int fd, Queue *queue_wd)
+{
+    if (recursive_flag == FALSE)
+        return;
+
+    size_t length = strlen(wd_data->path);
+    Queue *gone = queue_init();
+
+    /* the subdirectories deleted, or moved away */
+    QueueElement *element;
+    for (element = queue_wd->first; element != NULL; element = element->next)
+    {
+        char *path = ((WD_DATA *)element->data)->path;
+        if (strlen(path) <= length || strncmp(path, wd_data->path, length) != 0)
+            continue;
+
+        /* only the children, not the whole subtree */
+        char *slash = strchr(path + length, '/');
+        if (slash != NULL && slash[1] == '\0' && !is_dir(path))
+            queue_enqueue(gone, strdup(path));
+    }
+
+    char *path;
+    while ((path = (char *)queue_dequeue(gone)))
+    {
+        unwatch_path(path, fd, queue_wd);
+        free(path);
+    }
+    queue_free(gone);
+
+    /* the subdirectories created, or moved in */
+    DIR *dir_stream = opendir(wd_data->path);
+    if (dir_stream == NULL)
+        return;
+
+    /* NOTE: the symbolic links created meanwhile are not followed */
+    Queue *created = queue_init();
+    struct dirent *entry;
+    struct stat st;
+    while ((entry = readdir(dir_stream)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        path = append_dir(wd_data->path, entry->d_name);
+        if (lstat(path, &st) == 0 && S_ISDIR(st.st_mode) && get_node_from_path(path, queue_wd) == NULL)
+            queue_enqueue(created, path);
+        else
+            free(path);
+    }
+    closedir(dir_stream);
+
+    while ((path = (char *)queue_dequeue(created)))
+        watch_directory_tree(path, NULL, TRUE, fd, queue_wd);
+    queue_free(created);
+}
+
+void unwatch_path(char *absolute_path, int fd, Queue *queue_wd)
+{
+    QueueElement *element = get_node_from_path(absolute_path, queue_wd);
+    if (NULL == element)
+        return;
+
+    WD_DATA *wd_data = (WD_DATA *)element->data;
+
+    log_message("UNWATCHING: (fd:%d,wd:%d)\t\t\"%s\"", fd, wd_data->wd, absolute_path);
+    CWATCH_PROBE2(watch__remove, wd_data->wd, absolute_path);
+
+    release_watch(wd_data, fd);
+
+    if (wd_data->links->first != NULL)
+        queue_free(wd_data->links);
+
+    queue_remove(queue_wd, element);
+}
+
+void all_symlinks_contained_in(char *path, Queue *queue_wd, Queue *symlinks_found)
+{
+    QueueElement *element = queue_wd->first;
+
+    WD_DATA *wd_data = NULL;
+    while (element)
+    {
+        wd_data = (WD_DATA *)element->data;
+
+        symlinks_contained_in(path, wd_data->links, symlinks_found);
+
+        element = element->next;
+    }
+}
+
+void symlinks_contained_in(char *path, Queue *symlinks_to_check, Queue *symlinks_found)
+{
+    QueueElement *link_node = symlinks_to_check->first;
+    while (link_node)
+    {
+        LINK_DATA *link_data = (LINK_DATA *)link_node->data;
+        if (is_child_of(path, link_data->path) == TRUE)
+        {
+            queue_enqueue(symlinks_found, (void *)link_data->path);
+        }
+        link_node = link_node->next;
+    }
+}
+
+void remove_unreachable_resources(WD_DATA *wd_data, int fd, Queue *queue_wd)
+{
+    // TODO EXTRACT THIS CONTROL IN is_orphan
+    // wd_data->links->first == NULL && !is_child_of(root_path, wd_data->path)
+    if (wd_data->links->first != NULL || is_child_of(root_path, wd_data->path) == TRUE)
+        return;
+
+    Queue *referenced_paths = common_referenced_paths_for(wd_data->path, queue_wd);
+    if (NULL != referenced_paths)
+    {
+        remove_orphan_watched_resources(wd_data->path, referenced_paths, fd, queue_wd);
+    }
+    queue_free(referenced_paths);
+}
+
+Queue *
+common_referenced_paths_for(const char *path, Queue *queue_wd)
+{
+    Queue *referenced_paths = queue_init();
+    QueueElement *element;
+    WD_DATA *wd_data;
+
+    element = queue_wd->first;
+    while (element)
+    {
+        wd_data = (WD_DATA *)element->data;
+
+        if (wd_data->links->first != NULL && is_related_to(path, wd_data->path) && !is_listed_as_child(wd_data->path, referenced_paths))
+        {
+            queue_enqueue(referenced_paths, (void *)wd_data->path);
+        }
+        element = element->next;
+    }
+
+    return referenced_paths;
+}
+
+bool_t
+is_related_to(const char *path, const char *path_to_check)
+{
+    if (strncmp(path, path_to_check, strlen(path)) == 0 || strncmp(path, path_to_check, strlen(path_to_check)) == 0)
+    {
+        return TRUE;
+    }
+    return FALSE;
+}
+
+void remove_orphan_watched_resources(const char *path, Queue *references_list, int fd, Queue *queue_wd)
+{
+    QueueElement *element;
+    WD_DATA *wd_data;
+
+    element = queue_wd->first;
+    while (element)
+    {
+        wd_data = (WD_DATA *)element->data;
+
+        if (strcmp(root_path, wd_data->path) != 0 && wd_data->links->first == NULL && is_child_of(path, wd_data->path) == TRUE && !is_listed_as_child(wd_data->path, references_list))
+        {
+            log_message("UNWATCHING: (fd:%d,wd:%d)\t\t\"%s\"", fd, wd_data->wd, wd_data->path);
+
+            release_watch(wd_data, fd);
+            queue_remove(queue_wd, element);
+        }
+        element = element->next;
+    }
+}
+
+void unwatch_symlink(char *path_of_symlink, int fd, Queue *queue_wd)
+{
+    Queue *symlinks_to_remove = queue_init();
+    queue_enqueue(symlinks_to_remove, (void *)path_of_symlink);
+
+    while (symlinks_to_remove->first != NULL)
+    {
+        char *symlink = (char *)queue_dequeue(symlinks_to_remove);
+
+        QueueElement *link_node = get_link_node_from_path(symlink, queue_wd);
+
+        LINK_DATA *link_data = (LINK_DATA *)link_node->data;
+        WD_DATA *wd_data = (WD_DATA *)link_data->wd_data;
+
+        char *resolved_path = (char *)wd_data->path;
+        char *link_path = (char *)link_data->path;
+
+        log_message("UNWATCHING SYMBOLIC LINK: \t\"%s\" -> \"%s\"", link_path, wd_data->path);
+        queue_remove(wd_data->links, link_node);
+
+        all_symlinks_contained_in(resolved_path, queue_wd, symlinks_to_remove);
+
+        remove_unreachable_resources(wd_data, fd, queue_wd);
+    }
+
+    queue_free(symlinks_to_remove);
+}
+
+int monitor(int fd, Queue *queue_wd)
+{
+    /* Initialize the exec count */
+    exec_c = 0;
+
+    /* from now on a signal stops cwatch out of its handler */
+    monitoring = 1;
+
+    /* Buffer for File Descriptor */
+    char buffer[EVENT_BUF_LEN];
+    ssize_t len;
+
+    /* the priority lane (--priority-lane), inotify, the poller when some
+     * directories are polled, the workers when a tree is ingested in
+     * background, the ones that hash the files (--skip-unchanged), the
+     * end of the window of a save (--atomic-saves) and the end of the
+     * window of the events rolled up (--rollup-depth, --rollup-prefix).
+     * A negative fd is ignored.
+     */
+    struct pollfd fds[7];
+    fds[0].fd = lane_descriptor();
+    fds[1].fd = fd;
+    fds[4].fd = digest_descriptor();
+    fds[5].fd = atomic_descriptor();
+    fds[6].fd = rollup_descriptor();
+    fds[0].events = fds[1].events = fds[2].events = fds[3].events = fds[4].events = fds[5].events = fds[6].events = POLLIN;
+
+    /* the state is saved as soon as the tree is watched (--state-file) */
+    time_t saved_at = 0;
+
+    /* the metrics are written every --stats-interval */
+    time_t stats_at = time(NULL);
+
+    /* Wait for events */
+    while (1)
+    {
+        if (stop_signal != 0)
+        {
+            /* NOTE: with events still to handle, the last state saved is kept */
+            if (NULL != state_file && state_savable(fd) == TRUE)
+                save_state(queue_wd);
+            else if (NULL != state_file)
+                log_message("STATE NOT SAVED:\t\"%s\" (events still to handle)", state_file);
+            exit(128 + stop_signal);
+        }
+
+        if (NULL != state_file && time(NULL) - saved_at >= STATE_SAVE_INTERVAL && state_savable(fd) == TRUE)
+        {
+            save_state(queue_wd);
+            saved_at = time(NULL);
+        }
+
+        /* the hot directories come back after --hot-cooldown */
+        if (cooled_qty > 0)
+            rearm_cooled(fd, queue_wd);
+
+        /* the heavy hitters of the interval, or the ones so far on SIGUSR2 */
+        if (heavy_hitters > 0 && time(NULL) - heavy_since >= heavy_interval)
+            report_heavy(TRUE);
+        else if (heavy_signal != 0)
+            report_heavy(FALSE);
+
+        if (NULL != stats_file && time(NULL) - stats_at >= stats_interval)
+        {
+            write_stats();
+            stats_at = time(NULL);
+        }
+
+        /* the metrics so far, on SIGUSR1 */
+        if (metrics_signal != 0)
+        {
+            metrics_signal = 0;
+            char *text = metrics_text();
+            if (text != NULL)
+            {
+                fputs(text, stderr);
+                fflush(stderr);
+                free(text);
+            }
+        }
+
+        fds[2].fd = poller_descriptor();
+        fds[3].fd = ingest_descriptor();
+
+        int timeout = (NULL != state_file) ? STATE_SAVE_INTERVAL * 1000 : -1;
+        if (cooled_qty > 0)
+            timeout = 1000;
+
+        /* a move without its IN_MOVED_TO went out once the next loop is over */
+        if (NULL != mirror_destination && mirror_moves() > 0 && (timeout == -1 || timeout > MIRROR_MOVE_TIMEOUT))
+            timeout = MIRROR_MOVE_TIMEOUT;
+
+        if (heavy_hitters > 0)
+        {
+            int left = (int)(heavy_since + heavy_interval - time(NULL)) * 1000;
+            if (timeout == -1 || left < timeout)
+                timeout = (left > 0) ? left : 0;
+        }
+
+        if (NULL != stats_file)
+        {
+            int left = (int)(stats_at + stats_interval - time(NULL)) * 1000;
+            if (timeout == -1 || left < timeout)
+                timeout = (left > 0) ? left : 0;
+        }
+
+        if (poll(fds, 7, timeout) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            printf("ERROR: UNABLE TO READ INOTIFY QUEUE EVENTS!!!\n");
+            exit(EIO);
+        }
+
+        /* Drain the priority lane before any other event */
+        if (fds[0].revents & POLLIN)
+            drain_lane(fd, queue_wd);
+
+        /* Add the directories watched in background */
+        if (fds[3].revents & POLLIN)
+            collect_ingested(fd, queue_wd);
+
+        /* Release the events of the saves not recognized */
+        if (fds[5].revents & POLLIN)
+            atomic_expire();
+
+        /* Report the events whose digest is known */
+        if (fds[4].revents & POLLIN)
+            collect_digested();
+
+        /* Report the prefixes changed in the window that is over */
+        if (fds[6].revents & POLLIN)
+            collect_rolled_up();
+
+        int i;
+        for (i = 1; i < 3; ++i)
+        {
+            if (fds[i].fd == -1 || !(fds[i].revents & POLLIN))
+                continue;
+
+            if ((len = read(fds[i].fd, buffer, EVENT_BUF_LEN)) <= 0)
+            {
+                printf("ERROR: UNABLE TO READ INOTIFY QUEUE EVENTS!!!\n");
+                exit(EIO);
+            }
+
+            CWATCH_PROBE2(read, fds[i].fd, (long)len);
+
+            /* the latency of the events reported right away (see emit_event) */
+            clock_gettime(CLOCK_MONOTONIC, &read_at);
+
+            if (i == 1 && backend == BACKEND_FANOTIFY)
+                handle_fanotify_events(buffer, len, fd, queue_wd);
+            else
+                handle_events(buffer, len, fd, queue_wd);
+
+            memset(&read_at, 0, sizeof(read_at));
+        }
+
+        /* the events of the loop go to the plugin at once */
+        if (NULL != plugin_path && plugin_flush() == -1)
+            log_message("PLUGIN DISABLED:\t\"%s\" -> %s", plugin_path, plugin_error());
+
+        /* the files changed during the loop are copied at once */
+        if (NULL != mirror_destination)
+            mirror_flush();
+
+        /* the events of the loop go to the subscribers at once */
+        if (NULL != subscribe_socket)
+            subscribe_flush();
+
+        if (NULL != ring_socket)
+            shmring_flush();
+    }
+
+    return 0;
+}
+
+void drain_lane(int fd, Queue *queue_wd)
+{
+    char buffer[EVENT_BUF_LEN];
+    ssize_t len;
+
+    /* the lane is non blocking, read until it is empty */
+    while ((len = read(lane_descriptor(), buffer, EVENT_BUF_LEN)) > 0)
+    {
+        CWATCH_PROBE2(read, lane_descriptor(), (long)len);
+        clock_gettime(CLOCK_MONOTONIC, &read_at);
+        lane_translate(buffer, len);
+        handle_events(buffer, len, fd, queue_wd);
+        memset(&read_at, 0, sizeof(read_at));
+    }
+
+    if (len == -1 && errno != EAGAIN && errno != EINTR)
+    {
+        printf("ERROR: UNABLE TO READ INOTIFY QUEUE EVENTS!!!\n");
+        exit(EIO);
+    }
+}
+
+void handle_events(char *buffer, ssize_t len, int fd, Queue *queue_wd)
+{
+    /* inotify_event */
+    struct inotify_event *event = NULL;
+
+    /* Temporary element information */
+    QueueElement *element = NULL;
+
+    /* index of the event into the buffer */
+    ssize_t i = 0;
+    while (i < len)
+    {
+        /* inotify_event */
+        event = (struct inotify_event *)&buffer[i];
+
+        /* Next event */
+        i += EVENT_SIZE + event->len;
+
+        CWATCH_PROBE3(event, event->wd, event->mask, (event->len > 0) ? event->name : "");
+
+        /* the threads of the shards have counted them (see wanted_by_shard) */
+        if (shards == 1)
+        {
+            metrics_count_event(event->mask);
+            if (event->mask & IN_Q_OVERFLOW)
+                metrics_count(METRIC_OVERFLOWS);
+        }
+
+        if (!wanted(event))
+        {
+            CWATCH_PROBE4(exclude, event->wd, event->mask, (event->len > 0) ? event->name : "", 0);
+            metrics_count(METRIC_EVENTS_EXCLUDED);
+            continue;
+        }
+
+        element = get_node_from_wd(event->wd, queue_wd);
+        if (element != NULL)
+            handle_event(event, (WD_DATA *)element->data, fd, queue_wd);
+        else if ((event->mask & IN_IGNORED) == 0 && ingest_pending(event->wd))
+            defer_event(event);
+    }
+}
+
+void defer_event(struct inotify_event *event)
+{
+    if (NULL == pending_events)
+        pending_events = bfromcstr("");
+
+    /* NOTE: beyond the limit the events are lost, as on a kernel overflow */
+    if (blength(pending_events) + EVENT_SIZE + event->len > PENDING_EVENTS_MAX)
+    {
+        metrics_count(METRIC_OVERFLOWS);
+        return;
+    }
+
+    bcatblk(pending_events, event, EVENT_SIZE + event->len);
+}
+
+void handle_fanotify_events(char *buffer, ssize_t len, int fd, Queue *queue_wd)
+{
+    FAN_EVENT fan_event;
+    ssize_t offset = 0;
+
+    /* the event translated as inotify would have reported it */
+    union
+    {
+        struct inotify_event event;
+        char buffer[EVENT_SIZE + NAME_MAX + 1];
+    } record;
+
+    /* the directory of the event, as if it were watched */
+    WD_DATA wd_data;
+
+    while (fansource_next(buffer, len, &offset, &fan_event))
+    {
+        /* Discard the directories that inotify would not have watched */
+        int depth = depth_of(fan_event.directory);
+        if ((recursive_flag == FALSE && depth > 0) || (max_depth >= 0 && depth > max_depth))
+            continue;
+
+        size_t name_len = strlen(fan_event.name);
+        if (name_len > NAME_MAX)
+            continue;
+
+        record.event.wd = -1;
+        record.event.mask = fan_event.mask;
+        record.event.cookie = 0;
+        record.event.len = (name_len > 0) ? name_len + 1 : 0;
+        strcpy(record.event.name, fan_event.name);
+
+        CWATCH_PROBE3(event, -1, record.event.mask, record.event.name);
+
+        metrics_count_event(record.event.mask);
+        if (!wanted(&record.event))
+        {
+            CWATCH_PROBE4(exclude, -1, record.event.mask, record.event.name, 0);
+            metrics_count(METRIC_EVENTS_EXCLUDED);
+            continue;
+        }
+
+        /* NOTE: the fields added to WD_DATA start from zero */
+        memset(&wd_data, 0, sizeof(wd_data));
+        wd_data.wd = -1;
+        wd_data.path = (char *)fan_event.directory;
+        wd_data.depth = depth;
+        wd_data.include_state = include_state_of(fan_event.directory);
+
+        handle_event(&record.event, &wd_data, fd, queue_wd);
     }
 }
 
-void symlinks_contained_in(char *path, Queue *symlinks_to_check, Queue *symlinks_found)
+bool_t
+wanted(struct inotify_event *event)
+{
+    /* Discard all filename that matches regular expression (-x option) */
+    if (excluded((event->len > 0) ? event->name : ""))
+        return FALSE;
+
+    /* Discard the events that nobody is interested in */
+    if ((event->mask & event_mask) == 0 && (event->mask & structural_mask()) == 0 && (event->mask & recognizer_mask()) == 0)
+        return FALSE;
+
+    return TRUE;
+}
+
+int wanted_by_shard(struct inotify_event *event)
 {
-    QueueElement *link_node = symlinks_to_check->first;
-    while (link_node)
+    metrics_count_event_shared(event->mask);
+    if (event->mask & IN_Q_OVERFLOW)
+        metrics_count_shared(METRIC_OVERFLOWS);
+
+    if (wanted(event) == FALSE)
     {
-        LINK_DATA *link_data = (LINK_DATA *)link_node->data;
-        if (is_child_of(path, link_data->path) == TRUE)
-        {
-            queue_enqueue(symlinks_found, (void *)link_data->path);
-        }
-        link_node = link_node->next;
+        metrics_count_shared(METRIC_EVENTS_EXCLUDED);
+        return 0;
     }
+
+    return 1;
 }
 
-void remove_unreachable_resources(WD_DATA *wd_data, int fd, Queue *queue_wd)
+void handle_event(struct inotify_event *event, WD_DATA *wd_data, int fd, Queue *queue_wd)
 {
-    // TODO EXTRACT THIS CONTROL IN is_orphan
-    // wd_data->links->first == NULL && !is_child_of(root_path, wd_data->path)
-    if (wd_data->links->first != NULL || is_child_of(root_path, wd_data->path) == TRUE)
+    /* The real path of touched directory or file */
+    char *path = NULL;
+    char *name = (event->len > 0) ? event->name : "";
+
+    bool_t match;
+    uint32_t internal_mask = event->mask & structural_mask();
+
+    if (!included(event, wd_data, &match))
+    {
+        CWATCH_PROBE4(exclude, wd_data->wd, event->mask, name, 1);
+        metrics_count(METRIC_EVENTS_EXCLUDED);
         return;
+    }
 
-    Queue *referenced_paths = common_referenced_paths_for(wd_data->path, queue_wd);
-    if (NULL != referenced_paths)
+    time_t now = time(NULL);
+    touch_watch(wd_data, now);
+
+    /* An active polled directory deserves an inotify watch */
+    if (is_poller_wd(wd_data->wd))
+        promote_watch(wd_data, fd, queue_wd);
+    else if (hot_threshold > 0 && wd_data->cooled_until == 0 && track_rate(wd_data) == TRUE)
+        cool_watch(wd_data, fd);
+
+    /* Build the full path of the directory or symbolic link */
+    if (event->mask & IN_ISDIR)
+        path = append_dir(wd_data->path, name);
+    else
+        path = append_file(wd_data->path, name);
+
+    if (heavy_hitters > 0)
+        count_heavy(wd_data->path, path);
+
+    /* Already reported by a synthetic event, while scanning a new directory.
+     * An entry deleted or moved away is forgotten, its next creation is a new one.
+     */
+    if (event->mask & (IN_DELETE | IN_MOVED_FROM))
     {
-        remove_orphan_watched_resources(wd_data->path, referenced_paths, fd, queue_wd);
+        dedupe_forget(dedupe_set, path, now);
     }
-    queue_free(referenced_paths);
+    else if ((event->mask & IN_CREATE) && dedupe_forget(dedupe_set, path, now))
+    {
+        free(path);
+        return;
+    }
+
+    /* Execute the command before visiting a new directory,
+     * whose entries could be reported by synthetic events.
+     * The events still queued of a cooled directory are dropped.
+     */
+    if (wd_data->cooled_until == 0)
+        dispatch_event(event, wd_data, match);
+
+    /* Call the specific event handler to maintain the watched tree */
+    if (internal_mask != 0)
+    {
+        get_inotify_event(internal_mask)->handler(event, path, fd, queue_wd);
+    }
+
+    free(path);
 }
 
-Queue *
-common_referenced_paths_for(const char *path, Queue *queue_wd)
+void dispatch_event(struct inotify_event *event, WD_DATA *wd_data, bool_t match)
 {
-    Queue *referenced_paths = queue_init();
-    QueueElement *element;
-    WD_DATA *wd_data;
+    /* the saves of the editors are collapsed first */
+    if (atomic_saves_flag == TRUE && atomic_hold(event, wd_data->path, match) == 1)
+        return;
 
-    element = queue_wd->first;
-    while (element)
-    {
-        wd_data = (WD_DATA *)element->data;
+    forward_event(event, wd_data->path, match);
+}
 
-        if (wd_data->links->first != NULL && is_related_to(path, wd_data->path) && !is_listed_as_child(wd_data->path, referenced_paths))
-        {
-            queue_enqueue(referenced_paths, (void *)wd_data->path);
-        }
-        element = element->next;
-    }
+void forward_held(struct inotify_event *event, char *directory, int match)
+{
+    struct timespec at = read_at;
 
-    return referenced_paths;
+    memset(&read_at, 0, sizeof(read_at));
+    forward_event(event, directory, match);
+    read_at = at;
+}
+
+void forward_event(struct inotify_event *event, char *directory, int match)
+{
+    if (skip_unchanged_flag == TRUE && hold_event(event, directory, match) == TRUE)
+        return;
+
+    report_event(event, directory, match);
 }
 
 bool_t
-is_related_to(const char *path, const char *path_to_check)
+hold_event(struct inotify_event *event, char *directory, bool_t match)
 {
-    if (strncmp(path, path_to_check, strlen(path)) == 0 || strncmp(path, path_to_check, strlen(path_to_check)) == 0)
+    bool_t is_file = (event->len > 0 && (event->mask & IN_ISDIR) == 0) ? TRUE : FALSE;
+
+    /* a file deleted or moved away starts over */
+    if (is_file == TRUE && (event->mask & (IN_DELETE | IN_MOVED_FROM)))
     {
-        return TRUE;
+        char *path = append_file(directory, event->name);
+        digest_forget(path);
+        free(path);
     }
-    return FALSE;
+
+    /* nothing to report */
+    if ((event->mask & event_mask) == 0 || match == FALSE)
+        return FALSE;
+
+    int hash = (is_file == TRUE && (event->mask & IN_CLOSE_WRITE)) ? 1 : 0;
+
+    /* the other events wait only behind the ones of their path */
+    if (hash == 0 && digest_waits(directory, (event->len > 0) ? event->name : "") == 0)
+        return FALSE;
+
+    /* too many events held, the reads wait for the workers */
+    while (digest_held() >= DIGEST_MAX_HELD)
+    {
+        digest_wait();
+        collect_digested();
+    }
+
+    return (digest_hold(event, directory, match, hash) == 0) ? TRUE : FALSE;
 }
 
-void remove_orphan_watched_resources(const char *path, Queue *references_list, int fd, Queue *queue_wd)
+void collect_digested()
 {
-    QueueElement *element;
-    WD_DATA *wd_data;
+    DIGEST_ITEM *item;
 
-    element = queue_wd->first;
-    while (element)
-    {
-        wd_data = (WD_DATA *)element->data;
+    /* the events released were read before, they are not timed */
+    struct timespec at = read_at;
+    memset(&read_at, 0, sizeof(read_at));
 
-        if (strcmp(root_path, wd_data->path) != 0 && wd_data->links->first == NULL && is_child_of(path, wd_data->path) == TRUE && !is_listed_as_child(wd_data->path, references_list))
-        {
-            log_message("UNWATCHING: (fd:%d,wd:%d)\t\t\"%s\"", fd, wd_data->wd, wd_data->path);
+    Queue *released = digest_release();
+    while ((item = (DIGEST_ITEM *)queue_dequeue(released)))
+    {
+        if (item->changed == 1)
+            report_event(item->event, item->directory, item->match);
+        else
+            log_message("UNCHANGED:\t\"%s\"", item->path);
 
-            remove_watch_descriptor(fd, wd_data->wd);
-            queue_remove(queue_wd, element);
-        }
-        element = element->next;
+        digest_free(item);
     }
+    queue_free(released);
+
+    read_at = at;
 }
 
-void unwatch_symlink(char *path_of_symlink, int fd, Queue *queue_wd)
+int heavy_start()
 {
-    Queue *symlinks_to_remove = queue_init();
-    queue_enqueue(symlinks_to_remove, (void *)path_of_symlink);
+    heavy_paths = heavy_init(heavy_hitters * HEAVY_COUNTERS_PER_KEY);
+    heavy_directories = heavy_init(heavy_hitters * HEAVY_COUNTERS_PER_KEY);
+    if (heavy_paths == NULL || heavy_directories == NULL)
+        return -1;
 
-    while (symlinks_to_remove->first != NULL)
+    heavy_since = time(NULL);
+
+    return 0;
+}
+
+void count_heavy(char *directory, char *path)
+{
+    if (NULL == heavy_paths)
+        return;
+
+    heavy_count(heavy_paths, path);
+    heavy_count(heavy_directories, directory);
+}
+
+/* prints the keys of a tracker */
+static void print_heavy(char *title, HEAVY *heavy)
+{
+    HEAVY_ITEM items[heavy_hitters];
+    int qty = heavy_top(heavy, items, heavy_hitters);
+
+    fprintf(stderr, "  %s:\n", title);
+
+    int i;
+    for (i = 0; i < qty; ++i)
     {
-        char *symlink = (char *)queue_dequeue(symlinks_to_remove);
+        if (items[i].error > 0)
+            fprintf(stderr, "    %10lu (+-%lu)\t%s\n", items[i].count, items[i].error, items[i].key);
+        else
+            fprintf(stderr, "    %10lu\t\t%s\n", items[i].count, items[i].key);
+    }
+}
 
-        QueueElement *link_node = get_link_node_from_path(symlink, queue_wd);
+void report_heavy(bool_t reset)
+{
+    heavy_signal = 0;
 
-        LINK_DATA *link_data = (LINK_DATA *)link_node->data;
-        WD_DATA *wd_data = (WD_DATA *)link_data->wd_data;
+    if (NULL == heavy_paths)
+        return;
 
-        char *resolved_path = (char *)wd_data->path;
-        char *link_path = (char *)link_data->path;
+    fprintf(stderr, "HEAVY HITTERS: %lu events in %ld seconds\n", heavy_total(heavy_paths), (long)(time(NULL) - heavy_since));
+    print_heavy("DIRECTORIES", heavy_directories);
+    print_heavy("PATHS", heavy_paths);
+    fflush(stderr);
 
-        log_message("UNWATCHING SYMBOLIC LINK: \t\"%s\" -> \"%s\"", link_path, wd_data->path);
-        queue_remove(wd_data->links, link_node);
+    if (reset == FALSE)
+        return;
 
-        all_symlinks_contained_in(resolved_path, queue_wd, symlinks_to_remove);
+    heavy_reset(heavy_paths);
+    heavy_reset(heavy_directories);
+    heavy_since = time(NULL);
+}
 
-        remove_unreachable_resources(wd_data, fd, queue_wd);
+void report_event(struct inotify_event *event, char *directory, bool_t match)
+{
+    struct event_t *triggered_event = NULL;
+    char *name = (event->len > 0) ? event->name : "";
+    uint32_t user_mask = event->mask & event_mask;
+
+    /* Execute the command only for the events requested by the user */
+    if (user_mask != 0 && match == TRUE && (triggered_event = get_inotify_event(user_mask)) != NULL && triggered_event->name != NULL && regex_catch(name))
+    {
+        if (rollup_flag == TRUE)
+            roll_up_event(event, directory);
+        else
+            emit_event(event, directory, triggered_event->name, 1);
     }
+}
 
-    queue_free(symlinks_to_remove);
+void emit_event(struct inotify_event *event, char *directory, char *event_name, unsigned long count)
+{
+    char *name = (event->len > 0) ? event->name : "";
+
+    ++exec_c;
+    ++event_sequence;
+
+    /* the events held (--skip-unchanged, --atomic-saves, --rollup-*) are not timed */
+    metrics_count(METRIC_EVENTS_DISPATCHED);
+    if (read_at.tv_sec != 0 || read_at.tv_nsec != 0)
+        metrics_record(HISTOGRAM_DISPATCH_LATENCY, elapsed_us(&read_at));
+
+    /* the journal never waits for the disk (--journal) */
+    if (NULL != journal_directory)
+        journal_append(event_sequence, event->mask, event->cookie, directory, name);
+
+    if (NULL != cursor_socket)
+        cursor_record(event_sequence, event->mask, event->cookie, directory, name);
+
+    /* the subscribers filter the events by themselves (--subscribe-socket) */
+    if (NULL != subscribe_socket)
+        subscribe_publish(event_sequence, event->mask, event->cookie, directory, name);
+
+    if (NULL != ring_socket)
+        shmring_publish(event_sequence, event->mask, event->cookie, directory, name);
+
+    /* the events of a program that embeds cwatch (libcwatch.h) */
+    if (NULL != event_sink)
+        event_sink(event_sequence, event->mask, event->cookie, directory, name);
+
+    dispatched_event = event;
+    dispatched_count = count;
+    if (execute_command != NULL && execute_command(event_name, name, directory) == -1)
+    {
+        printf("ERROR OCCURED: Unable to execute the specified command!\n");
+        exit(EXIT_FAILURE);
+    }
 }
 
-int monitor(int fd, Queue *queue_wd)
+void roll_up_event(struct inotify_event *event, char *directory)
 {
-    /* Initialize the exec count */
-    exec_c = 0;
+    char *name = (event->len > 0) ? event->name : "";
 
-    /* Buffer for File Descriptor */
-    char buffer[EVENT_BUF_LEN];
+    /* the path relative to the root, a directory ends with a slash */
+    char *path = (event->mask & IN_ISDIR) ? append_dir(directory, name) : append_file(directory, name);
+    size_t root_len = strlen(root_path);
+    char *relative = (strncmp(path, root_path, root_len) == 0) ? path + root_len : path + strlen(path);
 
-    /* inotify_event */
-    struct inotify_event *event = NULL;
-    struct event_t *triggered_event = NULL;
+    if (rollup_event(relative, event->mask & event_mask) == -1)
+        log_message("UNABLE TO ROLL UP:\t\"%s\"", path);
 
-    /* The real path of touched directory or file */
-    char *path = NULL;
-    size_t len;
-    int i;
+    free(path);
+}
 
-    /* Temporary element information */
-    QueueElement *element = NULL;
-    WD_DATA *wd_data = NULL;
+void collect_rolled_up()
+{
+    ROLLUP_RECORD *record;
+    char event_name[256];
 
-    /* Wait for events */
-    while ((len = read(fd, buffer, EVENT_BUF_LEN)))
+    /* the record as inotify would have reported an event of the directory itself */
+    union
     {
-        if (len < 0)
-        {
-            printf("ERROR: UNABLE TO READ INOTIFY QUEUE EVENTS!!!\n");
-            exit(EIO);
-        }
+        struct inotify_event event;
+        char buffer[EVENT_SIZE + 1];
+    } rolled_up;
 
-        /* index of the event into file descriptor */
-        i = 0;
-        while (i < len)
-        {
-            /* inotify_event */
-            event = (struct inotify_event *)&buffer[i];
+    rolled_up.event.wd = -1;
+    rolled_up.event.cookie = 0;
+    rolled_up.event.len = 0;
 
-            /* Discard all filename that matches regular expression (-x option) */
-            if (excluded(event->name))
-            {
-                /* Next event */
-                i += EVENT_SIZE + event->len;
-                continue;
-            }
+    Queue *released = rollup_release();
+    if (released == NULL)
+        return;
 
-            /* Build the full path of the directory or symbolic link */
-            element = get_node_from_wd(event->wd, queue_wd);
-            if (element != NULL)
-            {
-                wd_data = (WD_DATA *)element->data;
-                path = append_file(wd_data->path, event->name);
-                if (event->mask & IN_ISDIR)
-                {
-                    free(path);
-                    path = append_dir(wd_data->path, event->name);
-                }
-            }
-            else
-            {
-                /* Next event */
-                i += EVENT_SIZE + event->len;
-                continue;
-            }
+    while ((record = (ROLLUP_RECORD *)queue_dequeue(released)))
+    {
+        char *directory = append_dir(root_path, record->prefix);
 
-            /* Call the specific event handler */
-            if (event->mask & event_mask && (triggered_event = get_inotify_event(event->mask & event_mask)) != NULL && triggered_event->name != NULL && regex_catch(event->name) && triggered_event->handler(event, path, fd, queue_wd) == 0)
-            {
-                ++exec_c;
+        /* NOTE: p_match holds the offsets of the last -X match, a record has no name to capture */
+        p_match[1].rm_so = p_match[1].rm_eo = -1;
 
-                if (execute_command(triggered_event->name, event->name, wd_data->path) == -1)
-                {
-                    printf("ERROR OCCURED: Unable to execute the specified command!\n");
-                    exit(EXIT_FAILURE);
-                }
-            }
-            else
-            {
-                free(path);
-            }
+        rolled_up.event.mask = record->mask | IN_ISDIR;
+        emit_event(&rolled_up.event, directory, event_names_of(record->mask, event_name, sizeof(event_name)), record->count);
 
-            /* Next event */
-            i += EVENT_SIZE + event->len;
-        }
+        free(directory);
+        rollup_free(record);
+    }
+    queue_free(released);
+}
+
+char *event_names_of(uint32_t mask, char *buffer, size_t size)
+{
+    size_t len = 0;
+    buffer[0] = '\0';
+
+    /* the events with a single bit, in the order of the LUT */
+    int i;
+    for (i = 0; i < 32 && len < size; ++i)
+    {
+        if (events_lut[i].name == NULL || (mask & events_lut[i].mask) == 0)
+            continue;
+
+        len += snprintf(buffer + len, size - len, (len > 0) ? ",%s" : "%s", events_lut[i].name);
     }
 
-    return 0;
+    return buffer;
+}
+
+void synthesize_create(WD_DATA *wd_data, const char *name, bool_t is_directory)
+{
+    if (synthesize_event(wd_data, name, IN_CREATE | ((is_directory == TRUE) ? IN_ISDIR : 0)) == FALSE)
+        return;
+
+    /* the real event, if the entry has been created after the watch, is dropped */
+    char *path = (is_directory == TRUE) ? append_dir(wd_data->path, name) : append_file(wd_data->path, name);
+    dedupe_remember(dedupe_set, path, time(NULL));
+    free(path);
+}
+
+bool_t
+synthesize_event(WD_DATA *wd_data, const char *name, uint32_t mask)
+{
+    bool_t match;
+    size_t name_len = strlen(name);
+
+    /* the event as inotify would have reported it */
+    union
+    {
+        struct inotify_event event;
+        char buffer[EVENT_SIZE + NAME_MAX + 1];
+    } record;
+
+    if (name_len > NAME_MAX)
+        return FALSE;
+
+    record.event.wd = wd_data->wd;
+    record.event.mask = mask;
+    record.event.cookie = 0;
+    record.event.len = name_len + 1;
+    strcpy(record.event.name, name);
+
+    if (!wanted(&record.event) || !included(&record.event, wd_data, &match))
+        return FALSE;
+
+    dispatch_event(&record.event, wd_data, match);
+    return TRUE;
 }
 
 int execute_command_inline(char *event_name, char *file_name, char *event_p_path)
@@ -1138,19 +3151,56 @@ int execute_command_inline(char *event_name, char *file_name, char *event_p_path
     /* Command token replacement */
     tmp_command = format_command((char *)command->data, event_p_path, file_name, event_name);
 
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    CWATCH_PROBE2(command__start, exec_c, (char *)tmp_command->data);
+
     int exit = 0;
     exit = system((const char *)tmp_command->data);
 
+    uint64_t duration = elapsed_us(&started);
+    CWATCH_PROBE3(command__done, exec_c, exit, duration);
+
+    metrics_count(METRIC_COMMANDS_RUN);
+    metrics_record(HISTOGRAM_COMMAND_DURATION, duration);
+
     if (exit == -1 || exit == 127)
     {
         log_message("Unable to execute the specified command!");
     }
 
+    if (exit == -1 || !WIFEXITED(exit) || WEXITSTATUS(exit) != 0)
+        metrics_count(METRIC_COMMANDS_FAILED);
+
     bdestroy(tmp_command);
 
     return 0;
 }
 
+int execute_command_plugin(char *event_name, char *file_name, char *event_p_path)
+{
+    const char *capture = NULL;
+    size_t capture_len = 0;
+
+    /* the first group matched by -X --regex-catch */
+    if (NULL != user_catch_regex && p_match[1].rm_so != -1)
+    {
+        capture = file_name + p_match[1].rm_so;
+        capture_len = p_match[1].rm_eo - p_match[1].rm_so;
+    }
+
+    plugin_add(event_sequence, dispatched_event->mask, event_name, event_p_path, file_name, capture, capture_len);
+
+    return 0;
+}
+
+int execute_command_mirror(char *event_name, char *file_name, char *event_p_path)
+{
+    mirror_event(dispatched_event->mask, dispatched_event->cookie, event_p_path, file_name);
+
+    return 0;
+}
+
 int execute_command_embedded(char *event_name, char *file_name, char *event_p_path)
 {
     log_message("EVENT TRIGGERED [%s] IN %s%s", event_name, event_p_path, file_name);
@@ -1168,6 +3218,8 @@ int execute_command_embedded(char *event_name, char *file_name, char *event_p_pa
 struct event_t *
 get_inotify_event(const uint32_t event_mask)
 {
+    CWATCH_PROBE1(dispatch, event_mask);
+
     /* NOTE: The following events are combinations
      * of other base-event so the first bit set can't uniquely
      * identify these events.
@@ -1201,9 +3253,24 @@ int event_handler_create(struct inotify_event *event, char *path, int fd, Queue
         return 0;
 
     /* Check for a directory */
+    /* NOTE: the watch list keeps its own copy of the path.
+     *       A created directory is watched and then visited, since its
+     *       entries could be created before its watch; the content of a
+     *       moved directory is not reported, as inotify does.
+     */
     if (event->mask & IN_ISDIR)
     {
-        watch_directory_tree(path, NULL, FALSE, fd, queue_wd);
+        char *real_path = strdup(path);
+        if (real_path == NULL)
+            return -1;
+
+        /* a moved directory can be a huge tree, visit it in background */
+        if (event->mask & IN_MOVED_TO)
+            ingest_directory_tree(real_path, fd, queue_wd);
+        else
+            walk_directory_tree(real_path, NULL, TRUE, TRUE, fd, queue_wd);
+
+        release_unwatched(real_path, NULL, queue_wd);
     }
     else if (nosymlink_flag == FALSE)
     {
@@ -1211,7 +3278,11 @@ int event_handler_create(struct inotify_event *event, char *path, int fd, Queue
         if (is_dir(path))
         {
             char *real_path = resolve_real_path(path);
-            watch_directory_tree(real_path, path, TRUE, fd, queue_wd);
+            char *symlink = strdup(path);
+            if (real_path != NULL && symlink != NULL)
+                watch_directory_tree(real_path, symlink, TRUE, fd, queue_wd);
+
+            release_unwatched(real_path, symlink, queue_wd);
         }
     }
 
@@ -1257,8 +3328,36 @@ int event_handler_moved_to(struct inotify_event *event, char *path, int fd, Queu
 
 void signal_callback_handler(int signum)
 {
-    printf("Cleaning...\n");
+    /* the state is saved, and the journal written, by monitor(), out of the handler. Twice is enough */
+    if (monitoring == 1 && stop_signal == 0)
+    {
+        stop_signal = signum;
+        return;
+    }
+
+    /* NOTE: only async-signal-safe calls here, the handlers of atexit() are not run */
+    static const char message[] = "Cleaning...\n";
+    if (write(STDOUT_FILENO, message, sizeof(message) - 1) == -1)
+    {
+        /* exiting anyway */
+    }
 
     /* TODO how to free??? queue_free(queue_wd); */
-    exit(signum);
+    _exit(128 + signum);
+}
+
+void heavy_signal_handler(int signum)
+{
+    heavy_signal = signum;
+}
+
+void metrics_signal_handler(int signum)
+{
+    metrics_signal = signum;
+}
+
+void write_stats()
+{
+    if (NULL != stats_file && metrics_write(stats_file) == -1)
+        log_message("UNABLE TO WRITE THE METRICS:\t\"%s\"", stats_file);
 }
@@ -31,18 +31,44 @@
 #include <stdlib.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <ctype.h>
 #include <syslog.h>
 #include <errno.h>
 #include <unistd.h>
 #include <getopt.h>
 #include <dirent.h>
 #include <regex.h>
+#include <poll.h>
+#include <time.h>
 #include <sys/inotify.h>
 #include <sys/param.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
 
 #include "bstrlib.h"
 #include "queue.h"
+#include "pathglob.h"
+#include "budget.h"
+#include "poller.h"
+#include "fansource.h"
+#include "shard.h"
+#include "lane.h"
+#include "dedupe.h"
+#include "ingest.h"
+#include "state.h"
+#include "journal.h"
+#include "cursor.h"
+#include "subscribe.h"
+#include "shmring.h"
+#include "plugin.h"
+#include "mirror.h"
+#include "digest.h"
+#include "atomic.h"
+#include "heavy.h"
+#include "rollup.h"
+#include "metrics.h"
+#include "probes.h"
 
 #define PROGRAM_NAME "cwatch"
 #define PROGRAM_VERSION "1.2.3"
@@ -51,8 +77,25 @@
 #define EVENT_SIZE (sizeof(struct inotify_event))
 #define EVENT_BUF_LEN (1024 * (EVENT_SIZE + 16))
 
+/* max bytes of events kept while a tree is ingested in background */
+#define PENDING_EVENTS_MAX (16 * 1024 * 1024)
+
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof(x[0]))
 
+/* seconds a hot directory is cooled down (--hot-threshold) */
+#define HOT_DEFAULT_COOLDOWN 10
+
+/* events that a cooled directory keeps in the kernel */
+#define COOLED_EVENTS (IN_DELETE_SELF | IN_MOVE_SELF)
+
+/* seconds between two reports of the heavy hitters (--heavy-hitters) */
+#define HEAVY_DEFAULT_INTERVAL 60
+
+/* events needed by cwatch itself to keep the tree of
+ * watched directories up to date (see structural_mask)
+ */
+#define STRUCTURAL_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
 /* List of pattern that will be replaced during the command execution
  * Note: See their initialization in the monitor() function
  *
@@ -79,6 +122,7 @@ extern const_bstring COMMAND_PATTERN_FILE;
 extern const_bstring COMMAND_PATTERN_EVENT;
 extern const_bstring COMMAND_PATTERN_REGEX;
 extern const_bstring COMMAND_PATTERN_COUNT;
+extern const_bstring COMMAND_PATTERN_EVENTS;
 
 typedef enum
 {
@@ -86,14 +130,40 @@ typedef enum
     TRUE
 } bool_t;
 
+/* source of the events, selected by --backend option */
+typedef enum
+{
+    BACKEND_INOTIFY,
+    BACKEND_POLL,
+    BACKEND_FANOTIFY
+} backend_t;
+
 /* used to store information about watched resource */
 typedef struct wd_data_s
 {
-    int wd;       /* inotify watch descriptor */
-    char *path;   /* absolute real path of the directory */
-    Queue *links; /* list of symlinks that point to this resource */
+    int wd;                         /* inotify watch descriptor */
+    char *path;                     /* absolute real path of the directory */
+    Queue *links;                   /* list of symlinks that point to this resource */
+    uint32_t mask;                  /* event mask registered in the kernel */
+    int depth;                      /* depth below the root_path */
+    time_t last_event;              /* when the last event occurred */
+    time_t rate_since;              /* second whose events are counted in rate_count */
+    int rate_count;                 /* events of that second (--hot-threshold) */
+    time_t cooled_until;            /* when the events of a hot directory come back, 0 if not cooled */
+    pathglob_state_t include_state; /* states of the --include automaton */
+    QueueElement *candidate;        /* in the candidates to the poller of the watch budget, or NULL */
 } WD_DATA;
 
+/* used to list a directory, from the saved state when it is not changed */
+typedef struct listing_s
+{
+    DIR *stream;             /* NULL when the entries come from the saved state */
+    const char *path;        /* absolute path of the directory */
+    int cursor;              /* position in the saved state */
+    bool_t changed;          /* TRUE if the directory changed since the state was saved */
+    char name[NAME_MAX + 1]; /* name of the entry taken from the saved state */
+} LISTING;
+
 /* used to store information about symbolic link */
 typedef struct link_data_s
 {
@@ -119,15 +189,67 @@ extern struct bstrList *split_event; /* list of events parsed from command line
 extern uint32_t event_mask;          /* the resulting event_mask */
 extern regex_t *exclude_regex;       /* the posix regular expression defined by -x option */
 extern regex_t *user_catch_regex;    /* the posix regular expression defined by -X option */
+extern PATHGLOB *include_glob;       /* the glob patterns defined by -i option */
 extern regmatch_t p_match[2];        /* store the matched regular expression by -X option */
 
 extern int exec_c;         /* the number of times command is executed */
 extern char exec_cstr[10]; /* used as conversion of exec_c to cstring */
 
+extern WATCH_BUDGET watch_budget; /* inotify watches that cwatch can use */
+extern int max_depth;             /* max depth defined by --max-depth option, -1 for none */
+extern int max_watches;           /* upper bound defined by --max-watches option */
+extern int poll_interval;         /* seconds between two scans of polled directories */
+extern int hot_threshold;         /* events per second defined by --hot-threshold option, 0 for none */
+extern int hot_cooldown;          /* seconds defined by --hot-cooldown option */
+extern int cooled_qty;            /* directories cooled down now */
+extern int heavy_hitters;         /* keys reported by --heavy-hitters option, 0 for none */
+extern int heavy_interval;        /* seconds defined by --heavy-interval option */
+extern volatile sig_atomic_t heavy_signal; /* the heavy hitters are requested (SIGUSR2) */
+extern backend_t backend;         /* source of the events */
+extern int shards;                /* inotify instances defined by --shards option */
+extern bstring pending_events;    /* events of the directories not yet added to the watch list */
+extern char *ready_file;          /* file defined by --ready-file option */
+extern struct timespec started_at; /* when cwatch started (CLOCK_MONOTONIC) */
+extern char *state_file;          /* file defined by --state-file option */
+extern STATE_SNAPSHOT *state_snapshot; /* state loaded at startup, until the tree is watched */
+extern DEDUPE_SET *dedupe_set;          /* the synthetic events remembered, see dedupe.h */
+extern uint64_t state_options;          /* hash of the options that shape the tree, see state_hash */
+extern volatile sig_atomic_t stop_signal; /* signal received, monitor() saves the state and exits */
+extern volatile sig_atomic_t monitoring;  /* 1 once monitor() handles the signals */
+extern char *journal_directory;   /* directory defined by --journal option */
+extern off_t journal_max_size;    /* bytes of a segment of the journal */
+extern int journal_max_age;       /* seconds of a segment of the journal */
+extern journal_fsync_t journal_fsync; /* when the journal is synced to the disk */
+extern uint64_t event_sequence;   /* sequence number of the last event reported */
+extern char *cursor_socket;       /* unix socket defined by --cursor-socket option */
+extern char *subscribe_socket;    /* unix socket defined by --subscribe-socket option */
+extern char *ring_socket;         /* unix socket defined by --ring-socket option */
+extern size_t ring_size;          /* bytes of the ring of --ring-socket */
+extern char *plugin_path;         /* shared library defined by --plugin option */
+extern char *plugin_argument;     /* argument defined by --plugin-arg option */
+extern char *mirror_destination;  /* directory defined by --mirror option */
+extern int mirror_workers;        /* threads defined by --mirror-workers option */
+extern struct inotify_event *dispatched_event; /* event given to execute_command */
+extern unsigned long dispatched_count; /* events rolled up into it, 1 without --rollup-* */
+extern int rollup_depth;          /* depth defined by --rollup-depth option, -1 for none */
+extern int rollup_window;         /* milliseconds defined by --rollup-window option */
+extern char *stats_file;          /* file defined by --stats-file option */
+extern int stats_interval;        /* seconds defined by --stats-interval option */
+extern char *metrics_socket;      /* socket defined by --metrics-socket option */
+extern volatile sig_atomic_t metrics_signal; /* the metrics are requested (SIGUSR1) */
+extern struct timespec read_at;   /* when the events being handled were read, zero otherwise */
+
 extern bool_t nosymlink_flag;
 extern bool_t recursive_flag;
 extern bool_t verbose_flag;
 extern bool_t syslog_flag;
+extern bool_t priority_lane_flag;
+extern bool_t progressive_flag;
+extern bool_t ready_flag; /* TRUE once the whole tree is watched */
+extern bool_t state_changes_flag;
+extern bool_t skip_unchanged_flag;
+extern bool_t atomic_saves_flag;
+extern bool_t rollup_flag;        /* TRUE with --rollup-depth or --rollup-prefix */
 
 /* function pointer to inotify_add_watch
  *
@@ -318,6 +440,29 @@ is_child_of(const char *, const char *);
 bool_t
 excluded(char *);
 
+/* returns the states of the --include automaton reached
+ * by a path, relative to the root_path.
+ * Paths outside the root_path have no states.
+ *
+ * @param  const char *     : absolute path
+ * @return pathglob_state_t
+ */
+pathglob_state_t
+include_state_of(const char *);
+
+/* checks whetever an event can match the glob patterns
+ * defined with -i option, without building its path
+ * See: include_glob
+ *
+ * @param  struct inotify_event * : inotify event
+ * @param  WD_DATA *              : watched directory of the event
+ * @param  bool_t *               : set to TRUE if the event matches,
+ *                                  FALSE if it may only lead to a match
+ * @return bool_t                 : FALSE if the event can be discarded
+ */
+bool_t
+included(struct inotify_event *, WD_DATA *, bool_t *);
+
 /* checks whetever a pattern match the regular
  * expression pattern defined with -X option
  * See: user_catch_regex
@@ -348,6 +493,48 @@ get_regex_catch(char *);
 bstring
 format_command(char *, char *, char *, char *);
 
+/* returns the events that cwatch needs internally to maintain
+ * the tree of watched resources, regardless of the -e option.
+ * These events are consumed by the handlers and never dispatched
+ * unless they are also requested by the user.
+ *
+ * @return uint32_t
+ */
+uint32_t
+structural_mask();
+
+/* returns the events that the recognizer of the saves needs
+ * (--atomic-saves option), regardless of the -e option
+ *
+ * @return uint32_t
+ */
+uint32_t
+recognizer_mask();
+
+/* returns the mask to register in the kernel for a watched directory:
+ * the user events, when something in the directory can match,
+ * plus the structural events
+ *
+ * @param  WD_DATA * : watched directory
+ * @return uint32_t
+ */
+uint32_t
+kernel_mask_for(WD_DATA *);
+
+/* registers again a watched directory if its kernel mask is changed
+ *
+ * @param WD_DATA * : watched directory
+ * @param int       : inotify file descriptor
+ */
+void refresh_watch_mask(WD_DATA *, int);
+
+/* parses a comma separated list of events, as the one of -e --events
+ *
+ * @param  const char * : the list
+ * @return uint32_t     : the mask of the events, 0 if an event is unrecognized
+ */
+uint32_t events_mask_of(const char *);
+
 /* parse the command line
  *
  * @param  int     : number of arguments
@@ -369,6 +556,131 @@ int parse_command_line(int, char **);
  */
 int watch_directory_tree(char *, char *, bool_t, int, Queue *);
 
+/* as watch_directory_tree, reporting a synthetic create event for
+ * each entry found, if requested. Each directory is watched before
+ * it is visited, so no entry is lost.
+ *
+ * @param  char *   : absolute path of directory to watch
+ * @param  char *   : symbolic link that point to the path
+ * @param  bool_t   : traverse directory recursively or not
+ * @param  bool_t   : report the entries found or not
+ * @param  int      : inotify file descriptor
+ * @param  Queue *  : queue of watched resources
+ * @return int      : -1 (An error occurred), 0 (Resource added correctly)
+ */
+int walk_directory_tree(char *, char *, bool_t, bool_t, int, Queue *);
+
+/* returns TRUE if the trees can be ingested in background, never
+ * within libcwatch
+ *
+ * @return bool_t
+ */
+bool_t
+ingestible_in_background();
+
+/* watches a directory, and visits the tree below it in background
+ * (see ingest.h), if possible
+ *
+ * @param  char *   : absolute path of directory to watch
+ * @param  int      : inotify file descriptor
+ * @param  Queue *  : queue of watched resources
+ * @return int      : -1 (An error occurred), 0 (Resource added correctly)
+ */
+int ingest_directory_tree(char *, int, Queue *);
+
+/* decides whether the workers have to visit an entry
+ * See: ingest_accept_t
+ */
+int accept_ingested(const INGEST_DIR *, const char *, unsigned char, INGEST_DIR *);
+
+/* adds a batch of directories watched by the workers to the watch list,
+ * then handles the events deferred until they were added
+ *
+ * @param int      : inotify file descriptor
+ * @param Queue *  : queue of watched resources
+ */
+void collect_ingested(int, Queue *);
+
+/* adds a directory watched by the workers to the watch list
+ *
+ * @param INGEST_DIR * : the directory, deallocated
+ * @param int          : inotify file descriptor
+ * @param Queue *      : queue of watched resources
+ */
+void register_ingested(INGEST_DIR *, int, Queue *);
+
+/* opens a directory to list its entries. When the directory is not
+ * changed since the state was saved (--state-file) the entries come
+ * from the snapshot, without listing it
+ *
+ * @param  const char * : absolute path of the directory
+ * @return LISTING *    : NULL if the directory can not be opened
+ */
+LISTING *open_listing(const char *);
+
+/* takes the next entry of a directory
+ *
+ * @param  LISTING *       : the directory
+ * @param  char **         : where to store the name of the entry
+ * @param  unsigned char * : where to store the type of the entry
+ * @return int             : 1 if an entry is found, 0 at the end
+ */
+int next_listing(LISTING *, char **, unsigned char *);
+
+/* closes a directory opened by open_listing */
+void close_listing(LISTING *);
+
+/* returns TRUE if an entry of a directory is in the saved state
+ *
+ * @param  const char *  : absolute path of the directory
+ * @param  const char *  : name of the entry
+ * @param  unsigned char : type of the entry
+ * @return bool_t
+ */
+bool_t
+saved_in_state(const char *, const char *, unsigned char);
+
+/* reports the entries of the saved state that are gone from a directory
+ *
+ * @param WD_DATA * : the directory
+ */
+void report_deleted_entries(WD_DATA *);
+
+/* returns TRUE if there are no events left to handle, so that the
+ * watch list is up to date with the directories
+ *
+ * @param  int    : inotify file descriptor
+ * @return bool_t
+ */
+bool_t
+state_savable(int);
+
+/* saves the watched directories into the --state-file
+ *
+ * @param  Queue * : queue of watched resources
+ * @return int     : 0 if success, -1 otherwise
+ */
+int save_state(Queue *);
+
+/* returns the milliseconds elapsed since a point in time
+ *
+ * @param  const struct timespec * : the point in time (CLOCK_MONOTONIC)
+ * @return long
+ */
+long elapsed_ms(const struct timespec *);
+
+/* returns the microseconds elapsed since a point in time
+ *
+ * @param  const struct timespec * : the point in time (CLOCK_MONOTONIC)
+ * @return uint64_t
+ */
+uint64_t elapsed_us(const struct timespec *);
+
+/* reports, only once, that the whole tree is watched: logs the time
+ * to ready and writes it into the --ready-file
+ */
+void report_ready();
+
 /* add a directory into watch Queue
  *
  * @param  char *      : absolute path of the directory to watch
@@ -380,6 +692,145 @@ int watch_directory_tree(char *, char *, bool_t, int, Queue *);
 QueueElement *
 add_to_watch_list(char *, char *, int, Queue *);
 
+/* add a directory into watch Queue, at a given depth and with
+ * the given states of the --include automaton
+ *
+ * @param  char *             : absolute path of the directory to watch
+ * @param  char *             : symbolic link that points to the absolute path
+ * @param  int                : depth below the root_path
+ * @param  pathglob_state_t   : states of the --include automaton
+ * @param  int                : inotify file descriptor
+ * @param  Queue *            : queue of watched resources
+ * @return QueueElement *     : pointer of the element added in the watch list
+ */
+QueueElement *
+watch_resource(char *, char *, int, pathglob_state_t, int, Queue *);
+
+/* frees the paths given to watch_resource that the watch list did not
+ * keep, because they were already watched or could not be watched
+ *
+ * @param char *  : absolute path of the directory, or NULL
+ * @param char *  : symbolic link that points to it, or NULL
+ * @param Queue * : queue of watched resources
+ */
+void release_unwatched(char *, char *, Queue *);
+
+/* returns the number of directories between the root_path and a path
+ *
+ * @param  const char * : absolute path
+ * @return int          : 0 for the root_path or a path outside of it
+ */
+int depth_of(const char *);
+
+/* registers a watched directory, with its mask, into
+ * inotify or into the poller
+ *
+ * @param  WD_DATA * : watched directory
+ * @param  int       : inotify file descriptor
+ * @param  bool_t    : TRUE to use the poller
+ * @return int       : watch descriptor, -1 on error
+ */
+int register_watch(WD_DATA *, int, bool_t);
+
+/* registers a new watched directory within the watch budget.
+ * When the budget is over, a deeper directory is demoted to the
+ * poller to make room, otherwise the directory itself is polled.
+ *
+ * @param  WD_DATA * : watched directory
+ * @param  int       : inotify file descriptor
+ * @param  Queue *   : queue of watched resources
+ * @return int       : watch descriptor, -1 on error
+ */
+int attach_watch(WD_DATA *, int, Queue *);
+
+/* unregisters a watched directory from inotify or from the poller
+ *
+ * @param WD_DATA * : watched directory
+ * @param int       : inotify file descriptor
+ */
+void release_watch(WD_DATA *, int);
+
+/* adds an inotify watch to the candidates to the poller, or moves it
+ * after the others of its depth, as the most recently active
+ *
+ * @param WD_DATA * : watched directory
+ */
+void track_candidate(WD_DATA *);
+
+/* removes a watch from the candidates to the poller, if it is there
+ *
+ * @param WD_DATA * : watched directory
+ */
+void untrack_candidate(WD_DATA *);
+
+/* records an event of a watched directory, at the given time
+ *
+ * @param WD_DATA * : watched directory
+ * @param time_t    : time of the event
+ */
+void touch_watch(WD_DATA *, time_t);
+
+/* returns the inotify watch that is worth less than a directory:
+ * the deepest one, deeper than the given depth or as deep but idle,
+ * the least recently active among them. It takes the first of the
+ * candidates to the poller, without looking at the whole watch list
+ *
+ * @param  int       : depth of the directory
+ * @param  time_t    : watches without events since then are idle
+ * @param  Queue *   : queue of watched resources
+ * @return WD_DATA * : NULL if there is none
+ */
+WD_DATA *
+watch_to_demote(int, time_t, Queue *);
+
+/* moves a watched directory from inotify to the poller
+ *
+ * @param WD_DATA * : watched directory
+ * @param int       : inotify file descriptor
+ */
+void demote_watch(WD_DATA *, int);
+
+/* moves an active polled directory to inotify, if the budget allows it
+ *
+ * @param WD_DATA * : watched directory
+ * @param int       : inotify file descriptor
+ * @param Queue *   : queue of watched resources
+ */
+void promote_watch(WD_DATA *, int, Queue *);
+
+/* counts an event of a directory, in the second of its last_event
+ *
+ * @param  WD_DATA * : watched directory
+ * @return bool_t    : TRUE if the directory is over --hot-threshold
+ */
+bool_t
+track_rate(WD_DATA *);
+
+/* drops the events of a hot directory from its kernel mask
+ * for --hot-cooldown seconds
+ *
+ * @param WD_DATA * : watched directory
+ * @param int       : inotify file descriptor
+ */
+void cool_watch(WD_DATA *, int);
+
+/* restores the kernel mask of the directories cooled long enough,
+ * rescans them and reports a single modify event for each one
+ *
+ * @param int     : inotify file descriptor
+ * @param Queue * : queue of watched resources
+ */
+void rearm_cooled(int, Queue *);
+
+/* watches the subdirectories created and unwatches the ones deleted
+ * while the events of a directory were not received
+ *
+ * @param WD_DATA * : watched directory
+ * @param int       : inotify file descriptor
+ * @param Queue *   : queue of watched resources
+ */
+void rescan_directory(WD_DATA *, int, Queue *);
+
 /* given a real path unwatch a directory from the watch list
  *
  * @param char *  : absolute path of the resource to remove
@@ -462,10 +913,188 @@ void unwatch_symlink(char *, int, Queue *);
  */
 int monitor(int, Queue *);
 
+/* handles all the events queued in the priority lane
+ *
+ * @param int      : inotify file descriptor
+ * @param Queue *  : queue of watched resources
+ */
+void drain_lane(int, Queue *);
+
+/* handles a buffer of inotify events
+ *
+ * @param char *   : buffer of struct inotify_event
+ * @param ssize_t  : length of the buffer
+ * @param int      : inotify file descriptor
+ * @param Queue *  : queue of watched resources
+ */
+void handle_events(char *, ssize_t, int, Queue *);
+
+/* keeps an event of a directory watched by the workers and not yet
+ * added to the watch list (see ingest_pending)
+ *
+ * @param struct inotify_event * : event
+ */
+void defer_event(struct inotify_event *);
+
+/* handles a buffer of fanotify events
+ *
+ * @param char *   : buffer read from the fanotify descriptor
+ * @param ssize_t  : length of the buffer
+ * @param int      : fanotify file descriptor
+ * @param Queue *  : queue of watched resources
+ */
+void handle_fanotify_events(char *, ssize_t, int, Queue *);
+
+/* returns TRUE if an event is worth handling, that is
+ * its name is not excluded and somebody is interested in it
+ *
+ * @param  struct inotify_event * : event
+ * @return bool_t
+ */
+bool_t
+wanted(struct inotify_event *);
+
+/* wanted() for the threads of the shards, that counts the events
+ * read and the ones excluded
+ *
+ * @param  struct inotify_event * : event
+ * @return int                    : 0 to discard the event
+ */
+int wanted_by_shard(struct inotify_event *);
+
+/* handles an event of a watched directory
+ *
+ * @param struct inotify_event * : event
+ * @param WD_DATA *              : the directory of the event
+ * @param int                    : file descriptor of the events
+ * @param Queue *                : queue of watched resources
+ */
+void handle_event(struct inotify_event *, WD_DATA *, int, Queue *);
+
+/* executes the command for an event, if requested by the user
+ *
+ * @param struct inotify_event * : event
+ * @param WD_DATA *              : the directory of the event
+ * @param bool_t                 : whether the event matches the globs (-i option)
+ */
+void dispatch_event(struct inotify_event *, WD_DATA *, bool_t);
+
+/* forward_event() for the events released by --atomic-saves: they
+ * were read before, so they are not timed. See: atomic_forward_t
+ *
+ * @param struct inotify_event * : event
+ * @param char *                 : the directory of the event
+ * @param int                    : whether the event matches the globs (-i option)
+ */
+void forward_held(struct inotify_event *, char *, int);
+
+/* passes an event to the --skip-unchanged stage, then to report_event.
+ * See: atomic_forward_t
+ *
+ * @param struct inotify_event * : event
+ * @param char *                 : the directory of the event
+ * @param int                    : whether the event matches the globs (-i option)
+ */
+void forward_event(struct inotify_event *, char *, int);
+
+/* holds an event until the digests of the files before it are known
+ * (--skip-unchanged option)
+ *
+ * @param  struct inotify_event * : event
+ * @param  char *                 : the directory of the event
+ * @param  bool_t                 : whether the event matches the globs (-i option)
+ * @return bool_t                 : TRUE if the event is held, it is reported later
+ */
+bool_t
+hold_event(struct inotify_event *, char *, bool_t);
+
+/* reports the events held whose turn has come, dropping the content
+ * events of the files not changed
+ */
+void collect_digested();
+
+/* starts counting the paths and the directories of the events
+ *
+ * @return int : 0 if success, -1 otherwise
+ */
+int heavy_start();
+
+/* counts an event for the heavy hitters
+ *
+ * @param char * : directory of the event
+ * @param char * : path of the event
+ */
+void count_heavy(char *, char *);
+
+/* prints the paths and the directories with the most events
+ * since the last report, on the standard error
+ *
+ * @param bool_t : TRUE to start counting again
+ */
+void report_heavy(bool_t);
+
+/* executes the command for an event, if requested by the user
+ *
+ * @param struct inotify_event * : event
+ * @param char *                 : the directory of the event
+ * @param bool_t                 : whether the event matches the globs (-i option)
+ */
+void report_event(struct inotify_event *, char *, bool_t);
+
+/* gives an event to the journal, the sockets, the embedding program
+ * and the command
+ *
+ * @param struct inotify_event * : event
+ * @param char *                 : the directory of the event
+ * @param char *                 : the name of the event (see events_lut)
+ * @param unsigned long          : number of events it stands for
+ */
+void emit_event(struct inotify_event *, char *, char *, unsigned long);
+
+/* rolls an event up into its prefix (--rollup-depth, --rollup-prefix)
+ *
+ * @param struct inotify_event * : event
+ * @param char *                 : the directory of the event
+ */
+void roll_up_event(struct inotify_event *, char *);
+
+/* reports a record for each prefix changed in the window that is over */
+void collect_rolled_up();
+
+/* writes the names of the events of a mask, separated by commas
+ *
+ * @param  uint32_t : mask
+ * @param  char *   : buffer
+ * @param  size_t   : size of the buffer
+ * @return char *   : the buffer
+ */
+char *event_names_of(uint32_t, char *, size_t);
+
+/* reports a synthetic create event for an entry
+ * found while visiting a new directory
+ *
+ * @param WD_DATA *    : the directory of the entry
+ * @param const char * : name of the entry
+ * @param bool_t       : whether the entry is a directory
+ */
+void synthesize_create(WD_DATA *, const char *, bool_t);
+
+/* reports a synthetic event for an entry of a directory
+ *
+ * @param  WD_DATA *    : the directory of the entry
+ * @param  const char * : name of the entry
+ * @param  uint32_t     : event mask
+ * @return bool_t       : TRUE if the event has been reported
+ */
+bool_t
+synthesize_event(WD_DATA *, const char *, uint32_t);
+
 /* COMMAND EXECUTION HANDLER
  *
  * _inline   : called when the -c --command option is given
  * _embedded : called when the -F --format  option is given
+ * _plugin   : called when the --plugin option is given
+ * _mirror   : called when the --mirror option is given
  *
  * These functions handles the execution of a command
  *
@@ -477,6 +1106,18 @@ int monitor(int, Queue *);
 extern int (*execute_command)(char *, char *, char *);
 int execute_command_inline(char *, char *, char *);
 int execute_command_embedded(char *, char *, char *);
+int execute_command_plugin(char *, char *, char *);
+int execute_command_mirror(char *, char *, char *);
+
+/* function pointer called for each event reported, set by libcwatch
+ *
+ * @param uint64_t     : sequence number
+ * @param uint32_t     : event mask
+ * @param uint32_t     : cookie
+ * @param const char * : directory of the event
+ * @param const char * : name of the file or directory, "" for none
+ */
+extern void (*event_sink)(uint64_t, uint32_t, uint32_t, const char *, const char *);
 
 /* get the inotify event handler from the event mask
  *
@@ -507,4 +1148,25 @@ int event_handler_moved_to(struct inotify_event *, char *, int, Queue *);
  * @param int : signal identifier
  */
 void signal_callback_handler(int);
+
+/* handler of SIGUSR2, the heavy hitters are reported by monitor()
+ *
+ * @param int : signal identifier
+ */
+void heavy_signal_handler(int);
+
+/* handler of SIGUSR1, the metrics are printed by monitor()
+ *
+ * @param int : signal identifier
+ */
+void metrics_signal_handler(int);
+
+/* writes the metrics into --stats-file */
+void write_stats();
+
+/* counts a watch added or removed, and the watches now
+ *
+ * @param metric_t : METRIC_WATCHES_ADDED or METRIC_WATCHES_REMOVED
+ */
+void count_watch(metric_t);
 #endif /* !__CWATCH_H */
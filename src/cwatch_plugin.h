@@ -0,0 +1,73 @@
+/* cwatch_plugin.h
+ * ABI of the plugins loaded by cwatch with --plugin
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#ifndef __CWATCH_PLUGIN_H
+#define __CWATCH_PLUGIN_H
+
+#include <stdint.h>
+
+/* A plugin is a shared library loaded with --plugin, that handles the
+ * events in the process of cwatch instead of a command. It exports:
+ *
+ *   int cwatch_plugin_init(uint32_t abi, const char *root, const char *argument,
+ *                          CWATCH_PLUGIN *plugin);
+ *
+ * that fills plugin, setting plugin->abi to the CWATCH_PLUGIN_ABI it
+ * has been built with, and returns 0 (-1 to refuse to start). cwatch
+ * refuses a plugin of another ABI.
+ *
+ * batch is called with the events of a loop of cwatch, at most once per
+ * loop. The events and their strings are valid only during the call.
+ * batch returns 0, or -1 to be disabled. A plugin runs in the process of
+ * cwatch: a plugin that crashes makes cwatch crash.
+ *
+ * fini, if not NULL, is called once when cwatch exits or disables the
+ * plugin.
+ */
+#define CWATCH_PLUGIN_ABI 1
+
+/* an event given to a plugin */
+typedef struct cwatch_plugin_event_s
+{
+    uint64_t sequence;
+    uint32_t mask;       /* inotify event mask */
+    const char *event;   /* name of the event, as in -e --events */
+    const char *path;    /* directory of the event, with the trailing slash */
+    const char *name;    /* name of the file or directory, "" for none */
+    const char *capture; /* first group matched by -X --regex-catch, NULL for none */
+} CWATCH_PLUGIN_EVENT;
+
+/* filled by cwatch_plugin_init */
+typedef struct cwatch_plugin_s
+{
+    uint32_t abi;
+    int (*batch)(const CWATCH_PLUGIN_EVENT *, int);
+    void (*fini)(void);
+} CWATCH_PLUGIN;
+
+/* the signature of cwatch_plugin_init */
+typedef int (*cwatch_plugin_init_t)(uint32_t, const char *, const char *, CWATCH_PLUGIN *);
+
+#endif /* !__CWATCH_PLUGIN_H */
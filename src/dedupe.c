@@ -0,0 +1,140 @@
+/* dedupe.c
+ * Drop the real events already reported by a synthetic one
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dedupe.h"
+
+static unsigned int hash_of(const char *path)
+{
+    unsigned int hash = 2166136261u;
+
+    while (*path != '\0')
+        hash = (hash ^ (unsigned char)*path++) * 16777619u;
+
+    return hash % DEDUPE_BUCKETS;
+}
+
+/* drops the paths whose real event, if any, is too late by now */
+static void sweep(DEDUPE_SET *set, time_t now)
+{
+    int i;
+    for (i = 0; i < DEDUPE_BUCKETS; ++i)
+    {
+        DEDUPE_ENTRY **entry = &set->remembered[i];
+        while (*entry)
+        {
+            if (now - (*entry)->since < DEDUPE_TTL)
+            {
+                entry = &(*entry)->next;
+                continue;
+            }
+
+            DEDUPE_ENTRY *expired = *entry;
+            *entry = expired->next;
+            free(expired->path);
+            free(expired);
+            --set->qty;
+        }
+    }
+    set->last_sweep = now;
+}
+
+void dedupe_remember(DEDUPE_SET *set, const char *path, time_t now)
+{
+    if (set->qty > 0 && now - set->last_sweep >= DEDUPE_TTL)
+        sweep(set, now);
+
+    DEDUPE_ENTRY *entry = (DEDUPE_ENTRY *)malloc(sizeof(DEDUPE_ENTRY));
+    if (entry == NULL)
+        return;
+
+    if ((entry->path = strdup(path)) == NULL)
+    {
+        free(entry);
+        return;
+    }
+
+    if (set->qty == 0)
+        set->last_sweep = now;
+
+    unsigned int bucket = hash_of(path);
+    entry->since = now;
+    entry->next = set->remembered[bucket];
+    set->remembered[bucket] = entry;
+    ++set->qty;
+}
+
+int dedupe_forget(DEDUPE_SET *set, const char *path, time_t now)
+{
+    if (set->qty == 0)
+        return 0;
+
+    if (now - set->last_sweep >= DEDUPE_TTL)
+    {
+        sweep(set, now);
+        if (set->qty == 0)
+            return 0;
+    }
+
+    DEDUPE_ENTRY **entry = &set->remembered[hash_of(path)];
+    while (*entry)
+    {
+        if (strcmp((*entry)->path, path) == 0)
+        {
+            DEDUPE_ENTRY *found = *entry;
+            *entry = found->next;
+            free(found->path);
+            free(found);
+            --set->qty;
+            return 1;
+        }
+        entry = &(*entry)->next;
+    }
+
+    return 0;
+}
+
+int dedupe_size(DEDUPE_SET *set)
+{
+    return set->qty;
+}
+
+void dedupe_clear(DEDUPE_SET *set)
+{
+    int i;
+    for (i = 0; i < DEDUPE_BUCKETS && set->qty > 0; ++i)
+    {
+        while (set->remembered[i])
+        {
+            DEDUPE_ENTRY *entry = set->remembered[i];
+            set->remembered[i] = entry->next;
+            free(entry->path);
+            free(entry);
+            --set->qty;
+        }
+    }
+}
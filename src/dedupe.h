@@ -0,0 +1,88 @@
+/* dedupe.h
+ * Drop the real events already reported by a synthetic one
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#ifndef __DEDUPE_H
+#define __DEDUPE_H
+
+#include <time.h>
+
+/* When a new directory is scanned, its entries are reported through
+ * synthetic create events, since they could be created before its watch.
+ * The ones created after the watch are reported by inotify too, so the
+ * synthetic events are remembered for a while and their real twins dropped.
+ */
+
+/* seconds a synthetic event is remembered */
+#define DEDUPE_TTL 5
+
+/* number of buckets of the set of the paths */
+#define DEDUPE_BUCKETS 4096
+
+typedef struct dedupe_entry_s
+{
+    char *path;
+    time_t since;
+    struct dedupe_entry_s *next;
+} DEDUPE_ENTRY;
+
+/* used to store the paths remembered, a set for each watched tree */
+typedef struct dedupe_set_s
+{
+    DEDUPE_ENTRY *remembered[DEDUPE_BUCKETS];
+    int qty;
+    time_t last_sweep;
+} DEDUPE_SET;
+
+/* remembers the path of a synthetic event
+ *
+ * @param DEDUPE_SET * : set
+ * @param const char * : path
+ * @param time_t       : current time
+ */
+void dedupe_remember(DEDUPE_SET *, const char *, time_t);
+
+/* forgets the path of a synthetic event
+ *
+ * @param  DEDUPE_SET * : set
+ * @param  const char * : path
+ * @param  time_t       : current time
+ * @return int          : 1 if the path was remembered, 0 otherwise
+ */
+int dedupe_forget(DEDUPE_SET *, const char *, time_t);
+
+/* returns the number of paths remembered
+ *
+ * @param  DEDUPE_SET * : set
+ * @return int
+ */
+int dedupe_size(DEDUPE_SET *);
+
+/* forgets all the paths remembered
+ *
+ * @param DEDUPE_SET * : set
+ */
+void dedupe_clear(DEDUPE_SET *);
+
+#endif /* !__DEDUPE_H */
@@ -0,0 +1,599 @@
+/* digest.c
+ * Drop the events of the files rewritten with the same content
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "digest.h"
+
+/* bytes read at once, a multiple of a stripe */
+#define DIGEST_CHUNK_SIZE (128 * 1024)
+
+#define PRIME64_1 11400714785074694791ULL
+#define PRIME64_2 14029467366897019727ULL
+#define PRIME64_3 1609587929392839161ULL
+#define PRIME64_4 9650029242287828579ULL
+#define PRIME64_5 2870177450012600261ULL
+
+/* the state of XXH64: four independent lanes over 32 bytes stripes,
+ * that the compiler can keep in registers (or vectorize)
+ */
+typedef struct digest_state_s
+{
+    uint64_t lane[4];
+    uint64_t total;
+    unsigned char tail[32];
+    size_t tail_len;
+} DIGEST_STATE;
+
+typedef struct digest_entry_s
+{
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    uint64_t digest;
+    struct digest_entry_s *next;
+} DIGEST_ENTRY;
+
+static DIGEST_ENTRY *digests[DIGEST_BUCKETS];
+static unsigned int forgotten[DIGEST_BUCKETS]; /* digests forgotten by bucket */
+static int digests_qty = 0;
+static pthread_mutex_t table_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static Queue *held = NULL;      /* queue of DIGEST_ITEM, in the order they came */
+static Queue *to_digest = NULL; /* queue of DIGEST_ITEM, to hash */
+static int held_qty = 0;
+static pthread_mutex_t digest_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t digest_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t digested_cond = PTHREAD_COND_INITIALIZER;
+static int notify_pipe[2] = {-1, -1};
+
+/* wakes up cwatch, a full pipe is already enough to wake it up */
+static void notify()
+{
+    if (write(notify_pipe[1], "", 1) == -1)
+        return;
+}
+
+static inline uint64_t rotl64(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t read64(const unsigned char *p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t read32(const unsigned char *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t round64(uint64_t lane, uint64_t input)
+{
+    lane += input * PRIME64_2;
+    lane = rotl64(lane, 31);
+    return lane * PRIME64_1;
+}
+
+static inline uint64_t merge64(uint64_t hash, uint64_t lane)
+{
+    hash ^= round64(0, lane);
+    return hash * PRIME64_1 + PRIME64_4;
+}
+
+static void state_init(DIGEST_STATE *state)
+{
+    state->lane[0] = PRIME64_1 + PRIME64_2;
+    state->lane[1] = PRIME64_2;
+    state->lane[2] = 0;
+    state->lane[3] = -PRIME64_1;
+    state->total = 0;
+    state->tail_len = 0;
+}
+
+static const unsigned char *stripes(DIGEST_STATE *state, const unsigned char *p, const unsigned char *end)
+{
+    uint64_t v1 = state->lane[0], v2 = state->lane[1], v3 = state->lane[2], v4 = state->lane[3];
+
+    for (; p + 32 <= end; p += 32)
+    {
+        v1 = round64(v1, read64(p));
+        v2 = round64(v2, read64(p + 8));
+        v3 = round64(v3, read64(p + 16));
+        v4 = round64(v4, read64(p + 24));
+    }
+
+    state->lane[0] = v1;
+    state->lane[1] = v2;
+    state->lane[2] = v3;
+    state->lane[3] = v4;
+
+    return p;
+}
+
+static void state_update(DIGEST_STATE *state, const unsigned char *p, size_t length)
+{
+    const unsigned char *end = p + length;
+    state->total += length;
+
+    if (state->tail_len > 0)
+    {
+        size_t missing = 32 - state->tail_len;
+        if (length < missing)
+        {
+            memcpy(state->tail + state->tail_len, p, length);
+            state->tail_len += length;
+            return;
+        }
+
+        memcpy(state->tail + state->tail_len, p, missing);
+        stripes(state, state->tail, state->tail + 32);
+        p += missing;
+        state->tail_len = 0;
+    }
+
+    p = stripes(state, p, end);
+
+    state->tail_len = end - p;
+    memcpy(state->tail, p, state->tail_len);
+}
+
+static uint64_t state_final(DIGEST_STATE *state)
+{
+    uint64_t hash;
+
+    if (state->total >= 32)
+    {
+        hash = rotl64(state->lane[0], 1) + rotl64(state->lane[1], 7) + rotl64(state->lane[2], 12) + rotl64(state->lane[3], 18);
+        hash = merge64(hash, state->lane[0]);
+        hash = merge64(hash, state->lane[1]);
+        hash = merge64(hash, state->lane[2]);
+        hash = merge64(hash, state->lane[3]);
+    }
+    else
+    {
+        hash = state->lane[2] + PRIME64_5;
+    }
+
+    hash += state->total;
+
+    const unsigned char *p = state->tail;
+    const unsigned char *end = p + state->tail_len;
+
+    for (; p + 8 <= end; p += 8)
+        hash = rotl64(hash ^ round64(0, read64(p)), 27) * PRIME64_1 + PRIME64_4;
+
+    if (p + 4 <= end)
+    {
+        hash = rotl64(hash ^ (read32(p) * PRIME64_1), 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+
+    for (; p < end; ++p)
+        hash = rotl64(hash ^ (*p * PRIME64_5), 11) * PRIME64_1;
+
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+uint64_t digest_of(const void *data, size_t length)
+{
+    DIGEST_STATE state;
+
+    state_init(&state);
+    state_update(&state, (const unsigned char *)data, length);
+
+    return state_final(&state);
+}
+
+/* NOTE: the file is read, not mapped, since a file truncated while it
+ * is hashed would kill cwatch with a SIGBUS
+ */
+static int digest_file(const char *path, uint64_t *digest)
+{
+    DIGEST_STATE state;
+    ssize_t length;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_NOATIME);
+    if (fd == -1 && errno == EPERM)
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+
+    unsigned char *buffer = (unsigned char *)malloc(DIGEST_CHUNK_SIZE);
+    if (buffer == NULL)
+    {
+        close(fd);
+        return -1;
+    }
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    state_init(&state);
+    while ((length = read(fd, buffer, DIGEST_CHUNK_SIZE)) > 0)
+        state_update(&state, buffer, length);
+
+    free(buffer);
+    close(fd);
+
+    if (length == -1)
+        return -1;
+
+    *digest = state_final(&state);
+    return 0;
+}
+
+static unsigned int bucket_of(const char *path)
+{
+    unsigned int hash = 2166136261u;
+
+    while (*path != '\0')
+        hash = (hash ^ (unsigned char)*path++) * 16777619u;
+
+    return hash % DIGEST_BUCKETS;
+}
+
+static DIGEST_ENTRY **find(const char *path)
+{
+    DIGEST_ENTRY **entry = &digests[bucket_of(path)];
+
+    while (*entry != NULL && strcmp((*entry)->path, path) != 0)
+        entry = &(*entry)->next;
+
+    return entry;
+}
+
+static int same_time(const struct timespec *a, const struct timespec *b)
+{
+    return a->tv_sec == b->tv_sec && a->tv_nsec == b->tv_nsec;
+}
+
+static int older(const struct timespec *a, const struct timespec *b)
+{
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+int digest_changed(const char *path)
+{
+    struct stat st;
+    DIGEST_ENTRY known;
+    uint64_t digest;
+
+    /* NOTE: a big file costs more to read than to report */
+    if (stat(path, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size > DIGEST_MAX_SIZE)
+    {
+        digest_forget(path);
+        return 1;
+    }
+
+    unsigned int bucket = bucket_of(path);
+
+    pthread_mutex_lock(&table_mutex);
+    DIGEST_ENTRY *entry = *find(path);
+    if (entry != NULL)
+        known = *entry;
+    unsigned int generation = forgotten[bucket];
+    pthread_mutex_unlock(&table_mutex);
+
+    /* the file has not been touched since the last time */
+    if (entry != NULL && known.dev == st.st_dev && known.ino == st.st_ino && known.size == st.st_size && same_time(&known.mtime, &st.st_mtim))
+        return 0;
+
+    if (digest_file(path, &digest) == -1)
+        return 1;
+
+    int changed = (entry == NULL || known.size != st.st_size || known.digest != digest) ? 1 : 0;
+
+    /* a digest forgotten while the file was hashed is not put back */
+    pthread_mutex_lock(&table_mutex);
+    if (forgotten[bucket] != generation)
+    {
+        pthread_mutex_unlock(&table_mutex);
+        return 1;
+    }
+
+    DIGEST_ENTRY **slot = find(path);
+    if (*slot == NULL && digests_qty < DIGEST_MAX_FILES && (*slot = (DIGEST_ENTRY *)calloc(1, sizeof(DIGEST_ENTRY))) != NULL)
+    {
+        (*slot)->path = strdup(path);
+        ++digests_qty;
+    }
+
+    /* another worker may have hashed a more recent version */
+    if (*slot != NULL && !older(&st.st_mtim, &(*slot)->mtime))
+    {
+        (*slot)->dev = st.st_dev;
+        (*slot)->ino = st.st_ino;
+        (*slot)->size = st.st_size;
+        (*slot)->mtime = st.st_mtim;
+        (*slot)->digest = digest;
+    }
+    pthread_mutex_unlock(&table_mutex);
+
+    return changed;
+}
+
+void digest_forget(const char *path)
+{
+    pthread_mutex_lock(&table_mutex);
+    ++forgotten[bucket_of(path)];
+    DIGEST_ENTRY **entry = find(path);
+    if (*entry != NULL)
+    {
+        DIGEST_ENTRY *found = *entry;
+        *entry = found->next;
+        free(found->path);
+        free(found);
+        --digests_qty;
+    }
+    pthread_mutex_unlock(&table_mutex);
+}
+
+int digest_files()
+{
+    pthread_mutex_lock(&table_mutex);
+    int qty = digests_qty;
+    pthread_mutex_unlock(&table_mutex);
+
+    return qty;
+}
+
+static void *digest_worker(void *arg)
+{
+    while (1)
+    {
+        pthread_mutex_lock(&digest_mutex);
+        while (to_digest->first == NULL)
+            pthread_cond_wait(&digest_cond, &digest_mutex);
+        DIGEST_ITEM *item = (DIGEST_ITEM *)queue_dequeue(to_digest);
+        pthread_mutex_unlock(&digest_mutex);
+
+        int changed = digest_changed(item->path);
+
+        pthread_mutex_lock(&digest_mutex);
+        item->changed = changed;
+        item->done = 1;
+        pthread_cond_broadcast(&digested_cond);
+        pthread_mutex_unlock(&digest_mutex);
+
+        notify();
+    }
+
+    return NULL;
+}
+
+int digest_start()
+{
+    if (notify_pipe[0] != -1)
+        return notify_pipe[0];
+
+    held = queue_init();
+    to_digest = queue_init();
+
+    if (held == NULL || to_digest == NULL || pipe2(notify_pipe, O_NONBLOCK | O_CLOEXEC) == -1)
+        return -1;
+
+    int i;
+    for (i = 0; i < DIGEST_WORKERS; ++i)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, digest_worker, NULL) != 0)
+            break;
+        pthread_detach(thread);
+    }
+
+    if (i == 0)
+    {
+        close(notify_pipe[0]);
+        close(notify_pipe[1]);
+        notify_pipe[0] = notify_pipe[1] = -1;
+        return -1;
+    }
+
+    return notify_pipe[0];
+}
+
+int digest_descriptor()
+{
+    return notify_pipe[0];
+}
+
+int digest_hold(const struct inotify_event *event, const char *directory, int match, int hash)
+{
+    if (notify_pipe[0] == -1)
+        return -1;
+
+    DIGEST_ITEM *item = (DIGEST_ITEM *)calloc(1, sizeof(DIGEST_ITEM));
+    if (item == NULL)
+        return -1;
+
+    size_t size = sizeof(struct inotify_event) + event->len;
+    item->event = (struct inotify_event *)malloc(size);
+    item->directory = strdup(directory);
+    item->match = match;
+    item->changed = 1;
+    item->hash = (hash == 1 && event->len > 0) ? 1 : 0;
+    item->done = (item->hash == 0) ? 1 : 0;
+
+    const char *name = (event->len > 0) ? event->name : "";
+    item->path = (char *)malloc(strlen(directory) + strlen(name) + 1);
+    if (item->path != NULL)
+        sprintf(item->path, "%s%s", directory, name);
+
+    if (item->event == NULL || item->directory == NULL || item->path == NULL)
+    {
+        digest_free(item);
+        return -1;
+    }
+    memcpy(item->event, event, size);
+
+    pthread_mutex_lock(&digest_mutex);
+    queue_enqueue(held, item);
+    ++held_qty;
+    if (item->done == 0)
+    {
+        queue_enqueue(to_digest, item);
+        pthread_cond_signal(&digest_cond);
+    }
+    else if (held_qty == 1)
+    {
+        notify();
+    }
+    pthread_mutex_unlock(&digest_mutex);
+
+    return 0;
+}
+
+/* returns 1 if path is prefix, or is inside it */
+static int is_inside(const char *path, const char *prefix)
+{
+    size_t length = strlen(prefix);
+
+    return (strncmp(path, prefix, length) == 0 &&
+            (path[length] == '\0' || path[length] == '/' || (length > 0 && prefix[length - 1] == '/')))
+               ? 1
+               : 0;
+}
+
+/* returns 1 if the events of two paths have to keep their order */
+static int related(const char *a, const char *b)
+{
+    return is_inside(a, b) || is_inside(b, a);
+}
+
+/* returns 1 if an event held before element is related to path. The
+ * caller holds digest_mutex */
+static int held_before(QueueElement *element, const char *path)
+{
+    QueueElement *before;
+    for (before = held->first; before != element; before = before->next)
+    {
+        if (related(((DIGEST_ITEM *)before->data)->path, path))
+            return 1;
+    }
+
+    return 0;
+}
+
+int digest_waits(const char *directory, const char *name)
+{
+    if (notify_pipe[0] == -1)
+        return 0;
+
+    char *path = (char *)malloc(strlen(directory) + strlen(name) + 1);
+    if (path == NULL)
+        return 1;
+    sprintf(path, "%s%s", directory, name);
+
+    pthread_mutex_lock(&digest_mutex);
+    int waits = held_before(NULL, path);
+    pthread_mutex_unlock(&digest_mutex);
+
+    free(path);
+    return waits;
+}
+
+void digest_wait()
+{
+    if (notify_pipe[0] == -1)
+        return;
+
+    pthread_mutex_lock(&digest_mutex);
+    while (held->first != NULL && ((DIGEST_ITEM *)held->first->data)->done == 0)
+        pthread_cond_wait(&digested_cond, &digest_mutex);
+    pthread_mutex_unlock(&digest_mutex);
+}
+
+int digest_held()
+{
+    pthread_mutex_lock(&digest_mutex);
+    int qty = held_qty;
+    pthread_mutex_unlock(&digest_mutex);
+
+    return qty;
+}
+
+Queue *digest_release()
+{
+    Queue *released = queue_init();
+    char drain[256];
+
+    /* NOTE: drain before releasing, so a notification is never lost */
+    while (read(notify_pipe[0], drain, sizeof(drain)) > 0)
+        ;
+
+    /* an event waits for the events of its path held before it only */
+    pthread_mutex_lock(&digest_mutex);
+    QueueElement *element = held->first;
+    while (element != NULL)
+    {
+        QueueElement *next = element->next;
+        DIGEST_ITEM *item = (DIGEST_ITEM *)element->data;
+
+        if (item->done == 1 && held_before(element, item->path) == 0)
+        {
+            queue_enqueue(released, item);
+            queue_remove(held, element);
+            --held_qty;
+        }
+
+        element = next;
+    }
+    pthread_mutex_unlock(&digest_mutex);
+
+    return released;
+}
+
+void digest_free(DIGEST_ITEM *item)
+{
+    if (item == NULL)
+        return;
+
+    free(item->directory);
+    free(item->path);
+    free(item->event);
+    free(item);
+}
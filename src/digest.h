@@ -0,0 +1,152 @@
+/* digest.h
+ * Drop the events of the files rewritten with the same content
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#ifndef __DIGEST_H
+#define __DIGEST_H
+
+#include <stdint.h>
+#include <sys/inotify.h>
+
+#include "queue.h"
+
+/* With --skip-unchanged the IN_CLOSE_WRITE of a file is reported only
+ * if its content changed. A digest of each file reported is kept: when
+ * the size, the modification time and the inode have not changed the
+ * file is not read at all, otherwise it is hashed again (XXH64) and
+ * compared. The IN_MODIFY are not hashed, a write gives many of them.
+ *
+ * The files are hashed by worker threads. An event is held until the
+ * digests of the events of its path (or of a directory around it, or of
+ * a file inside it) held before it are known: the order of the events
+ * of a path is kept, the other paths do not wait.
+ */
+#define DIGEST_WORKERS 2
+
+/* bytes of the biggest file hashed, the bigger ones are always reported */
+#define DIGEST_MAX_SIZE (64 * 1024 * 1024)
+
+/* max number of events held, then cwatch waits for the workers */
+#define DIGEST_MAX_HELD 1024
+
+/* number of buckets of the table of the digests */
+#define DIGEST_BUCKETS 4096
+
+/* max number of files whose digest is kept, the others are always reported */
+#define DIGEST_MAX_FILES 65536
+
+/* used to store an event held until its turn */
+typedef struct digest_item_s
+{
+    char *directory;             /* directory of the event, with the trailing slash */
+    char *path;                  /* path of the event */
+    int hash;                    /* 1 if the file is hashed, 0 if the event only waits its turn */
+    int match;                   /* the event matches --include */
+    int changed;                 /* 1 if the content changed, set by the workers */
+    int done;                    /* 1 when the digest is known */
+    struct inotify_event *event; /* copy of the event */
+} DIGEST_ITEM;
+
+/* starts the workers, if they are not already running
+ *
+ * @return int : the descriptor that becomes readable when there are
+ *               events to release, -1 on error
+ */
+int digest_start();
+
+/* returns the descriptor that becomes readable when there are
+ * events to release
+ *
+ * @return int : -1 if the workers are not running
+ */
+int digest_descriptor();
+
+/* holds an event until its turn
+ *
+ * @param  const struct inotify_event * : the event, it is copied
+ * @param  const char *                 : directory of the event, with the trailing slash
+ * @param  int                          : the event matches --include
+ * @param  int                          : 1 if the file of the event has to be hashed
+ * @return int                          : 0 if success, -1 otherwise
+ */
+int digest_hold(const struct inotify_event *, const char *, int, int);
+
+/* returns 1 if the events of a path have to wait, since events of it
+ * are held
+ *
+ * @param  const char * : directory of the event, with the trailing slash
+ * @param  const char * : name of the file or directory, "" for none
+ * @return int
+ */
+int digest_waits(const char *, const char *);
+
+/* waits until the first event held can be released */
+void digest_wait();
+
+/* returns the number of events held
+ *
+ * @return int
+ */
+int digest_held();
+
+/* takes the events whose turn has come, in the order they were held
+ * for each path
+ *
+ * @return Queue * : queue of DIGEST_ITEM
+ */
+Queue *digest_release();
+
+/* hashes a file if needed, and remembers its digest.
+ * It is called by the workers.
+ *
+ * @param  const char * : path of the file
+ * @return int          : 1 if the content changed (or it is not known), 0 otherwise
+ */
+int digest_changed(const char *);
+
+/* forgets the digest of a file deleted or moved away, a hash in
+ * flight of the file does not put it back
+ *
+ * @param const char * : path of the file
+ */
+void digest_forget(const char *);
+
+/* returns the number of files whose digest is kept
+ *
+ * @return int
+ */
+int digest_files();
+
+/* hashes a buffer with XXH64, seed 0
+ *
+ * @param  const void * : data
+ * @param  size_t       : length of the data
+ * @return uint64_t
+ */
+uint64_t digest_of(const void *, size_t);
+
+/* deallocates an event held */
+void digest_free(DIGEST_ITEM *);
+
+#endif /* !__DIGEST_H */
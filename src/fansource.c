@@ -0,0 +1,336 @@
+/* fansource.c
+ * Filesystem-wide events through fanotify
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#ifdef HAVE_SYS_FANOTIFY_H
+#include <sys/fanotify.h>
+#endif
+
+#include "fansource.h"
+
+/* number of buckets of the cache of the paths */
+#define FANSOURCE_CACHE_BUCKETS 4096
+
+typedef struct fan_cache_entry_s
+{
+    void *handle;
+    size_t length;
+    char *path;
+    struct fan_cache_entry_s *next;
+} FAN_CACHE_ENTRY;
+
+static FAN_CACHE_ENTRY *cache[FANSOURCE_CACHE_BUCKETS];
+static int cache_qty = 0;
+
+static unsigned int hash_of(const void *handle, size_t length)
+{
+    const unsigned char *byte = (const unsigned char *)handle;
+    unsigned int hash = 2166136261u;
+
+    size_t i;
+    for (i = 0; i < length; ++i)
+        hash = (hash ^ byte[i]) * 16777619u;
+
+    return hash % FANSOURCE_CACHE_BUCKETS;
+}
+
+const char *fansource_cache_get(const void *handle, size_t length)
+{
+    FAN_CACHE_ENTRY *entry = cache[hash_of(handle, length)];
+    while (entry)
+    {
+        if (entry->length == length && memcmp(entry->handle, handle, length) == 0)
+            return entry->path;
+        entry = entry->next;
+    }
+
+    return NULL;
+}
+
+const char *fansource_cache_put(const void *handle, size_t length, const char *path)
+{
+    if (cache_qty >= FANSOURCE_CACHE_MAX)
+        fansource_cache_clear();
+
+    FAN_CACHE_ENTRY *entry = (FAN_CACHE_ENTRY *)malloc(sizeof(FAN_CACHE_ENTRY));
+    if (entry == NULL)
+        return NULL;
+
+    entry->handle = malloc(length);
+    entry->path = strdup(path);
+    if (entry->handle == NULL || entry->path == NULL)
+    {
+        free(entry->handle);
+        free(entry->path);
+        free(entry);
+        return NULL;
+    }
+
+    memcpy(entry->handle, handle, length);
+    entry->length = length;
+
+    unsigned int bucket = hash_of(handle, length);
+    entry->next = cache[bucket];
+    cache[bucket] = entry;
+    ++cache_qty;
+
+    return entry->path;
+}
+
+static void free_entry(FAN_CACHE_ENTRY *entry)
+{
+    free(entry->handle);
+    free(entry->path);
+    free(entry);
+}
+
+int fansource_cache_invalidate(const char *directory)
+{
+    size_t length = strlen(directory);
+    int dropped = 0;
+
+    int i;
+    for (i = 0; i < FANSOURCE_CACHE_BUCKETS; ++i)
+    {
+        FAN_CACHE_ENTRY **link = &cache[i];
+        while (*link)
+        {
+            FAN_CACHE_ENTRY *entry = *link;
+            if (strncmp(entry->path, directory, length) != 0)
+            {
+                link = &entry->next;
+                continue;
+            }
+
+            *link = entry->next;
+            free_entry(entry);
+            ++dropped;
+        }
+    }
+    cache_qty -= dropped;
+
+    return dropped;
+}
+
+void fansource_cache_clear()
+{
+    int i;
+    for (i = 0; i < FANSOURCE_CACHE_BUCKETS; ++i)
+    {
+        while (cache[i])
+        {
+            FAN_CACHE_ENTRY *entry = cache[i];
+            cache[i] = entry->next;
+            free_entry(entry);
+        }
+    }
+    cache_qty = 0;
+}
+
+#if defined(HAVE_SYS_FANOTIFY_H) && defined(FAN_REPORT_DFID_NAME)
+
+/* fanotify reports these events with the same bits of inotify */
+#define FANSOURCE_EVENTS (FAN_ACCESS | FAN_MODIFY | FAN_ATTRIB | FAN_CLOSE_WRITE | FAN_CLOSE_NOWRITE | FAN_OPEN | \
+                          FAN_MOVED_FROM | FAN_MOVED_TO | FAN_CREATE | FAN_DELETE | FAN_DELETE_SELF | FAN_MOVE_SELF)
+
+/* events that change the path of a directory */
+#define FANSOURCE_RENAMES (FAN_MOVED_FROM | FAN_MOVED_TO | FAN_DELETE)
+
+static int cache_stale = 0;
+static char *stale_directory = NULL; /* the directory renamed or deleted, NULL if unknown */
+static int mount_fd = -1;
+static char *root = NULL;
+
+uint32_t fansource_mask_for(uint32_t inotify_mask)
+{
+    /* the renames are always needed to keep the cache of the paths valid */
+    return (inotify_mask & FANSOURCE_EVENTS) | FANSOURCE_RENAMES | FAN_ONDIR;
+}
+
+int fansource_init(const char *path, uint32_t mask)
+{
+    char resolved[PATH_MAX];
+    if (realpath(path, resolved) == NULL)
+        return -1;
+
+    int fd = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_REPORT_DFID_NAME, O_RDONLY | O_LARGEFILE);
+    if (fd == -1)
+        return -1;
+
+    if (fanotify_mark(fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, mask, AT_FDCWD, resolved) == -1 ||
+        (mount_fd = open(resolved, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+    {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+
+    free(root);
+    root = (char *)malloc(strlen(resolved) + 2);
+    sprintf(root, "%s%s", resolved, (strcmp(resolved, "/") == 0) ? "" : "/");
+
+    return fd;
+}
+
+/* resolves the file handle of a directory to its path */
+static const char *directory_of(const struct fanotify_event_info_fid *fid, struct file_handle *handle)
+{
+    size_t length = sizeof(fid->fsid) + sizeof(struct file_handle) + handle->handle_bytes;
+
+    const char *path = fansource_cache_get(&fid->fsid, length);
+    if (path != NULL)
+        return path;
+
+    int dir_fd = open_by_handle_at(mount_fd, handle, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd == -1)
+        return NULL;
+
+    char link[64], resolved[PATH_MAX + 1];
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", dir_fd);
+
+    ssize_t resolved_length = readlink(link, resolved, PATH_MAX - 1);
+    close(dir_fd);
+
+    /* NOTE: the directory could be already gone */
+    if (resolved_length <= 0 || resolved[0] != '/')
+        return NULL;
+
+    if (resolved[resolved_length - 1] != '/')
+        resolved[resolved_length++] = '/';
+    resolved[resolved_length] = '\0';
+
+    return fansource_cache_put(&fid->fsid, length, resolved);
+}
+
+int fansource_next(const char *buffer, ssize_t len, ssize_t *offset, FAN_EVENT *event)
+{
+    /* a directory renamed by the previous event makes the paths below it wrong */
+    if (cache_stale)
+    {
+        if (stale_directory != NULL)
+            fansource_cache_invalidate(stale_directory);
+        else
+            fansource_cache_clear();
+
+        free(stale_directory);
+        stale_directory = NULL;
+        cache_stale = 0;
+    }
+
+    while (*offset < len)
+    {
+        const struct fanotify_event_metadata *metadata = (const struct fanotify_event_metadata *)(buffer + *offset);
+        ssize_t remaining = len - *offset;
+
+        if (!FAN_EVENT_OK(metadata, remaining))
+            return 0;
+
+        *offset += metadata->event_len;
+
+        if (metadata->fd >= 0)
+            close(metadata->fd);
+
+        if (metadata->mask & FAN_Q_OVERFLOW)
+        {
+            event->mask = IN_Q_OVERFLOW;
+            event->directory = root;
+            event->name = "";
+            return 1;
+        }
+
+        const struct fanotify_event_info_fid *fid = NULL;
+        const char *info = (const char *)metadata + metadata->metadata_len;
+        while (info < (const char *)metadata + metadata->event_len)
+        {
+            const struct fanotify_event_info_header *header = (const struct fanotify_event_info_header *)info;
+            if (header->info_type == FAN_EVENT_INFO_TYPE_DFID_NAME || header->info_type == FAN_EVENT_INFO_TYPE_DFID)
+            {
+                fid = (const struct fanotify_event_info_fid *)info;
+                break;
+            }
+            if (header->len == 0)
+                break;
+            info += header->len;
+        }
+
+        if (fid == NULL)
+            continue;
+
+        struct file_handle *handle = (struct file_handle *)fid->handle;
+        const char *name = "";
+        if (fid->hdr.info_type == FAN_EVENT_INFO_TYPE_DFID_NAME)
+            name = (const char *)handle->f_handle + handle->handle_bytes;
+
+        const char *directory = directory_of(fid, handle);
+
+        /* NOTE: the paths stay valid until the next call, they are dropped then */
+        if ((metadata->mask & FAN_ONDIR) && (metadata->mask & (FANSOURCE_RENAMES | FAN_MOVE_SELF | FAN_DELETE_SELF)))
+        {
+            cache_stale = 1;
+            if (directory != NULL && asprintf(&stale_directory, "%s%s%s", directory, name, (*name != '\0') ? "/" : "") == -1)
+                stale_directory = NULL;
+        }
+        if (directory == NULL || strncmp(directory, root, strlen(root)) != 0)
+            continue;
+
+        event->mask = (metadata->mask & FANSOURCE_EVENTS) | ((metadata->mask & FAN_ONDIR) ? IN_ISDIR : 0);
+        event->directory = directory;
+        event->name = name;
+        return 1;
+    }
+
+    return 0;
+}
+
+#else /* fanotify is not supported by the system */
+
+uint32_t fansource_mask_for(uint32_t inotify_mask)
+{
+    return 0;
+}
+
+int fansource_init(const char *path, uint32_t mask)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int fansource_next(const char *buffer, ssize_t len, ssize_t *offset, FAN_EVENT *event)
+{
+    return 0;
+}
+
+#endif
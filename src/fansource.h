@@ -0,0 +1,103 @@
+/* fansource.h
+ * Filesystem-wide events through fanotify
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#ifndef __FANSOURCE_H
+#define __FANSOURCE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* With CAP_SYS_ADMIN a single fanotify mark observes a whole filesystem.
+ * Events carry the file handle of the directory and the name of the entry
+ * (FAN_REPORT_DFID_NAME), so the handles are resolved to paths through a
+ * cache, and only the events below the given directory are reported.
+ */
+
+/* the cache of the paths is dropped when it grows beyond this size */
+#define FANSOURCE_CACHE_MAX 65536
+
+/* used to store an event read from fanotify */
+typedef struct fan_event_s
+{
+    uint32_t mask;         /* inotify mask of the event */
+    const char *directory; /* absolute real path of the directory, with the trailing slash */
+    const char *name;      /* name of the entry, "" for the directory itself */
+} FAN_EVENT;
+
+/* marks the filesystem of a directory
+ *
+ * @param  const char * : absolute path of the directory
+ * @param  uint32_t     : inotify mask of the events to report
+ * @return int          : the descriptor from which read the events, -1 on error
+ */
+int fansource_init(const char *, uint32_t);
+
+/* returns the fanotify mask equivalent to an inotify mask
+ *
+ * @param  uint32_t : inotify mask
+ * @return uint32_t : 0 if fanotify is not supported
+ */
+uint32_t fansource_mask_for(uint32_t);
+
+/* parses the next event of a buffer read from the descriptor.
+ * The paths are valid until the next call.
+ *
+ * @param  const char * : buffer
+ * @param  ssize_t      : length of the buffer
+ * @param  ssize_t *    : offset of the next event, updated
+ * @param  FAN_EVENT *  : where to store the event
+ * @return int          : 1 if an event has been stored, 0 at the end of the buffer
+ */
+int fansource_next(const char *, ssize_t, ssize_t *, FAN_EVENT *);
+
+/* returns the path cached for a file handle
+ *
+ * @param  const void * : file handle, prefixed with its fsid
+ * @param  size_t       : length of the file handle
+ * @return const char * : NULL if not cached
+ */
+const char *fansource_cache_get(const void *, size_t);
+
+/* stores the path of a file handle into the cache
+ *
+ * @param  const void * : file handle, prefixed with its fsid
+ * @param  size_t       : length of the file handle
+ * @param  const char * : path
+ * @return const char * : the cached path, NULL on error
+ */
+const char *fansource_cache_put(const void *, size_t, const char *);
+
+/* drops the paths of the cache below a directory, and the directory itself
+ *
+ * @param  const char * : absolute path of the directory, with the trailing slash
+ * @return int          : number of paths dropped
+ */
+int fansource_cache_invalidate(const char *);
+
+/* drops all the paths of the cache */
+void fansource_cache_clear();
+
+#endif /* !__FANSOURCE_H */
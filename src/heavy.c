@@ -0,0 +1,304 @@
+/* heavy.c
+ * Find the keys that occur the most in a stream, in fixed memory
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "heavy.h"
+
+typedef struct heavy_bucket_s HEAVY_BUCKET;
+
+typedef struct heavy_counter_s
+{
+    char *key;
+    unsigned long error;
+    HEAVY_BUCKET *bucket;
+    struct heavy_counter_s *prev; /* in the bucket */
+    struct heavy_counter_s *next;
+    struct heavy_counter_s *chain; /* in the table of the keys */
+} HEAVY_COUNTER;
+
+struct heavy_bucket_s
+{
+    unsigned long count;
+    HEAVY_COUNTER *counters;
+    struct heavy_bucket_s *prev; /* lower count */
+    struct heavy_bucket_s *next; /* higher count */
+};
+
+struct heavy_s
+{
+    int capacity;
+    int used;
+    unsigned long total;
+    HEAVY_COUNTER *counters;  /* capacity counters */
+    HEAVY_BUCKET *buckets;    /* capacity buckets, there is never more */
+    HEAVY_BUCKET *spare;      /* buckets not used, chained by next */
+    HEAVY_BUCKET *lowest;
+    HEAVY_BUCKET *highest;
+    HEAVY_COUNTER **table;
+    unsigned int table_size;  /* a power of 2, at least twice the capacity */
+};
+
+static unsigned int hash_of(const char *key)
+{
+    unsigned int hash = 2166136261u;
+
+    while (*key != '\0')
+        hash = (hash ^ (unsigned char)*key++) * 16777619u;
+
+    return hash;
+}
+
+static HEAVY_COUNTER **slot_of(HEAVY *heavy, const char *key)
+{
+    HEAVY_COUNTER **slot = &heavy->table[hash_of(key) & (heavy->table_size - 1)];
+
+    while (*slot && strcmp((*slot)->key, key) != 0)
+        slot = &(*slot)->chain;
+
+    return slot;
+}
+
+/* the bucket after the given one (the lowest if NULL), with a count */
+static HEAVY_BUCKET *new_bucket(HEAVY *heavy, HEAVY_BUCKET *after, unsigned long count)
+{
+    HEAVY_BUCKET *bucket = heavy->spare;
+    heavy->spare = bucket->next;
+
+    bucket->count = count;
+    bucket->counters = NULL;
+    bucket->prev = after;
+    bucket->next = (after != NULL) ? after->next : heavy->lowest;
+
+    if (bucket->prev != NULL)
+        bucket->prev->next = bucket;
+    else
+        heavy->lowest = bucket;
+
+    if (bucket->next != NULL)
+        bucket->next->prev = bucket;
+    else
+        heavy->highest = bucket;
+
+    return bucket;
+}
+
+static void put(HEAVY_BUCKET *bucket, HEAVY_COUNTER *counter)
+{
+    counter->bucket = bucket;
+    counter->prev = NULL;
+    counter->next = bucket->counters;
+    if (counter->next != NULL)
+        counter->next->prev = counter;
+    bucket->counters = counter;
+}
+
+/* takes a counter out of its bucket, an empty bucket goes back to the spare ones */
+static void take(HEAVY *heavy, HEAVY_COUNTER *counter)
+{
+    HEAVY_BUCKET *bucket = counter->bucket;
+
+    if (counter->prev != NULL)
+        counter->prev->next = counter->next;
+    else
+        bucket->counters = counter->next;
+
+    if (counter->next != NULL)
+        counter->next->prev = counter->prev;
+
+    if (bucket->counters != NULL)
+        return;
+
+    if (bucket->prev != NULL)
+        bucket->prev->next = bucket->next;
+    else
+        heavy->lowest = bucket->next;
+
+    if (bucket->next != NULL)
+        bucket->next->prev = bucket->prev;
+    else
+        heavy->highest = bucket->prev;
+
+    bucket->next = heavy->spare;
+    heavy->spare = bucket;
+}
+
+/* moves a counter into the bucket of the next count */
+static void increment(HEAVY *heavy, HEAVY_COUNTER *counter)
+{
+    HEAVY_BUCKET *bucket = counter->bucket;
+    unsigned long count = bucket->count + 1;
+
+    /* alone in its bucket, and no bucket of the next count */
+    if (bucket->counters == counter && counter->next == NULL && (bucket->next == NULL || bucket->next->count != count))
+    {
+        bucket->count = count;
+        return;
+    }
+
+    HEAVY_BUCKET *next = bucket->next;
+    if (next == NULL || next->count != count)
+        next = new_bucket(heavy, bucket, count);
+
+    take(heavy, counter);
+    put(next, counter);
+}
+
+HEAVY *heavy_init(int capacity)
+{
+    if (capacity < 1)
+        return NULL;
+
+    HEAVY *heavy = (HEAVY *)calloc(1, sizeof(HEAVY));
+    if (heavy == NULL)
+        return NULL;
+
+    heavy->capacity = capacity;
+    heavy->table_size = 1;
+    while (heavy->table_size < (unsigned int)capacity * 2)
+        heavy->table_size <<= 1;
+
+    heavy->counters = (HEAVY_COUNTER *)calloc(capacity, sizeof(HEAVY_COUNTER));
+    heavy->buckets = (HEAVY_BUCKET *)calloc(capacity, sizeof(HEAVY_BUCKET));
+    heavy->table = (HEAVY_COUNTER **)calloc(heavy->table_size, sizeof(HEAVY_COUNTER *));
+    if (heavy->counters == NULL || heavy->buckets == NULL || heavy->table == NULL)
+    {
+        heavy_free(heavy);
+        return NULL;
+    }
+
+    heavy_reset(heavy);
+
+    return heavy;
+}
+
+void heavy_count(HEAVY *heavy, const char *key)
+{
+    HEAVY_COUNTER **slot = slot_of(heavy, key);
+    HEAVY_COUNTER *counter = *slot;
+
+    ++heavy->total;
+
+    if (counter != NULL)
+    {
+        increment(heavy, counter);
+        return;
+    }
+
+    char *copy = strdup(key);
+    if (copy == NULL)
+        return;
+
+    if (heavy->used < heavy->capacity)
+    {
+        counter = &heavy->counters[heavy->used++];
+        counter->key = copy;
+        counter->error = 0;
+
+        HEAVY_BUCKET *lowest = heavy->lowest;
+        if (lowest == NULL || lowest->count != 1)
+            lowest = new_bucket(heavy, NULL, 1);
+
+        put(lowest, counter);
+    }
+    else
+    {
+        /* the key takes the place of one of the lowest, and its count */
+        counter = heavy->lowest->counters;
+
+        HEAVY_COUNTER **victim = slot_of(heavy, counter->key);
+        *victim = counter->chain;
+        free(counter->key);
+
+        counter->key = copy;
+        counter->error = counter->bucket->count;
+        increment(heavy, counter);
+
+        /* the chain could have changed */
+        slot = slot_of(heavy, key);
+    }
+
+    counter->chain = NULL;
+    *slot = counter;
+}
+
+int heavy_top(HEAVY *heavy, HEAVY_ITEM *items, int qty)
+{
+    int i = 0;
+    HEAVY_BUCKET *bucket;
+    HEAVY_COUNTER *counter;
+
+    for (bucket = heavy->highest; bucket != NULL && i < qty; bucket = bucket->prev)
+    {
+        for (counter = bucket->counters; counter != NULL && i < qty; counter = counter->next, ++i)
+        {
+            items[i].key = counter->key;
+            items[i].count = bucket->count;
+            items[i].error = counter->error;
+        }
+    }
+
+    return i;
+}
+
+unsigned long heavy_total(HEAVY *heavy)
+{
+    return heavy->total;
+}
+
+void heavy_reset(HEAVY *heavy)
+{
+    int i;
+    for (i = 0; i < heavy->used; ++i)
+        free(heavy->counters[i].key);
+
+    memset(heavy->table, 0, heavy->table_size * sizeof(HEAVY_COUNTER *));
+
+    heavy->spare = NULL;
+    for (i = heavy->capacity - 1; i >= 0; --i)
+    {
+        heavy->buckets[i].next = heavy->spare;
+        heavy->spare = &heavy->buckets[i];
+    }
+
+    heavy->used = 0;
+    heavy->total = 0;
+    heavy->lowest = heavy->highest = NULL;
+}
+
+void heavy_free(HEAVY *heavy)
+{
+    if (heavy == NULL)
+        return;
+
+    if (heavy->counters != NULL && heavy->buckets != NULL && heavy->table != NULL)
+        heavy_reset(heavy);
+
+    free(heavy->counters);
+    free(heavy->buckets);
+    free(heavy->table);
+    free(heavy);
+}
@@ -0,0 +1,93 @@
+/* heavy.h
+ * Find the keys that occur the most in a stream, in fixed memory
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#ifndef __HEAVY_H
+#define __HEAVY_H
+
+/* The keys are counted with the Space-Saving algorithm: a fixed number of
+ * counters, and a key not counted yet takes the counter of the key with
+ * the lowest count, inheriting its count as an overestimation (error).
+ * Every key that occurs more than total / counters times has a counter.
+ *
+ * The counters are kept in buckets of the same count, sorted by count,
+ * so a key is counted in O(1) (Stream-Summary).
+ */
+
+/* counters per key reported, for the estimation to be good enough */
+#define HEAVY_COUNTERS_PER_KEY 8
+
+typedef struct heavy_s HEAVY;
+
+/* used to report a key */
+typedef struct heavy_item_s
+{
+    const char *key;     /* owned by the tracker, valid until the next heavy_count() */
+    unsigned long count; /* occurrences counted, at most error more than the real ones */
+    unsigned long error; /* max overestimation of the count */
+} HEAVY_ITEM;
+
+/* creates a tracker
+ *
+ * @param  int     : number of counters
+ * @return HEAVY * : NULL on error
+ */
+HEAVY *heavy_init(int);
+
+/* counts an occurrence of a key
+ *
+ * @param HEAVY *      : tracker
+ * @param const char * : key, it is copied
+ */
+void heavy_count(HEAVY *, const char *);
+
+/* returns the keys with the highest counts, the highest first
+ *
+ * @param  HEAVY *      : tracker
+ * @param  HEAVY_ITEM * : array filled with the keys
+ * @param  int          : size of the array
+ * @return int          : number of keys reported
+ */
+int heavy_top(HEAVY *, HEAVY_ITEM *, int);
+
+/* returns the number of occurrences counted
+ *
+ * @param  HEAVY *       : tracker
+ * @return unsigned long
+ */
+unsigned long heavy_total(HEAVY *);
+
+/* forgets all the counts
+ *
+ * @param HEAVY * : tracker
+ */
+void heavy_reset(HEAVY *);
+
+/* deallocates a tracker
+ *
+ * @param HEAVY * : tracker
+ */
+void heavy_free(HEAVY *);
+
+#endif /* !__HEAVY_H */
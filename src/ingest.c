@@ -0,0 +1,329 @@
+/* ingest.c
+ * Watch large directory trees on background threads
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "ingest.h"
+#include "probes.h"
+
+static Queue *to_visit = NULL;   /* queue of INGEST_DIR */
+static Queue *to_collect = NULL; /* queue of INGEST_DIR */
+static int in_progress = 0;      /* directories to visit or collect */
+static pthread_mutex_t ingest_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ingest_cond = PTHREAD_COND_INITIALIZER;
+static int notify_pipe[2] = {-1, -1};
+static int watch_fd = -1;
+static int (*add_watch)(int, const char *, uint32_t) = NULL;
+static ingest_accept_t accept_entry = NULL;
+static char *added = NULL;   /* by wd, 1 if added by the workers and not collected yet */
+static int added_size = 0;
+
+/* marks a watch descriptor added by the workers, making the table grow when needed */
+static int table_set(int wd, char value)
+{
+    if (wd < 0)
+        return -1;
+
+    if (wd >= added_size)
+    {
+        int new_size = (added_size == 0) ? 64 : added_size;
+        while (new_size <= wd)
+            new_size *= 2;
+
+        char *bigger = (char *)realloc(added, new_size);
+        if (bigger == NULL)
+            return -1;
+
+        memset(bigger + added_size, 0, new_size - added_size);
+        added = bigger;
+        added_size = new_size;
+    }
+
+    added[wd] = value;
+    return 0;
+}
+
+static int table_get(int wd)
+{
+    return (wd >= 0 && wd < added_size) ? added[wd] : 0;
+}
+
+/* wakes up cwatch, a full pipe is already enough to wake it up */
+static void notify()
+{
+    if (write(notify_pipe[1], "", 1) == -1)
+        return;
+}
+
+void ingest_free(INGEST_DIR *dir)
+{
+    if (dir == NULL)
+        return;
+
+    if (dir->created != NULL)
+    {
+        char *name;
+        while ((name = (char *)queue_dequeue(dir->created)))
+            free(name);
+        queue_free(dir->created);
+    }
+
+    free(dir->path);
+    free(dir->symlink);
+    free(dir);
+}
+
+static char *join(const char *directory, const char *name, const char *suffix)
+{
+    char *path = (char *)malloc(strlen(directory) + strlen(name) + strlen(suffix) + 1);
+    if (path != NULL)
+        sprintf(path, "%s%s%s", directory, name, suffix);
+
+    return path;
+}
+
+/* tells whether an entry of a directory was born after a time. Without
+ * the birth time, the time of its last change is the closest one.
+ */
+static int born_after(DIR *dir_stream, const char *name, const struct timespec *since)
+{
+    struct statx stx;
+    if (statx(dirfd(dir_stream), name, AT_SYMLINK_NOFOLLOW, STATX_BTIME | STATX_CTIME, &stx) == -1)
+        return 0;
+
+    struct statx_timestamp *born = (stx.stx_mask & STATX_BTIME) ? &stx.stx_btime : &stx.stx_ctime;
+
+    return born->tv_sec > since->tv_sec || (born->tv_sec == since->tv_sec && born->tv_nsec >= since->tv_nsec);
+}
+
+/* lists a directory, the directories found are queued to visit and
+ * the symbolic links to collect. Returns the number of them.
+ * With report, the entries born after the ingest started are
+ * collected with the directory.
+ */
+static int visit(INGEST_DIR *dir, Queue *found, int report)
+{
+    CWATCH_PROBE2(walk__directory, dir->path, dir->depth);
+
+    DIR *dir_stream = opendir(dir->path);
+    if (dir_stream == NULL)
+        return 0;
+
+    int qty = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir_stream)))
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        if (report && born_after(dir_stream, entry->d_name, &dir->since))
+        {
+            if (dir->created == NULL)
+                dir->created = queue_init();
+            char *name = join(entry->d_name, "", (entry->d_type == DT_DIR) ? "/" : "");
+            if (dir->created != NULL && name != NULL)
+                queue_enqueue(dir->created, name);
+            else
+                free(name);
+        }
+
+        if (entry->d_type != DT_DIR && entry->d_type != DT_LNK)
+            continue;
+
+        INGEST_DIR *child = (INGEST_DIR *)calloc(1, sizeof(INGEST_DIR));
+        if (child == NULL)
+            break;
+
+        child->wd = -1;
+        child->since = dir->since;
+        if (!accept_entry(dir, entry->d_name, entry->d_type, child))
+        {
+            free(child);
+            continue;
+        }
+
+        if (entry->d_type == DT_DIR)
+            child->path = join(dir->path, entry->d_name, "/");
+        else
+            child->symlink = join(dir->path, entry->d_name, "");
+
+        queue_enqueue(found, child);
+        ++qty;
+    }
+    closedir(dir_stream);
+
+    return qty;
+}
+
+static void *ingest_worker(void *arg)
+{
+    Queue *found = queue_init();
+
+    while (1)
+    {
+        pthread_mutex_lock(&ingest_mutex);
+        while (to_visit->first == NULL)
+            pthread_cond_wait(&ingest_cond, &ingest_mutex);
+        INGEST_DIR *dir = (INGEST_DIR *)queue_dequeue(to_visit);
+        pthread_mutex_unlock(&ingest_mutex);
+
+        /* NOTE: watch before listing, so no entry is lost. The watch is
+         * marked before cwatch can ask about its first event.
+         */
+        int report = (dir->wd == -1 && dir->since.tv_sec != 0);
+        if (dir->wd == -1)
+        {
+            pthread_mutex_lock(&ingest_mutex);
+            dir->wd = add_watch(watch_fd, dir->path, dir->mask);
+            table_set(dir->wd, 1);
+            pthread_mutex_unlock(&ingest_mutex);
+        }
+
+        int qty = (dir->wd == -1) ? 0 : visit(dir, found, report);
+
+        pthread_mutex_lock(&ingest_mutex);
+        in_progress += qty;
+        while (found->first != NULL)
+        {
+            INGEST_DIR *child = (INGEST_DIR *)queue_dequeue(found);
+            queue_enqueue((child->symlink != NULL) ? to_collect : to_visit, child);
+        }
+        queue_enqueue(to_collect, dir);
+        if (qty > 0)
+            pthread_cond_broadcast(&ingest_cond);
+        pthread_mutex_unlock(&ingest_mutex);
+
+        notify();
+    }
+
+    return NULL;
+}
+
+int ingest_start(int fd, int (*add)(int, const char *, uint32_t), ingest_accept_t accept)
+{
+    if (notify_pipe[0] != -1)
+        return notify_pipe[0];
+
+    watch_fd = fd;
+    add_watch = add;
+    accept_entry = accept;
+    to_visit = queue_init();
+    to_collect = queue_init();
+
+    if (to_visit == NULL || to_collect == NULL || pipe2(notify_pipe, O_NONBLOCK | O_CLOEXEC) == -1)
+        return -1;
+
+    int i;
+    for (i = 0; i < INGEST_WORKERS; ++i)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, ingest_worker, NULL) != 0)
+            break;
+        pthread_detach(thread);
+    }
+
+    if (i == 0)
+    {
+        close(notify_pipe[0]);
+        close(notify_pipe[1]);
+        notify_pipe[0] = notify_pipe[1] = -1;
+        return -1;
+    }
+
+    return notify_pipe[0];
+}
+
+int ingest_descriptor()
+{
+    return notify_pipe[0];
+}
+
+int ingest_subtree(INGEST_DIR *dir)
+{
+    if (notify_pipe[0] == -1)
+        return -1;
+
+    pthread_mutex_lock(&ingest_mutex);
+    ++in_progress;
+    queue_enqueue(to_visit, dir);
+    pthread_cond_signal(&ingest_cond);
+    pthread_mutex_unlock(&ingest_mutex);
+
+    return 0;
+}
+
+Queue *ingest_collect(int max, int *left)
+{
+    Queue *collected = queue_init();
+    char drain[256];
+
+    /* NOTE: drain before collecting, so a notification is never lost */
+    while (read(notify_pipe[0], drain, sizeof(drain)) > 0)
+        ;
+
+    pthread_mutex_lock(&ingest_mutex);
+    while (max-- > 0 && to_collect->first != NULL)
+    {
+        INGEST_DIR *dir = (INGEST_DIR *)queue_dequeue(to_collect);
+        table_set(dir->wd, 0);
+        queue_enqueue(collected, dir);
+        --in_progress;
+    }
+    *left = in_progress;
+
+    /* come back for the rest */
+    if (to_collect->first != NULL)
+        notify();
+    pthread_mutex_unlock(&ingest_mutex);
+
+    return collected;
+}
+
+int ingest_in_progress()
+{
+    pthread_mutex_lock(&ingest_mutex);
+    int left = in_progress;
+    pthread_mutex_unlock(&ingest_mutex);
+
+    return left;
+}
+
+int ingest_pending(int wd)
+{
+    pthread_mutex_lock(&ingest_mutex);
+    int pending = table_get(wd);
+    pthread_mutex_unlock(&ingest_mutex);
+
+    return pending;
+}
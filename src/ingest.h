@@ -0,0 +1,124 @@
+/* ingest.h
+ * Watch large directory trees on background threads
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#ifndef __INGEST_H
+#define __INGEST_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "queue.h"
+#include "pathglob.h"
+
+/* A directory tree moved into the watched one can be huge. Its
+ * directories are listed and watched by a pool of worker threads,
+ * while cwatch keeps handling the events. The directories watched by
+ * the workers are collected in batches and added to the watch list.
+ */
+#define INGEST_WORKERS 4
+
+/* max number of directories collected at once */
+#define INGEST_BATCH 1024
+
+/* The entries born after the ingest started, in the directories the
+ * workers watch, could be created before their watch: the workers
+ * collect them to be reported as created, as a walk does.
+ */
+
+/* used to store a directory found by the workers */
+typedef struct ingest_dir_s
+{
+    char *path;                     /* absolute real path, with the trailing slash */
+    char *symlink;                  /* a symbolic link found, not visited (path is NULL) */
+    int depth;                      /* levels below the watched directory */
+    pathglob_state_t include_state; /* states of the --include automaton */
+    uint32_t mask;                  /* events to watch */
+    int wd;                         /* watch descriptor, -1 if the watch failed */
+    struct timespec since;          /* when the ingest started, 0 not to collect the entries born after */
+    Queue *created;                 /* names of the entries born after since, the directories with a trailing slash */
+} INGEST_DIR;
+
+/* decides whether an entry of a directory has to be visited,
+ * filling its depth, include_state and mask.
+ * It is called by the workers.
+ *
+ * @param  const INGEST_DIR * : the directory
+ * @param  const char *       : name of the entry
+ * @param  unsigned char      : type of the entry (DT_DIR or DT_LNK)
+ * @param  INGEST_DIR *       : the entry
+ * @return int                : 1 to visit the entry, 0 otherwise
+ */
+typedef int (*ingest_accept_t)(const INGEST_DIR *, const char *, unsigned char, INGEST_DIR *);
+
+/* starts the workers, if they are not already running
+ *
+ * @param  int             : inotify file descriptor
+ * @param  int (*)(int, const char *, uint32_t) : adds a watch, as inotify_add_watch
+ * @param  ingest_accept_t : decides which entries to visit
+ * @return int             : the descriptor that becomes readable when
+ *                           there are directories to collect, -1 on error
+ */
+int ingest_start(int, int (*)(int, const char *, uint32_t), ingest_accept_t);
+
+/* returns the descriptor that becomes readable when there are
+ * directories to collect
+ *
+ * @return int : -1 if the workers are not running
+ */
+int ingest_descriptor();
+
+/* visits a directory already watched, and all the directories below it
+ *
+ * @param  INGEST_DIR * : the directory, the workers take its ownership
+ * @return int          : 0 if success, -1 otherwise
+ */
+int ingest_subtree(INGEST_DIR *);
+
+/* takes the directories watched by the workers so far
+ *
+ * @param  int   : max number of directories to take
+ * @param  int * : where to store the directories still to visit or collect
+ * @return Queue * : queue of INGEST_DIR
+ */
+Queue *ingest_collect(int, int *);
+
+/* returns the number of directories still to visit or collect
+ *
+ * @return int
+ */
+int ingest_in_progress();
+
+/* tells whether a watch descriptor was added by the workers, and its
+ * directory is not collected yet: its events have to wait for it
+ *
+ * @param  int : watch descriptor
+ * @return int : 1 if so, 0 otherwise
+ */
+int ingest_pending(int);
+
+/* deallocates a directory found by the workers */
+void ingest_free(INGEST_DIR *);
+
+#endif /* !__INGEST_H */
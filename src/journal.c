@@ -0,0 +1,549 @@
+/* journal.c
+ * Append-only binary journal of the events
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "journal.h"
+
+#define JOURNAL_ALIGN(length) (((length) + 7) & ~((size_t)7))
+
+/* the buffer filled by cwatch and the one written by the writer */
+typedef struct journal_buffer_s
+{
+    char *data;
+    size_t length;
+} JOURNAL_BUFFER;
+
+static char *journal_directory = NULL;
+static off_t max_size;
+static time_t max_age;
+static journal_fsync_t fsync_policy;
+
+static pthread_mutex_t journal_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t journal_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t written_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t writer;
+static JOURNAL_BUFFER buffers[2];
+static JOURNAL_BUFFER *filling = NULL;
+static uint64_t last_sequence = 0;
+static uint64_t dropped = 0;
+static uint64_t swapped = 0; /* batches taken by the writer */
+static uint64_t written = 0; /* batches done by the writer */
+static int stopping = 0;
+
+/* state of the writer thread only */
+static int segment_fd = -1;
+static off_t segment_size = 0;
+static time_t segment_created_at = 0;
+static time_t synced_at = 0;
+
+static int64_t now_ns(clockid_t clock)
+{
+    struct timespec now;
+    clock_gettime(clock, &now);
+
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static int is_segment(const char *name)
+{
+    size_t length = strlen(name);
+    size_t suffix_len = strlen(JOURNAL_SUFFIX);
+
+    return (length > suffix_len && strcmp(name + length - suffix_len, JOURNAL_SUFFIX) == 0) ? 1 : 0;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* lists the segments of a journal, sorted by their first sequence number */
+static int list_segments(const char *directory, char ***segments)
+{
+    DIR *dir_stream = opendir(directory);
+    if (dir_stream == NULL)
+        return -1;
+
+    int qty = 0;
+    int size = 16;
+    *segments = (char **)malloc(size * sizeof(char *));
+
+    struct dirent *entry;
+    while (*segments != NULL && (entry = readdir(dir_stream)))
+    {
+        if (!is_segment(entry->d_name))
+            continue;
+
+        if (qty == size)
+        {
+            size *= 2;
+            char **more = (char **)realloc(*segments, size * sizeof(char *));
+            if (more == NULL)
+                break;
+            *segments = more;
+        }
+        (*segments)[qty++] = strdup(entry->d_name);
+    }
+    closedir(dir_stream);
+
+    if (*segments == NULL)
+        return -1;
+
+    /* NOTE: names are zero padded, the order of the names is the one of the sequences */
+    qsort(*segments, qty, sizeof(char *), compare_names);
+    return qty;
+}
+
+static int open_segment(uint64_t first_sequence)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%020" PRIu64 "%s", journal_directory, first_sequence, JOURNAL_SUFFIX);
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1)
+        return -1;
+
+    JOURNAL_SEGMENT_HEADER header;
+    memset(&header, 0, sizeof(header));
+    header.magic = JOURNAL_MAGIC;
+    header.version = JOURNAL_VERSION;
+    header.first_sequence = first_sequence;
+    header.created_at = now_ns(CLOCK_REALTIME);
+    header.monotonic_at = now_ns(CLOCK_MONOTONIC);
+
+    if (write(fd, &header, sizeof(header)) != sizeof(header))
+    {
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+
+    segment_size = sizeof(header);
+    segment_created_at = time(NULL);
+
+    return fd;
+}
+
+static void close_segment()
+{
+    if (segment_fd == -1)
+        return;
+
+    if (fsync_policy != JOURNAL_FSYNC_NONE)
+        fdatasync(segment_fd);
+
+    close(segment_fd);
+    segment_fd = -1;
+}
+
+/* counts the records of a batch not written */
+static void drop_batch(JOURNAL_BUFFER *batch)
+{
+    uint64_t qty = 0;
+    size_t offset;
+    for (offset = 0; offset < batch->length; offset += ((const JOURNAL_RECORD *)(batch->data + offset))->length)
+        ++qty;
+
+    pthread_mutex_lock(&journal_mutex);
+    dropped += qty;
+    pthread_mutex_unlock(&journal_mutex);
+}
+
+/* writes a batch of records, rotating the segment first if needed */
+static void write_batch(JOURNAL_BUFFER *batch)
+{
+    if (batch->length == 0)
+        return;
+
+    if (segment_fd != -1 && (segment_size >= max_size || time(NULL) - segment_created_at >= max_age))
+        close_segment();
+
+    if (segment_fd == -1)
+    {
+        const JOURNAL_RECORD *first = (const JOURNAL_RECORD *)batch->data;
+        if ((segment_fd = open_segment(first->sequence)) == -1)
+        {
+            fprintf(stderr, "JOURNAL: unable to open a segment in \"%s\" -> %d\n", journal_directory, errno);
+            drop_batch(batch);
+            return;
+        }
+    }
+
+    size_t done = 0;
+    while (done < batch->length)
+    {
+        ssize_t length = write(segment_fd, batch->data + done, batch->length - done);
+        if (length == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            /* NOTE: a record half written would end the segment for the readers,
+             *       it is cut at the last batch written and the next batch starts a new one
+             */
+            fprintf(stderr, "JOURNAL: unable to write a segment in \"%s\" -> %d\n", journal_directory, errno);
+            if (ftruncate(segment_fd, segment_size) == -1)
+                fprintf(stderr, "JOURNAL: unable to truncate a segment in \"%s\" -> %d\n", journal_directory, errno);
+            close_segment();
+            drop_batch(batch);
+            return;
+        }
+        done += length;
+    }
+    segment_size += done;
+
+    if (fsync_policy == JOURNAL_FSYNC_BATCH || (fsync_policy == JOURNAL_FSYNC_SECOND && time(NULL) != synced_at))
+    {
+        fdatasync(segment_fd);
+        synced_at = time(NULL);
+    }
+}
+
+static void *journal_writer(void *arg)
+{
+    pthread_mutex_lock(&journal_mutex);
+    while (1)
+    {
+        if (filling->length == 0 && !stopping)
+        {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += JOURNAL_FLUSH_MS * 1000000;
+            if (deadline.tv_nsec >= 1000000000)
+            {
+                deadline.tv_sec += 1;
+                deadline.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&journal_cond, &journal_mutex, &deadline);
+        }
+
+        if (filling->length == 0 && stopping)
+            break;
+
+        /* swap the buffers: cwatch fills the other one while this is written */
+        JOURNAL_BUFFER *batch = filling;
+        filling = (filling == &buffers[0]) ? &buffers[1] : &buffers[0];
+        ++swapped;
+        pthread_mutex_unlock(&journal_mutex);
+
+        write_batch(batch);
+        batch->length = 0;
+
+        pthread_mutex_lock(&journal_mutex);
+        ++written;
+        pthread_cond_broadcast(&written_cond);
+    }
+    pthread_mutex_unlock(&journal_mutex);
+
+    close_segment();
+    return NULL;
+}
+
+/* returns the last sequence number written in the last segment, 0 if none */
+static uint64_t last_sequence_of(const char *directory, const char *segment)
+{
+    uint64_t first = strtoull(segment, NULL, 10);
+    uint64_t last = (first > 0) ? first - 1 : 0;
+
+    /* a reader from the first sequence number of the segment starts right from it */
+    JOURNAL_READER *reader = journal_reader_open(directory, first);
+    if (reader == NULL)
+        return 0;
+
+    const JOURNAL_RECORD *record;
+    while ((record = journal_reader_next(reader)) != NULL)
+        last = record->sequence;
+    journal_reader_close(reader);
+
+    return last;
+}
+
+int journal_start(const char *directory, off_t size, time_t age, journal_fsync_t policy)
+{
+    if (journal_directory != NULL)
+        return 0;
+
+    if (mkdir(directory, 0755) == -1 && errno != EEXIST)
+        return -1;
+
+    char **segments = NULL;
+    int qty = list_segments(directory, &segments);
+    if (qty == -1)
+        return -1;
+
+    last_sequence = (qty > 0) ? last_sequence_of(directory, segments[qty - 1]) : 0;
+
+    while (qty > 0)
+        free(segments[--qty]);
+    free(segments);
+
+    buffers[0].data = (char *)malloc(JOURNAL_BUFFER_MAX);
+    buffers[1].data = (char *)malloc(JOURNAL_BUFFER_MAX);
+    buffers[0].length = buffers[1].length = 0;
+    if (buffers[0].data == NULL || buffers[1].data == NULL)
+    {
+        free(buffers[0].data);
+        free(buffers[1].data);
+        return -1;
+    }
+
+    journal_directory = strdup(directory);
+    max_size = size;
+    max_age = age;
+    fsync_policy = policy;
+    filling = &buffers[0];
+    stopping = 0;
+    dropped = 0;
+    swapped = written = 0;
+
+    if (pthread_create(&writer, NULL, journal_writer, NULL) != 0)
+    {
+        free(journal_directory);
+        journal_directory = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+uint64_t journal_last_sequence()
+{
+    return last_sequence;
+}
+
+int journal_append(uint64_t sequence, uint32_t mask, uint32_t cookie, const char *directory, const char *name)
+{
+    size_t directory_len = strlen(directory);
+    size_t name_len = strlen(name);
+    size_t length = JOURNAL_ALIGN(sizeof(JOURNAL_RECORD) + directory_len + name_len + 1);
+    uint64_t timestamp = now_ns(CLOCK_MONOTONIC);
+
+    pthread_mutex_lock(&journal_mutex);
+
+    if (journal_directory == NULL)
+    {
+        pthread_mutex_unlock(&journal_mutex);
+        return -1;
+    }
+
+    /* NOTE: cwatch never waits for the disk, the sequence number is the trace of a drop */
+    if (filling->length + length > JOURNAL_BUFFER_MAX)
+    {
+        ++dropped;
+        pthread_mutex_unlock(&journal_mutex);
+        return -1;
+    }
+
+    JOURNAL_RECORD *record = (JOURNAL_RECORD *)(filling->data + filling->length);
+    record->length = length;
+    record->mask = mask;
+    record->sequence = sequence;
+    record->timestamp = timestamp;
+    record->cookie = cookie;
+    record->path_len = directory_len + name_len;
+
+    char *path = (char *)(record + 1);
+    memcpy(path, directory, directory_len);
+    memcpy(path + directory_len, name, name_len);
+    memset(path + record->path_len, 0, length - sizeof(JOURNAL_RECORD) - record->path_len);
+
+    filling->length += length;
+    if (filling->length >= JOURNAL_BATCH_BYTES)
+        pthread_cond_signal(&journal_cond);
+
+    last_sequence = sequence;
+    pthread_mutex_unlock(&journal_mutex);
+
+    return 0;
+}
+
+void journal_flush()
+{
+    pthread_mutex_lock(&journal_mutex);
+    if (journal_directory != NULL)
+    {
+        /* the batch being written, and the one being filled if any */
+        uint64_t batch = (filling->length > 0) ? swapped + 1 : swapped;
+        pthread_cond_signal(&journal_cond);
+        while (written < batch)
+            pthread_cond_wait(&written_cond, &journal_mutex);
+    }
+    pthread_mutex_unlock(&journal_mutex);
+}
+
+void journal_stop()
+{
+    if (journal_directory == NULL)
+        return;
+
+    pthread_mutex_lock(&journal_mutex);
+    stopping = 1;
+    pthread_cond_signal(&journal_cond);
+    pthread_mutex_unlock(&journal_mutex);
+
+    pthread_join(writer, NULL);
+
+    pthread_mutex_lock(&journal_mutex);
+    free(buffers[0].data);
+    free(buffers[1].data);
+    buffers[0].data = buffers[1].data = NULL;
+    free(journal_directory);
+    journal_directory = NULL;
+    pthread_mutex_unlock(&journal_mutex);
+}
+
+uint64_t journal_dropped()
+{
+    pthread_mutex_lock(&journal_mutex);
+    uint64_t qty = dropped;
+    pthread_mutex_unlock(&journal_mutex);
+
+    return qty;
+}
+
+JOURNAL_READER *journal_reader_open(const char *directory, uint64_t from)
+{
+    JOURNAL_READER *reader = (JOURNAL_READER *)calloc(1, sizeof(JOURNAL_READER));
+    if (reader == NULL)
+        return NULL;
+
+    if ((reader->qty = list_segments(directory, &reader->segments)) == -1)
+    {
+        free(reader);
+        return NULL;
+    }
+
+    reader->directory = strdup(directory);
+    reader->from = from;
+    reader->current = -1;
+
+    /* start from the last segment that begins before the first sequence number */
+    int i;
+    for (i = 0; i < reader->qty; ++i)
+    {
+        if (strtoull(reader->segments[i], NULL, 10) > from)
+            break;
+        reader->current = i - 1;
+    }
+
+    return reader;
+}
+
+/* maps the next segment of a reader, returns 0 if there are no more */
+static int map_next_segment(JOURNAL_READER *reader)
+{
+    while (1)
+    {
+        if (reader->map != NULL)
+            munmap(reader->map, reader->size);
+        reader->map = NULL;
+
+        if (++reader->current >= reader->qty)
+            return 0;
+
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", reader->directory, reader->segments[reader->current]);
+
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            continue;
+
+        struct stat st;
+        if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(JOURNAL_SEGMENT_HEADER))
+        {
+            close(fd);
+            continue;
+        }
+
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+            continue;
+
+        const JOURNAL_SEGMENT_HEADER *header = (const JOURNAL_SEGMENT_HEADER *)map;
+        if (header->magic != JOURNAL_MAGIC || header->version != JOURNAL_VERSION)
+        {
+            munmap(map, st.st_size);
+            continue;
+        }
+
+        reader->map = map;
+        reader->size = st.st_size;
+        reader->offset = sizeof(JOURNAL_SEGMENT_HEADER);
+        return 1;
+    }
+}
+
+const JOURNAL_RECORD *journal_reader_next(JOURNAL_READER *reader)
+{
+    while (1)
+    {
+        if (reader->map == NULL && !map_next_segment(reader))
+            return NULL;
+
+        /* NOTE: the tail of a segment could be torn by a crash */
+        const JOURNAL_RECORD *record = (const JOURNAL_RECORD *)((const char *)reader->map + reader->offset);
+        if (reader->offset + sizeof(JOURNAL_RECORD) > reader->size ||
+            record->length < sizeof(JOURNAL_RECORD) + record->path_len + 1 ||
+            record->length > reader->size - reader->offset)
+        {
+            munmap(reader->map, reader->size);
+            reader->map = NULL;
+            continue;
+        }
+
+        reader->offset += record->length;
+        if (record->sequence >= reader->from)
+            return record;
+    }
+}
+
+void journal_reader_close(JOURNAL_READER *reader)
+{
+    if (reader == NULL)
+        return;
+
+    if (reader->map != NULL)
+        munmap(reader->map, reader->size);
+
+    while (reader->qty > 0)
+        free(reader->segments[--reader->qty]);
+    free(reader->segments);
+    free(reader->directory);
+    free(reader);
+}
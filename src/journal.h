@@ -0,0 +1,165 @@
+/* journal.h
+ * Append-only binary journal of the events
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#ifndef __JOURNAL_H
+#define __JOURNAL_H
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+/* The journal (--journal) keeps every event reported by cwatch in a
+ * directory of segment files. cwatch only copies the events into a
+ * buffer: a writer thread appends the buffer to the current segment,
+ * so a whole batch is written, and synced, at once (group commit).
+ * A segment is named after the sequence number of its first event and
+ * it is rotated by size and by age.
+ *
+ * A segment is a JOURNAL_SEGMENT_HEADER followed by JOURNAL_RECORDs,
+ * each one followed by its path. Records are aligned to 8 bytes, so a
+ * segment can be mapped and read as it is.
+ */
+#define JOURNAL_MAGIC 0x4a575743 /* "CWWJ" */
+#define JOURNAL_VERSION 1
+#define JOURNAL_SUFFIX ".cwj"
+
+/* default limits of a segment */
+#define JOURNAL_DEFAULT_MAX_SIZE (64 * 1024 * 1024)
+#define JOURNAL_DEFAULT_MAX_AGE 3600
+
+/* bytes of events buffered while the writer is busy, beyond them
+ * the events are dropped (their sequence numbers are skipped)
+ */
+#define JOURNAL_BUFFER_MAX (8 * 1024 * 1024)
+
+/* the writer wakes up when this many bytes are buffered, or after
+ * JOURNAL_FLUSH_MS milliseconds
+ */
+#define JOURNAL_BATCH_BYTES (256 * 1024)
+#define JOURNAL_FLUSH_MS 10
+
+/* when the segments are synced to the disk */
+typedef enum
+{
+    JOURNAL_FSYNC_NONE,   /* never, it is up to the kernel */
+    JOURNAL_FSYNC_BATCH,  /* after each batch written */
+    JOURNAL_FSYNC_SECOND  /* at most once per second */
+} journal_fsync_t;
+
+typedef struct journal_segment_header_s
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t first_sequence; /* sequence number of the first record */
+    int64_t created_at;      /* CLOCK_REALTIME, in nanoseconds */
+    int64_t monotonic_at;    /* CLOCK_MONOTONIC at the same time, to convert the timestamps */
+} JOURNAL_SEGMENT_HEADER;
+
+typedef struct journal_record_s
+{
+    uint32_t length;    /* bytes of the record, with its path and padding */
+    uint32_t mask;      /* inotify event mask */
+    uint64_t sequence;  /* sequence number of the event */
+    uint64_t timestamp; /* CLOCK_MONOTONIC, in nanoseconds */
+    uint32_t cookie;    /* inotify cookie, to pair the moves */
+    uint32_t path_len;  /* bytes of the path, without the terminator */
+} JOURNAL_RECORD;
+
+/* path of a record */
+#define JOURNAL_PATH(record) ((const char *)((record) + 1))
+
+/* used to read the records of a journal */
+typedef struct journal_reader_s
+{
+    char *directory;     /* directory of the journal */
+    char **segments;     /* names of the segments, sorted */
+    int qty;             /* number of segments */
+    int current;         /* segment mapped */
+    void *map;           /* the mapped segment */
+    size_t size;         /* bytes of the mapped segment */
+    size_t offset;       /* next record to read */
+    uint64_t from;       /* first sequence number to read */
+} JOURNAL_READER;
+
+/* opens the journal and starts the writer thread
+ *
+ * @param  const char *    : directory of the journal, created if missing
+ * @param  off_t           : max bytes of a segment
+ * @param  time_t          : max seconds of a segment
+ * @param  journal_fsync_t : when to sync the segments
+ * @return int             : 0 if success, -1 otherwise
+ */
+int journal_start(const char *, off_t, time_t, journal_fsync_t);
+
+/* returns the sequence number of the last event in the journal,
+ * the next events have to continue from it
+ *
+ * @return uint64_t : 0 for an empty journal
+ */
+uint64_t journal_last_sequence();
+
+/* appends an event, without waiting for the disk
+ *
+ * @param  uint64_t     : sequence number of the event
+ * @param  uint32_t     : event mask
+ * @param  uint32_t     : cookie
+ * @param  const char * : directory of the event
+ * @param  const char * : name of the file or directory, "" for none
+ * @return int          : 0 if success, -1 if the event is dropped
+ */
+int journal_append(uint64_t, uint32_t, uint32_t, const char *, const char *);
+
+/* waits until the events appended so far are written */
+void journal_flush();
+
+/* writes all the events buffered and stops the writer thread */
+void journal_stop();
+
+/* returns the number of events dropped because the buffer was full,
+ * or because their segment could not be opened or written
+ *
+ * @return uint64_t
+ */
+uint64_t journal_dropped();
+
+/* opens a journal to read its records
+ *
+ * @param  const char *     : directory of the journal
+ * @param  uint64_t         : first sequence number to read
+ * @return JOURNAL_READER * : NULL on error
+ */
+JOURNAL_READER *journal_reader_open(const char *, uint64_t);
+
+/* reads the next record. The record is valid until the next call.
+ *
+ * @param  JOURNAL_READER *       : the reader
+ * @return const JOURNAL_RECORD * : NULL at the end of the journal
+ */
+const JOURNAL_RECORD *journal_reader_next(JOURNAL_READER *);
+
+/* deallocates a reader */
+void journal_reader_close(JOURNAL_READER *);
+
+#endif /* !__JOURNAL_H */
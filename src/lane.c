@@ -0,0 +1,150 @@
+/* lane.c
+ * A priority inotify instance for the events that shape the tree
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "lane.h"
+
+static int lane_fd = -1;
+static uint32_t lane_mask = 0;
+
+/* watch descriptors of the main instance indexed by the ones of the
+ * lane, and the other way round. Both the instances give small
+ * increasing numbers, so plain arrays are enough.
+ */
+static int *main_wd_of = NULL;
+static int *lane_wd_of = NULL;
+static int main_wd_size = 0;
+static int lane_wd_size = 0;
+
+/* stores value at index of a table, making it grow when needed */
+static int table_set(int **table, int *size, int index, int value)
+{
+    if (index >= *size)
+    {
+        int new_size = (*size == 0) ? 64 : *size;
+        while (new_size <= index)
+            new_size *= 2;
+
+        int *bigger = (int *)realloc(*table, new_size * sizeof(int));
+        if (bigger == NULL)
+            return -1;
+
+        int i;
+        for (i = *size; i < new_size; ++i)
+            bigger[i] = -1;
+
+        *table = bigger;
+        *size = new_size;
+    }
+
+    (*table)[index] = value;
+    return 0;
+}
+
+static int table_get(int *table, int size, int index)
+{
+    return (index >= 0 && index < size) ? table[index] : -1;
+}
+
+int lane_start(uint32_t mask)
+{
+    if (lane_fd != -1)
+        return lane_fd;
+
+    lane_mask = mask;
+    lane_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    return lane_fd;
+}
+
+int lane_descriptor()
+{
+    return lane_fd;
+}
+
+/* removes the lane watch of a main watch, if any */
+static void drop_lane_watch(int wd)
+{
+    int lane_wd = table_get(lane_wd_of, lane_wd_size, wd);
+    if (lane_wd == -1)
+        return;
+
+    inotify_rm_watch(lane_fd, lane_wd);
+    table_set(&main_wd_of, &main_wd_size, lane_wd, -1);
+    table_set(&lane_wd_of, &lane_wd_size, wd, -1);
+}
+
+int lane_add_watch(int fd, const char *path, uint32_t mask)
+{
+    /* NOTE: the main watch needs at least one event, IN_DELETE_SELF is a harmless one */
+    int wd = inotify_add_watch(fd, path, (mask & ~lane_mask) | IN_DELETE_SELF);
+    if (wd == -1)
+        return -1;
+
+    /* a watch whose new mask has no lane events leaves the lane */
+    if ((mask & lane_mask) == 0)
+    {
+        drop_lane_watch(wd);
+        return wd;
+    }
+
+    int lane_wd = inotify_add_watch(lane_fd, path, (mask & lane_mask) | IN_ONLYDIR);
+    if (lane_wd == -1 || table_set(&main_wd_of, &main_wd_size, lane_wd, wd) == -1 || table_set(&lane_wd_of, &lane_wd_size, wd, lane_wd) == -1)
+    {
+        int error = errno;
+        if (lane_wd != -1)
+            inotify_rm_watch(lane_fd, lane_wd);
+        inotify_rm_watch(fd, wd);
+        errno = error;
+        return -1;
+    }
+
+    return wd;
+}
+
+int lane_rm_watch(int fd, int wd)
+{
+    drop_lane_watch(wd);
+
+    return inotify_rm_watch(fd, wd);
+}
+
+void lane_translate(char *buffer, ssize_t len)
+{
+    ssize_t i = 0;
+    while (i < len)
+    {
+        struct inotify_event *event = (struct inotify_event *)&buffer[i];
+        i += sizeof(struct inotify_event) + event->len;
+
+        /* an overflow has no watch descriptor */
+        if (event->wd != -1)
+            event->wd = table_get(main_wd_of, main_wd_size, event->wd);
+    }
+}
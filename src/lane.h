@@ -0,0 +1,80 @@
+/* lane.h
+ * A priority inotify instance for the events that shape the tree
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#ifndef __LANE_H
+#define __LANE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/* The events of the lane mask (those that create, delete or move the
+ * directories) are watched through a dedicated inotify instance, so
+ * they are not queued behind the content events and they can be read
+ * first. Each directory has a watch on both the instances: the one of
+ * the lane is mapped back to the watch descriptor of the main instance,
+ * the only one that cwatch sees.
+ */
+
+/* starts the lane
+ *
+ * @param  uint32_t : events of the lane
+ * @return int      : the descriptor from which read the events, -1 on error
+ */
+int lane_start(uint32_t);
+
+/* returns the descriptor of the lane
+ *
+ * @return int : -1 if the lane is not started
+ */
+int lane_descriptor();
+
+/* adds the watches of a directory on both the instances.
+ * It has the same signature of inotify_add_watch
+ *
+ * @param  int          : main inotify file descriptor
+ * @param  const char * : absolute real path
+ * @param  uint32_t     : event mask
+ * @return int          : watch descriptor of the main instance, -1 on error
+ */
+int lane_add_watch(int, const char *, uint32_t);
+
+/* removes the watches of a directory from both the instances.
+ * It has the same signature of inotify_rm_watch
+ *
+ * @param  int : main inotify file descriptor
+ * @param  int : watch descriptor of the main instance
+ * @return int : 0 if success, -1 otherwise
+ */
+int lane_rm_watch(int, int);
+
+/* replaces the watch descriptors of a buffer read from the lane
+ * with the ones of the main instance
+ *
+ * @param char *  : buffer of struct inotify_event
+ * @param ssize_t : length of the buffer
+ */
+void lane_translate(char *, ssize_t);
+
+#endif /* !__LANE_H */
@@ -0,0 +1,340 @@
+/* libcwatch.c
+ * Embed cwatch into a program
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "cwatch.h"
+#include "libcwatch.h"
+
+/* the globals of the engine that describe a watched tree. They belong to
+ * a context, and are swapped in while the context is used.
+ */
+typedef struct engine_s
+{
+    char *root_path;
+    uint32_t event_mask;
+    regex_t *exclude_regex;
+    PATHGLOB *include_glob;
+    WATCH_BUDGET watch_budget;
+    DEDUPE_SET *dedupe_set;
+    bool_t recursive_flag;
+    bool_t nosymlink_flag;
+    uint64_t event_sequence;
+    int exec_c;
+    int (*execute_command)(char *, char *, char *);
+    void (*event_sink)(uint64_t, uint32_t, uint32_t, const char *, const char *);
+    int (*watch_descriptor_from)(int, const char *, uint32_t);
+    int (*remove_watch_descriptor)(int, int);
+} ENGINE;
+
+struct cwatch_s
+{
+    ENGINE engine;       /* the state of the engine for this context */
+    ENGINE saved;        /* the state of the engine while this context is used */
+    int fd;              /* inotify file descriptor */
+    Queue *queue_wd;     /* watched directories */
+    CWATCH_EVENT *events; /* the batch, the paths are offsets until it is given */
+    int qty;
+    int size;
+    bstring paths;       /* the paths of the events of the batch */
+    bool_t given;        /* TRUE once the batch has been given */
+};
+
+static pthread_mutex_t engine_mutex = PTHREAD_MUTEX_INITIALIZER;
+static CWATCH *active = NULL; /* the context in use */
+
+static void save_engine(ENGINE *engine)
+{
+    engine->root_path = root_path;
+    engine->event_mask = event_mask;
+    engine->exclude_regex = exclude_regex;
+    engine->include_glob = include_glob;
+    engine->watch_budget = watch_budget;
+    engine->dedupe_set = dedupe_set;
+    engine->recursive_flag = recursive_flag;
+    engine->nosymlink_flag = nosymlink_flag;
+    engine->event_sequence = event_sequence;
+    engine->exec_c = exec_c;
+    engine->execute_command = execute_command;
+    engine->event_sink = event_sink;
+    engine->watch_descriptor_from = watch_descriptor_from;
+    engine->remove_watch_descriptor = remove_watch_descriptor;
+}
+
+static void load_engine(const ENGINE *engine)
+{
+    root_path = engine->root_path;
+    event_mask = engine->event_mask;
+    exclude_regex = engine->exclude_regex;
+    include_glob = engine->include_glob;
+    watch_budget = engine->watch_budget;
+    dedupe_set = engine->dedupe_set;
+    recursive_flag = engine->recursive_flag;
+    nosymlink_flag = engine->nosymlink_flag;
+    event_sequence = engine->event_sequence;
+    exec_c = engine->exec_c;
+    execute_command = engine->execute_command;
+    event_sink = engine->event_sink;
+    watch_descriptor_from = engine->watch_descriptor_from;
+    remove_watch_descriptor = engine->remove_watch_descriptor;
+}
+
+static void enter(CWATCH *context)
+{
+    pthread_mutex_lock(&engine_mutex);
+    save_engine(&context->saved);
+    load_engine(&context->engine);
+    active = context;
+}
+
+static void leave(CWATCH *context)
+{
+    active = NULL;
+    save_engine(&context->engine);
+    load_engine(&context->saved);
+    pthread_mutex_unlock(&engine_mutex);
+}
+
+/* adds an event reported by the engine to the batch of the active context */
+static void collect(uint64_t sequence, uint32_t mask, uint32_t cookie, const char *directory, const char *name)
+{
+    CWATCH *context = active;
+
+    if (context->given == TRUE)
+    {
+        context->qty = 0;
+        btrunc(context->paths, 0);
+        context->given = FALSE;
+    }
+
+    if (context->qty == context->size)
+    {
+        int size = (context->size == 0) ? 64 : context->size * 2;
+        CWATCH_EVENT *events = (CWATCH_EVENT *)realloc(context->events, size * sizeof(CWATCH_EVENT));
+        if (events == NULL)
+            return;
+
+        context->events = events;
+        context->size = size;
+    }
+
+    CWATCH_EVENT *event = &context->events[context->qty++];
+    event->sequence = sequence;
+    event->mask = mask;
+    event->cookie = cookie;
+    event->path = (const char *)(uintptr_t)blength(context->paths);
+    event->path_len = strlen(directory) + strlen(name);
+
+    bcatcstr(context->paths, directory);
+    bcatcstr(context->paths, name);
+    bconchar(context->paths, '\0');
+}
+
+CWATCH *cwatch_open(uint32_t mask, int flags)
+{
+    CWATCH *context = (CWATCH *)calloc(1, sizeof(CWATCH));
+    if (context == NULL)
+        return NULL;
+
+    if ((context->engine.dedupe_set = (DEDUPE_SET *)calloc(1, sizeof(DEDUPE_SET))) == NULL)
+    {
+        free(context);
+        return NULL;
+    }
+
+    if ((context->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1)
+    {
+        free(context->engine.dedupe_set);
+        free(context);
+        return NULL;
+    }
+
+    context->queue_wd = queue_init();
+    context->paths = bfromcstr("");
+    context->given = TRUE;
+
+    ENGINE *engine = &context->engine;
+    engine->event_mask = (mask != 0) ? mask : IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVE;
+    engine->recursive_flag = (flags & CWATCH_RECURSIVE) ? TRUE : FALSE;
+    engine->nosymlink_flag = (flags & CWATCH_NO_SYMLINK) ? TRUE : FALSE;
+    engine->event_sink = collect;
+    engine->watch_descriptor_from = inotify_add_watch;
+    engine->remove_watch_descriptor = inotify_rm_watch;
+    watch_budget_init(&engine->watch_budget, 0);
+
+    return context;
+}
+
+int cwatch_include(CWATCH *context, const char *glob)
+{
+    if (context->engine.include_glob == NULL)
+        context->engine.include_glob = pathglob_init();
+
+    if (pathglob_add(context->engine.include_glob, glob) == -1)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+}
+
+int cwatch_exclude(CWATCH *context, const char *regex)
+{
+    regex_t *compiled = (regex_t *)malloc(sizeof(regex_t));
+    if (compiled == NULL)
+        return -1;
+
+    if (regcomp(compiled, regex, REG_EXTENDED | REG_NOSUB) != 0)
+    {
+        free(compiled);
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (context->engine.exclude_regex != NULL)
+    {
+        regfree(context->engine.exclude_regex);
+        free(context->engine.exclude_regex);
+    }
+    context->engine.exclude_regex = compiled;
+
+    return 0;
+}
+
+int cwatch_add_root(CWATCH *context, const char *path)
+{
+    if (context->engine.root_path != NULL)
+    {
+        errno = EBUSY;
+        return -1;
+    }
+
+    if (!is_dir(path))
+    {
+        errno = ENOTDIR;
+        return -1;
+    }
+
+    char *real_path = resolve_real_path(path);
+    if (real_path == NULL)
+        return -1;
+
+    context->engine.root_path = real_path;
+
+    enter(context);
+    int added = watch_directory_tree(root_path, NULL, recursive_flag, context->fd, context->queue_wd);
+    leave(context);
+
+    if (added == -1)
+    {
+        free(context->engine.root_path);
+        context->engine.root_path = NULL;
+        errno = ENOENT;
+        return -1;
+    }
+
+    return 0;
+}
+
+int cwatch_descriptor(CWATCH *context)
+{
+    return context->fd;
+}
+
+int cwatch_next_batch(CWATCH *context, const CWATCH_EVENT **events)
+{
+    char buffer[EVENT_BUF_LEN];
+
+    /* the events collected while adding the root are given first */
+    if (context->given == TRUE || context->qty == 0)
+    {
+        context->qty = 0;
+        btrunc(context->paths, 0);
+
+        ssize_t len = read(context->fd, buffer, EVENT_BUF_LEN);
+        if (len == -1)
+            return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+
+        context->given = FALSE;
+
+        enter(context);
+        handle_events(buffer, len, context->fd, context->queue_wd);
+        leave(context);
+    }
+
+    /* the paths do not move anymore */
+    int i;
+    for (i = 0; i < context->qty; ++i)
+        context->events[i].path = (const char *)context->paths->data + (uintptr_t)context->events[i].path;
+    context->given = TRUE;
+
+    *events = context->events;
+    return context->qty;
+}
+
+void cwatch_close(CWATCH *context)
+{
+    WD_DATA *wd_data;
+    while ((wd_data = (WD_DATA *)queue_dequeue(context->queue_wd)))
+    {
+        LINK_DATA *link_data;
+        while ((link_data = (LINK_DATA *)queue_dequeue(wd_data->links)))
+        {
+            free(link_data->path);
+            free(link_data);
+        }
+        queue_free(wd_data->links);
+
+        /* the root shares the path of the context */
+        if (wd_data->path != context->engine.root_path)
+            free(wd_data->path);
+        free(wd_data);
+    }
+    queue_free(context->queue_wd);
+    watch_candidates_free(&context->engine.watch_budget);
+    dedupe_clear(context->engine.dedupe_set);
+    free(context->engine.dedupe_set);
+    close(context->fd);
+
+    if (context->engine.include_glob != NULL)
+        pathglob_free(context->engine.include_glob);
+
+    if (context->engine.exclude_regex != NULL)
+    {
+        regfree(context->engine.exclude_regex);
+        free(context->engine.exclude_regex);
+    }
+
+    free(context->engine.root_path);
+    free(context->events);
+    bdestroy(context->paths);
+    free(context);
+}
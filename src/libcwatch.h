@@ -0,0 +1,119 @@
+/* libcwatch.h
+ * Embed cwatch into a program
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#ifndef __LIBCWATCH_H
+#define __LIBCWATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* libcwatch lets a program watch a directory tree as cwatch does,
+ * without spawning it and parsing its output:
+ *
+ *   CWATCH *context = cwatch_open(IN_CREATE | IN_MODIFY, CWATCH_RECURSIVE);
+ *   cwatch_add_root(context, "/srv/data");
+ *
+ *   (wait for cwatch_descriptor(context) to be readable, as with epoll)
+ *
+ *   const CWATCH_EVENT *events;
+ *   int qty = cwatch_next_batch(context, &events);
+ *
+ * The events of a batch point into a buffer of the context, they are
+ * valid until the next call of cwatch_next_batch() or cwatch_close().
+ *
+ * A context is used by a thread at a time. The contexts share the
+ * engine of cwatch, so the calls on different contexts are serialized.
+ */
+
+/* flags of cwatch_open */
+#define CWATCH_RECURSIVE 0x1  /* watch the subdirectories too */
+#define CWATCH_NO_SYMLINK 0x2 /* do not follow the symbolic links */
+
+typedef struct cwatch_s CWATCH;
+
+/* an event of a batch */
+typedef struct cwatch_event_s
+{
+    uint64_t sequence; /* increasing, per context */
+    uint32_t mask;     /* inotify event mask */
+    uint32_t cookie;   /* relates IN_MOVED_FROM and IN_MOVED_TO */
+    const char *path;  /* absolute path of the file or directory */
+    size_t path_len;
+} CWATCH_EVENT;
+
+/* creates a context
+ *
+ * @param  uint32_t : inotify events to report, 0 for the default of cwatch
+ * @param  int      : CWATCH_* flags
+ * @return CWATCH * : NULL on error
+ */
+CWATCH *cwatch_open(uint32_t, int);
+
+/* reports only the events of the files that match a glob, as -i --include.
+ * It has to be called before cwatch_add_root().
+ *
+ * @param  CWATCH *     : the context
+ * @param  const char * : the glob, relative to the root
+ * @return int          : 0 if success, -1 otherwise
+ */
+int cwatch_include(CWATCH *, const char *);
+
+/* ignores the paths that match a POSIX extended regex, as -x --exclude.
+ * It has to be called before cwatch_add_root().
+ *
+ * @param  CWATCH *     : the context
+ * @param  const char * : the regex
+ * @return int          : 0 if success, -1 otherwise
+ */
+int cwatch_exclude(CWATCH *, const char *);
+
+/* starts watching a directory. A context has a single root, open a
+ * context for each directory tree to watch.
+ *
+ * @param  CWATCH *     : the context
+ * @param  const char * : the directory
+ * @return int          : 0 if success, -1 otherwise (EBUSY with a root already)
+ */
+int cwatch_add_root(CWATCH *, const char *);
+
+/* returns a descriptor readable when there are events, for poll or epoll
+ *
+ * @param  CWATCH * : the context
+ * @return int
+ */
+int cwatch_descriptor(CWATCH *);
+
+/* gives the events available, without blocking
+ *
+ * @param  CWATCH *              : the context
+ * @param  const CWATCH_EVENT ** : where to store the events
+ * @return int                   : number of events, -1 on error
+ */
+int cwatch_next_batch(CWATCH *, const CWATCH_EVENT **);
+
+/* stops watching and deallocates a context */
+void cwatch_close(CWATCH *);
+
+#endif /* !__LIBCWATCH_H */
@@ -30,18 +30,230 @@ int main(int argc, char *argv[])
 
     if (parse_command_line(argc, argv) == 0)
     {
-        int fd = inotify_init();
+        clock_gettime(CLOCK_MONOTONIC, &started_at);
+        if (NULL != ready_file)
+            unlink(ready_file);
+
+        if (NULL != journal_directory)
+        {
+            if (journal_start(journal_directory, journal_max_size, journal_max_age, journal_fsync) == -1)
+            {
+                printf("An error occured while opening the journal \"%s\": %s\n", journal_directory, strerror(errno));
+                return EXIT_FAILURE;
+            }
+
+            /* the events buffered are written on the way out */
+            signal(SIGTERM, signal_callback_handler);
+            atexit(journal_stop);
+
+            /* the sequence numbers continue the ones of the journal */
+            event_sequence = journal_last_sequence();
+        }
+
+        if (NULL != cursor_socket && cursor_start(cursor_socket, journal_directory, event_sequence) == -1)
+        {
+            printf("An error occured while opening the socket \"%s\": %s\n", cursor_socket, strerror(errno));
+            return EXIT_FAILURE;
+        }
+
+        if (NULL != subscribe_socket && subscribe_start(subscribe_socket, root_path, events_mask_of) == -1)
+        {
+            printf("An error occured while opening the socket \"%s\": %s\n", subscribe_socket, strerror(errno));
+            return EXIT_FAILURE;
+        }
+
+        if (NULL != ring_socket && shmring_start(ring_socket, ring_size) == -1)
+        {
+            printf("An error occured while opening the socket \"%s\": %s\n", ring_socket, strerror(errno));
+            return EXIT_FAILURE;
+        }
+
+        if (NULL != plugin_path)
+        {
+            if (plugin_load(plugin_path, root_path, plugin_argument) == -1)
+            {
+                printf("An error occured while loading the plugin \"%s\": %s\n", plugin_path, plugin_error());
+                return EXIT_FAILURE;
+            }
+
+            /* the last batch is given on the way out */
+            atexit(plugin_unload);
+        }
+
+        if (skip_unchanged_flag == TRUE && digest_start() == -1)
+        {
+            printf("An error occured while starting the workers of --skip-unchanged: %s\n", strerror(errno));
+            return EXIT_FAILURE;
+        }
+
+        /* a save is reported as a modify, as a close_write when only that is requested */
+        if (atomic_saves_flag == TRUE && atomic_start((event_mask & IN_MODIFY) ? IN_MODIFY : IN_CLOSE_WRITE, forward_held) == -1)
+        {
+            printf("An error occured while starting the recognizer of --atomic-saves: %s\n", strerror(errno));
+            return EXIT_FAILURE;
+        }
+
+        if (heavy_hitters > 0)
+        {
+            if (heavy_start() == -1)
+            {
+                printf("An error occured while starting the counters of --heavy-hitters: %s\n", strerror(errno));
+                return EXIT_FAILURE;
+            }
+
+            /* the heavy hitters so far, on demand */
+            signal(SIGUSR2, heavy_signal_handler);
+        }
+
+        if (NULL != metrics_socket)
+        {
+            if (metrics_serve(metrics_socket) == -1)
+            {
+                printf("An error occured while opening the socket \"%s\": %s\n", metrics_socket, strerror(errno));
+                return EXIT_FAILURE;
+            }
+
+            atexit(metrics_stop);
+        }
+
+        /* the metrics of the whole run are written on the way out */
+        if (NULL != stats_file)
+            atexit(write_stats);
+
+        /* the metrics so far, on demand */
+        signal(SIGUSR1, metrics_signal_handler);
+
+        if (rollup_flag == TRUE)
+        {
+            if (rollup_start(rollup_depth, rollup_window) == -1)
+            {
+                printf("An error occured while starting the window of --rollup-depth: %s\n", strerror(errno));
+                return EXIT_FAILURE;
+            }
+
+            /* the last window is reported on the way out */
+            atexit(collect_rolled_up);
+        }
+
+        if (NULL != mirror_destination)
+        {
+            if (mirror_start(root_path, mirror_destination, mirror_workers) == -1)
+            {
+                printf("An error occured while starting the mirror \"%s\": %s\n", mirror_destination, strerror(errno));
+                return EXIT_FAILURE;
+            }
+
+            /* the last copies are done on the way out */
+            atexit(mirror_stop);
+        }
+
+        if (NULL != state_file)
+        {
+            /* save the state on the way out, as in a deploy */
+            signal(SIGTERM, signal_callback_handler);
+
+            if ((state_snapshot = state_load(state_file, state_options)) == NULL)
+                log_message("NO STATE TO RESTORE:\t\"%s\"", state_file);
+        }
+
         Queue *queue_wd = queue_init();
 
-        watch_descriptor_from = inotify_add_watch;
-        remove_watch_descriptor = inotify_rm_watch;
+        if (backend == BACKEND_FANOTIFY)
+        {
+            /* a single mark of the filesystem, there is no tree to walk */
+            int fd = fansource_init(root_path, fansource_mask_for(event_mask));
+            if (fd == -1)
+            {
+                printf("An error occured while starting fanotify: %s\n", strerror(errno));
+                return EXIT_FAILURE;
+            }
+
+            /* fanotify reports real paths */
+            char *real_path = resolve_real_path(root_path);
+            free(root_path);
+            root_path = real_path;
+
+            report_ready();
+            return monitor(fd, queue_wd);
+        }
+
+        int fd;
 
-        if (watch_directory_tree(root_path, NULL, recursive_flag, fd, queue_wd) == -1)
+        if (shards > 1)
+        {
+            /* the events of all the shards are merged into a single descriptor */
+            if ((fd = shards_start(root_path, shards, wanted_by_shard)) == -1)
+            {
+                printf("An error occured while starting the shards: %s\n", strerror(errno));
+                return EXIT_FAILURE;
+            }
+        }
+        else
+        {
+            fd = inotify_init();
+        }
+
+        if (backend == BACKEND_POLL)
+        {
+            if (poller_start(poll_interval) == -1)
+            {
+                printf("An error occured while starting the poller!\n");
+                return EXIT_FAILURE;
+            }
+
+            /* every directory is polled, there is no budget to honor */
+            watch_descriptor_from = poller_add_watch;
+            remove_watch_descriptor = poller_rm_watch;
+        }
+        else if (shards > 1)
+        {
+            watch_descriptor_from = shard_add_watch;
+            remove_watch_descriptor = shard_rm_watch;
+
+            watch_budget_init(&watch_budget, max_watches);
+        }
+        else if (priority_lane_flag == TRUE)
+        {
+            if (lane_start(STRUCTURAL_EVENTS) == -1)
+            {
+                printf("An error occured while starting the priority lane: %s\n", strerror(errno));
+                return EXIT_FAILURE;
+            }
+
+            watch_descriptor_from = lane_add_watch;
+            remove_watch_descriptor = lane_rm_watch;
+
+            /* each directory takes two watches */
+            watch_budget_init(&watch_budget, max_watches);
+            if (watch_budget.limit > 1)
+                watch_budget.limit /= 2;
+        }
+        else
+        {
+            watch_descriptor_from = inotify_add_watch;
+            remove_watch_descriptor = inotify_rm_watch;
+
+            watch_budget_init(&watch_budget, max_watches);
+        }
+
+        int added = (progressive_flag == TRUE && recursive_flag == TRUE)
+                        ? ingest_directory_tree(root_path, fd, queue_wd)
+                        : watch_directory_tree(root_path, NULL, recursive_flag, fd, queue_wd);
+
+        if (added == -1)
         {
             printf("An error occured while adding \"%s\" as watched resource!\n", root_path);
             return EXIT_FAILURE;
         }
 
+        /* the saved state is needed only by the first walk */
+        state_free(state_snapshot);
+        state_snapshot = NULL;
+
+        /* with --progressive the tree is still being watched by the workers */
+        if (ingest_in_progress() == 0)
+            report_ready();
+
         return monitor(fd, queue_wd);
     }
 
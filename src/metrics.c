@@ -0,0 +1,409 @@
+/* metrics.c
+ * Count what cwatch does, and expose it in the Prometheus text format
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "metrics.h"
+
+/* milliseconds a client has to write its request */
+#define METRICS_REQUEST_TIMEOUT 100
+
+typedef struct metrics_histogram_s
+{
+    uint64_t buckets[METRICS_HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+} METRICS_HISTOGRAM;
+
+static uint64_t counters[METRIC_COUNTERS];
+static uint64_t events_by_type[32];
+
+/* the counts of the threads of the shards, added atomically */
+static uint64_t shared_counters[METRIC_COUNTERS];
+static uint64_t shared_events_by_type[32];
+static int64_t gauges[METRIC_GAUGES];
+static METRICS_HISTOGRAM histograms[METRIC_HISTOGRAMS];
+
+static const char *counter_names[METRIC_COUNTERS] = {
+    "cwatch_events_read_total",
+    "cwatch_events_excluded_total",
+    "cwatch_events_dispatched_total",
+    "cwatch_commands_run_total",
+    "cwatch_commands_failed_total",
+    "cwatch_overflows_total",
+    "cwatch_watches_added_total",
+    "cwatch_watches_removed_total"};
+
+static const char *gauge_names[METRIC_GAUGES] = {
+    "cwatch_watches"};
+
+static const char *histogram_names[METRIC_HISTOGRAMS] = {
+    "cwatch_dispatch_latency_seconds",
+    "cwatch_command_duration_seconds"};
+
+/* the events by bit of the mask, as in inotify.h */
+static const char *event_names[32] = {
+    "access", "modify", "attrib", "close_write", "close_nowrite", "open", "moved_from", "moved_to",
+    "create", "delete", "delete_self", "move_self", NULL, "unmount", "q_overflow", "ignored"};
+
+static int server_fd = -1;
+static pthread_t server;
+static int serving = 0;
+
+/* the metrics are written by a single thread, but the shared ones */
+#define LOAD(value) __atomic_load_n(&(value), __ATOMIC_RELAXED)
+#define STORE(value, new_value) __atomic_store_n(&(value), (new_value), __ATOMIC_RELAXED)
+#define ADD(value, n) __atomic_fetch_add(&(value), (n), __ATOMIC_RELAXED)
+
+static int bucket_of(uint64_t value)
+{
+    if (value < METRICS_EXACT)
+        return (int)value;
+
+    int msb = 63 - __builtin_clzll(value);
+    int sub = (int)(value >> (msb - 3)) & (METRICS_SUB_BUCKETS - 1);
+
+    return METRICS_EXACT + (msb - 4) * METRICS_SUB_BUCKETS + sub;
+}
+
+/* the highest value of a bucket */
+static uint64_t upper_of(int bucket)
+{
+    if (bucket < METRICS_EXACT)
+        return (uint64_t)bucket;
+
+    int msb = (bucket - METRICS_EXACT) / METRICS_SUB_BUCKETS + 4;
+    int sub = (bucket - METRICS_EXACT) % METRICS_SUB_BUCKETS;
+
+    if (msb == 63 && sub == METRICS_SUB_BUCKETS - 1)
+        return UINT64_MAX;
+
+    return ((uint64_t)(METRICS_SUB_BUCKETS + sub + 1) << (msb - 3)) - 1;
+}
+
+void metrics_count(metric_t metric)
+{
+    STORE(counters[metric], counters[metric] + 1);
+}
+
+void metrics_count_event(uint32_t mask)
+{
+    STORE(counters[METRIC_EVENTS_READ], counters[METRIC_EVENTS_READ] + 1);
+
+    /* IN_ISDIR and the other flags are not types */
+    mask &= 0xffff;
+    while (mask != 0)
+    {
+        int bit = __builtin_ctz(mask);
+        STORE(events_by_type[bit], events_by_type[bit] + 1);
+        mask &= mask - 1;
+    }
+}
+
+void metrics_count_shared(metric_t metric)
+{
+    ADD(shared_counters[metric], 1);
+}
+
+void metrics_count_event_shared(uint32_t mask)
+{
+    ADD(shared_counters[METRIC_EVENTS_READ], 1);
+
+    mask &= 0xffff;
+    while (mask != 0)
+    {
+        ADD(shared_events_by_type[__builtin_ctz(mask)], 1);
+        mask &= mask - 1;
+    }
+}
+
+void metrics_gauge(metric_gauge_t gauge, int64_t value)
+{
+    STORE(gauges[gauge], value);
+}
+
+void metrics_record(metric_histogram_t histogram, uint64_t value)
+{
+    METRICS_HISTOGRAM *h = &histograms[histogram];
+    int bucket = bucket_of(value);
+
+    STORE(h->buckets[bucket], h->buckets[bucket] + 1);
+    STORE(h->sum, h->sum + value);
+    if (value > h->max)
+        STORE(h->max, value);
+    STORE(h->count, h->count + 1);
+}
+
+uint64_t metrics_counter(metric_t metric)
+{
+    return LOAD(counters[metric]) + LOAD(shared_counters[metric]);
+}
+
+uint64_t metrics_events_of(uint32_t mask)
+{
+    if (mask == 0)
+        return 0;
+
+    int bit = __builtin_ctz(mask);
+
+    return LOAD(events_by_type[bit]) + LOAD(shared_events_by_type[bit]);
+}
+
+uint64_t metrics_recorded(metric_histogram_t histogram)
+{
+    return LOAD(histograms[histogram].count);
+}
+
+uint64_t metrics_quantile(metric_histogram_t histogram, double quantile)
+{
+    METRICS_HISTOGRAM *h = &histograms[histogram];
+    uint64_t count = LOAD(h->count);
+    uint64_t max = LOAD(h->max);
+
+    if (count == 0)
+        return 0;
+
+    /* the rank of the value, from 1 */
+    uint64_t rank = (uint64_t)(quantile * count + 0.5);
+    if (rank < 1)
+        rank = 1;
+
+    uint64_t seen = 0;
+    int i;
+    for (i = 0; i < METRICS_HISTOGRAM_BUCKETS; ++i)
+    {
+        seen += LOAD(h->buckets[i]);
+        if (seen >= rank)
+            return (upper_of(i) < max) ? upper_of(i) : max;
+    }
+
+    return max;
+}
+
+char *metrics_text()
+{
+    char *text = NULL;
+    size_t length = 0;
+    static const double quantiles[] = {0.5, 0.9, 0.99};
+
+    FILE *stream = open_memstream(&text, &length);
+    if (stream == NULL)
+        return NULL;
+
+    int i, j;
+    for (i = 0; i < METRIC_COUNTERS; ++i)
+    {
+        fprintf(stream, "# TYPE %s counter\n", counter_names[i]);
+        fprintf(stream, "%s %" PRIu64 "\n", counter_names[i], metrics_counter((metric_t)i));
+    }
+
+    fprintf(stream, "# TYPE cwatch_events_total counter\n");
+    for (i = 0; i < 32; ++i)
+    {
+        if (event_names[i] != NULL)
+            fprintf(stream, "cwatch_events_total{type=\"%s\"} %" PRIu64 "\n", event_names[i], metrics_events_of(1u << i));
+    }
+
+    for (i = 0; i < METRIC_GAUGES; ++i)
+    {
+        fprintf(stream, "# TYPE %s gauge\n", gauge_names[i]);
+        fprintf(stream, "%s %" PRId64 "\n", gauge_names[i], LOAD(gauges[i]));
+    }
+
+    for (i = 0; i < METRIC_HISTOGRAMS; ++i)
+    {
+        METRICS_HISTOGRAM *h = &histograms[i];
+
+        fprintf(stream, "# TYPE %s summary\n", histogram_names[i]);
+        for (j = 0; j < (int)(sizeof(quantiles) / sizeof(quantiles[0])); ++j)
+            fprintf(stream, "%s{quantile=\"%g\"} %.6f\n", histogram_names[i], quantiles[j],
+                    metrics_quantile((metric_histogram_t)i, quantiles[j]) / 1e6);
+        fprintf(stream, "%s_sum %.6f\n", histogram_names[i], LOAD(h->sum) / 1e6);
+        fprintf(stream, "%s_count %" PRIu64 "\n", histogram_names[i], LOAD(h->count));
+        fprintf(stream, "# TYPE %s_max gauge\n", histogram_names[i]);
+        fprintf(stream, "%s_max %.6f\n", histogram_names[i], LOAD(h->max) / 1e6);
+    }
+
+    if (fclose(stream) != 0)
+    {
+        free(text);
+        return NULL;
+    }
+
+    return text;
+}
+
+int metrics_write(const char *path)
+{
+    char *text = metrics_text();
+    if (text == NULL)
+        return -1;
+
+    /* the readers never see a file half written */
+    size_t path_len = strlen(path);
+    char *temporary = (char *)malloc(path_len + 5);
+    if (temporary == NULL)
+    {
+        free(text);
+        return -1;
+    }
+    snprintf(temporary, path_len + 5, "%s.tmp", path);
+
+    int result = -1;
+    FILE *file = fopen(temporary, "w");
+    if (file != NULL)
+    {
+        int written = fputs(text, file) >= 0;
+        if (fclose(file) == 0 && written && rename(temporary, path) == 0)
+            result = 0;
+        else
+            unlink(temporary);
+    }
+
+    free(temporary);
+    free(text);
+
+    return result;
+}
+
+/* writes all the bytes of an answer */
+static void answer(int client_fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t written = send(client_fd, data, length, MSG_NOSIGNAL);
+        if (written <= 0)
+            return;
+
+        data += written;
+        length -= written;
+    }
+}
+
+static void *metrics_server(void *arg)
+{
+    char request[METRICS_REQUEST_MAX];
+    static const char http_header[] = "HTTP/1.0 200 OK\r\n"
+                                      "Content-Type: text/plain; version=0.0.4\r\n"
+                                      "Connection: close\r\n\r\n";
+
+    while (1)
+    {
+        int client_fd = accept(server_fd, NULL, NULL);
+        if (client_fd == -1)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;
+        }
+
+        /* a client that writes nothing gets the text alone */
+        struct pollfd pfd = {client_fd, POLLIN, 0};
+        ssize_t length = 0;
+        if (poll(&pfd, 1, METRICS_REQUEST_TIMEOUT) == 1)
+            length = read(client_fd, request, sizeof(request) - 1);
+
+        char *text = metrics_text();
+        if (text != NULL)
+        {
+            if (length >= 4 && strncmp(request, "GET ", 4) == 0)
+                answer(client_fd, http_header, sizeof(http_header) - 1);
+            answer(client_fd, text, strlen(text));
+            free(text);
+        }
+
+        close(client_fd);
+    }
+
+    return NULL;
+}
+
+int metrics_serve(const char *socket_path)
+{
+    struct sockaddr_un address;
+
+    if (server_fd != -1)
+        return 0;
+
+    if (strlen(socket_path) >= sizeof(address.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
+    unlink(socket_path);
+
+    if ((server_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1 ||
+        bind(server_fd, (struct sockaddr *)&address, sizeof(address)) == -1 ||
+        listen(server_fd, 16) == -1 ||
+        (serving = (pthread_create(&server, NULL, metrics_server, NULL) == 0)) == 0)
+    {
+        int error = errno;
+        metrics_stop();
+        errno = error;
+        return -1;
+    }
+
+    return 0;
+}
+
+void metrics_stop()
+{
+    if (server_fd == -1)
+        return;
+
+    /* wakes up the server from accept(), then waits for the last answer */
+    shutdown(server_fd, SHUT_RDWR);
+    if (serving)
+        pthread_join(server, NULL);
+    close(server_fd);
+    server_fd = -1;
+    serving = 0;
+}
+
+void metrics_reset()
+{
+    memset(counters, 0, sizeof(counters));
+    memset(events_by_type, 0, sizeof(events_by_type));
+    memset(shared_counters, 0, sizeof(shared_counters));
+    memset(shared_events_by_type, 0, sizeof(shared_events_by_type));
+    memset(gauges, 0, sizeof(gauges));
+    memset(histograms, 0, sizeof(histograms));
+}
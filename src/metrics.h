@@ -0,0 +1,171 @@
+/* metrics.h
+ * Count what cwatch does, and expose it in the Prometheus text format
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#ifndef __METRICS_H
+#define __METRICS_H
+
+#include <stdint.h>
+
+/* The metrics are updated by the thread of the events only, so a
+ * counter costs a plain increment; they are read by the thread of the
+ * socket (--metrics-socket) through relaxed atomic loads. The threads
+ * of the shards (--shards) count apart, with atomic adds.
+ *
+ * The histograms are log-linear, as HDR histograms: the values below
+ * METRICS_EXACT are counted exactly, the others in 8 sub-buckets per
+ * power of 2, that is within 12.5%. The values are microseconds.
+ */
+#define METRICS_EXACT 16
+#define METRICS_SUB_BUCKETS 8
+#define METRICS_HISTOGRAM_BUCKETS (METRICS_EXACT + (64 - 4) * METRICS_SUB_BUCKETS)
+
+/* seconds between two writes of --stats-file */
+#define METRICS_DEFAULT_INTERVAL 10
+
+/* max bytes of a request to the socket */
+#define METRICS_REQUEST_MAX 1024
+
+typedef enum
+{
+    METRIC_EVENTS_READ,       /* events read from the kernel */
+    METRIC_EVENTS_EXCLUDED,   /* events discarded by -x, -i and the mask */
+    METRIC_EVENTS_DISPATCHED, /* events reported */
+    METRIC_COMMANDS_RUN,      /* commands of -c executed */
+    METRIC_COMMANDS_FAILED,   /* commands not executed, or exited with an error */
+    METRIC_OVERFLOWS,         /* overflows of the queue of the kernel, or of cwatch */
+    METRIC_WATCHES_ADDED,     /* inotify watches added */
+    METRIC_WATCHES_REMOVED,   /* inotify watches removed */
+    METRIC_COUNTERS
+} metric_t;
+
+typedef enum
+{
+    GAUGE_WATCHES, /* inotify watches now */
+    METRIC_GAUGES
+} metric_gauge_t;
+
+typedef enum
+{
+    HISTOGRAM_DISPATCH_LATENCY, /* from the read of an event to its report */
+    HISTOGRAM_COMMAND_DURATION, /* run time of a command of -c */
+    METRIC_HISTOGRAMS
+} metric_histogram_t;
+
+/* increments a counter
+ *
+ * @param metric_t : counter
+ */
+void metrics_count(metric_t);
+
+/* counts an event read, and its type
+ *
+ * @param uint32_t : mask of the event
+ */
+void metrics_count_event(uint32_t);
+
+/* increments a counter, from any thread
+ *
+ * @param metric_t : counter
+ */
+void metrics_count_shared(metric_t);
+
+/* counts an event read, and its type, from any thread
+ *
+ * @param uint32_t : mask of the event
+ */
+void metrics_count_event_shared(uint32_t);
+
+/* sets a gauge
+ *
+ * @param metric_gauge_t : gauge
+ * @param int64_t        : value
+ */
+void metrics_gauge(metric_gauge_t, int64_t);
+
+/* records a value into a histogram
+ *
+ * @param metric_histogram_t : histogram
+ * @param uint64_t           : microseconds
+ */
+void metrics_record(metric_histogram_t, uint64_t);
+
+/* returns the value of a counter
+ *
+ * @param  metric_t : counter
+ * @return uint64_t
+ */
+uint64_t metrics_counter(metric_t);
+
+/* returns the number of events read of a type
+ *
+ * @param  uint32_t : mask of a single event (IN_MODIFY, ...)
+ * @return uint64_t
+ */
+uint64_t metrics_events_of(uint32_t);
+
+/* returns the number of values recorded into a histogram
+ *
+ * @param  metric_histogram_t : histogram
+ * @return uint64_t
+ */
+uint64_t metrics_recorded(metric_histogram_t);
+
+/* returns a quantile of a histogram, as the upper bound of its bucket
+ *
+ * @param  metric_histogram_t : histogram
+ * @param  double             : quantile, between 0 and 1
+ * @return uint64_t           : microseconds, 0 if nothing is recorded
+ */
+uint64_t metrics_quantile(metric_histogram_t, double);
+
+/* returns the metrics in the Prometheus text format
+ *
+ * @return char * : to free, NULL on error
+ */
+char *metrics_text();
+
+/* writes the metrics into a file, replaced at once
+ *
+ * @param  const char * : path of the file
+ * @return int          : 0 if success, -1 otherwise
+ */
+int metrics_write(const char *);
+
+/* starts serving the metrics on a unix socket. A client gets them as
+ * soon as it connects; one that writes an HTTP request (as Prometheus
+ * does through a unix socket) gets an HTTP answer.
+ *
+ * @param  const char * : path of the unix socket, replaced if it exists
+ * @return int          : 0 if success, -1 otherwise
+ */
+int metrics_serve(const char *);
+
+/* stops serving the metrics */
+void metrics_stop();
+
+/* sets all the metrics to zero */
+void metrics_reset();
+
+#endif /* !__METRICS_H */
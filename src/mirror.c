@@ -0,0 +1,721 @@
+/* mirror.c
+ * Replicate the changes of the watched tree into a destination directory
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <linux/fs.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#include "bstrlib.h"
+#include "queue.h"
+#include "mirror.h"
+
+/* bytes copied at once when the kernel can not copy by itself */
+#define MIRROR_BUFFER_SIZE (64 * 1024)
+
+/* a rename waiting for its IN_MOVED_TO */
+typedef struct mirror_move_s
+{
+    uint32_t cookie;
+    char *path;  /* relative to the roots */
+    int carried; /* 1 if it comes from the previous loop */
+} MIRROR_MOVE;
+
+static char *source_root = NULL;
+static size_t source_len = 0;
+static char *destination_root = NULL;
+
+static pthread_mutex_t mirror_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t work_done = PTHREAD_COND_INITIALIZER;
+static pthread_t *workers = NULL;
+static int workers_qty = 0;
+static Queue *jobs = NULL; /* paths to copy, relative to the roots */
+static int in_flight = 0;  /* copies taken by a worker */
+static char **busy = NULL; /* path copied by each worker, NULL for none */
+static int stopping = 0;
+static unsigned long copies = 0;
+static unsigned long failures = 0;
+static unsigned long temporary = 0;
+
+/* state of monitor() only */
+static char **pending = NULL; /* paths to copy at the end of the loop */
+static int pending_qty = 0;
+static int pending_size = 0;
+static MIRROR_MOVE *moves = NULL;
+static int moves_qty = 0;
+static int moves_size = 0;
+
+static void count_failure()
+{
+    pthread_mutex_lock(&mirror_mutex);
+    ++failures;
+    pthread_mutex_unlock(&mirror_mutex);
+}
+
+/* returns 1 if path is prefix or is inside it */
+static int is_inside(const char *path, const char *prefix)
+{
+    size_t length = strlen(prefix);
+    return (strncmp(path, prefix, length) == 0 && (path[length] == '\0' || path[length] == '/')) ? 1 : 0;
+}
+
+/* creates the missing directories of a path, but the last component */
+static void make_parents(const char *path)
+{
+    char *copy = strdup(path);
+    char *slash;
+
+    for (slash = strchr(copy + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/'))
+    {
+        *slash = '\0';
+        mkdir(copy, 0755);
+        *slash = '/';
+    }
+
+    free(copy);
+}
+
+static int make_directory(const char *path, mode_t mode)
+{
+    if (mkdir(path, mode) == 0 || errno == EEXIST)
+        return 0;
+
+    if (errno != ENOENT)
+        return -1;
+
+    make_parents(path);
+    return (mkdir(path, mode) == 0 || errno == EEXIST) ? 0 : -1;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+    return (remove(path) == -1 && errno != ENOENT) ? -1 : 0;
+}
+
+static int remove_tree(const char *path)
+{
+    struct stat st;
+
+    if (lstat(path, &st) == -1)
+        return (errno == ENOENT) ? 0 : -1;
+
+    if (!S_ISDIR(st.st_mode))
+        return (unlink(path) == -1 && errno != ENOENT) ? -1 : 0;
+
+    return nftw(path, remove_entry, 32, FTW_DEPTH | FTW_PHYS);
+}
+
+/* copies the content of a file, sharing the blocks when possible */
+static int copy_content(int in, int out)
+{
+    if (ioctl(out, FICLONE, in) == 0)
+        return 0;
+
+    /* until the end of the file, that can grow while it is copied */
+    ssize_t copied;
+    while ((copied = copy_file_range(in, NULL, out, NULL, 1 << 30, 0)) > 0)
+        ;
+
+    if (copied == 0)
+        return 0;
+
+    if (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP)
+        return -1;
+
+    char *buffer = (char *)malloc(MIRROR_BUFFER_SIZE);
+    if (buffer == NULL)
+        return -1;
+
+    ssize_t length;
+    while ((length = read(in, buffer, MIRROR_BUFFER_SIZE)) > 0)
+    {
+        if (write(out, buffer, length) != length)
+        {
+            length = -1;
+            break;
+        }
+    }
+
+    free(buffer);
+    return (length == 0) ? 0 : -1;
+}
+
+int mirror_copy(const char *source, const char *destination)
+{
+    struct stat st;
+
+    /* a source gone is not an error, its deletion comes later */
+    if (lstat(source, &st) == -1)
+        return (errno == ENOENT || errno == ENOTDIR) ? 0 : -1;
+
+    if (S_ISDIR(st.st_mode))
+        return make_directory(destination, st.st_mode & 07777);
+
+    if (!S_ISREG(st.st_mode) && !S_ISLNK(st.st_mode))
+        return 0;
+
+    /* the copy is written aside, then renamed over the destination */
+    const char *slash = strrchr(destination, '/');
+    bstring temporary_path = bformat("%.*s.%s.cwatch-%lu", (int)(slash - destination + 1), destination, slash + 1,
+                                     __sync_add_and_fetch(&temporary, 1));
+    const char *tmp = (const char *)temporary_path->data;
+    int result = -1;
+
+    if (S_ISLNK(st.st_mode))
+    {
+        char target[4096];
+        ssize_t length = readlink(source, target, sizeof(target) - 1);
+        if (length == -1)
+        {
+            bdestroy(temporary_path);
+            return (errno == ENOENT) ? 0 : -1;
+        }
+        target[length] = '\0';
+
+        if (symlink(target, tmp) == -1 && errno == ENOENT)
+        {
+            make_parents(destination);
+            result = symlink(target, tmp);
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    else
+    {
+        int in = open(source, O_RDONLY | O_CLOEXEC);
+        if (in == -1)
+        {
+            bdestroy(temporary_path);
+            return (errno == ENOENT) ? 0 : -1;
+        }
+
+        int out = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (out == -1 && errno == ENOENT)
+        {
+            make_parents(destination);
+            out = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        }
+
+        if (out != -1)
+        {
+            result = copy_content(in, out);
+            if (fchmod(out, st.st_mode & 07777) == -1 || close(out) == -1)
+                result = -1;
+        }
+        close(in);
+    }
+
+    if (result == 0 && rename(tmp, destination) == -1)
+        result = -1;
+
+    if (result == -1)
+        unlink(tmp);
+
+    bdestroy(temporary_path);
+    return result;
+}
+
+static void *mirror_worker(void *arg)
+{
+    int index = (int)(intptr_t)arg;
+
+    pthread_mutex_lock(&mirror_mutex);
+
+    while (1)
+    {
+        while (!stopping && jobs->first == NULL)
+            pthread_cond_wait(&work_ready, &mirror_mutex);
+
+        char *relative = (char *)queue_dequeue(jobs);
+        if (relative == NULL)
+            break;
+
+        ++in_flight;
+        busy[index] = relative;
+        pthread_mutex_unlock(&mirror_mutex);
+
+        bstring source = bformat("%s%s", source_root, relative);
+        bstring destination = bformat("%s%s", destination_root, relative);
+        int result = mirror_copy((const char *)source->data, (const char *)destination->data);
+        bdestroy(source);
+        bdestroy(destination);
+
+        pthread_mutex_lock(&mirror_mutex);
+        --in_flight;
+        busy[index] = NULL;
+        free(relative);
+        if (result == 0)
+            ++copies;
+        else
+            ++failures;
+
+        /* a deletion or a rename can wait for this path */
+        pthread_cond_broadcast(&work_done);
+    }
+
+    pthread_mutex_unlock(&mirror_mutex);
+    return NULL;
+}
+
+int mirror_start(const char *source, const char *destination, int qty)
+{
+    if (workers != NULL)
+        return 0;
+
+    if (qty < 1 || qty > MIRROR_MAX_WORKERS)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    source_root = strdup(source);
+    source_len = strlen(source_root);
+    destination_root = strdup(destination);
+    jobs = queue_init();
+    stopping = 0;
+    copies = failures = 0;
+
+    workers = (pthread_t *)calloc(qty, sizeof(pthread_t));
+    busy = (char **)calloc(qty, sizeof(char *));
+    for (workers_qty = 0; workers_qty < qty; ++workers_qty)
+    {
+        if (pthread_create(&workers[workers_qty], NULL, mirror_worker, (void *)(intptr_t)workers_qty) != 0)
+        {
+            mirror_stop();
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void add_pending(char *relative)
+{
+    if (pending_qty == pending_size)
+    {
+        int size = (pending_size == 0) ? 64 : pending_size * 2;
+        char **paths = (char **)realloc(pending, size * sizeof(char *));
+        if (paths == NULL)
+        {
+            free(relative);
+            return;
+        }
+
+        pending = paths;
+        pending_size = size;
+    }
+
+    pending[pending_qty++] = relative;
+}
+
+/* drops the copies still to do of a path and of its content */
+static void drop_pending(const char *relative)
+{
+    int i, kept = 0;
+    for (i = 0; i < pending_qty; ++i)
+    {
+        if (is_inside(pending[i], relative))
+            free(pending[i]);
+        else
+            pending[kept++] = pending[i];
+    }
+    pending_qty = kept;
+}
+
+/* returns path, inside from, moved inside to */
+static char *renamed_path(char *path, const char *from, const char *to)
+{
+    bstring renamed = bformat("%s%s", to, path + strlen(from));
+    char *new_path = strdup((const char *)renamed->data);
+    bdestroy(renamed);
+    free(path);
+
+    return new_path;
+}
+
+/* moves the copies still to do of a path and of its content */
+static void rename_pending(const char *from, const char *to)
+{
+    int i;
+    for (i = 0; i < pending_qty; ++i)
+    {
+        if (is_inside(pending[i], from))
+            pending[i] = renamed_path(pending[i], from, to);
+    }
+}
+
+/* drops the copies queued of a path and of its content, or moves them
+ * inside to if not NULL. The caller holds mirror_mutex */
+static void update_queued(const char *relative, const char *to)
+{
+    QueueElement *element = jobs->first;
+    while (element != NULL)
+    {
+        QueueElement *next = element->next;
+
+        if (is_inside((const char *)element->data, relative))
+        {
+            if (to != NULL)
+            {
+                element->data = renamed_path((char *)element->data, relative, to);
+            }
+            else
+            {
+                free(element->data);
+                queue_remove(jobs, element);
+            }
+        }
+
+        element = next;
+    }
+}
+
+/* returns 1 if a worker is copying a path or its content. The caller
+ * holds mirror_mutex */
+static int is_busy(const char *relative)
+{
+    int i;
+    for (i = 0; i < workers_qty; ++i)
+    {
+        if (busy[i] != NULL && is_inside(busy[i], relative))
+            return 1;
+    }
+
+    return 0;
+}
+
+/* takes back the copies queued of a path, and waits for the ones of the
+ * workers. The copies of the other paths go on */
+static void settle(const char *relative, const char *to)
+{
+    pthread_mutex_lock(&mirror_mutex);
+    update_queued(relative, to);
+    while (is_busy(relative) || (to != NULL && is_busy(to)))
+        pthread_cond_wait(&work_done, &mirror_mutex);
+    pthread_mutex_unlock(&mirror_mutex);
+}
+
+static int add_moved_in_entry(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+    const char *relative = path + source_len;
+
+    if (type == FTW_D)
+    {
+        bstring destination = bformat("%s%s", destination_root, relative);
+        make_directory((const char *)destination->data, st->st_mode & 07777);
+        bdestroy(destination);
+    }
+    else
+    {
+        add_pending(strdup(relative));
+    }
+
+    return 0;
+}
+
+/* copies a file or a directory tree that has not a counterpart yet */
+static void moved_in(char *relative)
+{
+    bstring source = bformat("%s%s", source_root, relative);
+    nftw((const char *)source->data, add_moved_in_entry, 32, FTW_PHYS);
+    bdestroy(source);
+    free(relative);
+}
+
+static void apply_delete(char *relative)
+{
+    settle(relative, NULL);
+    drop_pending(relative);
+
+    bstring destination = bformat("%s%s", destination_root, relative);
+    if (remove_tree((const char *)destination->data) == -1)
+        count_failure();
+    bdestroy(destination);
+
+    free(relative);
+}
+
+static void apply_rename(char *from, char *to)
+{
+    settle(from, to);
+    rename_pending(from, to);
+
+    bstring old_path = bformat("%s%s", destination_root, from);
+    bstring new_path = bformat("%s%s", destination_root, to);
+
+    if (rename((const char *)old_path->data, (const char *)new_path->data) == 0)
+        free(to);
+    else
+        moved_in(to);
+
+    bdestroy(old_path);
+    bdestroy(new_path);
+    free(from);
+}
+
+/* the moves without their IN_MOVED_TO went out of the tree */
+static void resolve_moves()
+{
+    int i;
+    for (i = 0; i < moves_qty; ++i)
+        apply_delete(moves[i].path);
+    moves_qty = 0;
+}
+
+/* the moves of the previous loop still without their IN_MOVED_TO went out
+ * of the tree, the ones of this loop can get it at the next read */
+static void carry_moves()
+{
+    int i, kept = 0;
+    for (i = 0; i < moves_qty; ++i)
+    {
+        if (moves[i].carried)
+        {
+            apply_delete(moves[i].path);
+        }
+        else
+        {
+            moves[i].carried = 1;
+            moves[kept++] = moves[i];
+        }
+    }
+    moves_qty = kept;
+}
+
+/* returns 1 if a path is inside a move waiting for its IN_MOVED_TO */
+static int is_moving(const char *relative)
+{
+    int i;
+    for (i = 0; i < moves_qty; ++i)
+    {
+        if (is_inside(relative, moves[i].path))
+            return 1;
+    }
+
+    return 0;
+}
+
+void mirror_event(uint32_t mask, uint32_t cookie, const char *directory, const char *name)
+{
+    if (workers == NULL || *name == '\0' || strncmp(directory, source_root, source_len) != 0)
+        return;
+
+    bstring path = bformat("%s%s", directory + source_len, name);
+    char *relative = strdup((const char *)path->data);
+    bdestroy(path);
+
+    if (mask & IN_MOVED_FROM)
+    {
+        if (moves_qty == moves_size)
+        {
+            int size = (moves_size == 0) ? 16 : moves_size * 2;
+            MIRROR_MOVE *new_moves = (MIRROR_MOVE *)realloc(moves, size * sizeof(MIRROR_MOVE));
+            if (new_moves == NULL)
+            {
+                /* NOTE: as a move out, the IN_MOVED_TO if any copies the path again */
+                apply_delete(relative);
+                return;
+            }
+
+            moves = new_moves;
+            moves_size = size;
+        }
+
+        moves[moves_qty].cookie = cookie;
+        moves[moves_qty].carried = 0;
+        moves[moves_qty++].path = relative;
+        return;
+    }
+
+    if (mask & IN_MOVED_TO)
+    {
+        int i;
+        for (i = 0; i < moves_qty && moves[i].cookie != cookie; ++i)
+            ;
+
+        if (i < moves_qty)
+        {
+            char *from = moves[i].path;
+            moves[i] = moves[--moves_qty];
+            resolve_moves();
+            apply_rename(from, relative);
+        }
+        else
+        {
+            resolve_moves();
+            moved_in(relative);
+        }
+        return;
+    }
+
+    /* the IN_MOVED_TO of a move comes right after its IN_MOVED_FROM, or
+     * first in the next read */
+    resolve_moves();
+
+    if (mask & IN_DELETE)
+    {
+        apply_delete(relative);
+    }
+    else if ((mask & IN_CREATE) && (mask & IN_ISDIR))
+    {
+        bstring source = bformat("%s%s", source_root, relative);
+        bstring destination = bformat("%s%s", destination_root, relative);
+        if (mirror_copy((const char *)source->data, (const char *)destination->data) == -1)
+            count_failure();
+        bdestroy(source);
+        bdestroy(destination);
+        free(relative);
+    }
+    else
+    {
+        add_pending(relative);
+    }
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+void mirror_flush()
+{
+    if (workers == NULL)
+        return;
+
+    carry_moves();
+    if (pending_qty == 0)
+        return;
+
+    /* a file changed many times during the loop is copied once */
+    qsort(pending, pending_qty, sizeof(char *), compare_paths);
+
+    /* the copies inside a move carried over wait for its end */
+    pthread_mutex_lock(&mirror_mutex);
+    const char *last = NULL;
+    int i, kept = 0;
+    for (i = 0; i < pending_qty; ++i)
+    {
+        if (last != NULL && strcmp(pending[i], last) == 0)
+        {
+            free(pending[i]);
+            continue;
+        }
+
+        last = pending[i];
+        if (is_moving(pending[i]))
+            pending[kept++] = pending[i];
+        else
+            queue_enqueue(jobs, pending[i]);
+    }
+    pthread_cond_broadcast(&work_ready);
+    pthread_mutex_unlock(&mirror_mutex);
+
+    pending_qty = kept;
+}
+
+void mirror_wait()
+{
+    if (workers == NULL)
+        return;
+
+    pthread_mutex_lock(&mirror_mutex);
+    while (jobs->first != NULL || in_flight > 0)
+        pthread_cond_wait(&work_done, &mirror_mutex);
+    pthread_mutex_unlock(&mirror_mutex);
+}
+
+int mirror_moves()
+{
+    return moves_qty;
+}
+
+unsigned long mirror_copies()
+{
+    pthread_mutex_lock(&mirror_mutex);
+    unsigned long qty = copies;
+    pthread_mutex_unlock(&mirror_mutex);
+
+    return qty;
+}
+
+unsigned long mirror_failures()
+{
+    pthread_mutex_lock(&mirror_mutex);
+    unsigned long qty = failures;
+    pthread_mutex_unlock(&mirror_mutex);
+
+    return qty;
+}
+
+void mirror_stop()
+{
+    if (workers == NULL)
+        return;
+
+    resolve_moves();
+    mirror_flush();
+
+    pthread_mutex_lock(&mirror_mutex);
+    stopping = 1;
+    pthread_cond_broadcast(&work_ready);
+    pthread_mutex_unlock(&mirror_mutex);
+
+    /* the workers copy all the files queued before leaving */
+    int i;
+    for (i = 0; i < workers_qty; ++i)
+        pthread_join(workers[i], NULL);
+
+    free(workers);
+    free(busy);
+    workers = NULL;
+    busy = NULL;
+    workers_qty = 0;
+    queue_free(jobs);
+    jobs = NULL;
+
+    free(source_root);
+    free(destination_root);
+    source_root = destination_root = NULL;
+
+    free(pending);
+    free(moves);
+    pending = NULL;
+    moves = NULL;
+    pending_qty = pending_size = moves_qty = moves_size = 0;
+}
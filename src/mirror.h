@@ -0,0 +1,113 @@
+/* mirror.h
+ * Replicate the changes of the watched tree into a destination directory
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#ifndef __MIRROR_H
+#define __MIRROR_H
+
+#include <stdint.h>
+
+/* With --mirror the events are applied to a destination directory,
+ * instead of running a command for each of them:
+ *
+ *   - a directory created is created, a file created or written is copied
+ *   - a file or directory deleted (or moved away) is deleted
+ *   - a file or directory renamed is renamed
+ *   - a directory moved into the tree is copied with all its content
+ *
+ * The files to copy are coalesced during a loop of monitor() and copied
+ * by a pool of workers, with a reflink (FICLONE) when the filesystem
+ * supports it, with copy_file_range otherwise. A copy is written to a
+ * temporary file and renamed, so the destination never has half a file.
+ * Deletions and renames wait for the copies in flight of their paths
+ * only, and move or drop the copies still to do. An IN_MOVED_FROM
+ * without its IN_MOVED_TO waits for the next loop, the kernel can give
+ * them in two reads.
+ *
+ * The destination is expected to start as a copy of the watched tree.
+ */
+#define MIRROR_DEFAULT_WORKERS 4
+#define MIRROR_MAX_WORKERS 64
+
+/* milliseconds a loop waits at most while a move waits for its IN_MOVED_TO */
+#define MIRROR_MOVE_TIMEOUT 100
+
+/* events needed by the mirror */
+#define MIRROR_EVENTS (IN_CREATE | IN_CLOSE_WRITE | IN_DELETE | IN_MOVE)
+
+/* starts the workers
+ *
+ * @param  const char * : absolute path of the watched directory, with the trailing slash
+ * @param  const char * : absolute path of the destination, with the trailing slash
+ * @param  int          : number of workers
+ * @return int          : 0 if success, -1 otherwise
+ */
+int mirror_start(const char *, const char *, int);
+
+/* applies an event
+ *
+ * @param uint32_t     : event mask
+ * @param uint32_t     : cookie
+ * @param const char * : directory of the event
+ * @param const char * : name of the file or directory, "" for none
+ */
+void mirror_event(uint32_t, uint32_t, const char *, const char *);
+
+/* hands the copies of the current loop to the workers */
+void mirror_flush();
+
+/* waits for the copies in flight */
+void mirror_wait();
+
+/* returns the number of IN_MOVED_FROM waiting for their IN_MOVED_TO,
+ * they are applied as deletions at the end of the next loop
+ *
+ * @return int
+ */
+int mirror_moves();
+
+/* copies a file, a symbolic link or a directory (without its content)
+ *
+ * @param  const char * : source
+ * @param  const char * : destination
+ * @return int          : 0 if success or if the source is gone, -1 otherwise
+ */
+int mirror_copy(const char *, const char *);
+
+/* returns the number of files copied so far
+ *
+ * @return unsigned long
+ */
+unsigned long mirror_copies();
+
+/* returns the number of copies failed so far
+ *
+ * @return unsigned long
+ */
+unsigned long mirror_failures();
+
+/* flushes, waits for the copies and stops the workers */
+void mirror_stop();
+
+#endif /* !__MIRROR_H */
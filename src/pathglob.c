@@ -0,0 +1,282 @@
+/* pathglob.c
+ * Compile a set of glob patterns into a path automaton
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fnmatch.h>
+
+#include "pathglob.h"
+
+#define STATE(i) (((pathglob_state_t)1) << (i))
+
+PATHGLOB *pathglob_init()
+{
+    PATHGLOB *glob = (PATHGLOB *)malloc(sizeof(PATHGLOB));
+    if (glob == NULL)
+        return NULL;
+
+    memset(glob, 0, sizeof(PATHGLOB));
+
+    /* state 0 is the root directory */
+    glob->qty = 1;
+    glob->parent[0] = -1;
+
+    return glob;
+}
+
+/* returns the child of a state entered by the segment, creating it
+ * if it does not exist yet. Returns -1 if there are too many states.
+ */
+static int child_state(PATHGLOB *glob, int parent, const char *segment, size_t length)
+{
+    int is_globstar = (length == 2 && strncmp(segment, "**", 2) == 0);
+
+    int i;
+    for (i = 1; i < glob->qty; ++i)
+    {
+        if (glob->parent[i] != parent)
+            continue;
+
+        if (is_globstar && (glob->globstar & STATE(i)))
+            return i;
+
+        if (!is_globstar && glob->segment[i] != NULL && strlen(glob->segment[i]) == length && strncmp(glob->segment[i], segment, length) == 0)
+            return i;
+    }
+
+    if (glob->qty == PATHGLOB_MAX_STATES)
+        return -1;
+
+    i = glob->qty++;
+    glob->parent[i] = parent;
+
+    if (is_globstar)
+        glob->globstar |= STATE(i);
+    else
+        glob->segment[i] = strndup(segment, length);
+
+    return i;
+}
+
+static int compile(PATHGLOB *glob, const char *pattern)
+{
+    int state = 0;
+    const char *segment = pattern;
+
+    while (*segment != '\0')
+    {
+        /* skip "./" and repeated slashes */
+        if (*segment == '/')
+        {
+            ++segment;
+            continue;
+        }
+        if (segment[0] == '.' && (segment[1] == '/' || segment[1] == '\0'))
+        {
+            ++segment;
+            continue;
+        }
+
+        size_t length = strcspn(segment, "/");
+        if ((state = child_state(glob, state, segment, length)) == -1)
+            return -1;
+
+        segment += length;
+    }
+
+    if (state == 0)
+        return -1;
+
+    glob->accept |= STATE(state);
+    return 0;
+}
+
+/* expands the first {a,b,...} group of the pattern and compiles
+ * each alternative, recursively
+ */
+static int expand(PATHGLOB *glob, const char *pattern)
+{
+    const char *open = strchr(pattern, '{');
+    if (open == NULL)
+        return compile(glob, pattern);
+
+    const char *close;
+    int depth = 0;
+    for (close = open; *close != '\0'; ++close)
+    {
+        if (*close == '{')
+            ++depth;
+        else if (*close == '}' && --depth == 0)
+            break;
+    }
+
+    if (*close == '\0')
+        return -1;
+
+    size_t length = strlen(pattern);
+    char *alternative = (char *)malloc(length + 1);
+    if (alternative == NULL)
+        return -1;
+
+    const char *start = open + 1;
+    const char *cursor;
+    depth = 0;
+    for (cursor = start; cursor <= close; ++cursor)
+    {
+        if (*cursor == '{')
+            ++depth;
+        else if (*cursor == '}' && depth > 0)
+            --depth;
+        else if ((*cursor == ',' && depth == 0) || cursor == close)
+        {
+            size_t prefix = open - pattern;
+            size_t choice = cursor - start;
+
+            memcpy(alternative, pattern, prefix);
+            memcpy(alternative + prefix, start, choice);
+            strcpy(alternative + prefix + choice, close + 1);
+
+            if (expand(glob, alternative) == -1)
+            {
+                free(alternative);
+                return -1;
+            }
+            start = cursor + 1;
+        }
+    }
+
+    free(alternative);
+    return 0;
+}
+
+int pathglob_add(PATHGLOB *glob, const char *pattern)
+{
+    if (glob == NULL || pattern == NULL || *pattern == '\0')
+        return -1;
+
+    return expand(glob, pattern);
+}
+
+/* adds the "**" states reachable without consuming any segment */
+static pathglob_state_t closure(const PATHGLOB *glob, pathglob_state_t state)
+{
+    int i;
+    for (i = 1; i < glob->qty; ++i)
+    {
+        if ((glob->globstar & STATE(i)) && (state & STATE(glob->parent[i])))
+            state |= STATE(i);
+    }
+
+    return state;
+}
+
+pathglob_state_t pathglob_start(const PATHGLOB *glob)
+{
+    return closure(glob, STATE(0));
+}
+
+pathglob_state_t pathglob_step(const PATHGLOB *glob, pathglob_state_t state, const char *name)
+{
+    pathglob_state_t next = 0;
+
+    int i;
+    for (i = 1; i < glob->qty && state != 0; ++i)
+    {
+        if (glob->globstar & STATE(i))
+        {
+            next |= state & STATE(i);
+        }
+        else if ((state & STATE(glob->parent[i])) && fnmatch(glob->segment[i], name, 0) == 0)
+        {
+            next |= STATE(i);
+        }
+    }
+
+    return closure(glob, next);
+}
+
+pathglob_state_t pathglob_walk(const PATHGLOB *glob, pathglob_state_t state, const char *path)
+{
+    char name[256];
+
+    while (*path != '\0' && state != 0)
+    {
+        if (*path == '/')
+        {
+            ++path;
+            continue;
+        }
+
+        size_t length = strcspn(path, "/");
+        if (length >= sizeof(name))
+            return 0;
+
+        memcpy(name, path, length);
+        name[length] = '\0';
+
+        state = pathglob_step(glob, state, name);
+        path += length;
+    }
+
+    return state;
+}
+
+int pathglob_accepts(const PATHGLOB *glob, pathglob_state_t state)
+{
+    return (state & glob->accept) != 0;
+}
+
+int pathglob_accepts_child(const PATHGLOB *glob, pathglob_state_t state)
+{
+    int i;
+    for (i = 1; i < glob->qty; ++i)
+    {
+        if (!(glob->accept & STATE(i)))
+            continue;
+
+        if (glob->globstar & STATE(i))
+        {
+            if (state & STATE(i))
+                return 1;
+        }
+        else if (state & STATE(glob->parent[i]))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+void pathglob_free(PATHGLOB *glob)
+{
+    if (glob == NULL)
+        return;
+
+    int i;
+    for (i = 0; i < glob->qty; ++i)
+        free(glob->segment[i]);
+
+    free(glob);
+}
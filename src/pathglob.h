@@ -0,0 +1,118 @@
+/* pathglob.h
+ * Compile a set of glob patterns into a path automaton
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __PATHGLOB_H
+#define __PATHGLOB_H
+
+#include <stdint.h>
+
+/* Patterns are relative to the monitored directory and are matched
+ * one path segment at a time:
+ *
+ *   *      any sequence of characters inside a segment
+ *   ?      any single character inside a segment
+ *   [...]  any character of the class
+ *   **     zero or more whole segments
+ *   {a,b}  alternatives, expanded before the compilation
+ *
+ * All the patterns are merged into a single non-deterministic automaton
+ * (patterns that share a prefix share the same states), so a set of
+ * states fits in a pathglob_state_t bitmask.
+ */
+#define PATHGLOB_MAX_STATES 64
+
+typedef uint64_t pathglob_state_t;
+
+typedef struct pathglob_s
+{
+    int qty;                                 /* number of states */
+    int parent[PATHGLOB_MAX_STATES];         /* state from which the state is entered */
+    char *segment[PATHGLOB_MAX_STATES];      /* glob to enter the state, NULL for "**" */
+    pathglob_state_t globstar;               /* states that loop on any segment */
+    pathglob_state_t accept;                 /* states in which a pattern is matched */
+} PATHGLOB;
+
+/* initialize an empty automaton
+ *
+ * @return PATHGLOB * : a pointer to the new automaton
+ */
+PATHGLOB *pathglob_init();
+
+/* compile a pattern into the automaton
+ *
+ * @param  PATHGLOB *   : automaton
+ * @param  const char * : glob pattern
+ * @return int          : -1 if the pattern is malformed or there are
+ *                        too many states, 0 otherwise
+ */
+int pathglob_add(PATHGLOB *, const char *);
+
+/* returns the set of states of the root directory
+ *
+ * @param  const PATHGLOB *  : automaton
+ * @return pathglob_state_t
+ */
+pathglob_state_t pathglob_start(const PATHGLOB *);
+
+/* returns the set of states reached consuming a path segment
+ * An empty set means that nothing below the segment can match.
+ *
+ * @param  const PATHGLOB *  : automaton
+ * @param  pathglob_state_t  : current set of states
+ * @param  const char *      : name of the file or directory
+ * @return pathglob_state_t
+ */
+pathglob_state_t pathglob_step(const PATHGLOB *, pathglob_state_t, const char *);
+
+/* returns the set of states reached consuming all the segments
+ * of a relative path
+ *
+ * @param  const PATHGLOB *  : automaton
+ * @param  pathglob_state_t  : current set of states
+ * @param  const char *      : relative path
+ * @return pathglob_state_t
+ */
+pathglob_state_t pathglob_walk(const PATHGLOB *, pathglob_state_t, const char *);
+
+/* returns 1 if the set of states contains an accepting state
+ *
+ * @param  const PATHGLOB *  : automaton
+ * @param  pathglob_state_t  : set of states
+ * @return int
+ */
+int pathglob_accepts(const PATHGLOB *, pathglob_state_t);
+
+/* returns 1 if a direct child of a directory in the set of
+ * states can be accepted
+ *
+ * @param  const PATHGLOB *  : automaton
+ * @param  pathglob_state_t  : set of states of the directory
+ * @return int
+ */
+int pathglob_accepts_child(const PATHGLOB *, pathglob_state_t);
+
+/* deallocates the automaton */
+void pathglob_free(PATHGLOB *);
+
+#endif /* !__PATHGLOB_H */
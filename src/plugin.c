@@ -0,0 +1,223 @@
+/* plugin.c
+ * Load a plugin and give it the events in batches
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+
+#include "bstrlib.h"
+#include "plugin.h"
+
+/* an event of the batch, the strings are offsets in the strings of the batch */
+typedef struct plugin_entry_s
+{
+    uint64_t sequence;
+    uint32_t mask;
+    int event;
+    int path;
+    int name;
+    int capture; /* -1 for none */
+} PLUGIN_ENTRY;
+
+static void *handle = NULL;
+static CWATCH_PLUGIN plugin;
+static int enabled = 0;
+static char error[256];
+
+static PLUGIN_ENTRY *entries = NULL;
+static CWATCH_PLUGIN_EVENT *events = NULL;
+static int qty = 0;
+static int size = 0;
+static bstring strings = NULL;
+
+static void disable(const char *reason)
+{
+    enabled = 0;
+    snprintf(error, sizeof(error), "%s", reason);
+
+    if (plugin.fini != NULL)
+        plugin.fini();
+}
+
+int plugin_load(const char *path, const char *root, const char *argument)
+{
+    cwatch_plugin_init_t init;
+    int result;
+
+    if (handle != NULL)
+        return 0;
+
+    if ((handle = dlopen(path, RTLD_NOW | RTLD_LOCAL)) == NULL)
+    {
+        snprintf(error, sizeof(error), "%s", dlerror());
+        return -1;
+    }
+
+    *(void **)(&init) = dlsym(handle, "cwatch_plugin_init");
+    if (init == NULL)
+    {
+        snprintf(error, sizeof(error), "cwatch_plugin_init not found");
+        dlclose(handle);
+        handle = NULL;
+        return -1;
+    }
+
+    memset(&plugin, 0, sizeof(plugin));
+    result = init(CWATCH_PLUGIN_ABI, root, argument, &plugin);
+
+    if (result != 0)
+        snprintf(error, sizeof(error), "the plugin refused to start");
+    else if (plugin.abi != CWATCH_PLUGIN_ABI)
+        snprintf(error, sizeof(error), "the plugin has ABI %u, cwatch has ABI %u", plugin.abi, CWATCH_PLUGIN_ABI);
+    else if (plugin.batch == NULL)
+        snprintf(error, sizeof(error), "the plugin has no batch callback");
+
+    if (result != 0 || plugin.abi != CWATCH_PLUGIN_ABI || plugin.batch == NULL)
+    {
+        dlclose(handle);
+        handle = NULL;
+        return -1;
+    }
+
+    strings = bfromcstr("");
+    error[0] = '\0';
+    enabled = 1;
+
+    return 0;
+}
+
+/* appends a string to the strings of the batch, returns its offset */
+static int append_string(const char *string, size_t length)
+{
+    int offset = blength(strings);
+
+    bcatblk(strings, string, length);
+    bconchar(strings, '\0');
+
+    return offset;
+}
+
+void plugin_add(uint64_t sequence, uint32_t mask, const char *event, const char *path, const char *name, const char *capture, size_t capture_len)
+{
+    if (!enabled)
+        return;
+
+    if (qty == size)
+    {
+        int new_size = (size == 0) ? 64 : size * 2;
+        PLUGIN_ENTRY *new_entries = (PLUGIN_ENTRY *)realloc(entries, new_size * sizeof(PLUGIN_ENTRY));
+        CWATCH_PLUGIN_EVENT *new_events = (CWATCH_PLUGIN_EVENT *)realloc(events, new_size * sizeof(CWATCH_PLUGIN_EVENT));
+
+        if (new_entries != NULL)
+            entries = new_entries;
+        if (new_events != NULL)
+            events = new_events;
+        if (new_entries == NULL || new_events == NULL)
+            return;
+
+        size = new_size;
+    }
+
+    PLUGIN_ENTRY *entry = &entries[qty++];
+    entry->sequence = sequence;
+    entry->mask = mask;
+    entry->event = append_string(event, strlen(event));
+    entry->path = append_string(path, strlen(path));
+    entry->name = append_string(name, strlen(name));
+    entry->capture = (capture != NULL) ? append_string(capture, capture_len) : -1;
+}
+
+int plugin_flush()
+{
+    int result;
+
+    if (!enabled || qty == 0)
+        return 0;
+
+    /* the strings do not move anymore */
+    const char *base = (const char *)strings->data;
+    int i;
+    for (i = 0; i < qty; ++i)
+    {
+        events[i].sequence = entries[i].sequence;
+        events[i].mask = entries[i].mask;
+        events[i].event = base + entries[i].event;
+        events[i].path = base + entries[i].path;
+        events[i].name = base + entries[i].name;
+        events[i].capture = (entries[i].capture != -1) ? base + entries[i].capture : NULL;
+    }
+
+    /* NOTE: a plugin runs in the process of cwatch, a crash of the plugin
+     * is a crash of cwatch */
+    result = plugin.batch(events, qty);
+
+    qty = 0;
+    btrunc(strings, 0);
+
+    if (result != 0)
+    {
+        disable("the plugin failed");
+        return -1;
+    }
+
+    return 0;
+}
+
+int plugin_enabled()
+{
+    return enabled;
+}
+
+const char *plugin_error()
+{
+    return error;
+}
+
+void plugin_unload()
+{
+    if (handle == NULL)
+        return;
+
+    if (enabled)
+    {
+        plugin_flush();
+        if (enabled)
+            disable("the plugin is unloaded");
+    }
+
+    dlclose(handle);
+    handle = NULL;
+
+    free(entries);
+    free(events);
+    bdestroy(strings);
+    entries = NULL;
+    events = NULL;
+    strings = NULL;
+    qty = size = 0;
+}
@@ -0,0 +1,76 @@
+/* plugin.h
+ * Load a plugin and give it the events in batches
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#ifndef __PLUGIN_H
+#define __PLUGIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cwatch_plugin.h"
+
+/* loads a plugin (see cwatch_plugin.h)
+ *
+ * @param  const char * : path of the shared library
+ * @param  const char * : absolute path of the watched directory
+ * @param  const char * : argument for the plugin, NULL for none
+ * @return int          : 0 if success, -1 otherwise (see plugin_error)
+ */
+int plugin_load(const char *, const char *, const char *);
+
+/* adds an event to the batch of the current loop
+ *
+ * @param uint64_t     : sequence number
+ * @param uint32_t     : event mask
+ * @param const char * : name of the event
+ * @param const char * : directory of the event
+ * @param const char * : name of the file or directory
+ * @param const char * : text captured by -X, NULL for none
+ * @param size_t       : bytes of the text captured
+ */
+void plugin_add(uint64_t, uint32_t, const char *, const char *, const char *, const char *, size_t);
+
+/* gives the batch of the current loop to the plugin
+ *
+ * @return int : 0, -1 if the plugin has just been disabled
+ */
+int plugin_flush();
+
+/* returns 1 if a plugin is loaded and enabled
+ *
+ * @return int
+ */
+int plugin_enabled();
+
+/* returns the reason of the last failure of the plugin
+ *
+ * @return const char *
+ */
+const char *plugin_error();
+
+/* gives the last batch to the plugin and unloads it */
+void plugin_unload();
+
+#endif /* !__PLUGIN_H */
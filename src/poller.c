@@ -0,0 +1,623 @@
+/* poller.c
+ * Stat-based directory poller that emits inotify-like events
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "queue.h"
+#include "poller.h"
+
+static Queue *polled_directories = NULL; /* queue of POLL_DATA */
+static pthread_mutex_t poller_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t poller_thread;
+static int poller_pipe[2] = {-1, -1};
+static int poller_interval = POLLER_DEFAULT_INTERVAL;
+static int poller_next_wd = POLLER_WD_BASE;
+static uint32_t poller_cookie = 0;
+
+/* a worker scans the directories first, first + step, ... */
+typedef struct poll_worker_s
+{
+    pthread_t thread;
+    int running;
+    POLL_DATA **directories;
+    int qty;
+    int first;
+    int step;
+    int found;
+    bstring events;
+} POLL_WORKER;
+
+static int compare_entries(const void *a, const void *b)
+{
+    return strcmp(((const POLL_ENTRY *)a)->name, ((const POLL_ENTRY *)b)->name);
+}
+
+static void fill_entry(POLL_ENTRY *entry, char *name, const struct stat *st)
+{
+    entry->name = name;
+    entry->ino = st->st_ino;
+    entry->size = st->st_size;
+    entry->mtime = st->st_mtim;
+    entry->ctime = st->st_ctim;
+    entry->is_dir = S_ISDIR(st->st_mode);
+}
+
+int poller_snapshot(const char *path, POLL_ENTRY **entries)
+{
+    DIR *dir_stream = opendir(path);
+    if (dir_stream == NULL)
+        return -1;
+
+    int qty = 0, size = 16;
+    POLL_ENTRY *snapshot = (POLL_ENTRY *)malloc(size * sizeof(POLL_ENTRY));
+    struct dirent *dir;
+    struct stat st;
+
+    while (snapshot != NULL && (dir = readdir(dir_stream)))
+    {
+        if (strcmp(dir->d_name, ".") == 0 || strcmp(dir->d_name, "..") == 0)
+            continue;
+
+        if (fstatat(dirfd(dir_stream), dir->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1)
+            continue;
+
+        if (qty == size)
+        {
+            size *= 2;
+            POLL_ENTRY *bigger = (POLL_ENTRY *)realloc(snapshot, size * sizeof(POLL_ENTRY));
+            if (bigger == NULL)
+            {
+                poller_free_snapshot(snapshot, qty);
+                snapshot = NULL;
+                break;
+            }
+            snapshot = bigger;
+        }
+
+        fill_entry(&snapshot[qty++], strdup(dir->d_name), &st);
+    }
+    closedir(dir_stream);
+
+    if (snapshot == NULL)
+        return -1;
+
+    qsort(snapshot, qty, sizeof(POLL_ENTRY), compare_entries);
+
+    *entries = snapshot;
+    return qty;
+}
+
+int poller_refresh(const char *path, const POLL_ENTRY *old, int qty, POLL_ENTRY **entries)
+{
+    int dir_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd == -1)
+        return -1;
+
+    POLL_ENTRY *snapshot = (POLL_ENTRY *)malloc((qty + 1) * sizeof(POLL_ENTRY));
+    struct stat st;
+
+    int i;
+    for (i = 0; snapshot != NULL && i < qty; ++i)
+    {
+        if (fstatat(dir_fd, old[i].name, &st, AT_SYMLINK_NOFOLLOW) == -1)
+            break;
+
+        fill_entry(&snapshot[i], old[i].name, &st);
+    }
+    close(dir_fd);
+
+    if (snapshot == NULL || i < qty)
+    {
+        free(snapshot);
+        return -1;
+    }
+
+    *entries = snapshot;
+    return qty;
+}
+
+void poller_free_snapshot(POLL_ENTRY *entries, int qty)
+{
+    if (entries == NULL)
+        return;
+
+    int i;
+    for (i = 0; i < qty; ++i)
+        free(entries[i].name);
+
+    free(entries);
+}
+
+void poller_append_event(bstring events, int wd, uint32_t mask, uint32_t cookie, const char *name)
+{
+    struct inotify_event event;
+    size_t length = (name == NULL) ? 0 : strlen(name) + 1;
+
+    /* pad the name as the kernel does, to keep the records aligned */
+    uint32_t padded = (length + sizeof(struct inotify_event) - 1) & ~(sizeof(struct inotify_event) - 1);
+
+    memset(&event, 0, sizeof(event));
+    event.wd = wd;
+    event.mask = mask;
+    event.cookie = cookie;
+    event.len = padded;
+
+    bcatblk(events, &event, sizeof(event));
+    if (padded > 0)
+    {
+        bcatblk(events, name, length - 1);
+        int i;
+        for (i = length - 1; i < padded; ++i)
+            bconchar(events, '\0');
+    }
+}
+
+static int same_time(struct timespec a, struct timespec b)
+{
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+static int append_if_requested(bstring events, int wd, uint32_t mask, uint32_t event_mask, uint32_t cookie, const POLL_ENTRY *entry)
+{
+    if (!(event_mask & mask))
+        return 0;
+
+    poller_append_event(events, wd, event_mask | (entry->is_dir ? IN_ISDIR : 0), cookie, entry->name);
+    return 1;
+}
+
+int poller_diff(const POLL_ENTRY *old, int old_qty, const POLL_ENTRY *new, int new_qty, int wd, uint32_t mask, bstring events)
+{
+    int qty = 0, i = 0, j = 0, deleted_qty = 0, created_qty = 0;
+    const POLL_ENTRY **deleted = (const POLL_ENTRY **)malloc((old_qty + 1) * sizeof(POLL_ENTRY *));
+    const POLL_ENTRY **created = (const POLL_ENTRY **)malloc((new_qty + 1) * sizeof(POLL_ENTRY *));
+
+    if (deleted == NULL || created == NULL)
+    {
+        free(deleted);
+        free(created);
+        return 0;
+    }
+
+    /* both the snapshots are sorted by name */
+    while (i < old_qty || j < new_qty)
+    {
+        int order = (i == old_qty) ? 1 : (j == new_qty) ? -1 : strcmp(old[i].name, new[j].name);
+
+        if (order < 0)
+        {
+            deleted[deleted_qty++] = &old[i++];
+        }
+        else if (order > 0)
+        {
+            created[created_qty++] = &new[j++];
+        }
+        else
+        {
+            if (old[i].ino != new[j].ino || old[i].is_dir != new[j].is_dir)
+            {
+                /* replaced by another file or directory */
+                deleted[deleted_qty++] = &old[i];
+                created[created_qty++] = &new[j];
+            }
+            else if (!new[j].is_dir && (old[i].size != new[j].size || !same_time(old[i].mtime, new[j].mtime)))
+            {
+                qty += append_if_requested(events, wd, mask, IN_MODIFY, 0, &new[j]);
+            }
+            else if (!same_time(old[i].ctime, new[j].ctime) && (new[j].is_dir == 0 || same_time(old[i].mtime, new[j].mtime)))
+            {
+                qty += append_if_requested(events, wd, mask, IN_ATTRIB, 0, &new[j]);
+            }
+            ++i;
+            ++j;
+        }
+    }
+
+    /* an inode deleted and created under another name has been renamed */
+    for (i = 0; i < deleted_qty; ++i)
+    {
+        for (j = 0; j < created_qty; ++j)
+        {
+            if (created[j] != NULL && created[j]->ino == deleted[i]->ino && created[j]->is_dir == deleted[i]->is_dir)
+                break;
+        }
+
+        if (j == created_qty)
+        {
+            qty += append_if_requested(events, wd, mask, IN_DELETE, 0, deleted[i]);
+            continue;
+        }
+
+        uint32_t cookie = __sync_add_and_fetch(&poller_cookie, 1);
+        qty += append_if_requested(events, wd, mask, IN_MOVED_FROM, cookie, deleted[i]);
+        qty += append_if_requested(events, wd, mask, IN_MOVED_TO, cookie, created[j]);
+        created[j] = NULL;
+    }
+
+    for (j = 0; j < created_qty; ++j)
+    {
+        if (created[j] != NULL)
+            qty += append_if_requested(events, wd, mask, IN_CREATE, 0, created[j]);
+    }
+
+    free(deleted);
+    free(created);
+
+    return qty;
+}
+
+int write_event_packets(int fd, bstring events)
+{
+    int offset = 0;
+
+    while (offset < blength(events))
+    {
+        int packet = 0;
+        while (offset + packet < blength(events))
+        {
+            struct inotify_event *event = (struct inotify_event *)(events->data + offset + packet);
+            int size = sizeof(struct inotify_event) + event->len;
+
+            if (packet + size > PIPE_BUF)
+                break;
+            packet += size;
+        }
+
+        if (write(fd, events->data + offset, packet) == -1)
+            return -1;
+        offset += packet;
+    }
+
+    return 0;
+}
+
+/* lists a directory, remembering its mtime */
+static int list_directory(POLL_DATA *poll_data, POLL_ENTRY **entries)
+{
+    struct stat st;
+    time_t now = time(NULL);
+
+    /* NOTE: stat before listing, so a change in between is seen the next time */
+    if (stat(poll_data->path, &st) == -1)
+        return -1;
+
+    int qty = poller_snapshot(poll_data->path, entries);
+    if (qty != -1)
+    {
+        poll_data->mtime = st.st_mtim;
+        poll_data->listed_at = now;
+    }
+
+    return qty;
+}
+
+static int poll_directory(POLL_DATA *poll_data, bstring events)
+{
+    POLL_ENTRY *entries = NULL;
+    int qty = -1, shared_names = 0;
+    struct stat st;
+
+    if (stat(poll_data->path, &st) == -1)
+    {
+        /* the directory is gone, its parent will report the deletion */
+        return 0;
+    }
+
+    /* NOTE: the mtime of a directory changes only when an entry is added,
+     *       removed or renamed, otherwise there is no need to list it again.
+     *       A directory changed in the second it was listed could hide a
+     *       change behind a coarse timestamp, so it is listed again.
+     */
+    if (same_time(st.st_mtim, poll_data->mtime) && st.st_mtim.tv_sec < poll_data->listed_at)
+    {
+        qty = poller_refresh(poll_data->path, poll_data->entries, poll_data->qty, &entries);
+        shared_names = (qty != -1);
+    }
+
+    if (qty == -1 && (qty = list_directory(poll_data, &entries)) == -1)
+        return 0;
+
+    uint32_t mask = __atomic_load_n(&poll_data->mask, __ATOMIC_RELAXED);
+    int found = poller_diff(poll_data->entries, poll_data->qty, entries, qty, poll_data->wd, mask, events);
+
+    if (shared_names)
+        free(poll_data->entries);
+    else
+        poller_free_snapshot(poll_data->entries, poll_data->qty);
+
+    poll_data->entries = entries;
+    poll_data->qty = qty;
+
+    return found;
+}
+
+static void *poll_worker(void *arg)
+{
+    POLL_WORKER *worker = (POLL_WORKER *)arg;
+
+    int i;
+    for (i = worker->first; i < worker->qty; i += worker->step)
+        worker->found += poll_directory(worker->directories[i], worker->events);
+
+    return NULL;
+}
+
+static void free_poll_data(POLL_DATA *poll_data)
+{
+    poller_free_snapshot(poll_data->entries, poll_data->qty);
+    free(poll_data->path);
+    free(poll_data);
+}
+
+/* scans all the polled directories, in parallel when they are many.
+ * The poller_mutex is held only to take the directories and to give
+ * them back, so the watches can be added and removed meanwhile.
+ */
+static int scan_directories(bstring events)
+{
+    pthread_mutex_lock(&poller_mutex);
+
+    int qty = queue_size(polled_directories);
+    POLL_DATA **directories = (POLL_DATA **)malloc((qty + 1) * sizeof(POLL_DATA *));
+    if (directories == NULL)
+    {
+        pthread_mutex_unlock(&poller_mutex);
+        return 0;
+    }
+
+    int i = 0;
+    QueueElement *element = polled_directories->first;
+    while (element)
+    {
+        POLL_DATA *poll_data = (POLL_DATA *)element->data;
+        poll_data->scanning = 1;
+        directories[i++] = poll_data;
+        element = element->next;
+    }
+
+    pthread_mutex_unlock(&poller_mutex);
+
+    long workers_qty = sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers_qty > POLLER_MAX_WORKERS)
+        workers_qty = POLLER_MAX_WORKERS;
+    if (workers_qty > qty / POLLER_DIRS_PER_WORKER)
+        workers_qty = qty / POLLER_DIRS_PER_WORKER;
+    if (workers_qty < 1)
+        workers_qty = 1;
+
+    POLL_WORKER workers[POLLER_MAX_WORKERS];
+    int found = 0;
+
+    for (i = 0; i < workers_qty; ++i)
+    {
+        workers[i].directories = directories;
+        workers[i].qty = qty;
+        workers[i].first = i;
+        workers[i].step = workers_qty;
+        workers[i].found = 0;
+        workers[i].events = (i == 0) ? events : bfromcstr("");
+
+        /* the first worker is the poller thread itself */
+        workers[i].running = (i > 0 && pthread_create(&workers[i].thread, NULL, poll_worker, &workers[i]) == 0);
+    }
+
+    poll_worker(&workers[0]);
+    found += workers[0].found;
+
+    for (i = 1; i < workers_qty; ++i)
+    {
+        /* a worker that failed to start is run here */
+        if (workers[i].running)
+            pthread_join(workers[i].thread, NULL);
+        else
+            poll_worker(&workers[i]);
+
+        bconcat(events, workers[i].events);
+        bdestroy(workers[i].events);
+        found += workers[i].found;
+    }
+
+    /* the directories removed meanwhile are freed here */
+    pthread_mutex_lock(&poller_mutex);
+    for (i = 0; i < qty; ++i)
+    {
+        directories[i]->scanning = 0;
+        if (directories[i]->removed)
+            free_poll_data(directories[i]);
+    }
+    pthread_mutex_unlock(&poller_mutex);
+
+    free(directories);
+    return found;
+}
+
+static void *poller_loop(void *arg)
+{
+    bstring events = bfromcstr("");
+    int interval = poller_interval;
+
+    while (1)
+    {
+        sleep(interval);
+
+        int found = scan_directories(events);
+
+        write_event_packets(poller_pipe[1], events);
+        btrunc(events, 0);
+
+        /* look again soon after some activity, less and less often when quiet */
+        if (found > 0)
+            interval = POLLER_MIN_INTERVAL;
+        else if ((interval *= 2) > poller_interval)
+            interval = poller_interval;
+    }
+
+    return NULL;
+}
+
+int poller_start(int interval)
+{
+    if (poller_pipe[0] != -1)
+        return poller_pipe[0];
+
+    if (interval > 0)
+        poller_interval = interval;
+
+    polled_directories = queue_init();
+
+    /* NOTE: O_DIRECT makes a packet pipe, so a read never splits an event */
+    if (polled_directories == NULL || pipe2(poller_pipe, O_DIRECT | O_CLOEXEC) == -1)
+        return -1;
+
+    if (pthread_create(&poller_thread, NULL, poller_loop, NULL) != 0)
+    {
+        close(poller_pipe[0]);
+        close(poller_pipe[1]);
+        poller_pipe[0] = poller_pipe[1] = -1;
+        return -1;
+    }
+
+    return poller_pipe[0];
+}
+
+int poller_descriptor()
+{
+    return poller_pipe[0];
+}
+
+int is_poller_wd(int wd)
+{
+    return wd >= POLLER_WD_BASE;
+}
+
+static QueueElement *get_poll_node_from_wd(int wd)
+{
+    QueueElement *element = polled_directories->first;
+    while (element)
+    {
+        if (((POLL_DATA *)element->data)->wd == wd)
+            return element;
+        element = element->next;
+    }
+
+    return NULL;
+}
+
+/* must be called holding the poller_mutex */
+static POLL_DATA *get_poll_data_from_path(const char *path)
+{
+    QueueElement *element = polled_directories->first;
+    while (element)
+    {
+        POLL_DATA *poll_data = (POLL_DATA *)element->data;
+        if (strcmp(poll_data->path, path) == 0)
+            return poll_data;
+        element = element->next;
+    }
+
+    return NULL;
+}
+
+int poller_add_watch(int fd, const char *path, uint32_t mask)
+{
+    if (polled_directories == NULL)
+        return -1;
+
+    pthread_mutex_lock(&poller_mutex);
+
+    /* as inotify does, a path already polled keeps its descriptor */
+    POLL_DATA *poll_data = get_poll_data_from_path(path);
+    if (poll_data != NULL)
+    {
+        __atomic_store_n(&poll_data->mask, mask, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&poller_mutex);
+        return poll_data->wd;
+    }
+
+    pthread_mutex_unlock(&poller_mutex);
+
+    /* the directory is listed out of the lock, the poller can be scanning */
+    poll_data = (POLL_DATA *)calloc(1, sizeof(POLL_DATA));
+    if (poll_data == NULL || (poll_data->path = strdup(path)) == NULL)
+    {
+        free(poll_data);
+        return -1;
+    }
+
+    if ((poll_data->qty = list_directory(poll_data, &poll_data->entries)) == -1)
+    {
+        free(poll_data->path);
+        free(poll_data);
+        return -1;
+    }
+
+    poll_data->mask = mask;
+
+    pthread_mutex_lock(&poller_mutex);
+    poll_data->wd = poller_next_wd++;
+    queue_enqueue(polled_directories, (void *)poll_data);
+    pthread_mutex_unlock(&poller_mutex);
+
+    return poll_data->wd;
+}
+
+int poller_rm_watch(int fd, int wd)
+{
+    if (polled_directories == NULL)
+        return -1;
+
+    pthread_mutex_lock(&poller_mutex);
+
+    QueueElement *element = get_poll_node_from_wd(wd);
+    if (element == NULL)
+    {
+        pthread_mutex_unlock(&poller_mutex);
+        return -1;
+    }
+
+    POLL_DATA *poll_data = (POLL_DATA *)element->data;
+    queue_remove(polled_directories, element);
+
+    /* a directory being scanned is freed by the poller, once done */
+    int scanning = poll_data->scanning;
+    poll_data->removed = 1;
+
+    pthread_mutex_unlock(&poller_mutex);
+
+    if (!scanning)
+        free_poll_data(poll_data);
+
+    return 0;
+}
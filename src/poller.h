@@ -0,0 +1,180 @@
+/* poller.h
+ * Stat-based directory poller that emits inotify-like events
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __POLLER_H
+#define __POLLER_H
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "bstrlib.h"
+
+/* The poller keeps a snapshot of each polled directory and, every
+ * interval, compares it with a new one. The differences are written
+ * as struct inotify_event records into a pipe, so the events can be
+ * read and handled exactly as the ones of an inotify descriptor.
+ *
+ * Watch descriptors of the poller start from POLLER_WD_BASE and never
+ * collide with the ones of inotify.
+ */
+#define POLLER_WD_BASE (1 << 30)
+
+/* default seconds between two scans. The interval adapts to the
+ * activity: after a scan that found some changes the next one comes
+ * after POLLER_MIN_INTERVAL, then the interval doubles at each quiet
+ * scan up to the one requested.
+ */
+#define POLLER_DEFAULT_INTERVAL 30
+#define POLLER_MIN_INTERVAL 1
+
+/* directories are scanned in parallel by up to POLLER_MAX_WORKERS
+ * threads, each one with at least POLLER_DIRS_PER_WORKER directories
+ */
+#define POLLER_MAX_WORKERS 8
+#define POLLER_DIRS_PER_WORKER 64
+
+/* used to store the state of an entry of a polled directory */
+typedef struct poll_entry_s
+{
+    char *name;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    struct timespec ctime;
+    int is_dir;
+} POLL_ENTRY;
+
+/* used to store information about polled directory */
+typedef struct poll_data_s
+{
+    int wd;                /* poller watch descriptor */
+    char *path;            /* absolute real path of the directory */
+    uint32_t mask;         /* events to report */
+    struct timespec mtime; /* mtime of the directory when it was listed */
+    time_t listed_at;      /* when the directory was listed */
+    POLL_ENTRY *entries;   /* snapshot sorted by name */
+    int qty;               /* number of entries of the snapshot */
+    int scanning;          /* TRUE while the poller scans it, out of the lock */
+    int removed;           /* TRUE if removed while scanned, freed by the poller */
+} POLL_DATA;
+
+/* starts the poller thread, if it is not already running
+ *
+ * @param  int : seconds between two scans
+ * @return int : the descriptor from which read the events, -1 on error
+ */
+int poller_start(int);
+
+/* returns the descriptor from which read the events
+ *
+ * @return int : -1 if the poller is not running
+ */
+int poller_descriptor();
+
+/* start polling a directory.
+ * It has the same signature of inotify_add_watch
+ *
+ * @param  int          : ignored
+ * @param  const char * : absolute real path
+ * @param  uint32_t     : event mask
+ * @return int          : watch descriptor, -1 on error
+ */
+int poller_add_watch(int, const char *, uint32_t);
+
+/* stop polling a directory.
+ * It has the same signature of inotify_rm_watch
+ *
+ * @param  int : ignored
+ * @param  int : watch descriptor
+ * @return int : 0 if success, -1 otherwise
+ */
+int poller_rm_watch(int, int);
+
+/* returns 1 if the watch descriptor belongs to the poller
+ *
+ * @param  int : watch descriptor
+ * @return int
+ */
+int is_poller_wd(int);
+
+/* takes a snapshot of a directory, sorted by name
+ *
+ * @param  const char *  : absolute path of the directory
+ * @param  POLL_ENTRY ** : where to store the entries
+ * @return int           : number of entries, -1 on error
+ */
+int poller_snapshot(const char *, POLL_ENTRY **);
+
+/* refreshes the state of the entries of a snapshot, without listing
+ * the directory again. The new snapshot shares the names of the old one.
+ *
+ * @param  const char *       : absolute path of the directory
+ * @param  const POLL_ENTRY * : old snapshot
+ * @param  int                : number of entries of the old snapshot
+ * @param  POLL_ENTRY **      : where to store the entries
+ * @return int                : number of entries, -1 if an entry is gone
+ */
+int poller_refresh(const char *, const POLL_ENTRY *, int, POLL_ENTRY **);
+
+/* compares two snapshots of the same directory and appends
+ * the struct inotify_event records of the differences.
+ * An entry deleted and created with the same inode under
+ * another name is reported as IN_MOVED_FROM and IN_MOVED_TO.
+ *
+ * @param  const POLL_ENTRY * : old snapshot
+ * @param  int                : number of entries of the old snapshot
+ * @param  const POLL_ENTRY * : new snapshot
+ * @param  int                : number of entries of the new snapshot
+ * @param  int                : watch descriptor of the events
+ * @param  uint32_t           : events to report
+ * @param  bstring            : where to append the events
+ * @return int                : number of events appended
+ */
+int poller_diff(const POLL_ENTRY *, int, const POLL_ENTRY *, int, int, uint32_t, bstring);
+
+/* appends a struct inotify_event record
+ *
+ * @param bstring      : where to append the event
+ * @param int          : watch descriptor
+ * @param uint32_t     : event mask
+ * @param uint32_t     : cookie
+ * @param const char * : name of the file or directory, NULL for none
+ */
+void poller_append_event(bstring, int, uint32_t, uint32_t, const char *);
+
+/* writes struct inotify_event records into a packet pipe (O_DIRECT),
+ * grouped in packets of at most PIPE_BUF bytes, so that a read never
+ * splits an event
+ *
+ * @param  int     : write end of the pipe
+ * @param  bstring : the events
+ * @return int     : 0 if success, -1 otherwise
+ */
+int write_event_packets(int, bstring);
+
+/* deallocates a snapshot */
+void poller_free_snapshot(POLL_ENTRY *, int);
+
+#endif /* !__POLLER_H */
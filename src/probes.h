@@ -0,0 +1,69 @@
+/* probes.h
+ * Static tracepoints (USDT) on the hot paths, for perf and bpftrace
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#ifndef __PROBES_H
+#define __PROBES_H
+
+/* When <sys/sdt.h> is available (systemtap-sdt-dev) each probe is a nop
+ * and a note in the ELF file; the tracers turn it into a breakpoint only
+ * while they are attached. Otherwise the probes are compiled out.
+ *
+ * The probes of the provider cwatch, and their arguments:
+ *
+ *   read             (int fd, long bytes)         the kernel gave events
+ *   event            (int wd, uint32_t mask, char *name)
+ *                                                 an event decoded
+ *   exclude          (int wd, uint32_t mask, char *name, int by_include)
+ *                                                 an event discarded by -x or
+ *                                                 the mask (0), by -i (1)
+ *   dispatch         (uint32_t mask)              the handler of an event is looked up
+ *   command__start   (int number, char *command)
+ *   command__done    (int number, int status, uint64_t microseconds)
+ *   watch__add       (int wd, char *path)
+ *   watch__remove    (int wd, char *path)
+ *   walk__directory  (char *path, int depth)      a directory listed by a walk
+ *
+ * e.g.  bpftrace -e 'usdt:./cwatch:cwatch:command__done { @us = hist(arg2); }'
+ */
+
+#ifdef HAVE_SYS_SDT_H
+
+#include <sys/sdt.h>
+
+#define CWATCH_PROBE1(name, a1) DTRACE_PROBE1(cwatch, name, a1)
+#define CWATCH_PROBE2(name, a1, a2) DTRACE_PROBE2(cwatch, name, a1, a2)
+#define CWATCH_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(cwatch, name, a1, a2, a3)
+#define CWATCH_PROBE4(name, a1, a2, a3, a4) DTRACE_PROBE4(cwatch, name, a1, a2, a3, a4)
+
+#else
+
+#define CWATCH_PROBE1(name, a1) do { } while (0)
+#define CWATCH_PROBE2(name, a1, a2) do { } while (0)
+#define CWATCH_PROBE3(name, a1, a2, a3) do { } while (0)
+#define CWATCH_PROBE4(name, a1, a2, a3, a4) do { } while (0)
+
+#endif /* HAVE_SYS_SDT_H */
+
+#endif /* !__PROBES_H */
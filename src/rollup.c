@@ -0,0 +1,287 @@
+/* rollup.c
+ * Roll the events up into one record per directory and per window
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "rollup.h"
+
+/* a prefix changed in the current window */
+typedef struct rollup_entry_s
+{
+    ROLLUP_RECORD *record;
+    struct rollup_entry_s *next;
+} ROLLUP_ENTRY;
+
+static char **prefixes = NULL; /* with the trailing slash */
+static int prefixes_qty = 0;
+static int depth = -1;
+static int window_ms = ROLLUP_DEFAULT_WINDOW_MS;
+
+static ROLLUP_ENTRY *entries[ROLLUP_BUCKETS];
+static Queue *window = NULL; /* queue of ROLLUP_RECORD, in the order they changed first */
+static int timer_fd = -1;
+
+static unsigned int hash_of(const char *prefix)
+{
+    unsigned int hash = 2166136261u;
+
+    while (*prefix != '\0')
+        hash = (hash ^ (unsigned char)*prefix++) * 16777619u;
+
+    return hash % ROLLUP_BUCKETS;
+}
+
+/* starts the window, or stops it with 0 */
+static void arm(int milliseconds)
+{
+    struct itimerspec timer;
+
+    memset(&timer, 0, sizeof(timer));
+    timer.it_value.tv_sec = milliseconds / 1000;
+    timer.it_value.tv_nsec = (milliseconds % 1000) * 1000000L;
+    timerfd_settime(timer_fd, 0, &timer, NULL);
+}
+
+int rollup_add_prefix(const char *prefix)
+{
+    size_t len = strlen(prefix);
+
+    /* the root is the empty prefix */
+    while (len > 0 && prefix[0] == '/')
+    {
+        ++prefix;
+        --len;
+    }
+    while (len > 0 && prefix[len - 1] == '/')
+        --len;
+
+    char **grown = (char **)realloc(prefixes, (prefixes_qty + 1) * sizeof(char *));
+    if (grown == NULL)
+        return -1;
+    prefixes = grown;
+
+    char *copy = (char *)malloc(len + 2);
+    if (copy == NULL)
+        return -1;
+
+    memcpy(copy, prefix, len);
+    if (len > 0)
+        copy[len++] = '/';
+    copy[len] = '\0';
+
+    prefixes[prefixes_qty++] = copy;
+
+    return 0;
+}
+
+int rollup_start(int ancestors_depth, int milliseconds)
+{
+    if (timer_fd != -1)
+        return timer_fd;
+
+    if ((window = queue_init()) == NULL)
+        return -1;
+
+    if ((timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) == -1)
+    {
+        queue_free(window);
+        window = NULL;
+        return -1;
+    }
+
+    depth = ancestors_depth;
+    window_ms = milliseconds;
+
+    return timer_fd;
+}
+
+int rollup_descriptor()
+{
+    return timer_fd;
+}
+
+int rollup_prefix_of(const char *path, char *prefix, size_t size)
+{
+    size_t len = 0;
+    int matched = 0;
+
+    /* the longest prefix given that contains the path, the root is "" */
+    int i;
+    for (i = 0; i < prefixes_qty; ++i)
+    {
+        size_t prefix_len = strlen(prefixes[i]);
+        if ((matched == 0 || prefix_len >= len) && strncmp(path, prefixes[i], prefix_len) == 0)
+        {
+            len = prefix_len;
+            matched = 1;
+        }
+    }
+
+    if (matched == 0 && depth > 0)
+    {
+        /* the ancestor at the depth, or the deepest directory */
+        int components = 0;
+        const char *slash = path;
+        while (components < depth && (slash = strchr(slash, '/')) != NULL)
+        {
+            len = ++slash - path;
+            ++components;
+        }
+    }
+
+    if (len + 1 > size)
+        return -1;
+
+    memcpy(prefix, path, len);
+    prefix[len] = '\0';
+
+    return 0;
+}
+
+int rollup_event(const char *path, uint32_t mask)
+{
+    char *prefix = (char *)malloc(strlen(path) + 1);
+    if (prefix == NULL)
+        return -1;
+
+    rollup_prefix_of(path, prefix, strlen(path) + 1);
+
+    unsigned int bucket = hash_of(prefix);
+    ROLLUP_ENTRY *entry;
+    for (entry = entries[bucket]; entry != NULL; entry = entry->next)
+    {
+        if (strcmp(entry->record->prefix, prefix) == 0)
+        {
+            entry->record->mask |= mask;
+            ++entry->record->count;
+            free(prefix);
+            return 0;
+        }
+    }
+
+    ROLLUP_RECORD *record = (ROLLUP_RECORD *)malloc(sizeof(ROLLUP_RECORD));
+    entry = (ROLLUP_ENTRY *)malloc(sizeof(ROLLUP_ENTRY));
+    if (record == NULL || entry == NULL)
+    {
+        free(record);
+        free(entry);
+        free(prefix);
+        return -1;
+    }
+
+    record->prefix = prefix;
+    record->mask = mask;
+    record->count = 1;
+
+    /* the first event starts the window */
+    if (window->first == NULL)
+        arm(window_ms);
+
+    queue_enqueue(window, record);
+    entry->record = record;
+    entry->next = entries[bucket];
+    entries[bucket] = entry;
+
+    return 0;
+}
+
+int rollup_pending()
+{
+    if (window == NULL)
+        return 0;
+
+    return queue_size(window);
+}
+
+static void forget_entries()
+{
+    int i;
+    for (i = 0; i < ROLLUP_BUCKETS; ++i)
+    {
+        while (entries[i] != NULL)
+        {
+            ROLLUP_ENTRY *entry = entries[i];
+            entries[i] = entry->next;
+            free(entry);
+        }
+    }
+}
+
+Queue *rollup_release()
+{
+    uint64_t expirations;
+    Queue *released = window;
+
+    /* the descriptor is readable until it is read */
+    if (read(timer_fd, &expirations, sizeof(expirations)) == -1)
+        expirations = 0;
+
+    /* the window goes on, it is released at the next expiration */
+    Queue *next_window = queue_init();
+    if (next_window == NULL)
+    {
+        arm(window_ms);
+        return NULL;
+    }
+
+    arm(0);
+    forget_entries();
+    window = next_window;
+
+    return released;
+}
+
+void rollup_free(ROLLUP_RECORD *record)
+{
+    free(record->prefix);
+    free(record);
+}
+
+void rollup_stop()
+{
+    ROLLUP_RECORD *record;
+
+    if (timer_fd != -1)
+    {
+        arm(0);
+        forget_entries();
+        while ((record = (ROLLUP_RECORD *)queue_dequeue(window)))
+            rollup_free(record);
+        queue_free(window);
+        window = NULL;
+
+        close(timer_fd);
+        timer_fd = -1;
+    }
+
+    while (prefixes_qty > 0)
+        free(prefixes[--prefixes_qty]);
+    free(prefixes);
+    prefixes = NULL;
+    depth = -1;
+}
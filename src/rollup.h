@@ -0,0 +1,116 @@
+/* rollup.h
+ * Roll the events up into one record per directory and per window
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#ifndef __ROLLUP_H
+#define __ROLLUP_H
+
+#include <stdint.h>
+
+#include "queue.h"
+
+/* An event is rolled up into the longest of the prefixes given that
+ * contains it, otherwise into its ancestor at the depth given (the
+ * deepest directory of the path if it is not as deep). The paths are
+ * relative to the root, the directories end with a slash and the root
+ * is the empty prefix.
+ *
+ * A window starts with the first event rolled up, and lasts the
+ * milliseconds given: then a record per prefix changed is released,
+ * with the number of events and their masks merged, in the order the
+ * prefixes changed first.
+ */
+#define ROLLUP_DEFAULT_WINDOW_MS 1000
+
+/* number of buckets of the table of the prefixes of a window */
+#define ROLLUP_BUCKETS 1024
+
+/* used to release the events of a prefix */
+typedef struct rollup_record_s
+{
+    char *prefix;        /* relative to the root, "" for the root itself */
+    uint32_t mask;       /* masks of the events merged */
+    unsigned long count; /* number of events */
+} ROLLUP_RECORD;
+
+/* adds a prefix, before rollup_start()
+ *
+ * @param  const char * : prefix relative to the root, the trailing slash is optional
+ * @return int          : 0 if success, -1 otherwise
+ */
+int rollup_add_prefix(const char *);
+
+/* starts rolling up the events
+ *
+ * @param  int : depth of the ancestors, -1 to roll up into the root
+ *               the events outside of the prefixes
+ * @param  int : milliseconds of a window
+ * @return int : the descriptor that becomes readable when a window is
+ *               over, -1 on error
+ */
+int rollup_start(int, int);
+
+/* returns the descriptor that becomes readable when a window is over
+ *
+ * @return int : -1 if the events are not rolled up
+ */
+int rollup_descriptor();
+
+/* returns the prefix an event is rolled up into
+ *
+ * @param  const char * : path of the event, relative to the root
+ * @param  char *       : buffer for the prefix
+ * @param  size_t       : size of the buffer
+ * @return int          : 0 if success, -1 if the buffer is too short
+ */
+int rollup_prefix_of(const char *, char *, size_t);
+
+/* rolls an event up into its prefix
+ *
+ * @param  const char * : path of the event, relative to the root
+ * @param  uint32_t     : mask of the event
+ * @return int          : 0 if success, -1 otherwise
+ */
+int rollup_event(const char *, uint32_t);
+
+/* returns the number of prefixes changed in the current window
+ *
+ * @return int
+ */
+int rollup_pending();
+
+/* ends the current window
+ *
+ * @return Queue * : queue of ROLLUP_RECORD, in the order the prefixes changed first,
+ *                   NULL on error (the window goes on)
+ */
+Queue *rollup_release();
+
+/* deallocates a record released */
+void rollup_free(ROLLUP_RECORD *);
+
+/* forgets the prefixes and the window, closes the descriptor */
+void rollup_stop();
+
+#endif /* !__ROLLUP_H */
@@ -0,0 +1,284 @@
+/* shard.c
+ * Spread the watches across many inotify instances
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "bstrlib.h"
+#include "poller.h"
+#include "shard.h"
+
+/* size of the buffer of each shard thread */
+#define SHARD_BUF_LEN (1024 * (sizeof(struct inotify_event) + 16))
+
+static int shard_fds[SHARDS_MAX];
+static int shards_qty = 0;
+static int merge_pipe[2] = {-1, -1};
+static char *shard_root = NULL;
+static int (*shard_filter)(struct inotify_event *) = NULL;
+
+/* the watch descriptors of cwatch indexed by the ones of each shard,
+ * guarded by the mutex of the shard, since its thread translates them.
+ * The shard and the descriptor of the shard of each watch descriptor
+ * of cwatch are used by the main thread only.
+ */
+static pthread_mutex_t shard_mutexes[SHARDS_MAX];
+static int *wd_of[SHARDS_MAX];
+static int wd_size[SHARDS_MAX];
+static int *shard_of_wd = NULL;
+static int *local_wd_of = NULL;
+static int shard_of_size = 0;
+static int local_wd_size = 0;
+static int next_wd = 1;
+
+/* stores value at index of a table, making it grow when needed */
+static int table_set(int **table, int *size, int index, int value)
+{
+    if (index >= *size)
+    {
+        int new_size = (*size == 0) ? 64 : *size;
+        while (new_size <= index)
+            new_size *= 2;
+
+        int *bigger = (int *)realloc(*table, new_size * sizeof(int));
+        if (bigger == NULL)
+            return -1;
+
+        int i;
+        for (i = *size; i < new_size; ++i)
+            bigger[i] = -1;
+
+        *table = bigger;
+        *size = new_size;
+    }
+
+    (*table)[index] = value;
+    return 0;
+}
+
+static int table_get(int *table, int size, int index)
+{
+    return (index >= 0 && index < size) ? table[index] : -1;
+}
+
+/* returns the watch descriptor of cwatch of a watch of a shard, -1 if it is removed */
+static int translate(int shard, int local_wd)
+{
+    pthread_mutex_lock(&shard_mutexes[shard]);
+    int wd = table_get(wd_of[shard], wd_size[shard], local_wd);
+    pthread_mutex_unlock(&shard_mutexes[shard]);
+
+    return wd;
+}
+
+int shard_of(const char *root, const char *path, int qty)
+{
+    size_t root_len = strlen(root);
+    const char *subtree = path;
+    int whole_path = 1;
+
+    /* NOTE: directories outside the tree (symbolic links) are a subtree on their own */
+    if (strncmp(root, path, root_len) == 0)
+    {
+        subtree = path + root_len;
+        if (*subtree == '\0')
+            return 0;
+        whole_path = 0;
+    }
+
+    unsigned int hash = 2166136261u;
+    while (*subtree != '\0' && (whole_path || *subtree != '/'))
+        hash = (hash ^ (unsigned char)*subtree++) * 16777619u;
+
+    return hash % qty;
+}
+
+static void *shard_loop(void *arg)
+{
+    int shard = (int)(long)arg;
+    char *buffer = (char *)malloc(SHARD_BUF_LEN);
+    bstring events = bfromcstr("");
+    ssize_t len;
+
+    while (buffer != NULL && (len = read(shard_fds[shard], buffer, SHARD_BUF_LEN)) != 0)
+    {
+        if (len == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        ssize_t i = 0;
+        while (i < len)
+        {
+            struct inotify_event *event = (struct inotify_event *)&buffer[i];
+            i += sizeof(struct inotify_event) + event->len;
+
+            if (shard_filter != NULL && !shard_filter(event))
+                continue;
+
+            /* an overflow has no watch descriptor, the events of a watch removed meanwhile are dropped */
+            if (event->wd != -1 && (event->wd = translate(shard, event->wd)) == -1)
+                continue;
+
+            bcatblk(events, event, sizeof(struct inotify_event) + event->len);
+        }
+
+        write_event_packets(merge_pipe[1], events);
+        btrunc(events, 0);
+    }
+
+    free(buffer);
+    bdestroy(events);
+
+    return NULL;
+}
+
+/* releases what shards_start allocated before failing */
+static int abort_start()
+{
+    int error = errno;
+
+    while (shards_qty > 0)
+        close(shard_fds[--shards_qty]);
+
+    free(shard_root);
+    shard_root = NULL;
+    close(merge_pipe[0]);
+    close(merge_pipe[1]);
+    merge_pipe[0] = merge_pipe[1] = -1;
+
+    errno = error;
+    return -1;
+}
+
+int shards_start(const char *root, int qty, int (*filter)(struct inotify_event *))
+{
+    if (qty < 1 || qty > SHARDS_MAX)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* NOTE: O_DIRECT makes a packet pipe, so a read never splits an event */
+    if (pipe2(merge_pipe, O_DIRECT | O_CLOEXEC) == -1)
+        return -1;
+
+    if ((shard_root = strdup(root)) == NULL)
+        return abort_start();
+
+    shard_filter = filter;
+
+    for (shards_qty = 0; shards_qty < qty; ++shards_qty)
+    {
+        if ((shard_fds[shards_qty] = inotify_init1(IN_CLOEXEC)) == -1)
+            return abort_start();
+
+        pthread_mutex_init(&shard_mutexes[shards_qty], NULL);
+    }
+
+    /* NOTE: the threads already started can not be stopped, cwatch is going to exit */
+    int shard;
+    for (shard = 0; shard < qty; ++shard)
+    {
+        pthread_t thread;
+
+        if (pthread_create(&thread, NULL, shard_loop, (void *)(long)shard) != 0)
+            return -1;
+
+        pthread_detach(thread);
+    }
+
+    return merge_pipe[0];
+}
+
+int shard_add_watch(int fd, const char *path, uint32_t mask)
+{
+    int shard = shard_of(shard_root, path, shards_qty);
+    int wd = -1;
+
+    pthread_mutex_lock(&shard_mutexes[shard]);
+
+    int local_wd = inotify_add_watch(shard_fds[shard], path, mask);
+    if (local_wd != -1)
+    {
+        /* as inotify does, a directory already watched keeps its descriptor */
+        wd = table_get(wd_of[shard], wd_size[shard], local_wd);
+
+        if (wd == -1 && next_wd >= POLLER_WD_BASE)
+        {
+            inotify_rm_watch(shard_fds[shard], local_wd);
+            errno = ENOSPC;
+        }
+        else if (wd == -1)
+        {
+            if (table_set(&shard_of_wd, &shard_of_size, next_wd, shard) == -1 ||
+                table_set(&local_wd_of, &local_wd_size, next_wd, local_wd) == -1 ||
+                table_set(&wd_of[shard], &wd_size[shard], local_wd, next_wd) == -1)
+            {
+                int error = errno;
+                inotify_rm_watch(shard_fds[shard], local_wd);
+                errno = error;
+            }
+            else
+            {
+                wd = next_wd++;
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&shard_mutexes[shard]);
+
+    return wd;
+}
+
+int shard_rm_watch(int fd, int wd)
+{
+    int shard = table_get(shard_of_wd, shard_of_size, wd);
+    int local_wd = table_get(local_wd_of, local_wd_size, wd);
+
+    if (shard == -1 || local_wd == -1)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pthread_mutex_lock(&shard_mutexes[shard]);
+    table_set(&wd_of[shard], &wd_size[shard], local_wd, -1);
+    pthread_mutex_unlock(&shard_mutexes[shard]);
+
+    table_set(&shard_of_wd, &shard_of_size, wd, -1);
+    table_set(&local_wd_of, &local_wd_size, wd, -1);
+
+    return inotify_rm_watch(shard_fds[shard], local_wd);
+}
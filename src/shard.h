@@ -0,0 +1,82 @@
+/* shard.h
+ * Spread the watches across many inotify instances
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#ifndef __SHARD_H
+#define __SHARD_H
+
+#include <stdint.h>
+#include <sys/inotify.h>
+
+/* Each subtree of the watched directory is assigned to one of many
+ * inotify instances (shards), each one with its own kernel queue and
+ * drained by its own thread. The threads filter the events and merge
+ * them into a single packet pipe, so the events of a directory keep
+ * their order.
+ *
+ * The watch descriptors seen by cwatch are given by the shards in
+ * increasing order and never reused, so they are unique across all
+ * the shards; the threads translate the ones of their instance.
+ */
+#define SHARDS_MAX 32
+
+/* starts the shards and their threads
+ *
+ * @param  const char * : the watched directory
+ * @param  int          : number of shards, up to SHARDS_MAX
+ * @param  int (*)(struct inotify_event *) : returns 0 to discard an event
+ * @return int          : the descriptor from which read the events, -1 on error
+ */
+int shards_start(const char *, int, int (*)(struct inotify_event *));
+
+/* adds a watch to the shard of a directory.
+ * It has the same signature of inotify_add_watch
+ *
+ * @param  int          : ignored
+ * @param  const char * : absolute real path
+ * @param  uint32_t     : event mask
+ * @return int          : watch descriptor, -1 on error
+ */
+int shard_add_watch(int, const char *, uint32_t);
+
+/* removes a watch from its shard.
+ * It has the same signature of inotify_rm_watch
+ *
+ * @param  int : ignored
+ * @param  int : watch descriptor
+ * @return int : 0 if success, -1 otherwise
+ */
+int shard_rm_watch(int, int);
+
+/* returns the shard of a directory, given by its first
+ * directory below the watched one
+ *
+ * @param  const char * : the watched directory
+ * @param  const char * : absolute path of the directory
+ * @param  int          : number of shards
+ * @return int
+ */
+int shard_of(const char *, const char *, int);
+
+#endif /* !__SHARD_H */
@@ -0,0 +1,414 @@
+/* shmring.c
+ * Shared memory ring of the events, for the consumers of the same host
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+
+#include "shmring.h"
+
+/* bytes of a record with a path of the given length */
+#define RECORD_LENGTH(path_len) (((sizeof(SHMRING_RECORD) + (path_len) + 1) + 7) & ~(uint64_t)7)
+
+static int ring_fd = -1;
+static SHMRING_HEADER *header = NULL;
+static char *data = NULL;
+static uint64_t write_position = 0;
+static int server_fd = -1;
+static pthread_t server;
+static int serving = 0;
+
+static long futex(uint32_t *address, int operation, uint32_t value, const struct timespec *timeout)
+{
+    return syscall(SYS_futex, address, operation, value, timeout, NULL, 0);
+}
+
+/* gives a read-only descriptor of the ring, the readers can not corrupt it */
+static void send_ring(int client_fd)
+{
+    char proc_path[64];
+    char byte = 'R';
+    char control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = {&byte, 1};
+    struct msghdr message;
+
+    snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", ring_fd);
+    int fd = open(proc_path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return;
+
+    memset(&message, 0, sizeof(message));
+    memset(control, 0, sizeof(control));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    if (sendmsg(client_fd, &message, MSG_NOSIGNAL) == -1)
+        ;
+    close(fd);
+}
+
+static void *shmring_server(void *arg)
+{
+    while (1)
+    {
+        int client_fd = accept(server_fd, NULL, NULL);
+        if (client_fd == -1)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;
+        }
+
+        send_ring(client_fd);
+        close(client_fd);
+    }
+
+    return NULL;
+}
+
+int shmring_start(const char *socket_path, size_t size)
+{
+    struct sockaddr_un address;
+
+    if (header != NULL)
+        return 0;
+
+    if (strlen(socket_path) >= sizeof(address.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    size &= ~(size_t)7;
+    if (size < SHMRING_MIN_SIZE)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* the size is sealed, a reader can trust it */
+    if ((ring_fd = memfd_create("cwatch-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING)) == -1 ||
+        ftruncate(ring_fd, SHMRING_HEADER_SIZE + size) == -1 ||
+        fcntl(ring_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1)
+    {
+        int error = errno;
+        shmring_stop();
+        errno = error;
+        return -1;
+    }
+
+    void *mapped = mmap(NULL, SHMRING_HEADER_SIZE + size, PROT_READ | PROT_WRITE, MAP_SHARED, ring_fd, 0);
+    if (mapped == MAP_FAILED)
+    {
+        int error = errno;
+        shmring_stop();
+        errno = error;
+        return -1;
+    }
+
+    header = (SHMRING_HEADER *)mapped;
+    data = (char *)mapped + SHMRING_HEADER_SIZE;
+    header->magic = SHMRING_MAGIC;
+    header->version = SHMRING_VERSION;
+    header->size = size;
+    write_position = 0;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
+    unlink(socket_path);
+
+    if ((server_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1 ||
+        bind(server_fd, (struct sockaddr *)&address, sizeof(address)) == -1 ||
+        listen(server_fd, 16) == -1 ||
+        (serving = (pthread_create(&server, NULL, shmring_server, NULL) == 0)) == 0)
+    {
+        int error = errno;
+        shmring_stop();
+        errno = error;
+        return -1;
+    }
+
+    return 0;
+}
+
+void shmring_publish(uint64_t sequence, uint32_t mask, uint32_t cookie, const char *directory, const char *name)
+{
+    if (header == NULL)
+        return;
+
+    size_t directory_len = strlen(directory);
+    size_t name_len = strlen(name);
+    uint64_t size = header->size;
+    uint64_t length = RECORD_LENGTH(directory_len + name_len);
+    if (length > size / 2)
+        return;
+
+    uint64_t offset = write_position % size;
+    uint64_t padding = (offset + length > size) ? size - offset : 0;
+
+    /* announce the bytes to overwrite before touching them */
+    __atomic_store_n(&header->reserved, write_position + padding + length, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    if (padding > 0)
+    {
+        SHMRING_RECORD *skip = (SHMRING_RECORD *)(data + offset);
+        skip->length = padding;
+        skip->mask = 0;
+        write_position += padding;
+        offset = 0;
+    }
+
+    SHMRING_RECORD *record = (SHMRING_RECORD *)(data + offset);
+    record->length = length;
+    record->mask = mask;
+    record->sequence = sequence;
+    record->cookie = cookie;
+    record->path_len = directory_len + name_len;
+    memcpy(record->path, directory, directory_len);
+    memcpy(record->path + directory_len, name, name_len + 1);
+
+    write_position += length;
+}
+
+void shmring_flush()
+{
+    if (header == NULL || header->head == write_position)
+        return;
+
+    __atomic_store_n(&header->head, write_position, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&header->futex, 1, __ATOMIC_SEQ_CST);
+    futex(&header->futex, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+int shmring_descriptor()
+{
+    return ring_fd;
+}
+
+void shmring_stop()
+{
+    if (server_fd != -1)
+    {
+        /* wakes up the server from accept() */
+        shutdown(server_fd, SHUT_RDWR);
+        if (serving)
+            pthread_join(server, NULL);
+        close(server_fd);
+        server_fd = -1;
+        serving = 0;
+    }
+
+    if (header != NULL)
+    {
+        munmap(header, SHMRING_HEADER_SIZE + header->size);
+        header = NULL;
+        data = NULL;
+    }
+
+    /* NOTE: the readers keep the ring they have mapped */
+    if (ring_fd != -1)
+    {
+        close(ring_fd);
+        ring_fd = -1;
+    }
+}
+
+int shmring_receive(const char *socket_path)
+{
+    struct sockaddr_un address;
+    char byte;
+    char control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = {&byte, 1};
+    struct msghdr message;
+
+    if (strlen(socket_path) >= sizeof(address.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
+
+    int client_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (client_fd == -1)
+        return -1;
+
+    if (connect(client_fd, (struct sockaddr *)&address, sizeof(address)) == -1)
+    {
+        close(client_fd);
+        return -1;
+    }
+
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    int fd = -1;
+    if (recvmsg(client_fd, &message, MSG_CMSG_CLOEXEC) == 1)
+    {
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+        if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+    close(client_fd);
+
+    if (fd == -1)
+        errno = EPROTO;
+    return fd;
+}
+
+int shmring_attach(int fd, SHMRING_READER *reader)
+{
+    struct stat st;
+
+    if (fstat(fd, &st) == -1)
+        return -1;
+
+    if (st.st_size <= SHMRING_HEADER_SIZE)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    void *mapped = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED)
+        return -1;
+
+    const SHMRING_HEADER *ring = (const SHMRING_HEADER *)mapped;
+    if (ring->magic != SHMRING_MAGIC || ring->version != SHMRING_VERSION ||
+        ring->size + SHMRING_HEADER_SIZE != (uint64_t)st.st_size)
+    {
+        munmap(mapped, st.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+
+    reader->header = ring;
+    reader->data = (const char *)mapped + SHMRING_HEADER_SIZE;
+    reader->mapped = st.st_size;
+    reader->position = reader->current = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+    return 0;
+}
+
+/* returns 1 if the writer could have overwritten the record at a position */
+static int lapped(const SHMRING_READER *reader, uint64_t position)
+{
+    return (__atomic_load_n(&reader->header->reserved, __ATOMIC_RELAXED) > position + reader->header->size) ? 1 : 0;
+}
+
+shmring_status_t shmring_next(SHMRING_READER *reader, const SHMRING_RECORD **record)
+{
+    uint64_t size = reader->header->size;
+
+    while (1)
+    {
+        uint64_t head = __atomic_load_n(&reader->header->head, __ATOMIC_ACQUIRE);
+        if (reader->position == head)
+            return SHMRING_EMPTY;
+
+        const SHMRING_RECORD *next = (const SHMRING_RECORD *)(reader->data + reader->position % size);
+        uint32_t length = __atomic_load_n(&next->length, __ATOMIC_RELAXED);
+        uint32_t mask = __atomic_load_n(&next->mask, __ATOMIC_RELAXED);
+
+        /* the length is trusted only if it has not been overwritten meanwhile */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (lapped(reader, reader->position))
+        {
+            reader->position = reader->current = __atomic_load_n(&reader->header->head, __ATOMIC_ACQUIRE);
+            return SHMRING_LAPPED;
+        }
+
+        reader->current = reader->position;
+        reader->position += length;
+
+        if (mask != 0)
+        {
+            *record = next;
+            return SHMRING_READ;
+        }
+    }
+}
+
+int shmring_valid(const SHMRING_READER *reader)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return lapped(reader, reader->current) ? 0 : 1;
+}
+
+int shmring_wait(SHMRING_READER *reader, int timeout)
+{
+    struct timespec interval;
+    uint32_t *word = (uint32_t *)&reader->header->futex;
+
+    uint32_t value = __atomic_load_n(word, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&reader->header->head, __ATOMIC_ACQUIRE) != reader->position)
+        return 1;
+
+    interval.tv_sec = timeout / 1000;
+    interval.tv_nsec = (timeout % 1000) * 1000000L;
+
+    /* the writer changes the word before waking up, a publication is never missed */
+    futex(word, FUTEX_WAIT, value, (timeout < 0) ? NULL : &interval);
+
+    return (__atomic_load_n(&reader->header->head, __ATOMIC_ACQUIRE) != reader->position) ? 1 : 0;
+}
+
+void shmring_detach(SHMRING_READER *reader)
+{
+    if (reader->header != NULL)
+        munmap((void *)reader->header, reader->mapped);
+
+    reader->header = NULL;
+    reader->data = NULL;
+}
@@ -0,0 +1,171 @@
+/* shmring.h
+ * Shared memory ring of the events, for the consumers of the same host
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#ifndef __SHMRING_H
+#define __SHMRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* With --ring-socket the events are also written into a ring of shared
+ * memory (a memfd), for the consumers of the same host that can not
+ * afford a copy through a socket. A consumer connects to the unix socket
+ * and receives a read-only descriptor of the ring, that it maps.
+ *
+ * cwatch is the only writer and never waits for the readers. Each
+ * reader keeps its own position: a reader that is lapped notices it,
+ * because the writer announces the bytes it is about to overwrite
+ * (reserved) before writing them. The readers wait for new events on
+ * a futex in the shared memory, woken once per loop of monitor().
+ *
+ * The positions are byte offsets that never wrap, the offset in the
+ * data is the position modulo the size. A record never wraps: the
+ * space left at the end of the data is skipped with a padding record.
+ */
+#define SHMRING_MAGIC 0x63776d72 /* "cwmr" */
+#define SHMRING_VERSION 1
+
+/* the data start at the page after the header */
+#define SHMRING_HEADER_SIZE 4096
+
+#define SHMRING_DEFAULT_SIZE (16 * 1024 * 1024)
+#define SHMRING_MIN_SIZE (64 * 1024)
+
+/* header of the ring, in the shared memory */
+typedef struct shmring_header_s
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;     /* bytes of the data */
+    uint64_t reserved; /* end of the record being written */
+    uint64_t head;     /* end of the records published */
+    uint32_t futex;    /* changes at each publication */
+    uint32_t padding;
+} SHMRING_HEADER;
+
+/* a record of the ring, 8 bytes aligned */
+typedef struct shmring_record_s
+{
+    uint32_t length;   /* bytes of the record */
+    uint32_t mask;     /* event mask, 0 for a padding record */
+    uint64_t sequence;
+    uint32_t cookie;
+    uint32_t path_len; /* bytes of the path, without the '\0' */
+    char path[];       /* absolute path of the event */
+} SHMRING_RECORD;
+
+/* used by a consumer to read a ring */
+typedef struct shmring_reader_s
+{
+    const SHMRING_HEADER *header;
+    const char *data;
+    size_t mapped;     /* bytes mapped */
+    uint64_t position; /* of the next record to read */
+    uint64_t current;  /* of the last record read */
+} SHMRING_READER;
+
+/* status of a read */
+typedef enum
+{
+    SHMRING_EMPTY,
+    SHMRING_READ,
+    SHMRING_LAPPED
+} shmring_status_t;
+
+/* creates the ring and starts giving it to the consumers
+ *
+ * @param  const char * : path of the unix socket, replaced if it exists
+ * @param  size_t       : bytes of the data of the ring
+ * @return int          : 0 if success, -1 otherwise
+ */
+int shmring_start(const char *, size_t);
+
+/* writes an event into the ring, the readers see it after shmring_flush()
+ *
+ * @param uint64_t     : sequence number
+ * @param uint32_t     : event mask
+ * @param uint32_t     : cookie
+ * @param const char * : directory of the event
+ * @param const char * : name of the file or directory, "" for none
+ */
+void shmring_publish(uint64_t, uint32_t, uint32_t, const char *, const char *);
+
+/* publishes the events written and wakes up the readers */
+void shmring_flush();
+
+/* returns the descriptor of the ring
+ *
+ * @return int : -1 if the ring is not started
+ */
+int shmring_descriptor();
+
+/* stops giving the ring to the consumers and unmaps it */
+void shmring_stop();
+
+/* asks the descriptor of a ring to cwatch
+ *
+ * @param  const char * : path of the unix socket
+ * @return int          : the descriptor, -1 on error
+ */
+int shmring_receive(const char *);
+
+/* maps a ring, the reader starts from the events published after
+ *
+ * @param  int              : descriptor of the ring
+ * @param  SHMRING_READER * : the reader
+ * @return int              : 0 if success, -1 otherwise
+ */
+int shmring_attach(int, SHMRING_READER *);
+
+/* gives the next record, without copying it. The record can be
+ * overwritten while it is used: it is valid only if shmring_valid()
+ * says so after it has been used. On SHMRING_LAPPED the reader skips
+ * to the last event published and the consumer has to rescan.
+ *
+ * @param  SHMRING_READER *        : the reader
+ * @param  const SHMRING_RECORD ** : where to store the record
+ * @return shmring_status_t
+ */
+shmring_status_t shmring_next(SHMRING_READER *, const SHMRING_RECORD **);
+
+/* returns 1 if the last record given has not been overwritten
+ *
+ * @param  const SHMRING_READER * : the reader
+ * @return int
+ */
+int shmring_valid(const SHMRING_READER *);
+
+/* waits for new records
+ *
+ * @param  SHMRING_READER * : the reader
+ * @param  int              : milliseconds, -1 for ever
+ * @return int              : 1 if there are new records, 0 otherwise
+ */
+int shmring_wait(SHMRING_READER *, int);
+
+/* unmaps a ring */
+void shmring_detach(SHMRING_READER *);
+
+#endif /* !__SHMRING_H */
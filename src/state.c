@@ -0,0 +1,306 @@
+/* state.c
+ * Snapshot of the watched directories, to restart without a full walk
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "state.h"
+
+/* records are aligned to 8 bytes, so they can be used from the map */
+#define STATE_ALIGN(length) (((length) + 7) & ~((size_t)7))
+
+int state_append(bstring buffer, const char *path, unsigned char type, int list_anyway)
+{
+    static const char padding[8] = {0};
+    STATE_RECORD record;
+    struct stat st;
+
+    memset(&record, 0, sizeof(record));
+    record.type = type;
+
+    if (type == DT_DIR)
+    {
+        if (stat(path, &st) == -1)
+            return -1;
+
+        record.dev = st.st_dev;
+        record.ino = st.st_ino;
+
+        /* NOTE: a change in the same second of the save could not move the mtime */
+        if (!list_anyway && st.st_mtim.tv_sec < time(NULL) - 1)
+        {
+            record.mtime_sec = st.st_mtim.tv_sec;
+            record.mtime_nsec = st.st_mtim.tv_nsec;
+        }
+    }
+
+    size_t path_len = strlen(path) + 1;
+    record.length = STATE_ALIGN(path_len);
+
+    bcatblk(buffer, &record, sizeof(record));
+    bcatblk(buffer, path, path_len);
+    bcatblk(buffer, padding, record.length - path_len);
+
+    return 0;
+}
+
+uint64_t state_hash(uint64_t hash, const char *option, const char *value)
+{
+    /* the terminators too, so "-x", "ab" is not "-xa", "b" */
+    size_t i;
+    for (i = 0; i <= strlen(option); ++i)
+        hash = (hash ^ (unsigned char)option[i]) * 1099511628211ULL;
+    for (i = 0; i <= strlen(value); ++i)
+        hash = (hash ^ (unsigned char)value[i]) * 1099511628211ULL;
+
+    return hash;
+}
+
+int state_save(const char *file, bstring records, int qty, uint64_t options)
+{
+    STATE_HEADER header;
+    memset(&header, 0, sizeof(header));
+    header.magic = STATE_MAGIC;
+    header.version = STATE_VERSION;
+    header.qty = qty;
+    header.saved_at = time(NULL);
+    header.options = options;
+
+    bstring tmp_file = bformat("%s.tmp", file);
+    int fd = open((char *)tmp_file->data, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+    {
+        bdestroy(tmp_file);
+        return -1;
+    }
+
+    int result = -1;
+    if (write(fd, &header, sizeof(header)) == sizeof(header) &&
+        write(fd, records->data, blength(records)) == blength(records) &&
+        fsync(fd) == 0)
+    {
+        result = 0;
+    }
+    close(fd);
+
+    /* the old state is replaced only by a complete one */
+    if (result == 0 && rename((char *)tmp_file->data, file) == -1)
+        result = -1;
+
+    if (result == -1)
+        unlink((char *)tmp_file->data);
+
+    bdestroy(tmp_file);
+    return result;
+}
+
+static int compare_records(const void *a, const void *b)
+{
+    return strcmp(STATE_PATH(*(const STATE_RECORD **)a), STATE_PATH(*(const STATE_RECORD **)b));
+}
+
+STATE_SNAPSHOT *state_load(const char *file, uint64_t options)
+{
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(STATE_HEADER))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    STATE_SNAPSHOT *snapshot = (STATE_SNAPSHOT *)calloc(1, sizeof(STATE_SNAPSHOT));
+    const STATE_HEADER *header = (const STATE_HEADER *)map;
+    if (snapshot == NULL || header->magic != STATE_MAGIC || header->version != STATE_VERSION ||
+        header->options != options)
+        goto invalid;
+
+    snapshot->map = map;
+    snapshot->size = st.st_size;
+    snapshot->saved_at = header->saved_at;
+    snapshot->records = (const STATE_RECORD **)malloc((header->qty + 1) * sizeof(STATE_RECORD *));
+    if (snapshot->records == NULL)
+        goto invalid;
+
+    /* NOTE: the file could be truncated or corrupted, every record is checked */
+    size_t offset = sizeof(STATE_HEADER);
+    uint32_t i;
+    for (i = 0; i < header->qty; ++i)
+    {
+        if (offset + sizeof(STATE_RECORD) > snapshot->size)
+            goto invalid;
+
+        const STATE_RECORD *record = (const STATE_RECORD *)((const char *)map + offset);
+        if (record->length == 0 || record->length > snapshot->size - offset - sizeof(STATE_RECORD) ||
+            memchr(STATE_PATH(record), '\0', record->length) == NULL)
+            goto invalid;
+
+        snapshot->records[snapshot->qty++] = record;
+        offset += sizeof(STATE_RECORD) + record->length;
+    }
+
+    qsort(snapshot->records, snapshot->qty, sizeof(STATE_RECORD *), compare_records);
+
+    return snapshot;
+
+invalid:
+    if (snapshot != NULL)
+        free(snapshot->records);
+    free(snapshot);
+    munmap(map, st.st_size);
+    return NULL;
+}
+
+void state_free(STATE_SNAPSHOT *snapshot)
+{
+    if (snapshot == NULL)
+        return;
+
+    munmap(snapshot->map, snapshot->size);
+    free(snapshot->records);
+    free(snapshot);
+}
+
+const STATE_RECORD *state_find(const STATE_SNAPSHOT *snapshot, const char *path)
+{
+    int low = 0;
+    int high = snapshot->qty - 1;
+
+    while (low <= high)
+    {
+        int middle = (low + high) / 2;
+        int compare = strcmp(STATE_PATH(snapshot->records[middle]), path);
+
+        if (compare == 0)
+            return snapshot->records[middle];
+
+        if (compare < 0)
+            low = middle + 1;
+        else
+            high = middle - 1;
+    }
+
+    return NULL;
+}
+
+int state_unchanged(const STATE_SNAPSHOT *snapshot, const char *path, const struct stat *st)
+{
+    const STATE_RECORD *record = state_find(snapshot, path);
+
+    return (record != NULL && record->type == DT_DIR && record->mtime_sec != 0 &&
+            record->dev == (uint64_t)st->st_dev && record->ino == (uint64_t)st->st_ino &&
+            record->mtime_sec == st->st_mtim.tv_sec && record->mtime_nsec == st->st_mtim.tv_nsec)
+               ? 1
+               : 0;
+}
+
+/* returns the index of the first record, from a given one, that does not
+ * start with a prefix and follows it. The paths with the same prefix are
+ * contiguous, since the records are sorted.
+ */
+static int first_after(const STATE_SNAPSHOT *snapshot, const char *prefix, size_t prefix_len, int from)
+{
+    int low = from;
+    int high = snapshot->qty;
+
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (strncmp(STATE_PATH(snapshot->records[middle]), prefix, prefix_len) <= 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+int state_next_entry(const STATE_SNAPSHOT *snapshot, const char *directory, int *cursor, char *name, unsigned char *type)
+{
+    size_t directory_len = strlen(directory);
+
+    /* the entries follow the directory itself */
+    if (*cursor == -1)
+    {
+        int low = 0;
+        int high = snapshot->qty;
+        while (low < high)
+        {
+            int middle = (low + high) / 2;
+            if (strcmp(STATE_PATH(snapshot->records[middle]), directory) <= 0)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        *cursor = low;
+    }
+
+    while (*cursor < snapshot->qty)
+    {
+        const STATE_RECORD *record = snapshot->records[*cursor];
+        const char *path = STATE_PATH(record);
+
+        if (strncmp(path, directory, directory_len) != 0)
+            break;
+
+        const char *rest = path + directory_len;
+        const char *slash = strchr(rest, '/');
+        size_t name_len = (slash == NULL) ? strlen(rest) : (size_t)(slash - rest);
+
+        /* deeper entries: skip the whole subtree of the entry */
+        if (slash != NULL && slash[1] != '\0')
+        {
+            *cursor = first_after(snapshot, path, directory_len + name_len + 1, *cursor);
+            continue;
+        }
+
+        ++(*cursor);
+        if (name_len == 0 || name_len > NAME_MAX)
+            continue;
+
+        memcpy(name, rest, name_len);
+        name[name_len] = '\0';
+        *type = record->type;
+
+        return 1;
+    }
+
+    *cursor = snapshot->qty;
+    return 0;
+}
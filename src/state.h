@@ -0,0 +1,155 @@
+/* state.h
+ * Snapshot of the watched directories, to restart without a full walk
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#ifndef __STATE_H
+#define __STATE_H
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "bstrlib.h"
+
+/* The state file (--state-file) keeps the directories watched by cwatch
+ * and the symbolic links that lead to them. Each directory is saved with
+ * its device, inode and mtime: at the next start, a directory still equal
+ * to its snapshot is not listed again, its entries are taken from the
+ * snapshot. The file is a header and a sequence of records, each one
+ * followed by its path, so it can be mapped and used as it is.
+ */
+#define STATE_MAGIC 0x54535743 /* "CWST" */
+#define STATE_VERSION 2
+
+/* the hash of the options that shape the tree, before any of them */
+#define STATE_OPTIONS_INIT 14695981039346656037ULL
+
+/* seconds between two saves of the state file */
+#define STATE_SAVE_INTERVAL 60
+
+typedef struct state_header_s
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t qty;     /* number of records */
+    uint32_t padding;
+    int64_t saved_at; /* when the state was saved */
+    uint64_t options; /* hash of the options that shape the tree (-x, -i, ...) */
+} STATE_HEADER;
+
+typedef struct state_record_s
+{
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime_sec;  /* 0 when the directory must be listed anyway */
+    int64_t mtime_nsec;
+    uint32_t type;      /* DT_DIR or DT_LNK */
+    uint32_t length;    /* bytes of the path that follows, with the padding */
+} STATE_RECORD;
+
+/* path of a record, with the trailing slash for the directories */
+#define STATE_PATH(record) ((const char *)((record) + 1))
+
+/* used to store a state file loaded in memory */
+typedef struct state_snapshot_s
+{
+    void *map;                     /* the mapped file */
+    size_t size;                   /* bytes of the mapped file */
+    time_t saved_at;               /* when the state was saved */
+    const STATE_RECORD **records;  /* records sorted by path */
+    int qty;                       /* number of records */
+} STATE_SNAPSHOT;
+
+/* appends the record of a directory or of a symbolic link.
+ * The mtime of a directory changed in the last second is not trusted.
+ *
+ * @param  bstring       : where to append the record
+ * @param  const char *  : absolute path
+ * @param  unsigned char : type (DT_DIR or DT_LNK)
+ * @param  int           : 1 if the directory must be listed anyway at the next start
+ * @return int           : 0 if success, -1 if the directory is gone
+ */
+int state_append(bstring, const char *, unsigned char, int);
+
+/* adds an option and its value to the hash of the options that shape
+ * the tree (FNV-1a), starting from STATE_OPTIONS_INIT
+ *
+ * @param  uint64_t     : hash so far
+ * @param  const char * : option
+ * @param  const char * : value
+ * @return uint64_t     : the new hash
+ */
+uint64_t state_hash(uint64_t, const char *, const char *);
+
+/* writes the records into the state file, atomically
+ *
+ * @param  const char * : path of the state file
+ * @param  bstring      : records appended by state_append
+ * @param  int          : number of records
+ * @param  uint64_t     : hash of the options that shape the tree
+ * @return int          : 0 if success, -1 otherwise
+ */
+int state_save(const char *, bstring, int, uint64_t);
+
+/* maps a state file in memory. A state saved with other options is
+ * not valid: a directory not listed again would keep a different tree.
+ *
+ * @param  const char *     : path of the state file
+ * @param  uint64_t         : hash of the options that shape the tree
+ * @return STATE_SNAPSHOT * : NULL if it is missing or not valid
+ */
+STATE_SNAPSHOT *state_load(const char *, uint64_t);
+
+/* finds the record of a path
+ *
+ * @param  const STATE_SNAPSHOT * : snapshot
+ * @param  const char *           : absolute path
+ * @return const STATE_RECORD *   : NULL if not found
+ */
+const STATE_RECORD *state_find(const STATE_SNAPSHOT *, const char *);
+
+/* returns 1 if a directory is still equal to its snapshot
+ *
+ * @param  const STATE_SNAPSHOT * : snapshot
+ * @param  const char *           : absolute path of the directory
+ * @param  const struct stat *    : current state of the directory
+ * @return int
+ */
+int state_unchanged(const STATE_SNAPSHOT *, const char *, const struct stat *);
+
+/* iterates over the entries of a directory in the snapshot
+ *
+ * @param  const STATE_SNAPSHOT * : snapshot
+ * @param  const char *           : absolute path of the directory
+ * @param  int *                  : cursor, -1 to start
+ * @param  char *                 : where to store the name (NAME_MAX + 1 bytes)
+ * @param  unsigned char *        : where to store the type
+ * @return int                    : 1 if an entry is found, 0 at the end
+ */
+int state_next_entry(const STATE_SNAPSHOT *, const char *, int *, char *, unsigned char *);
+
+/* deallocates a snapshot */
+void state_free(STATE_SNAPSHOT *);
+
+#endif /* !__STATE_H */
@@ -0,0 +1,632 @@
+/* subscribe.c
+ * Fan out the events to the subscribers of a unix socket
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "cursor.h"
+#include "subscribe.h"
+
+/* used to store a part of the events to write to a subscriber */
+typedef struct subscribe_chunk_s
+{
+    SUBSCRIBE_BATCH *batch; /* a batch shared with other subscribers, or */
+    bstring own;            /* the events of the batch wanted by the subscriber */
+} SUBSCRIBE_CHUNK;
+
+static char *root = NULL;
+static size_t root_len = 0;
+static subscribe_events_t parse_events = NULL;
+
+static int listen_fd = -1;
+static int wake_pipe[2] = {-1, -1};
+static pthread_t server;
+static int running = 0;
+static volatile int stopping = 0;
+
+static pthread_mutex_t subscribe_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Queue *inbox = NULL;       /* batches handed to the server thread */
+static size_t inbox_bytes = 0;
+static int clients_qty = 0;
+
+/* state of monitor() only */
+static SUBSCRIBE_BATCH *pending = NULL;
+
+/* state of the server thread only */
+static SUBSCRIBER *clients[SUBSCRIBE_MAX_CLIENTS];
+
+static void release_batch(SUBSCRIBE_BATCH *batch)
+{
+    if (--batch->references > 0)
+        return;
+
+    bdestroy(batch->lines);
+    bdestroy(batch->paths);
+    free(batch->events);
+    free(batch);
+}
+
+static void release_chunk(SUBSCRIBE_CHUNK *chunk)
+{
+    if (chunk->batch != NULL)
+        release_batch(chunk->batch);
+    else
+        bdestroy(chunk->own);
+
+    free(chunk);
+}
+
+static void free_subscriber(SUBSCRIBER *subscriber)
+{
+    close(subscriber->fd);
+    free(subscriber->prefix);
+
+    if (subscriber->include != NULL)
+        pathglob_free(subscriber->include);
+
+    if (subscriber->exclude != NULL)
+    {
+        regfree(subscriber->exclude);
+        free(subscriber->exclude);
+    }
+
+    SUBSCRIBE_CHUNK *chunk;
+    while ((chunk = (SUBSCRIBE_CHUNK *)queue_dequeue(subscriber->chunks)))
+        release_chunk(chunk);
+    queue_free(subscriber->chunks);
+
+    free(subscriber);
+}
+
+static void remove_client(int i)
+{
+    free_subscriber(clients[i]);
+    clients[i] = NULL;
+
+    pthread_mutex_lock(&subscribe_mutex);
+    --clients_qty;
+    pthread_mutex_unlock(&subscribe_mutex);
+}
+
+/* tells something to a subscriber, as long as it does not block */
+static void tell(SUBSCRIBER *subscriber, const char *message)
+{
+    if (send(subscriber->fd, message, strlen(message), MSG_DONTWAIT | MSG_NOSIGNAL) == -1)
+        return;
+}
+
+const char *subscribe_parse(SUBSCRIBER *subscriber, const char *request)
+{
+    if (strncmp(request, "SUBSCRIBE", 9) != 0 || (request[9] != '\0' && request[9] != ' '))
+        return "not a SUBSCRIBE request";
+
+    subscriber->mask = UINT32_MAX;
+
+    const char *cursor = request + 9;
+    while (*cursor != '\0')
+    {
+        if (*cursor == ' ')
+        {
+            ++cursor;
+            continue;
+        }
+
+        /* the regex can contain spaces, it takes the rest of the line */
+        if (strncmp(cursor, "exclude=", 8) == 0)
+        {
+            subscriber->exclude = (regex_t *)malloc(sizeof(regex_t));
+            if (subscriber->exclude == NULL || regcomp(subscriber->exclude, cursor + 8, REG_EXTENDED | REG_NOSUB) != 0)
+            {
+                free(subscriber->exclude);
+                subscriber->exclude = NULL;
+                return "malformed exclude regex";
+            }
+            break;
+        }
+
+        size_t token_len = strcspn(cursor, " ");
+        char *token = strndup(cursor, token_len);
+        cursor += token_len;
+
+        const char *error = NULL;
+        if (strncmp(token, "events=", 7) == 0)
+        {
+            if ((subscriber->mask = parse_events(token + 7)) == 0)
+                error = "unrecognized events";
+        }
+        else if (strncmp(token, "prefix=", 7) == 0)
+        {
+            free(subscriber->prefix);
+            if (token[7] == '/')
+            {
+                subscriber->prefix = strdup(token + 7);
+            }
+            else
+            {
+                subscriber->prefix = (char *)malloc(root_len + strlen(token + 7) + 1);
+                sprintf(subscriber->prefix, "%s%s", (root != NULL) ? root : "", token + 7);
+            }
+        }
+        else if (strncmp(token, "include=", 8) == 0)
+        {
+            if (subscriber->include == NULL)
+                subscriber->include = pathglob_init();
+
+            if (pathglob_add(subscriber->include, token + 8) == -1)
+                error = "malformed include glob";
+        }
+        else
+        {
+            error = "unrecognized filter";
+        }
+
+        free(token);
+        if (error != NULL)
+            return error;
+    }
+
+    return NULL;
+}
+
+int subscribe_wants(const SUBSCRIBER *subscriber, uint32_t mask, const char *path)
+{
+    if ((mask & subscriber->mask) == 0)
+        return 0;
+
+    if (subscriber->prefix != NULL && strncmp(path, subscriber->prefix, strlen(subscriber->prefix)) != 0)
+        return 0;
+
+    if (subscriber->include != NULL)
+    {
+        const char *relative = (root != NULL && strncmp(path, root, root_len) == 0) ? path + root_len : path;
+        pathglob_state_t state = pathglob_walk(subscriber->include, pathglob_start(subscriber->include), relative);
+
+        if (!pathglob_accepts(subscriber->include, state))
+            return 0;
+    }
+
+    if (subscriber->exclude != NULL && regexec(subscriber->exclude, path, 0, NULL, 0) == 0)
+        return 0;
+
+    return 1;
+}
+
+/* queues the events of a batch wanted by a subscriber, the whole batch
+ * is shared when it wants all of them. Returns -1 if it is too late.
+ */
+static int deliver(SUBSCRIBER *subscriber, SUBSCRIBE_BATCH *batch)
+{
+    int i;
+    int wanted = 0;
+    char *wants = (char *)malloc(batch->qty);
+
+    for (i = 0; i < batch->qty; ++i)
+    {
+        wants[i] = subscribe_wants(subscriber, batch->events[i].mask, (char *)batch->paths->data + batch->events[i].path);
+        wanted += wants[i];
+    }
+
+    SUBSCRIBE_CHUNK *chunk = NULL;
+    if (wanted > 0)
+        chunk = (SUBSCRIBE_CHUNK *)calloc(1, sizeof(SUBSCRIBE_CHUNK));
+
+    if (chunk != NULL && wanted == batch->qty)
+    {
+        chunk->batch = batch;
+        ++batch->references;
+        subscriber->queued += blength(batch->lines);
+    }
+    else if (chunk != NULL)
+    {
+        chunk->own = bfromcstr("");
+        for (i = 0; i < batch->qty; ++i)
+        {
+            if (wants[i])
+                bcatblk(chunk->own, batch->lines->data + batch->events[i].line, batch->events[i].length);
+        }
+        subscriber->queued += blength(chunk->own);
+    }
+    free(wants);
+
+    if (chunk != NULL)
+        queue_enqueue(subscriber->chunks, chunk);
+
+    return (subscriber->queued > SUBSCRIBE_QUEUE_MAX) ? -1 : 0;
+}
+
+/* writes what is queued for a subscriber, until it would block */
+static int write_chunks(SUBSCRIBER *subscriber)
+{
+    SUBSCRIBE_CHUNK *chunk;
+
+    while (subscriber->chunks->first != NULL)
+    {
+        chunk = (SUBSCRIBE_CHUNK *)subscriber->chunks->first->data;
+        bstring data = (chunk->batch != NULL) ? chunk->batch->lines : chunk->own;
+
+        ssize_t length = send(subscriber->fd, data->data + subscriber->offset, blength(data) - subscriber->offset,
+                              MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (length == -1)
+            return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+
+        subscriber->offset += length;
+        subscriber->queued -= length;
+
+        if (subscriber->offset == (size_t)blength(data))
+        {
+            release_chunk((SUBSCRIBE_CHUNK *)queue_dequeue(subscriber->chunks));
+            subscriber->offset = 0;
+        }
+    }
+
+    return 0;
+}
+
+/* reads the request of a subscriber, or notices that it is gone */
+static int read_request(SUBSCRIBER *subscriber)
+{
+    char discard[256];
+
+    if (subscriber->subscribed)
+    {
+        ssize_t length = recv(subscriber->fd, discard, sizeof(discard), MSG_DONTWAIT);
+        return (length == 0 || (length == -1 && errno != EAGAIN && errno != EINTR)) ? -1 : 0;
+    }
+
+    ssize_t length = recv(subscriber->fd, subscriber->request + subscriber->request_len,
+                          SUBSCRIBE_REQUEST_MAX - 1 - subscriber->request_len, MSG_DONTWAIT);
+    if (length <= 0)
+        return (length == -1 && (errno == EAGAIN || errno == EINTR)) ? 0 : -1;
+
+    subscriber->request_len += length;
+    subscriber->request[subscriber->request_len] = '\0';
+
+    char *newline = strchr(subscriber->request, '\n');
+    if (newline == NULL)
+    {
+        if (subscriber->request_len < SUBSCRIBE_REQUEST_MAX - 1)
+            return 0;
+
+        tell(subscriber, "ERROR request too long\n");
+        return -1;
+    }
+
+    *newline = '\0';
+    if (newline > subscriber->request && newline[-1] == '\r')
+        newline[-1] = '\0';
+
+    const char *error = subscribe_parse(subscriber, subscriber->request);
+    if (error != NULL)
+    {
+        char message[128];
+        snprintf(message, sizeof(message), "ERROR %s\n", error);
+        tell(subscriber, message);
+        return -1;
+    }
+
+    subscriber->subscribed = 1;
+    tell(subscriber, "OK\n");
+
+    return 0;
+}
+
+static void accept_client()
+{
+    int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd == -1)
+        return;
+
+    int i;
+    for (i = 0; i < SUBSCRIBE_MAX_CLIENTS && clients[i] != NULL; ++i)
+        ;
+
+    SUBSCRIBER *subscriber = (i < SUBSCRIBE_MAX_CLIENTS) ? (SUBSCRIBER *)calloc(1, sizeof(SUBSCRIBER)) : NULL;
+    if (subscriber == NULL)
+    {
+        if (send(fd, "ERROR too many subscribers\n", 27, MSG_DONTWAIT | MSG_NOSIGNAL) == -1)
+            ;
+        close(fd);
+        return;
+    }
+
+    subscriber->fd = fd;
+    subscriber->chunks = queue_init();
+    clients[i] = subscriber;
+
+    pthread_mutex_lock(&subscribe_mutex);
+    ++clients_qty;
+    pthread_mutex_unlock(&subscribe_mutex);
+}
+
+/* hands the batches received to the subscribers */
+static void fan_out()
+{
+    char drain[256];
+    while (read(wake_pipe[0], drain, sizeof(drain)) > 0)
+        ;
+
+    pthread_mutex_lock(&subscribe_mutex);
+    Queue *batches = inbox;
+    inbox = queue_init();
+    inbox_bytes = 0;
+    pthread_mutex_unlock(&subscribe_mutex);
+
+    SUBSCRIBE_BATCH *batch;
+    while ((batch = (SUBSCRIBE_BATCH *)queue_dequeue(batches)))
+    {
+        int i;
+        for (i = 0; i < SUBSCRIBE_MAX_CLIENTS; ++i)
+        {
+            if (clients[i] == NULL || !clients[i]->subscribed)
+                continue;
+
+            if (deliver(clients[i], batch) == -1)
+            {
+                tell(clients[i], "OVERFLOW\n");
+                remove_client(i);
+            }
+        }
+
+        release_batch(batch);
+    }
+    queue_free(batches);
+}
+
+static void *subscribe_server(void *arg)
+{
+    struct pollfd fds[SUBSCRIBE_MAX_CLIENTS + 2];
+    int owners[SUBSCRIBE_MAX_CLIENTS + 2];
+
+    while (!stopping)
+    {
+        int qty = 0;
+        fds[qty].fd = wake_pipe[0];
+        fds[qty++].events = POLLIN;
+        fds[qty].fd = listen_fd;
+        fds[qty++].events = POLLIN;
+
+        int i;
+        for (i = 0; i < SUBSCRIBE_MAX_CLIENTS; ++i)
+        {
+            if (clients[i] == NULL)
+                continue;
+
+            owners[qty] = i;
+            fds[qty].fd = clients[i]->fd;
+            fds[qty++].events = POLLIN | ((clients[i]->queued > 0) ? POLLOUT : 0);
+        }
+
+        if (poll(fds, qty, -1) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        for (i = 2; i < qty; ++i)
+        {
+            SUBSCRIBER *subscriber = clients[owners[i]];
+
+            if (((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) && read_request(subscriber) == -1) ||
+                ((fds[i].revents & POLLOUT) && write_chunks(subscriber) == -1))
+            {
+                remove_client(owners[i]);
+            }
+        }
+
+        if (fds[1].revents & POLLIN)
+            accept_client();
+
+        if (fds[0].revents & POLLIN)
+            fan_out();
+    }
+
+    return NULL;
+}
+
+void subscribe_publish(uint64_t sequence, uint32_t mask, uint32_t cookie, const char *directory, const char *name)
+{
+    if (!running)
+        return;
+
+    if (pending == NULL)
+    {
+        pending = (SUBSCRIBE_BATCH *)calloc(1, sizeof(SUBSCRIBE_BATCH));
+        if (pending == NULL)
+            return;
+
+        pending->references = 1;
+        pending->lines = bfromcstr("");
+        pending->paths = bfromcstr("");
+    }
+
+    if (pending->qty == pending->size)
+    {
+        int size = (pending->size == 0) ? 64 : pending->size * 2;
+        SUBSCRIBE_EVENT *events = (SUBSCRIBE_EVENT *)realloc(pending->events, size * sizeof(SUBSCRIBE_EVENT));
+        if (events == NULL)
+            return;
+
+        pending->events = events;
+        pending->size = size;
+    }
+
+    SUBSCRIBE_EVENT *event = &pending->events[pending->qty++];
+    event->mask = mask;
+    event->line = blength(pending->lines);
+    event->path = blength(pending->paths);
+
+    bformata(pending->lines, "%" PRIu64 " 0x%08x %u ", sequence, mask, cookie);
+    cursor_append_escaped(pending->lines, directory);
+    cursor_append_escaped(pending->lines, name);
+    bconchar(pending->lines, '\n');
+    event->length = blength(pending->lines) - event->line;
+
+    bcatcstr(pending->paths, directory);
+    bcatcstr(pending->paths, name);
+    bconchar(pending->paths, '\0');
+}
+
+void subscribe_flush()
+{
+    if (pending == NULL)
+        return;
+
+    SUBSCRIBE_BATCH *batch = pending;
+    pending = NULL;
+
+    pthread_mutex_lock(&subscribe_mutex);
+    int dropped = (inbox_bytes + blength(batch->lines) > SUBSCRIBE_INBOX_MAX) ? 1 : 0;
+    if (!dropped)
+    {
+        queue_enqueue(inbox, batch);
+        inbox_bytes += blength(batch->lines);
+    }
+    pthread_mutex_unlock(&subscribe_mutex);
+
+    /* NOTE: the server thread is too late, the subscribers will see a gap */
+    if (dropped)
+    {
+        release_batch(batch);
+        return;
+    }
+
+    if (write(wake_pipe[1], "", 1) == -1)
+        return;
+}
+
+int subscribe_start(const char *socket_path, const char *root_path, subscribe_events_t events_of)
+{
+    struct sockaddr_un address;
+
+    if (running)
+        return 0;
+
+    if (strlen(socket_path) >= sizeof(address.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    root = strdup(root_path);
+    root_len = strlen(root);
+    parse_events = events_of;
+    stopping = 0;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
+    unlink(socket_path);
+
+    if (pipe2(wake_pipe, O_NONBLOCK | O_CLOEXEC) == -1 ||
+        (listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1 ||
+        bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) == -1 ||
+        listen(listen_fd, SUBSCRIBE_MAX_CLIENTS) == -1)
+    {
+        int error = errno;
+        subscribe_stop();
+        errno = error;
+        return -1;
+    }
+
+    inbox = queue_init();
+    if (pthread_create(&server, NULL, subscribe_server, NULL) != 0)
+    {
+        subscribe_stop();
+        return -1;
+    }
+    running = 1;
+
+    return 0;
+}
+
+int subscribe_clients()
+{
+    pthread_mutex_lock(&subscribe_mutex);
+    int qty = clients_qty;
+    pthread_mutex_unlock(&subscribe_mutex);
+
+    return qty;
+}
+
+void subscribe_stop()
+{
+    if (running)
+    {
+        stopping = 1;
+        if (write(wake_pipe[1], "", 1) == -1)
+            ;
+        pthread_join(server, NULL);
+        running = 0;
+
+        /* NOTE: the events not written yet are lost, as for a slow subscriber */
+        int i;
+        for (i = 0; i < SUBSCRIBE_MAX_CLIENTS; ++i)
+        {
+            if (clients[i] != NULL)
+                remove_client(i);
+        }
+    }
+
+    if (inbox != NULL)
+    {
+        SUBSCRIBE_BATCH *batch;
+        while ((batch = (SUBSCRIBE_BATCH *)queue_dequeue(inbox)))
+            release_batch(batch);
+        queue_free(inbox);
+        inbox = NULL;
+        inbox_bytes = 0;
+    }
+
+    if (pending != NULL)
+    {
+        release_batch(pending);
+        pending = NULL;
+    }
+
+    if (listen_fd != -1)
+        close(listen_fd);
+    if (wake_pipe[0] != -1)
+    {
+        close(wake_pipe[0]);
+        close(wake_pipe[1]);
+    }
+    listen_fd = wake_pipe[0] = wake_pipe[1] = -1;
+
+    free(root);
+    root = NULL;
+    root_len = 0;
+}
@@ -0,0 +1,156 @@
+/* subscribe.h
+ * Fan out the events to the subscribers of a unix socket
+ *
+ * Copyright (C) 2012, Joe Bew <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#ifndef __SUBSCRIBE_H
+#define __SUBSCRIBE_H
+
+#include <stdint.h>
+#include <regex.h>
+
+#include "bstrlib.h"
+#include "queue.h"
+#include "pathglob.h"
+
+/* With --subscribe-socket a single cwatch owns the watches and many
+ * consumers subscribe to its events through a unix socket, each one
+ * with its own filters. A subscriber connects and writes a line:
+ *
+ *   SUBSCRIBE [events=<list>] [prefix=<path>] [include=<glob>]... [exclude=<regex>]
+ *
+ * events is a list as the one of -e, prefix an absolute path or one
+ * relative to the watched directory, include a glob as the one of -i
+ * and exclude a POSIX extended regex matched against the whole path.
+ * exclude takes the rest of the line. cwatch answers "OK" (or "ERROR
+ * <reason>") and then a line for each event, as the cursor socket:
+ *
+ *   <sequence> <mask, hexadecimal> <cookie> <path>
+ *
+ * The events of a loop of monitor() are encoded once, into a batch
+ * shared by all the subscribers that want all of them. The batches are
+ * handed to a server thread that filters and writes them, so monitor()
+ * never waits for a subscriber. A subscriber that falls behind by more
+ * than SUBSCRIBE_QUEUE_MAX bytes is told "OVERFLOW" and disconnected.
+ */
+#define SUBSCRIBE_MAX_CLIENTS 64
+#define SUBSCRIBE_QUEUE_MAX (4 * 1024 * 1024)
+#define SUBSCRIBE_REQUEST_MAX 1024
+
+/* bytes of batches waiting for the server thread, beyond them the
+ * batches are dropped: the subscribers see a gap in the sequence numbers
+ */
+#define SUBSCRIBE_INBOX_MAX (16 * 1024 * 1024)
+
+/* used to store an event of a batch */
+typedef struct subscribe_event_s
+{
+    uint32_t mask;
+    uint32_t line;   /* offset of the line in the batch */
+    uint32_t path;   /* offset of the path in the paths of the batch */
+    uint32_t length; /* bytes of the line */
+} SUBSCRIBE_EVENT;
+
+/* used to store the events of a loop of monitor(), encoded once */
+typedef struct subscribe_batch_s
+{
+    int references;          /* subscribers that still have to write it */
+    bstring lines;           /* the encoded events */
+    bstring paths;           /* the paths of the events, to filter them */
+    SUBSCRIBE_EVENT *events;
+    int qty;
+    int size;
+} SUBSCRIBE_BATCH;
+
+/* used to store a subscriber */
+typedef struct subscriber_s
+{
+    int fd;
+    int subscribed;            /* 1 once the request is accepted */
+    char request[SUBSCRIBE_REQUEST_MAX];
+    size_t request_len;
+    uint32_t mask;             /* events wanted */
+    char *prefix;              /* absolute path, NULL for any */
+    PATHGLOB *include;         /* NULL for any */
+    regex_t *exclude;          /* NULL for none */
+    Queue *chunks;             /* parts of the batches to write */
+    size_t queued;             /* bytes to write */
+    size_t offset;             /* bytes of the first chunk already written */
+} SUBSCRIBER;
+
+/* parses a list of events, as the one of -e
+ *
+ * @param  const char * : the list
+ * @return uint32_t     : the mask, 0 if the list is not valid
+ */
+typedef uint32_t (*subscribe_events_t)(const char *);
+
+/* starts the server thread
+ *
+ * @param  const char *       : path of the unix socket, replaced if it exists
+ * @param  const char *       : absolute path of the watched directory
+ * @param  subscribe_events_t : parses the lists of events
+ * @return int                : 0 if success, -1 otherwise
+ */
+int subscribe_start(const char *, const char *, subscribe_events_t);
+
+/* adds an event to the batch of the current loop
+ *
+ * @param uint64_t     : sequence number
+ * @param uint32_t     : event mask
+ * @param uint32_t     : cookie
+ * @param const char * : directory of the event
+ * @param const char * : name of the file or directory, "" for none
+ */
+void subscribe_publish(uint64_t, uint32_t, uint32_t, const char *, const char *);
+
+/* hands the batch of the current loop to the server thread */
+void subscribe_flush();
+
+/* parses a SUBSCRIBE request into the filters of a subscriber
+ *
+ * @param  SUBSCRIBER * : the subscriber
+ * @param  const char * : the request, without the newline
+ * @return const char * : NULL if success, the reason of the error otherwise
+ */
+const char *subscribe_parse(SUBSCRIBER *, const char *);
+
+/* returns 1 if an event passes the filters of a subscriber
+ *
+ * @param  const SUBSCRIBER * : the subscriber
+ * @param  uint32_t           : event mask
+ * @param  const char *       : absolute path of the event
+ * @return int
+ */
+int subscribe_wants(const SUBSCRIBER *, uint32_t, const char *);
+
+/* returns the number of subscribers connected
+ *
+ * @return int
+ */
+int subscribe_clients();
+
+/* disconnects all the subscribers and stops the server thread */
+void subscribe_stop();
+
+#endif /* !__SUBSCRIBE_H */
@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <check.h>
+#include <sys/inotify.h>
+
+#include "../src/atomic.h"
+
+/* helper functions */
+char reported[1024];
+
+/* writes the events forwarded as "<mask> <name>" lines */
+void record(struct inotify_event *event, char *directory, int match)
+{
+    ck_assert_str_eq(directory, "/home/cwatch/");
+    sprintf(reported + strlen(reported), "0x%08x %s\n", event->mask, event->name);
+}
+
+/* gives an event to the recognizer, as cwatch does */
+void give(uint32_t mask, uint32_t cookie, const char *name)
+{
+    union
+    {
+        struct inotify_event event;
+        char buffer[sizeof(struct inotify_event) + 64];
+    } event;
+
+    event.event.wd = 1;
+    event.event.mask = mask;
+    event.event.cookie = cookie;
+    event.event.len = 64;
+    strcpy(event.event.name, name);
+
+    if (atomic_hold(&event.event, "/home/cwatch/", 1) == 0)
+        record(&event.event, "/home/cwatch/", 1);
+}
+
+char *target_of(const char *name)
+{
+    static char target[64];
+
+    if (atomic_temporary(name, target, sizeof(target)) == 0)
+        return NULL;
+
+    return target;
+}
+/* end of helper functions */
+
+void setup(void)
+{
+    reported[0] = '\0';
+    ck_assert_int_ne(atomic_start(IN_MODIFY, record), -1);
+}
+
+void teardown(void)
+{
+    atomic_stop();
+}
+
+START_TEST(recognizes_the_temporary_names)
+{
+    ck_assert_str_eq(target_of("main.c~"), "main.c");
+    ck_assert_str_eq(target_of("main.c___jb_tmp___"), "main.c");
+    ck_assert_str_eq(target_of("main.c___jb_old___"), "main.c");
+    ck_assert_str_eq(target_of(".main.c.swp"), "main.c");
+    ck_assert_str_eq(target_of("main.c.tmp"), "main.c");
+    ck_assert_str_eq(target_of("main.c.tmp.1234"), "main.c");
+    ck_assert_str_eq(target_of(".main.c.Ab12Cd"), "main.c");
+    ck_assert_str_eq(target_of("4913"), "");
+    ck_assert_str_eq(target_of("sedX1b2c3"), "");
+    ck_assert_str_eq(target_of("tmpa1b2c3d4"), "");
+    ck_assert_str_eq(target_of(".goutputstream-ABC123"), "");
+
+    ck_assert_ptr_eq(target_of("main.c"), NULL);
+    ck_assert_ptr_eq(target_of(".bashrc"), NULL);
+    ck_assert_ptr_eq(target_of("template.html"), NULL);
+    ck_assert_ptr_eq(target_of(".tmp"), NULL);
+    ck_assert_ptr_eq(target_of("notes.tmp.txt.bak"), NULL);
+    ck_assert_ptr_eq(target_of("site.tmpl"), NULL);
+    ck_assert_ptr_eq(target_of(".bashrc.backup"), NULL);
+    ck_assert_ptr_eq(target_of(".config.123456"), NULL);
+}
+END_TEST
+
+START_TEST(collapses_a_temporary_file_renamed)
+{
+    give(IN_CREATE, 0, "main.c.tmp.42");
+    give(IN_MODIFY, 0, "main.c.tmp.42");
+    give(IN_CLOSE_WRITE, 0, "main.c.tmp.42");
+    give(IN_MOVED_FROM, 5, "main.c.tmp.42");
+    give(IN_MOVED_TO, 5, "main.c");
+
+    ck_assert_str_eq(reported, "0x00000002 main.c\n");
+    ck_assert_int_eq(atomic_in_progress(), 0);
+}
+END_TEST
+
+START_TEST(collapses_a_file_written_again_after_its_backup)
+{
+    /* vim */
+    give(IN_CREATE, 0, "4913");
+    give(IN_DELETE, 0, "4913");
+    give(IN_MOVED_FROM, 7, "main.c");
+    give(IN_MOVED_TO, 7, "main.c~");
+    give(IN_CREATE, 0, "main.c");
+    give(IN_MODIFY, 0, "main.c");
+    give(IN_CLOSE_WRITE, 0, "main.c");
+    give(IN_DELETE, 0, "main.c~");
+
+    ck_assert_str_eq(reported, "0x00000002 main.c\n");
+    ck_assert_int_eq(atomic_in_progress(), 0);
+}
+END_TEST
+
+START_TEST(collapses_both_the_ways_at_once)
+{
+    /* JetBrains */
+    give(IN_CREATE, 0, "main.c___jb_tmp___");
+    give(IN_CLOSE_WRITE, 0, "main.c___jb_tmp___");
+    give(IN_MOVED_FROM, 1, "main.c");
+    give(IN_MOVED_TO, 1, "main.c___jb_old___");
+    give(IN_MOVED_FROM, 2, "main.c___jb_tmp___");
+    give(IN_MOVED_TO, 2, "main.c");
+    give(IN_DELETE, 0, "main.c___jb_old___");
+
+    ck_assert_str_eq(reported, "0x00000002 main.c\n");
+    ck_assert_int_eq(atomic_in_progress(), 0);
+}
+END_TEST
+
+START_TEST(lets_the_other_events_go)
+{
+    give(IN_CLOSE_WRITE, 0, "main.c");
+    give(IN_MOVED_FROM, 3, "main.c");
+    give(IN_MOVED_TO, 3, "list.c");
+    give(IN_DELETE, 0, "list.c");
+
+    ck_assert_str_eq(reported, "0x00000008 main.c\n"
+                               "0x00000040 main.c\n"
+                               "0x00000080 list.c\n"
+                               "0x00000200 list.c\n");
+    ck_assert_int_eq(atomic_in_progress(), 0);
+}
+END_TEST
+
+START_TEST(lets_a_rename_without_a_save_go)
+{
+    /* main.c.tmp has not been written within the window */
+    give(IN_MOVED_FROM, 4, "main.c.tmp");
+    give(IN_MOVED_TO, 4, "main.c");
+
+    ck_assert_str_eq(reported, "0x00000040 main.c.tmp\n"
+                               "0x00000080 main.c\n");
+    ck_assert_int_eq(atomic_in_progress(), 0);
+}
+END_TEST
+
+START_TEST(releases_the_events_once_the_window_is_over)
+{
+    struct pollfd pfd = {atomic_descriptor(), POLLIN, 0};
+
+    give(IN_CREATE, 0, "main.c.tmp");
+    give(IN_CLOSE_WRITE, 0, "main.c.tmp");
+    ck_assert_str_eq(reported, "");
+    ck_assert_int_eq(atomic_in_progress(), 1);
+
+    ck_assert_int_eq(poll(&pfd, 1, ATOMIC_WINDOW_MS * 4), 1);
+    atomic_expire();
+
+    ck_assert_str_eq(reported, "0x00000100 main.c.tmp\n"
+                               "0x00000008 main.c.tmp\n");
+    ck_assert_int_eq(atomic_in_progress(), 0);
+}
+END_TEST
+
+Suite *atomic_suite(void)
+{
+    Suite *s = suite_create("atomic");
+
+    TCase *tc_core = tcase_create("When the editors save through temporary files");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    tcase_add_test(tc_core, recognizes_the_temporary_names);
+    tcase_add_test(tc_core, collapses_a_temporary_file_renamed);
+    tcase_add_test(tc_core, collapses_a_file_written_again_after_its_backup);
+    tcase_add_test(tc_core, collapses_both_the_ways_at_once);
+    tcase_add_test(tc_core, lets_the_other_events_go);
+    tcase_add_test(tc_core, lets_a_rename_without_a_save_go);
+    tcase_add_test(tc_core, releases_the_events_once_the_window_is_over);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s = atomic_suite();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
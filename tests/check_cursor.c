@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <check.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "../src/journal.h"
+#include "../src/cursor.h"
+
+/* helper functions */
+char answer[65536];
+
+cursor_status_t ask_since(uint64_t since)
+{
+    int fds[2];
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    cursor_status_t status = cursor_since(since, fds[0]);
+    close(fds[0]);
+
+    size_t length = 0;
+    ssize_t bytes;
+    while ((bytes = read(fds[1], answer + length, sizeof(answer) - 1 - length)) > 0)
+        length += bytes;
+    answer[length] = '\0';
+    close(fds[1]);
+
+    return status;
+}
+
+void record(uint64_t from, uint64_t to)
+{
+    for (; from <= to; ++from)
+        cursor_record(from, IN_CREATE, 0, "/home/cwatch/", "file");
+}
+/* end of helper functions */
+
+char directory[64];
+char socket_path[96];
+char command[128];
+
+void setup(void)
+{
+    snprintf(directory, sizeof(directory), "/tmp/check_cursor_XXXXXX");
+    ck_assert_ptr_ne(mkdtemp(directory), NULL);
+    snprintf(socket_path, sizeof(socket_path), "%s/socket", directory);
+}
+
+void teardown(void)
+{
+    cursor_stop();
+
+    snprintf(command, sizeof(command), "rm -rf %s", directory);
+    ck_assert_int_eq(system(command), 0);
+}
+
+START_TEST(gives_the_events_after_a_sequence_number)
+{
+    ck_assert_int_eq(cursor_start(socket_path, NULL, 0), 0);
+    record(1, 3);
+
+    ck_assert_int_eq(ask_since(1), CURSOR_END);
+    ck_assert_str_eq(answer, "2 0x00000100 0 /home/cwatch/file\n"
+                             "3 0x00000100 0 /home/cwatch/file\n"
+                             "END 3\n");
+
+    ck_assert_int_eq(ask_since(3), CURSOR_END);
+    ck_assert_str_eq(answer, "END 3\n");
+}
+END_TEST
+
+START_TEST(gives_more_events_than_copied_at_once)
+{
+    ck_assert_int_eq(cursor_start(socket_path, NULL, 0), 0);
+    record(1, 1500);
+
+    ck_assert_int_eq(ask_since(0), CURSOR_END);
+
+    int lines = 0;
+    char *line;
+    for (line = answer; (line = strchr(line, '\n')) != NULL; ++line)
+        ++lines;
+    ck_assert_int_eq(lines, 1501);
+    ck_assert(strstr(answer, "\n1025 0x00000100 0 /home/cwatch/file\n") != NULL);
+    ck_assert(strstr(answer, "\nEND 1500\n") != NULL);
+}
+END_TEST
+
+START_TEST(tells_to_rescan_when_the_events_are_lost)
+{
+    ck_assert_int_eq(cursor_start(socket_path, NULL, 0), 0);
+    record(1, CURSOR_RING_SIZE + 10);
+
+    ck_assert_int_eq(ask_since(5), CURSOR_GAP);
+    ck_assert_str_eq(answer, "GAP 11\n");
+
+    /* a sequence number never given */
+    ck_assert_int_eq(ask_since(CURSOR_RING_SIZE + 20), CURSOR_GAP);
+}
+END_TEST
+
+START_TEST(reads_the_older_events_from_the_journal)
+{
+    uint64_t sequence;
+
+    ck_assert_int_eq(journal_start(directory, JOURNAL_DEFAULT_MAX_SIZE, JOURNAL_DEFAULT_MAX_AGE, JOURNAL_FSYNC_NONE), 0);
+    for (sequence = 1; sequence <= 4; ++sequence)
+        journal_append(sequence, IN_DELETE, 0, "/home/cwatch/", "old");
+    journal_stop();
+
+    ck_assert_int_eq(cursor_start(socket_path, directory, 4), 0);
+    record(5, 5);
+
+    ck_assert_int_eq(ask_since(2), CURSOR_END);
+    ck_assert_str_eq(answer, "3 0x00000200 0 /home/cwatch/old\n"
+                             "4 0x00000200 0 /home/cwatch/old\n"
+                             "5 0x00000100 0 /home/cwatch/file\n"
+                             "END 5\n");
+}
+END_TEST
+
+START_TEST(answers_through_the_socket)
+{
+    struct sockaddr_un address;
+    char buffer[256];
+    size_t length = 0;
+    ssize_t bytes;
+
+    ck_assert_int_eq(cursor_start(socket_path, NULL, 0), 0);
+    record(1, 1);
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ck_assert_int_eq(connect(fd, (struct sockaddr *)&address, sizeof(address)), 0);
+    ck_assert_int_eq(write(fd, "SINCE 0\n", 8), 8);
+
+    while ((bytes = read(fd, buffer + length, sizeof(buffer) - length - 1)) > 0)
+        length += bytes;
+    buffer[length] = '\0';
+    close(fd);
+
+    ck_assert_str_eq(buffer, "1 0x00000100 0 /home/cwatch/file\nEND 1\n");
+}
+END_TEST
+
+Suite *cursor_suite(void)
+{
+    Suite *s = suite_create("cursor");
+
+    TCase *tc_core = tcase_create("When a consumer resumes from a sequence number");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    tcase_add_test(tc_core, gives_the_events_after_a_sequence_number);
+    tcase_add_test(tc_core, gives_more_events_than_copied_at_once);
+    tcase_add_test(tc_core, tells_to_rescan_when_the_events_are_lost);
+    tcase_add_test(tc_core, reads_the_older_events_from_the_journal);
+    tcase_add_test(tc_core, answers_through_the_socket);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s = cursor_suite();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -29,6 +29,7 @@ void setup(void)
 {
     watch_descriptor_from = inotify_add_watch_mock;
     remove_watch_descriptor = inotify_rm_watch_mock;
+    watch_candidates_free(&watch_budget);
 }
 
 void teardown(void)
@@ -578,6 +579,253 @@ START_TEST(remove_unreachable_resources_not_in_root_path)
 }
 END_TEST
 
+START_TEST(computes_the_include_state_of_a_path)
+{
+    root_path = "/home/cwatch/";
+    include_glob = pathglob_init();
+    pathglob_add(include_glob, "src/**/*.c");
+
+    ck_assert_msg(
+        include_state_of("/home/cwatch/src/module/") != 0,
+        "A directory that may contain a match has no state");
+
+    ck_assert_msg(
+        include_state_of("/home/cwatch/doc/") == 0,
+        "A directory that can never contain a match has a state");
+
+    ck_assert_msg(
+        include_state_of("/home/outside/src/") == 0,
+        "A path outside of the root path has a state");
+
+    pathglob_free(include_glob);
+    include_glob = NULL;
+}
+END_TEST
+
+START_TEST(adds_structural_events_to_the_kernel_mask_when_recursive)
+{
+    WD_DATA *wd_data = create_wd_data("/home/cwatch/", 1);
+
+    event_mask = IN_MODIFY;
+
+    recursive_flag = FALSE;
+    ck_assert_int_eq(kernel_mask_for(wd_data) & IN_ALL_EVENTS, IN_MODIFY);
+
+    recursive_flag = TRUE;
+    ck_assert_int_eq(kernel_mask_for(wd_data) & IN_ALL_EVENTS, IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVE);
+
+    recursive_flag = FALSE;
+    event_mask = 0;
+}
+END_TEST
+
+START_TEST(omits_user_events_where_nothing_can_match)
+{
+    root_path = "/home/cwatch/";
+    include_glob = pathglob_init();
+    pathglob_add(include_glob, "src/*.c");
+
+    event_mask = IN_MODIFY;
+
+    WD_DATA *root = create_wd_data("/home/cwatch/", 1);
+    root->include_state = include_state_of(root->path);
+
+    WD_DATA *src = create_wd_data("/home/cwatch/src/", 2);
+    src->include_state = include_state_of(src->path);
+
+    ck_assert_int_eq(kernel_mask_for(root) & IN_MODIFY, 0);
+    ck_assert_int_eq(kernel_mask_for(src) & IN_MODIFY, IN_MODIFY);
+
+    event_mask = 0;
+    pathglob_free(include_glob);
+    include_glob = NULL;
+}
+END_TEST
+
+START_TEST(computes_the_depth_of_a_path)
+{
+    root_path = "/home/cwatch/";
+
+    ck_assert_int_eq(depth_of("/home/cwatch/"), 0);
+    ck_assert_int_eq(depth_of("/home/cwatch/a/"), 1);
+    ck_assert_int_eq(depth_of("/home/cwatch/a/b/c"), 3);
+    ck_assert_int_eq(depth_of("/home/outside/a/"), 0);
+}
+END_TEST
+
+START_TEST(demotes_the_deepest_and_least_active_watch)
+{
+    int fd = 1;
+    Queue *queue_wd = queue_init();
+
+    root_path = "/home/cwatch/";
+
+    add_to_watch_list("/home/cwatch/", NULL, fd, queue_wd);
+    add_to_watch_list("/home/cwatch/a/", NULL, fd, queue_wd);
+    add_to_watch_list("/home/cwatch/a/b/", NULL, fd, queue_wd);
+    add_to_watch_list("/home/cwatch/a/c/", NULL, fd, queue_wd);
+
+    WD_DATA *b = (WD_DATA *)get_node_from_path("/home/cwatch/a/b/", queue_wd)->data;
+    WD_DATA *c = (WD_DATA *)get_node_from_path("/home/cwatch/a/c/", queue_wd)->data;
+    touch_watch(c, 5);
+    touch_watch(b, 10);
+
+    WD_DATA *victim = watch_to_demote(1, 0, queue_wd);
+    ck_assert_str_eq(victim->path, "/home/cwatch/a/c/");
+
+    victim = watch_to_demote(2, 0, queue_wd);
+    ck_assert_ptr_eq(victim, NULL);
+
+    victim = watch_to_demote(2, 8, queue_wd);
+    ck_assert_str_eq(victim->path, "/home/cwatch/a/c/");
+
+    /* an event makes it the most recently active */
+    touch_watch(c, 12);
+    victim = watch_to_demote(1, 0, queue_wd);
+    ck_assert_str_eq(victim->path, "/home/cwatch/a/b/");
+
+    /* a released watch is no longer a candidate */
+    release_watch(b, fd);
+    victim = watch_to_demote(1, 0, queue_wd);
+    ck_assert_str_eq(victim->path, "/home/cwatch/a/c/");
+
+    release_watch(c, fd);
+    victim = watch_to_demote(0, 0, queue_wd);
+    ck_assert_str_eq(victim->path, "/home/cwatch/a/");
+
+    queue_free(queue_wd);
+}
+END_TEST
+
+START_TEST(does_not_watch_directories_beyond_the_max_depth)
+{
+    int fd = 1;
+    Queue *queue_wd = queue_init();
+
+    root_path = "/home/cwatch/";
+    max_depth = 1;
+
+    ck_assert_ptr_ne(add_to_watch_list("/home/cwatch/a/", NULL, fd, queue_wd), NULL);
+    ck_assert_ptr_eq(add_to_watch_list("/home/cwatch/a/b/", NULL, fd, queue_wd), NULL);
+
+    max_depth = -1;
+    queue_free(queue_wd);
+}
+END_TEST
+
+START_TEST(reports_the_time_to_ready_only_once)
+{
+    char path[] = "/tmp/check_cwatch_ready_XXXXXX";
+    long time_to_ready = -1;
+
+    ck_assert_int_ne(mkstemp(path), -1);
+    ready_file = path;
+    ready_flag = FALSE;
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+
+    report_ready();
+
+    FILE *file = fopen(path, "r");
+    ck_assert_ptr_ne(file, NULL);
+    ck_assert_int_eq(fscanf(file, "%ld", &time_to_ready), 1);
+    ck_assert(time_to_ready >= 0);
+    fclose(file);
+
+    /* once ready, the file is not written again */
+    unlink(path);
+    report_ready();
+    ck_assert_int_eq(access(path, F_OK), -1);
+
+    ready_file = NULL;
+}
+END_TEST
+
+START_TEST(cools_down_a_hot_directory)
+{
+    WD_DATA *wd_data = create_wd_data("/home/cwatch/spool/", 1);
+
+    hot_threshold = 3;
+    event_mask = IN_MODIFY;
+
+    wd_data->last_event = 100;
+    ck_assert_int_eq(track_rate(wd_data), FALSE);
+    ck_assert_int_eq(track_rate(wd_data), FALSE);
+    ck_assert_int_eq(track_rate(wd_data), FALSE);
+    ck_assert_int_eq(track_rate(wd_data), TRUE);
+
+    /* counted again in the next second */
+    wd_data->last_event = 101;
+    ck_assert_int_eq(track_rate(wd_data), FALSE);
+
+    cool_watch(wd_data, 1);
+    ck_assert(wd_data->cooled_until >= time(NULL) + HOT_DEFAULT_COOLDOWN - 1);
+    ck_assert_int_eq(cooled_qty, 1);
+    ck_assert_int_eq(wd_data->mask & IN_ALL_EVENTS, COOLED_EVENTS);
+
+    release_watch(wd_data, 1);
+    ck_assert_int_eq(cooled_qty, 0);
+
+    hot_threshold = 0;
+    event_mask = 0;
+}
+END_TEST
+
+char sunk[256];
+
+void sink_event(uint64_t sequence, uint32_t mask, uint32_t cookie, const char *path, const char *name)
+{
+    sprintf(sunk + strlen(sunk), "0x%08x %s%s\n", mask, path, name);
+}
+
+START_TEST(rearms_a_cooled_directory_after_a_rescan)
+{
+    int fd = 1;
+    char directory[] = "/tmp/check_cwatch_hot_XXXXXX";
+    char path[96];
+    Queue *queue_wd = queue_init();
+
+    ck_assert_ptr_ne(mkdtemp(directory), NULL);
+    snprintf(path, sizeof(path), "%s/", directory);
+    root_path = path;
+    recursive_flag = TRUE;
+    event_mask = IN_MODIFY;
+    event_sink = sink_event;
+    sunk[0] = '\0';
+
+    WD_DATA *root = (WD_DATA *)add_to_watch_list(strdup(path), NULL, fd, queue_wd)->data;
+    snprintf(path, sizeof(path), "%s/gone/", directory);
+    add_to_watch_list(strdup(path), NULL, fd, queue_wd);
+
+    /* while cooled, a directory is created and another one deleted */
+    root->cooled_until = 1;
+    ++cooled_qty;
+    snprintf(path, sizeof(path), "%s/new", directory);
+    ck_assert_int_eq(mkdir(path, 0755), 0);
+
+    rearm_cooled(fd, queue_wd);
+
+    ck_assert_int_eq(cooled_qty, 0);
+    ck_assert_int_eq(root->cooled_until, 0);
+    ck_assert_int_eq(root->mask & IN_CREATE, IN_CREATE);
+
+    snprintf(path, sizeof(path), "%s/new/", directory);
+    ck_assert_ptr_ne(get_node_from_path(path, queue_wd), NULL);
+    snprintf(path, sizeof(path), "%s/gone/", directory);
+    ck_assert_ptr_eq(get_node_from_path(path, queue_wd), NULL);
+
+    snprintf(path, sizeof(path), "0x%08x %s/\n", IN_MODIFY | IN_ISDIR, directory);
+    ck_assert_str_eq(sunk, path);
+
+    snprintf(path, sizeof(path), "%s/new", directory);
+    rmdir(path);
+    rmdir(directory);
+    recursive_flag = FALSE;
+    event_mask = 0;
+    event_sink = NULL;
+    queue_free(queue_wd);
+}
+END_TEST
+
 Suite *cwatch_suite(void)
 {
     Suite *s = suite_create("cwatch");
@@ -615,6 +863,15 @@ Suite *cwatch_suite(void)
     tcase_add_test(tc_core, remove_unreachable_resources_not_in_root_path);
     tcase_add_test(tc_core, test_cases_for_append_dir);
     tcase_add_test(tc_core, test_cases_for_append_file);
+    tcase_add_test(tc_core, computes_the_include_state_of_a_path);
+    tcase_add_test(tc_core, adds_structural_events_to_the_kernel_mask_when_recursive);
+    tcase_add_test(tc_core, omits_user_events_where_nothing_can_match);
+    tcase_add_test(tc_core, computes_the_depth_of_a_path);
+    tcase_add_test(tc_core, demotes_the_deepest_and_least_active_watch);
+    tcase_add_test(tc_core, does_not_watch_directories_beyond_the_max_depth);
+    tcase_add_test(tc_core, reports_the_time_to_ready_only_once);
+    tcase_add_test(tc_core, cools_down_a_hot_directory);
+    tcase_add_test(tc_core, rearms_a_cooled_directory_after_a_rescan);
 
     suite_add_tcase(s, tc_core);
 
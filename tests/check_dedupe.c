@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include <string.h>
+#include <check.h>
+
+#include "../src/dedupe.h"
+
+DEDUPE_SET set;
+
+void setup(void)
+{
+}
+
+void teardown(void)
+{
+    /* forget everything remembered by the test */
+    dedupe_clear(&set);
+    ck_assert_int_eq(dedupe_size(&set), 0);
+}
+
+START_TEST(drops_the_real_twin_of_a_synthetic_event)
+{
+    dedupe_remember(&set, "/home/cwatch/a/", 100);
+
+    ck_assert_int_eq(dedupe_forget(&set, "/home/cwatch/a/", 101), 1);
+    ck_assert_int_eq(dedupe_forget(&set, "/home/cwatch/a/", 101), 0);
+    ck_assert_int_eq(dedupe_size(&set), 0);
+}
+END_TEST
+
+START_TEST(does_not_drop_other_events)
+{
+    dedupe_remember(&set, "/home/cwatch/a/", 100);
+
+    ck_assert_int_eq(dedupe_forget(&set, "/home/cwatch/b/", 101), 0);
+    ck_assert_int_eq(dedupe_size(&set), 1);
+}
+END_TEST
+
+START_TEST(forgets_the_synthetic_events_after_a_while)
+{
+    dedupe_remember(&set, "/home/cwatch/a/", 100);
+
+    ck_assert_int_eq(dedupe_forget(&set, "/home/cwatch/a/", 100 + DEDUPE_TTL), 0);
+    ck_assert_int_eq(dedupe_size(&set), 0);
+}
+END_TEST
+
+START_TEST(keeps_the_paths_of_each_set_apart)
+{
+    DEDUPE_SET other;
+    memset(&other, 0, sizeof(other));
+
+    dedupe_remember(&set, "/home/cwatch/a/", 100);
+
+    ck_assert_int_eq(dedupe_forget(&other, "/home/cwatch/a/", 101), 0);
+    ck_assert_int_eq(dedupe_forget(&set, "/home/cwatch/a/", 101), 1);
+}
+END_TEST
+
+Suite *dedupe_suite(void)
+{
+    Suite *s = suite_create("dedupe");
+
+    TCase *tc_core = tcase_create("When reporting the entries of a new directory");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    tcase_add_test(tc_core, drops_the_real_twin_of_a_synthetic_event);
+    tcase_add_test(tc_core, does_not_drop_other_events);
+    tcase_add_test(tc_core, forgets_the_synthetic_events_after_a_while);
+    tcase_add_test(tc_core, keeps_the_paths_of_each_set_apart);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s = dedupe_suite();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
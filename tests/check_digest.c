@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+#include <check.h>
+#include <sys/inotify.h>
+#include <sys/time.h>
+
+#include "../src/digest.h"
+
+char directory[64];
+char prefix[96];
+char path[96];
+char command[256];
+
+/* helper functions */
+void write_file(const char *content)
+{
+    FILE *file = fopen(path, "w");
+    ck_assert_ptr_ne(file, NULL);
+    fputs(content, file);
+    fclose(file);
+}
+
+/* moves the modification time, as a rewrite a bit later would do */
+void touch_later(int seconds)
+{
+    struct timeval times[2];
+    gettimeofday(&times[0], NULL);
+    times[0].tv_sec += seconds;
+    times[1] = times[0];
+    ck_assert_int_eq(utimes(path, times), 0);
+}
+
+/* holds an event of a file of the directory */
+void hold(uint32_t mask, const char *name, int hash)
+{
+    union
+    {
+        struct inotify_event event;
+        char buffer[sizeof(struct inotify_event) + 32];
+    } record;
+
+    record.event.wd = 1;
+    record.event.mask = mask;
+    record.event.cookie = 0;
+    record.event.len = 32;
+    strcpy(record.event.name, name);
+
+    ck_assert_int_eq(digest_hold(&record.event, prefix, 1, hash), 0);
+}
+
+/* waits and writes the events released as "<name>:<changed>" */
+char released[256];
+
+void release(int qty)
+{
+    struct pollfd pfd = {digest_descriptor(), POLLIN, 0};
+    DIGEST_ITEM *item;
+
+    released[0] = '\0';
+    while (qty > 0 && poll(&pfd, 1, 2000) == 1)
+    {
+        Queue *items = digest_release();
+        while ((item = (DIGEST_ITEM *)queue_dequeue(items)))
+        {
+            sprintf(released + strlen(released), "%s:%d ", item->event->name, item->changed);
+            digest_free(item);
+            --qty;
+        }
+        queue_free(items);
+    }
+}
+/* end of helper functions */
+
+void setup(void)
+{
+    snprintf(directory, sizeof(directory), "/tmp/check_digest_XXXXXX");
+    ck_assert_ptr_ne(mkdtemp(directory), NULL);
+    snprintf(prefix, sizeof(prefix), "%s/", directory);
+    snprintf(path, sizeof(path), "%s/file", directory);
+}
+
+void teardown(void)
+{
+    digest_forget(path);
+
+    snprintf(command, sizeof(command), "rm -rf %s", directory);
+    ck_assert_int_eq(system(command), 0);
+}
+
+START_TEST(hashes_as_xxh64)
+{
+    char data[1000];
+    int i;
+    for (i = 0; i < 1000; ++i)
+        data[i] = (char)(i * 7);
+
+    ck_assert_uint_eq(digest_of("", 0), 0xEF46DB3751D8E999ULL);
+    ck_assert_uint_eq(digest_of("a", 1), 0xD24EC4F1A98C6E5BULL);
+    ck_assert_uint_eq(digest_of("abc", 3), 0x44BC2CF5AD770999ULL);
+    ck_assert_uint_eq(digest_of(data, 1000), 0x25275608A9CFC168ULL);
+}
+END_TEST
+
+START_TEST(tells_whether_the_content_changed)
+{
+    write_file("one");
+    int files = digest_files();
+
+    /* nothing known about the file */
+    ck_assert_int_eq(digest_changed(path), 1);
+    ck_assert_int_eq(digest_files(), files + 1);
+
+    /* not touched */
+    ck_assert_int_eq(digest_changed(path), 0);
+
+    /* rewritten with the same content */
+    write_file("one");
+    touch_later(5);
+    ck_assert_int_eq(digest_changed(path), 0);
+
+    /* same size, another content */
+    write_file("two");
+    touch_later(10);
+    ck_assert_int_eq(digest_changed(path), 1);
+
+    /* deleted and created again */
+    digest_forget(path);
+    ck_assert_int_eq(digest_files(), files);
+    ck_assert_int_eq(digest_changed(path), 1);
+
+    /* too big to be hashed */
+    ck_assert_int_eq(truncate(path, DIGEST_MAX_SIZE + 1), 0);
+    ck_assert_int_eq(digest_changed(path), 1);
+    ck_assert_int_eq(digest_changed(path), 1);
+    ck_assert_int_eq(digest_files(), files);
+}
+END_TEST
+
+START_TEST(keeps_the_order_of_the_events)
+{
+    write_file("one");
+    ck_assert_int_eq(digest_start(), digest_descriptor());
+    ck_assert_int_ne(digest_descriptor(), -1);
+
+    hold(IN_CLOSE_WRITE, "file", 1);
+    hold(IN_CLOSE_WRITE, "missing", 1);
+    release(2);
+    ck_assert_int_eq(digest_held(), 0);
+
+    /* the same content is dropped, the events of the file after it wait */
+    write_file("one");
+    touch_later(5);
+    hold(IN_CLOSE_WRITE, "file", 1);
+    ck_assert_int_eq(digest_waits(prefix, "file"), 1);
+    ck_assert_int_eq(digest_waits(prefix, ""), 1);
+    hold(IN_DELETE, "file", 0);
+    release(2);
+    ck_assert_str_eq(released, "file:0 file:1 ");
+}
+END_TEST
+
+START_TEST(does_not_hold_the_events_of_the_other_paths)
+{
+    write_file("one");
+    ck_assert_int_eq(digest_start(), digest_descriptor());
+
+    hold(IN_CLOSE_WRITE, "file", 1);
+    ck_assert_int_eq(digest_waits(prefix, "other"), 0);
+
+    digest_wait();
+    release(1);
+    ck_assert_str_eq(released, "file:1 ");
+    ck_assert_int_eq(digest_waits(prefix, "file"), 0);
+}
+END_TEST
+
+Suite *digest_suite(void)
+{
+    Suite *s = suite_create("digest");
+
+    TCase *tc_core = tcase_create("When the unchanged files are skipped");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    tcase_add_test(tc_core, hashes_as_xxh64);
+    tcase_add_test(tc_core, tells_whether_the_content_changed);
+    tcase_add_test(tc_core, keeps_the_order_of_the_events);
+    tcase_add_test(tc_core, does_not_hold_the_events_of_the_other_paths);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s = digest_suite();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
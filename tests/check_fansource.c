@@ -0,0 +1,106 @@
+#include <stdlib.h>
+#include <check.h>
+#include <sys/inotify.h>
+
+#include "../src/fansource.h"
+
+void setup(void)
+{
+}
+
+void teardown(void)
+{
+    fansource_cache_clear();
+}
+
+START_TEST(caches_the_path_of_a_file_handle)
+{
+    char handle[] = {1, 2, 3, 4};
+    char other[] = {1, 2, 3, 5};
+
+    ck_assert_ptr_eq(fansource_cache_get(handle, sizeof(handle)), NULL);
+
+    fansource_cache_put(handle, sizeof(handle), "/home/cwatch/");
+
+    ck_assert_str_eq(fansource_cache_get(handle, sizeof(handle)), "/home/cwatch/");
+    ck_assert_ptr_eq(fansource_cache_get(other, sizeof(other)), NULL);
+    ck_assert_ptr_eq(fansource_cache_get(handle, sizeof(handle) - 1), NULL);
+}
+END_TEST
+
+START_TEST(forgets_all_the_paths_when_cleared)
+{
+    char handle[] = {1, 2, 3, 4};
+
+    fansource_cache_put(handle, sizeof(handle), "/home/cwatch/");
+    fansource_cache_clear();
+
+    ck_assert_ptr_eq(fansource_cache_get(handle, sizeof(handle)), NULL);
+}
+END_TEST
+
+START_TEST(forgets_only_the_paths_below_a_directory)
+{
+    char handle[] = {1, 2, 3, 4};
+    char below[] = {1, 2, 3, 5};
+    char sibling[] = {1, 2, 3, 6};
+    char parent[] = {1, 2, 3, 7};
+
+    fansource_cache_put(handle, sizeof(handle), "/home/cwatch/a/");
+    fansource_cache_put(below, sizeof(below), "/home/cwatch/a/b/");
+    fansource_cache_put(sibling, sizeof(sibling), "/home/cwatch/ab/");
+    fansource_cache_put(parent, sizeof(parent), "/home/cwatch/");
+
+    ck_assert_int_eq(fansource_cache_invalidate("/home/cwatch/a/"), 2);
+
+    ck_assert_ptr_eq(fansource_cache_get(handle, sizeof(handle)), NULL);
+    ck_assert_ptr_eq(fansource_cache_get(below, sizeof(below)), NULL);
+    ck_assert_str_eq(fansource_cache_get(sibling, sizeof(sibling)), "/home/cwatch/ab/");
+    ck_assert_str_eq(fansource_cache_get(parent, sizeof(parent)), "/home/cwatch/");
+}
+END_TEST
+
+START_TEST(always_asks_for_the_renames_of_the_directories)
+{
+    uint32_t mask = fansource_mask_for(IN_MODIFY);
+
+    /* zero when fanotify is not supported */
+    if (mask != 0)
+    {
+        ck_assert(mask & IN_MODIFY);
+        ck_assert(mask & IN_MOVED_FROM);
+        ck_assert(mask & IN_MOVED_TO);
+        ck_assert(mask & IN_DELETE);
+        ck_assert(mask & IN_ISDIR);
+        ck_assert(!(mask & IN_CREATE));
+    }
+}
+END_TEST
+
+Suite *fansource_suite(void)
+{
+    Suite *s = suite_create("fansource");
+
+    TCase *tc_core = tcase_create("When resolving the directories of fanotify events");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    tcase_add_test(tc_core, caches_the_path_of_a_file_handle);
+    tcase_add_test(tc_core, forgets_all_the_paths_when_cleared);
+    tcase_add_test(tc_core, forgets_only_the_paths_below_a_directory);
+    tcase_add_test(tc_core, always_asks_for_the_renames_of_the_directories);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s = fansource_suite();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <check.h>
+
+#include "../src/heavy.h"
+
+HEAVY *heavy;
+
+/* helper functions */
+void count(const char *key, int times)
+{
+    while (times-- > 0)
+        heavy_count(heavy, key);
+}
+/* end of helper functions */
+
+void setup(void)
+{
+    heavy = heavy_init(4);
+    ck_assert_ptr_ne(heavy, NULL);
+}
+
+void teardown(void)
+{
+    heavy_free(heavy);
+}
+
+START_TEST(counts_exactly_while_there_are_counters)
+{
+    HEAVY_ITEM items[4];
+
+    count("/a", 3);
+    count("/b", 5);
+    count("/c", 1);
+    count("/a", 1);
+
+    ck_assert_int_eq(heavy_top(heavy, items, 4), 3);
+    ck_assert_str_eq(items[0].key, "/b");
+    ck_assert_uint_eq(items[0].count, 5);
+    ck_assert_str_eq(items[1].key, "/a");
+    ck_assert_uint_eq(items[1].count, 4);
+    ck_assert_str_eq(items[2].key, "/c");
+    ck_assert_uint_eq(items[2].count, 1);
+    ck_assert_uint_eq(items[2].error, 0);
+    ck_assert_uint_eq(heavy_total(heavy), 10);
+
+    /* the array is not overrun */
+    ck_assert_int_eq(heavy_top(heavy, items, 1), 1);
+    ck_assert_str_eq(items[0].key, "/b");
+}
+END_TEST
+
+START_TEST(takes_the_counter_of_the_lowest)
+{
+    HEAVY_ITEM items[4];
+
+    count("/a", 10);
+    count("/b", 8);
+    count("/c", 2);
+    count("/d", 3);
+    count("/e", 1);
+
+    ck_assert_int_eq(heavy_top(heavy, items, 4), 4);
+    ck_assert_str_eq(items[0].key, "/a");
+    ck_assert_str_eq(items[1].key, "/b");
+
+    /* /e took the place of /c, with its count */
+    int e = (strcmp(items[2].key, "/e") == 0) ? 2 : 3;
+    ck_assert_str_eq(items[5 - e].key, "/d");
+    ck_assert_str_eq(items[e].key, "/e");
+    ck_assert_uint_eq(items[e].count, 3);
+    ck_assert_uint_eq(items[e].error, 2);
+}
+END_TEST
+
+START_TEST(finds_the_heavy_hitters_of_a_long_stream)
+{
+    HEAVY_ITEM items[4];
+    char key[32];
+    int i, warm = 0;
+
+    /* two keys over a fourth of the events, among many rare ones */
+    for (i = 0; i < 10000; ++i)
+    {
+        snprintf(key, sizeof(key), "/rare/%d", i);
+        heavy_count(heavy, key);
+        heavy_count(heavy, "/hot");
+        if (i % 4 != 0)
+            heavy_count(heavy, "/warm");
+    }
+    ck_assert_uint_eq(heavy_total(heavy), 27500);
+
+    ck_assert_int_eq(heavy_top(heavy, items, 4), 4);
+    ck_assert_str_eq(items[0].key, "/hot");
+    ck_assert_int_ge(items[0].count, 10000);
+    ck_assert_int_le(items[0].count - items[0].error, 10000);
+
+    for (i = 1; i < 4; ++i)
+    {
+        if (strcmp(items[i].key, "/warm") != 0)
+            continue;
+
+        ck_assert_int_ge(items[i].count, 7500);
+        ck_assert_int_le(items[i].count - items[i].error, 7500);
+        ++warm;
+    }
+    ck_assert_int_eq(warm, 1);
+}
+END_TEST
+
+START_TEST(starts_over_once_reset)
+{
+    HEAVY_ITEM items[4];
+
+    count("/a", 5);
+    heavy_reset(heavy);
+    ck_assert_int_eq(heavy_top(heavy, items, 4), 0);
+    ck_assert_uint_eq(heavy_total(heavy), 0);
+
+    count("/b", 2);
+    ck_assert_int_eq(heavy_top(heavy, items, 4), 1);
+    ck_assert_str_eq(items[0].key, "/b");
+    ck_assert_uint_eq(items[0].count, 2);
+}
+END_TEST
+
+Suite *heavy_suite(void)
+{
+    Suite *s = suite_create("heavy");
+
+    TCase *tc_core = tcase_create("When the keys that occur the most are counted");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    tcase_add_test(tc_core, counts_exactly_while_there_are_counters);
+    tcase_add_test(tc_core, takes_the_counter_of_the_lowest);
+    tcase_add_test(tc_core, finds_the_heavy_hitters_of_a_long_stream);
+    tcase_add_test(tc_core, starts_over_once_reset);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s = heavy_suite();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <check.h>
+#include <sys/stat.h>
+
+#include "../src/ingest.h"
+
+/* helper functions */
+static int next_wd = 1;
+
+int fake_add_watch(int fd, const char *path, uint32_t mask)
+{
+    return __sync_fetch_and_add(&next_wd, 1);
+}
+
+int accept_all_but_skip(const INGEST_DIR *parent, const char *name, unsigned char type, INGEST_DIR *child)
+{
+    if (strncmp(name, "skip", 4) == 0)
+        return 0;
+
+    child->depth = parent->depth + 1;
+    return 1;
+}
+
+/* collects until the workers are done, returns the directories collected */
+int collect_all(int *symlinks, int *max_depth)
+{
+    int dirs = 0;
+    int left = 1;
+    int rounds = 0;
+    INGEST_DIR *dir;
+
+    *symlinks = *max_depth = 0;
+    while (left > 0 && rounds++ < 500)
+    {
+        Queue *collected = ingest_collect(2, &left);
+        while ((dir = (INGEST_DIR *)queue_dequeue(collected)))
+        {
+            if (dir->symlink != NULL)
+            {
+                ++(*symlinks);
+            }
+            else
+            {
+                ck_assert_int_ne(dir->wd, -1);
+                ck_assert_int_eq(dir->path[strlen(dir->path) - 1], '/');
+                ++dirs;
+            }
+            if (dir->depth > *max_depth)
+                *max_depth = dir->depth;
+            ingest_free(dir);
+        }
+        queue_free(collected);
+
+        if (left > 0)
+            usleep(10000);
+    }
+
+    return dirs;
+}
+
+void ingest(const char *path)
+{
+    INGEST_DIR *dir = (INGEST_DIR *)calloc(1, sizeof(INGEST_DIR));
+    dir->path = strdup(path);
+    dir->wd = -1;
+
+    ck_assert_int_eq(ingest_subtree(dir), 0);
+}
+/* end of helper functions */
+
+char root[32];
+char command[256];
+
+void setup(void)
+{
+    snprintf(root, sizeof(root), "/tmp/check_ingest_XXXXXX");
+    ck_assert_ptr_ne(mkdtemp(root), NULL);
+    strcat(root, "/");
+
+    ck_assert_int_ne(ingest_start(-1, fake_add_watch, accept_all_but_skip), -1);
+}
+
+void teardown(void)
+{
+    snprintf(command, sizeof(command), "rm -rf %s", root);
+    ck_assert_int_eq(system(command), 0);
+}
+
+START_TEST(watches_every_directory_of_a_tree)
+{
+    int symlinks, max_depth;
+    char path[128];
+
+    snprintf(path, sizeof(path), "%sa/b/c", root);
+    snprintf(command, sizeof(command), "mkdir -p %s %sd", path, root);
+    ck_assert_int_eq(system(command), 0);
+
+    ingest(root);
+
+    ck_assert_int_eq(collect_all(&symlinks, &max_depth), 5);
+    ck_assert_int_eq(symlinks, 0);
+    ck_assert_int_eq(max_depth, 3);
+    ck_assert_int_eq(ingest_in_progress(), 0);
+}
+END_TEST
+
+START_TEST(does_not_visit_the_entries_not_accepted)
+{
+    int symlinks, max_depth;
+
+    snprintf(command, sizeof(command), "mkdir -p %sskip/a %sb", root, root);
+    ck_assert_int_eq(system(command), 0);
+
+    ingest(root);
+
+    ck_assert_int_eq(collect_all(&symlinks, &max_depth), 2);
+}
+END_TEST
+
+START_TEST(collects_the_symbolic_links_without_following_them)
+{
+    int symlinks, max_depth;
+
+    snprintf(command, sizeof(command), "mkdir -p %sa && ln -s /tmp %slink", root, root);
+    ck_assert_int_eq(system(command), 0);
+
+    ingest(root);
+
+    ck_assert_int_eq(collect_all(&symlinks, &max_depth), 2);
+    ck_assert_int_eq(symlinks, 1);
+}
+END_TEST
+
+START_TEST(tells_the_watches_not_collected_yet)
+{
+    int symlinks, max_depth, rounds = 0;
+
+    snprintf(command, sizeof(command), "mkdir -p %sa", root);
+    ck_assert_int_eq(system(command), 0);
+
+    int first_wd = next_wd;
+    ingest(root);
+
+    /* both the directories are watched, and wait to be collected */
+    while (ingest_pending(first_wd + 1) == 0 && rounds++ < 500)
+        usleep(10000);
+    ck_assert_int_eq(ingest_pending(first_wd), 1);
+    ck_assert_int_eq(ingest_pending(first_wd + 1), 1);
+    ck_assert_int_eq(ingest_pending(first_wd + 2), 0);
+    ck_assert_int_eq(ingest_pending(-1), 0);
+
+    ck_assert_int_eq(collect_all(&symlinks, &max_depth), 2);
+    ck_assert_int_eq(ingest_pending(first_wd), 0);
+    ck_assert_int_eq(ingest_pending(first_wd + 1), 0);
+}
+END_TEST
+
+START_TEST(collects_the_entries_born_after_the_ingest_started)
+{
+    Queue *collected;
+    INGEST_DIR *dir;
+    int left, rounds = 0;
+    char path[128];
+
+    snprintf(command, sizeof(command), "mkdir -p %sold && touch %sold/file", root, root);
+    ck_assert_int_eq(system(command), 0);
+    usleep(20000);
+
+    dir = (INGEST_DIR *)calloc(1, sizeof(INGEST_DIR));
+    dir->path = strdup(root);
+    dir->wd = -1;
+    clock_gettime(CLOCK_REALTIME_COARSE, &dir->since);
+    usleep(20000);
+
+    snprintf(command, sizeof(command), "mkdir -p %snew && touch %snew/file %sold/new_file", root, root, root);
+    ck_assert_int_eq(system(command), 0);
+    ck_assert_int_eq(ingest_subtree(dir), 0);
+
+    int created = 0;
+    do
+    {
+        collected = ingest_collect(INGEST_BATCH, &left);
+        while ((dir = (INGEST_DIR *)queue_dequeue(collected)))
+        {
+            char *name;
+            while (dir->created != NULL && (name = (char *)queue_dequeue(dir->created)))
+            {
+                snprintf(path, sizeof(path), "%s%s", dir->path, name);
+                free(name);
+                ck_assert(strstr(path, "new") != NULL);
+                ++created;
+            }
+            ingest_free(dir);
+        }
+        queue_free(collected);
+        usleep(10000);
+    } while (left > 0 && rounds++ < 500);
+
+    /* new/, new/file and old/new_file */
+    ck_assert_int_eq(created, 3);
+}
+END_TEST
+
+Suite *ingest_suite(void)
+{
+    Suite *s = suite_create("ingest");
+
+    TCase *tc_core = tcase_create("When a directory tree is ingested in background");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    tcase_add_test(tc_core, watches_every_directory_of_a_tree);
+    tcase_add_test(tc_core, does_not_visit_the_entries_not_accepted);
+    tcase_add_test(tc_core, collects_the_symbolic_links_without_following_them);
+    tcase_add_test(tc_core, tells_the_watches_not_collected_yet);
+    tcase_add_test(tc_core, collects_the_entries_born_after_the_ingest_started);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s = ingest_suite();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <check.h>
+#include <sys/inotify.h>
+
+#include "../src/journal.h"
+
+/* helper functions */
+int count_segments(const char *directory)
+{
+    int qty = 0;
+    DIR *dir_stream = opendir(directory);
+    struct dirent *entry;
+
+    while ((entry = readdir(dir_stream)))
+    {
+        if (strstr(entry->d_name, JOURNAL_SUFFIX) != NULL)
+            ++qty;
+    }
+    closedir(dir_stream);
+
+    return qty;
+}
+/* end of helper functions */
+
+char directory[64];
+char command[128];
+
+void setup(void)
+{
+    snprintf(directory, sizeof(directory), "/tmp/check_journal_XXXXXX");
+    ck_assert_ptr_ne(mkdtemp(directory), NULL);
+}
+
+void teardown(void)
+{
+    journal_stop();
+
+    snprintf(command, sizeof(command), "rm -rf %s", directory);
+    ck_assert_int_eq(system(command), 0);
+}
+
+START_TEST(reads_back_the_events_appended)
+{
+    ck_assert_int_eq(journal_start(directory, JOURNAL_DEFAULT_MAX_SIZE, JOURNAL_DEFAULT_MAX_AGE, JOURNAL_FSYNC_BATCH), 0);
+
+    ck_assert_int_eq(journal_append(1, IN_CREATE, 0, "/home/cwatch/", "a"), 0);
+    ck_assert_int_eq(journal_append(2, IN_MOVED_FROM, 7, "/home/cwatch/", "b"), 0);
+    journal_stop();
+
+    JOURNAL_READER *reader = journal_reader_open(directory, 0);
+    ck_assert_ptr_ne(reader, NULL);
+
+    const JOURNAL_RECORD *record = journal_reader_next(reader);
+    ck_assert_ptr_ne(record, NULL);
+    ck_assert_int_eq(record->sequence, 1);
+    ck_assert_int_eq(record->mask, IN_CREATE);
+    ck_assert_str_eq(JOURNAL_PATH(record), "/home/cwatch/a");
+
+    record = journal_reader_next(reader);
+    ck_assert_ptr_ne(record, NULL);
+    ck_assert_int_eq(record->sequence, 2);
+    ck_assert_int_eq(record->cookie, 7);
+
+    ck_assert_ptr_eq(journal_reader_next(reader), NULL);
+    journal_reader_close(reader);
+}
+END_TEST
+
+START_TEST(rotates_the_segments_by_size)
+{
+    int i;
+    uint64_t sequence = 0;
+
+    ck_assert_int_eq(journal_start(directory, 1024, JOURNAL_DEFAULT_MAX_AGE, JOURNAL_FSYNC_NONE), 0);
+
+    /* each batch goes to a new segment once the current one is full */
+    for (i = 0; i < 3; ++i)
+    {
+        int j;
+        for (j = 0; j < 32; ++j)
+            journal_append(++sequence, IN_MODIFY, 0, "/home/cwatch/", "file");
+        journal_flush();
+    }
+    journal_stop();
+
+    ck_assert_int_eq(count_segments(directory), 3);
+
+    /* a reader can start from any sequence number */
+    JOURNAL_READER *reader = journal_reader_open(directory, 50);
+    const JOURNAL_RECORD *record = journal_reader_next(reader);
+    ck_assert_ptr_ne(record, NULL);
+    ck_assert_int_eq(record->sequence, 50);
+
+    int qty = 1;
+    while (journal_reader_next(reader) != NULL)
+        ++qty;
+    ck_assert_int_eq(qty, 96 - 49);
+    journal_reader_close(reader);
+}
+END_TEST
+
+START_TEST(continues_the_sequence_numbers_of_the_journal)
+{
+    ck_assert_int_eq(journal_start(directory, JOURNAL_DEFAULT_MAX_SIZE, JOURNAL_DEFAULT_MAX_AGE, JOURNAL_FSYNC_NONE), 0);
+    ck_assert_int_eq(journal_last_sequence(), 0);
+    journal_append(1, IN_CREATE, 0, "/home/cwatch/", "a");
+    journal_append(2, IN_CREATE, 0, "/home/cwatch/", "b");
+    journal_stop();
+
+    ck_assert_int_eq(journal_start(directory, JOURNAL_DEFAULT_MAX_SIZE, JOURNAL_DEFAULT_MAX_AGE, JOURNAL_FSYNC_NONE), 0);
+    ck_assert_int_eq(journal_last_sequence(), 2);
+    journal_append(3, IN_CREATE, 0, "/home/cwatch/", "c");
+    journal_stop();
+
+    ck_assert_int_eq(count_segments(directory), 2);
+}
+END_TEST
+
+START_TEST(counts_the_events_of_a_segment_not_opened)
+{
+    ck_assert_int_eq(journal_start(directory, JOURNAL_DEFAULT_MAX_SIZE, JOURNAL_DEFAULT_MAX_AGE, JOURNAL_FSYNC_NONE), 0);
+    ck_assert_int_eq(rmdir(directory), 0);
+
+    journal_append(1, IN_CREATE, 0, "/home/cwatch/", "a");
+    journal_append(2, IN_CREATE, 0, "/home/cwatch/", "b");
+    journal_flush();
+
+    ck_assert_int_eq(journal_dropped(), 2);
+}
+END_TEST
+
+Suite *journal_suite(void)
+{
+    Suite *s = suite_create("journal");
+
+    TCase *tc_core = tcase_create("When journaling the events");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    tcase_add_test(tc_core, reads_back_the_events_appended);
+    tcase_add_test(tc_core, rotates_the_segments_by_size);
+    tcase_add_test(tc_core, continues_the_sequence_numbers_of_the_journal);
+    tcase_add_test(tc_core, counts_the_events_of_a_segment_not_opened);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s = journal_suite();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
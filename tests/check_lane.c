@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <check.h>
+#include <sys/inotify.h>
+
+#include "../src/lane.h"
+
+/* helper functions */
+void drain(int descriptor)
+{
+    char buffer[4096];
+
+    while (read(descriptor, buffer, sizeof(buffer)) > 0)
+        ;
+}
+/* end of helper functions */
+
+char path[32];
+char file[64];
+int fd;
+
+void setup(void)
+{
+    snprintf(path, sizeof(path), "/tmp/check_lane_XXXXXX");
+    ck_assert_ptr_ne(mkdtemp(path), NULL);
+    snprintf(file, sizeof(file), "%s/file", path);
+
+    fd = inotify_init1(IN_NONBLOCK);
+    ck_assert_int_ne(lane_start(IN_CREATE | IN_DELETE), -1);
+
+    /* drop what is left by the previous tests */
+    drain(lane_descriptor());
+}
+
+void teardown(void)
+{
+    unlink(file);
+    rmdir(path);
+    close(fd);
+}
+
+START_TEST(reports_the_lane_events_with_the_main_watch_descriptor)
+{
+    char buffer[4096];
+
+    int wd = lane_add_watch(fd, path, IN_CREATE | IN_MODIFY);
+    ck_assert_int_ne(wd, -1);
+
+    fclose(fopen(file, "w"));
+
+    ssize_t len = read(lane_descriptor(), buffer, sizeof(buffer));
+    ck_assert(len > 0);
+
+    lane_translate(buffer, len);
+    ck_assert_int_eq(((struct inotify_event *)buffer)->wd, wd);
+    ck_assert_int_eq(((struct inotify_event *)buffer)->mask, IN_CREATE);
+
+    /* the create event is not reported twice */
+    ck_assert_int_eq(read(fd, buffer, sizeof(buffer)), -1);
+}
+END_TEST
+
+START_TEST(reports_the_other_events_on_the_main_instance)
+{
+    char buffer[4096];
+
+    fclose(fopen(file, "w"));
+
+    int wd = lane_add_watch(fd, path, IN_CREATE | IN_MODIFY);
+    ck_assert_int_ne(wd, -1);
+
+    FILE *stream = fopen(file, "w");
+    fputs("changed", stream);
+    fclose(stream);
+
+    ck_assert(read(fd, buffer, sizeof(buffer)) > 0);
+    ck_assert_int_eq(((struct inotify_event *)buffer)->wd, wd);
+    ck_assert_int_eq(((struct inotify_event *)buffer)->mask, IN_MODIFY);
+
+    ck_assert_int_eq(read(lane_descriptor(), buffer, sizeof(buffer)), -1);
+}
+END_TEST
+
+START_TEST(removes_the_watches_from_both_the_instances)
+{
+    char buffer[4096];
+
+    int wd = lane_add_watch(fd, path, IN_CREATE | IN_MODIFY);
+    ck_assert_int_eq(lane_rm_watch(fd, wd), 0);
+
+    /* drop the IN_IGNORED events */
+    drain(lane_descriptor());
+
+    fclose(fopen(file, "w"));
+
+    ck_assert_int_eq(read(lane_descriptor(), buffer, sizeof(buffer)), -1);
+}
+END_TEST
+
+START_TEST(leaves_the_lane_when_the_mask_loses_its_events)
+{
+    char buffer[4096];
+
+    int wd = lane_add_watch(fd, path, IN_CREATE | IN_MODIFY);
+    ck_assert_int_eq(lane_add_watch(fd, path, IN_MODIFY), wd);
+
+    /* drop the IN_IGNORED events */
+    drain(lane_descriptor());
+
+    fclose(fopen(file, "w"));
+
+    ck_assert_int_eq(read(lane_descriptor(), buffer, sizeof(buffer)), -1);
+    ck_assert_int_eq(lane_rm_watch(fd, wd), 0);
+}
+END_TEST
+
+Suite *lane_suite(void)
+{
+    Suite *s = suite_create("lane");
+
+    TCase *tc_core = tcase_create("When watching the tree through the priority lane");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    tcase_add_test(tc_core, reports_the_lane_events_with_the_main_watch_descriptor);
+    tcase_add_test(tc_core, reports_the_other_events_on_the_main_instance);
+    tcase_add_test(tc_core, removes_the_watches_from_both_the_instances);
+    tcase_add_test(tc_core, leaves_the_lane_when_the_mask_loses_its_events);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s = lane_suite();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
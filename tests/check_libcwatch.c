@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <check.h>
+#include <sys/inotify.h>
+
+#include "../src/libcwatch.h"
+
+/* helper functions */
+char batch[4096];
+
+/* waits for a batch and writes it as "<mask> <path relative to the root>" lines */
+int next_batch(CWATCH *context, const char *root)
+{
+    struct pollfd pfd = {cwatch_descriptor(context), POLLIN, 0};
+    const CWATCH_EVENT *events;
+
+    batch[0] = '\0';
+    if (poll(&pfd, 1, 2000) != 1)
+        return 0;
+
+    int qty = cwatch_next_batch(context, &events);
+
+    int i;
+    for (i = 0; i < qty; ++i)
+    {
+        ck_assert_uint_eq(events[i].path_len, strlen(events[i].path));
+        sprintf(batch + strlen(batch), "0x%08x %s\n", events[i].mask, events[i].path + strlen(root));
+    }
+
+    return qty;
+}
+/* end of helper functions */
+
+char directory[64];
+char root[96];
+char shell[256];
+
+void setup(void)
+{
+    snprintf(directory, sizeof(directory), "/tmp/check_libcwatch_XXXXXX");
+    ck_assert_ptr_ne(mkdtemp(directory), NULL);
+    snprintf(root, sizeof(root), "%s/", directory);
+}
+
+void teardown(void)
+{
+    snprintf(shell, sizeof(shell), "rm -rf %s", directory);
+    ck_assert_int_eq(system(shell), 0);
+}
+
+START_TEST(gives_the_events_in_batches)
+{
+    const CWATCH_EVENT *events;
+    CWATCH *context = cwatch_open(IN_CREATE | IN_DELETE, 0);
+    ck_assert_ptr_ne(context, NULL);
+    ck_assert_int_eq(cwatch_add_root(context, directory), 0);
+
+    ck_assert_int_eq(cwatch_next_batch(context, &events), 0);
+
+    snprintf(shell, sizeof(shell), "touch %s/one %s/two && rm %s/one", directory, directory, directory);
+    ck_assert_int_eq(system(shell), 0);
+
+    ck_assert_int_eq(next_batch(context, root), 3);
+    ck_assert_str_eq(batch, "0x00000100 one\n"
+                            "0x00000100 two\n"
+                            "0x00000200 one\n");
+
+    cwatch_close(context);
+}
+END_TEST
+
+START_TEST(watches_the_new_directories_when_recursive)
+{
+    CWATCH *context = cwatch_open(IN_CREATE, CWATCH_RECURSIVE);
+    ck_assert_int_eq(cwatch_add_root(context, directory), 0);
+
+    snprintf(shell, sizeof(shell), "mkdir %s/sub", directory);
+    ck_assert_int_eq(system(shell), 0);
+    ck_assert_int_eq(next_batch(context, root), 1);
+    ck_assert_str_eq(batch, "0x40000100 sub\n");
+
+    snprintf(shell, sizeof(shell), "touch %s/sub/file", directory);
+    ck_assert_int_eq(system(shell), 0);
+    ck_assert_int_eq(next_batch(context, root), 1);
+    ck_assert_str_eq(batch, "0x00000100 sub/file\n");
+
+    cwatch_close(context);
+}
+END_TEST
+
+START_TEST(watches_a_tree_moved_in)
+{
+    CWATCH *context = cwatch_open(IN_CREATE | IN_MOVED_TO, CWATCH_RECURSIVE);
+    snprintf(root, sizeof(root), "%s/root", directory);
+    snprintf(shell, sizeof(shell), "mkdir -p %s/root %s/tree/a/b", directory, directory);
+    ck_assert_int_eq(system(shell), 0);
+    ck_assert_int_eq(cwatch_add_root(context, root), 0);
+
+    snprintf(shell, sizeof(shell), "mv %s/tree %s/root/", directory, directory);
+    ck_assert_int_eq(system(shell), 0);
+    snprintf(root, sizeof(root), "%s/root/", directory);
+    ck_assert_int_eq(next_batch(context, root), 1);
+    ck_assert_str_eq(batch, "0x40000080 tree\n");
+
+    snprintf(shell, sizeof(shell), "touch %s/root/tree/a/b/file", directory);
+    ck_assert_int_eq(system(shell), 0);
+    ck_assert_int_eq(next_batch(context, root), 1);
+    ck_assert_str_eq(batch, "0x00000100 tree/a/b/file\n");
+
+    cwatch_close(context);
+}
+END_TEST
+
+START_TEST(filters_the_events_of_a_context)
+{
+    CWATCH *context = cwatch_open(IN_CREATE, 0);
+    ck_assert_int_eq(cwatch_include(context, "*.c"), 0);
+    ck_assert_int_eq(cwatch_exclude(context, "_test\\.c$"), 0);
+    ck_assert_int_eq(cwatch_add_root(context, directory), 0);
+
+    snprintf(shell, sizeof(shell), "touch %s/main.c %s/main.h %s/main_test.c", directory, directory, directory);
+    ck_assert_int_eq(system(shell), 0);
+
+    ck_assert_int_eq(next_batch(context, root), 1);
+    ck_assert_str_eq(batch, "0x00000100 main.c\n");
+
+    cwatch_close(context);
+}
+END_TEST
+
+START_TEST(keeps_the_contexts_apart)
+{
+    char other[96];
+    snprintf(other, sizeof(other), "%s/other", directory);
+    snprintf(shell, sizeof(shell), "mkdir %s/one %s", directory, other);
+    ck_assert_int_eq(system(shell), 0);
+
+    CWATCH *first = cwatch_open(IN_CREATE, 0);
+    CWATCH *second = cwatch_open(IN_DELETE, 0);
+    snprintf(root, sizeof(root), "%s/one", directory);
+    ck_assert_int_eq(cwatch_add_root(first, root), 0);
+    ck_assert_int_eq(cwatch_add_root(second, other), 0);
+
+    /* a single root for each context */
+    ck_assert_int_eq(cwatch_add_root(first, other), -1);
+    ck_assert_int_eq(errno, EBUSY);
+
+    snprintf(shell, sizeof(shell), "touch %s/one/file %s/file && rm %s/file", directory, other, other);
+    ck_assert_int_eq(system(shell), 0);
+
+    snprintf(root, sizeof(root), "%s/one/", directory);
+    ck_assert_int_eq(next_batch(first, root), 1);
+    ck_assert_str_eq(batch, "0x00000100 file\n");
+
+    snprintf(root, sizeof(root), "%s/", other);
+    ck_assert_int_eq(next_batch(second, root), 1);
+    ck_assert_str_eq(batch, "0x00000200 file\n");
+
+    cwatch_close(first);
+    cwatch_close(second);
+}
+END_TEST
+
+Suite *libcwatch_suite(void)
+{
+    Suite *s = suite_create("libcwatch");
+
+    TCase *tc_core = tcase_create("When cwatch is embedded into a program");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    tcase_add_test(tc_core, gives_the_events_in_batches);
+    tcase_add_test(tc_core, watches_the_new_directories_when_recursive);
+    tcase_add_test(tc_core, watches_a_tree_moved_in);
+    tcase_add_test(tc_core, filters_the_events_of_a_context);
+    tcase_add_test(tc_core, keeps_the_contexts_apart);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s = libcwatch_suite();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
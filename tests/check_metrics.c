@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <check.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "../src/metrics.h"
+
+char directory[64];
+char path[96];
+char command[128];
+
+/* helper functions */
+int contains(const char *text, const char *line)
+{
+    return strstr(text, line) != NULL;
+}
+
+/* connects to the socket, writes a request if any and reads the answer */
+char answer[8192];
+
+char *scrape(const char *request)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ck_assert_int_ne(fd, -1);
+    ck_assert_int_eq(connect(fd, (struct sockaddr *)&address, sizeof(address)), 0);
+
+    if (request != NULL)
+        ck_assert_int_eq(write(fd, request, strlen(request)), strlen(request));
+
+    size_t length = 0;
+    ssize_t bytes;
+    while ((bytes = read(fd, answer + length, sizeof(answer) - 1 - length)) > 0)
+        length += bytes;
+    answer[length] = '\0';
+    close(fd);
+
+    return answer;
+}
+/* end of helper functions */
+
+void setup(void)
+{
+    metrics_reset();
+
+    snprintf(directory, sizeof(directory), "/tmp/check_metrics_XXXXXX");
+    ck_assert_ptr_ne(mkdtemp(directory), NULL);
+    snprintf(path, sizeof(path), "%s/metrics", directory);
+}
+
+void teardown(void)
+{
+    metrics_stop();
+
+    snprintf(command, sizeof(command), "rm -rf %s", directory);
+    ck_assert_int_eq(system(command), 0);
+}
+
+START_TEST(counts_the_events_by_type)
+{
+    metrics_count_event(IN_CREATE | IN_ISDIR);
+    metrics_count_event(IN_MODIFY);
+    metrics_count_event(IN_MODIFY);
+    metrics_count(METRIC_EVENTS_EXCLUDED);
+    metrics_gauge(GAUGE_WATCHES, 42);
+
+    ck_assert_uint_eq(metrics_counter(METRIC_EVENTS_READ), 3);
+    ck_assert_uint_eq(metrics_counter(METRIC_EVENTS_EXCLUDED), 1);
+    ck_assert_uint_eq(metrics_events_of(IN_MODIFY), 2);
+    ck_assert_uint_eq(metrics_events_of(IN_CREATE), 1);
+    ck_assert_uint_eq(metrics_events_of(IN_ISDIR), 0);
+
+    char *text = metrics_text();
+    ck_assert_ptr_ne(text, NULL);
+    ck_assert(contains(text, "\ncwatch_events_read_total 3\n"));
+    ck_assert(contains(text, "\ncwatch_events_total{type=\"modify\"} 2\n"));
+    ck_assert(contains(text, "\ncwatch_events_total{type=\"create\"} 1\n"));
+    ck_assert(contains(text, "\ncwatch_watches 42\n"));
+    free(text);
+}
+END_TEST
+
+START_TEST(adds_the_counts_of_the_other_threads)
+{
+    metrics_count_event(IN_MODIFY);
+    metrics_count_event_shared(IN_MODIFY);
+    metrics_count_event_shared(IN_CREATE);
+    metrics_count_shared(METRIC_EVENTS_EXCLUDED);
+
+    ck_assert_uint_eq(metrics_counter(METRIC_EVENTS_READ), 3);
+    ck_assert_uint_eq(metrics_counter(METRIC_EVENTS_EXCLUDED), 1);
+    ck_assert_uint_eq(metrics_events_of(IN_MODIFY), 2);
+
+    char *text = metrics_text();
+    ck_assert(contains(text, "\ncwatch_events_total{type=\"modify\"} 2\n"));
+    ck_assert(contains(text, "\ncwatch_events_excluded_total 1\n"));
+    free(text);
+
+    metrics_reset();
+    ck_assert_uint_eq(metrics_counter(METRIC_EVENTS_READ), 0);
+}
+END_TEST
+
+START_TEST(gives_the_quantiles_within_the_precision)
+{
+    ck_assert_uint_eq(metrics_quantile(HISTOGRAM_COMMAND_DURATION, 0.5), 0);
+
+    int i;
+    for (i = 1; i <= 1000; ++i)
+        metrics_record(HISTOGRAM_COMMAND_DURATION, i * 100);
+
+    ck_assert_uint_eq(metrics_recorded(HISTOGRAM_COMMAND_DURATION), 1000);
+
+    /* within 12.5% of the real ones */
+    uint64_t median = metrics_quantile(HISTOGRAM_COMMAND_DURATION, 0.5);
+    ck_assert_int_ge(median, 50000);
+    ck_assert_int_le(median, 50000 + 50000 / 8);
+
+    uint64_t p99 = metrics_quantile(HISTOGRAM_COMMAND_DURATION, 0.99);
+    ck_assert_int_ge(p99, 99000);
+    ck_assert_int_le(p99, 100000);
+
+    /* the small values are exact */
+    metrics_reset();
+    metrics_record(HISTOGRAM_DISPATCH_LATENCY, 3);
+    ck_assert_uint_eq(metrics_quantile(HISTOGRAM_DISPATCH_LATENCY, 0.5), 3);
+
+    char *text = metrics_text();
+    ck_assert(contains(text, "\ncwatch_dispatch_latency_seconds{quantile=\"0.5\"} 0.000003\n"));
+    ck_assert(contains(text, "\ncwatch_dispatch_latency_seconds_count 1\n"));
+    free(text);
+}
+END_TEST
+
+START_TEST(writes_the_metrics_into_a_file)
+{
+    char content[4096];
+
+    metrics_count(METRIC_COMMANDS_RUN);
+    ck_assert_int_eq(metrics_write(path), 0);
+
+    FILE *file = fopen(path, "r");
+    ck_assert_ptr_ne(file, NULL);
+    size_t length = fread(content, 1, sizeof(content) - 1, file);
+    content[length] = '\0';
+    fclose(file);
+
+    ck_assert(contains(content, "# TYPE cwatch_commands_run_total counter\ncwatch_commands_run_total 1\n"));
+}
+END_TEST
+
+START_TEST(serves_the_metrics_on_a_socket)
+{
+    metrics_count(METRIC_OVERFLOWS);
+    ck_assert_int_eq(metrics_serve(path), 0);
+
+    scrape(NULL);
+    ck_assert_int_eq(strncmp(answer, "# TYPE", 6), 0);
+    ck_assert(contains(answer, "\ncwatch_overflows_total 1\n"));
+
+    scrape("GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    ck_assert_int_eq(strncmp(answer, "HTTP/1.0 200 OK\r\n", 17), 0);
+    ck_assert(contains(answer, "\r\n\r\n# TYPE"));
+}
+END_TEST
+
+Suite *metrics_suite(void)
+{
+    Suite *s = suite_create("metrics");
+
+    TCase *tc_core = tcase_create("When cwatch is instrumented");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    tcase_add_test(tc_core, counts_the_events_by_type);
+    tcase_add_test(tc_core, adds_the_counts_of_the_other_threads);
+    tcase_add_test(tc_core, gives_the_quantiles_within_the_precision);
+    tcase_add_test(tc_core, writes_the_metrics_into_a_file);
+    tcase_add_test(tc_core, serves_the_metrics_on_a_socket);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s = metrics_suite();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <check.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include "../src/mirror.h"
+
+char directory[64];
+char source[96];
+char destination[96];
+char command[512];
+
+/* helper functions */
+void run(const char *format, const char *argument)
+{
+    snprintf(command, sizeof(command), format, argument, argument, argument);
+    ck_assert_int_eq(system(command), 0);
+}
+
+/* returns the content of a file of the destination */
+char content[256];
+
+char *mirrored(const char *relative)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s%s", destination, relative);
+
+    content[0] = '\0';
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return NULL;
+
+    size_t length = fread(content, 1, sizeof(content) - 1, file);
+    content[length] = '\0';
+    fclose(file);
+
+    return content;
+}
+
+int exists(const char *relative)
+{
+    char path[256];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s%s", destination, relative);
+
+    return lstat(path, &st) == 0;
+}
+
+/* an event on the source, given by its path relative to the roots */
+void event(uint32_t mask, uint32_t cookie, const char *relative)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s%s", source, relative);
+
+    char *slash = strrchr(path, '/');
+    char name[128];
+    strcpy(name, slash + 1);
+    slash[1] = '\0';
+
+    mirror_event(mask, cookie, path, name);
+}
+
+void sync_mirror()
+{
+    mirror_flush();
+    mirror_wait();
+}
+/* end of helper functions */
+
+void setup(void)
+{
+    snprintf(directory, sizeof(directory), "/tmp/check_mirror_XXXXXX");
+    ck_assert_ptr_ne(mkdtemp(directory), NULL);
+    snprintf(source, sizeof(source), "%s/source/", directory);
+    snprintf(destination, sizeof(destination), "%s/destination/", directory);
+    run("mkdir %s/source %s/destination", directory);
+
+    ck_assert_int_eq(mirror_start(source, destination, 2), 0);
+}
+
+void teardown(void)
+{
+    mirror_stop();
+    run("rm -rf %s", directory);
+}
+
+START_TEST(copies_the_files_written)
+{
+    run("mkdir %s/source/sub && echo one > %s/source/sub/file && ln -s file %s/source/sub/link", directory);
+
+    event(IN_CREATE | IN_ISDIR, 0, "sub");
+    ck_assert_int_eq(exists("sub"), 1);
+
+    event(IN_CLOSE_WRITE, 0, "sub/file");
+    event(IN_CREATE, 0, "sub/link");
+    ck_assert_ptr_eq(mirrored("sub/file"), NULL);
+
+    sync_mirror();
+    ck_assert_str_eq(mirrored("sub/file"), "one\n");
+    ck_assert_str_eq(mirrored("sub/link"), "one\n");
+    ck_assert_uint_eq(mirror_copies(), 2);
+    ck_assert_uint_eq(mirror_failures(), 0);
+
+    /* the copy keeps the mode */
+    struct stat st;
+    run("chmod 640 %s/source/sub/file", directory);
+    event(IN_CLOSE_WRITE, 0, "sub/file");
+    sync_mirror();
+    snprintf(command, sizeof(command), "%ssub/file", destination);
+    ck_assert_int_eq(stat(command, &st), 0);
+    ck_assert_int_eq(st.st_mode & 0777, 0640);
+}
+END_TEST
+
+START_TEST(copies_a_file_once_per_loop)
+{
+    run("echo two > %s/source/file", directory);
+
+    int i;
+    for (i = 0; i < 100; ++i)
+        event(IN_CLOSE_WRITE, 0, "file");
+    sync_mirror();
+
+    ck_assert_str_eq(mirrored("file"), "two\n");
+    ck_assert_uint_eq(mirror_copies(), 1);
+}
+END_TEST
+
+START_TEST(applies_the_deletions)
+{
+    run("mkdir -p %s/destination/sub/deep && touch %s/destination/sub/deep/file %s/destination/file", directory);
+
+    event(IN_DELETE, 0, "file");
+    ck_assert_int_eq(exists("file"), 0);
+
+    /* a copy to do of a file deleted is dropped */
+    event(IN_CLOSE_WRITE, 0, "sub/deep/file");
+    event(IN_DELETE | IN_ISDIR, 0, "sub");
+    ck_assert_int_eq(exists("sub"), 0);
+
+    sync_mirror();
+    ck_assert_uint_eq(mirror_copies(), 0);
+    ck_assert_uint_eq(mirror_failures(), 0);
+}
+END_TEST
+
+START_TEST(renames_without_copying)
+{
+    struct stat before, after;
+    run("echo one > %s/source/new && echo one > %s/destination/old", directory);
+    snprintf(command, sizeof(command), "%sold", destination);
+    ck_assert_int_eq(stat(command, &before), 0);
+
+    event(IN_MOVED_FROM, 7, "old");
+    event(IN_MOVED_TO, 7, "new");
+    sync_mirror();
+
+    ck_assert_int_eq(exists("old"), 0);
+    snprintf(command, sizeof(command), "%snew", destination);
+    ck_assert_int_eq(stat(command, &after), 0);
+    ck_assert_uint_eq(before.st_ino, after.st_ino);
+    ck_assert_uint_eq(mirror_copies(), 0);
+}
+END_TEST
+
+START_TEST(moves_the_copies_to_do_with_a_rename)
+{
+    run("mkdir %s/source/new %s/destination/old && echo one > %s/source/new/file", directory);
+
+    event(IN_CLOSE_WRITE, 0, "old/file");
+    event(IN_MOVED_FROM | IN_ISDIR, 9, "old");
+    event(IN_MOVED_TO | IN_ISDIR, 9, "new");
+    sync_mirror();
+
+    ck_assert_int_eq(exists("old"), 0);
+    ck_assert_str_eq(mirrored("new/file"), "one\n");
+}
+END_TEST
+
+START_TEST(renames_across_two_loops)
+{
+    struct stat before, after;
+    run("mkdir %s/source/new %s/destination/old && echo one > %s/destination/old/file", directory);
+    snprintf(command, sizeof(command), "%sold/file", destination);
+    ck_assert_int_eq(stat(command, &before), 0);
+
+    event(IN_MOVED_FROM | IN_ISDIR, 5, "old");
+    mirror_flush();
+    ck_assert_int_eq(exists("old"), 1);
+
+    event(IN_MOVED_TO | IN_ISDIR, 5, "new");
+    sync_mirror();
+
+    ck_assert_int_eq(exists("old"), 0);
+    snprintf(command, sizeof(command), "%snew/file", destination);
+    ck_assert_int_eq(stat(command, &after), 0);
+    ck_assert_uint_eq(before.st_ino, after.st_ino);
+
+    /* a move without its IN_MOVED_TO in the next loop went out */
+    event(IN_MOVED_FROM | IN_ISDIR, 6, "new");
+    mirror_flush();
+    ck_assert_int_eq(mirror_moves(), 1);
+    mirror_flush();
+    ck_assert_int_eq(mirror_moves(), 0);
+    ck_assert_int_eq(exists("new"), 0);
+}
+END_TEST
+
+START_TEST(copies_a_tree_moved_in_and_deletes_a_tree_moved_out)
+{
+    run("mkdir -p %s/source/in/deep && echo one > %s/source/in/deep/file && mkdir %s/destination/out", directory);
+
+    event(IN_MOVED_TO | IN_ISDIR, 3, "in");
+    event(IN_MOVED_FROM | IN_ISDIR, 4, "out");
+    sync_mirror();
+    ck_assert_str_eq(mirrored("in/deep/file"), "one\n");
+
+    /* the IN_MOVED_TO can still come in the next loop */
+    ck_assert_int_eq(exists("out"), 1);
+    sync_mirror();
+    ck_assert_int_eq(exists("out"), 0);
+}
+END_TEST
+
+Suite *mirror_suite(void)
+{
+    Suite *s = suite_create("mirror");
+
+    TCase *tc_core = tcase_create("When the changes are mirrored into a destination");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    tcase_add_test(tc_core, copies_the_files_written);
+    tcase_add_test(tc_core, copies_a_file_once_per_loop);
+    tcase_add_test(tc_core, applies_the_deletions);
+    tcase_add_test(tc_core, renames_without_copying);
+    tcase_add_test(tc_core, moves_the_copies_to_do_with_a_rename);
+    tcase_add_test(tc_core, renames_across_two_loops);
+    tcase_add_test(tc_core, copies_a_tree_moved_in_and_deletes_a_tree_moved_out);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s = mirror_suite();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
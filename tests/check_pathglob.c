@@ -0,0 +1,128 @@
+#include <stdlib.h>
+#include <check.h>
+
+#include "../src/pathglob.h"
+
+PATHGLOB *glob;
+
+void setup(void)
+{
+    glob = pathglob_init();
+}
+
+void teardown(void)
+{
+    pathglob_free(glob);
+}
+
+/* helper functions */
+int matches(const char *path)
+{
+    return pathglob_accepts(glob, pathglob_walk(glob, pathglob_start(glob), path));
+}
+
+int may_lead_to_a_match(const char *path)
+{
+    return pathglob_walk(glob, pathglob_start(glob), path) != 0;
+}
+/* end of helper functions */
+
+START_TEST(matches_a_file_in_a_directory)
+{
+    pathglob_add(glob, "src/*.c");
+
+    ck_assert_int_eq(matches("src/main.c"), 1);
+    ck_assert_int_eq(matches("src/main.h"), 0);
+    ck_assert_int_eq(matches("src/sub/main.c"), 0);
+    ck_assert_int_eq(matches("main.c"), 0);
+}
+END_TEST
+
+START_TEST(matches_any_number_of_directories_with_globstar)
+{
+    pathglob_add(glob, "src/**/*.c");
+
+    ck_assert_int_eq(matches("src/main.c"), 1);
+    ck_assert_int_eq(matches("src/a/b/c/main.c"), 1);
+    ck_assert_int_eq(matches("lib/main.c"), 0);
+}
+END_TEST
+
+START_TEST(expands_the_alternatives)
+{
+    pathglob_add(glob, "{src,lib}/**/*.{c,h}");
+
+    ck_assert_int_eq(matches("src/a/main.c"), 1);
+    ck_assert_int_eq(matches("lib/main.h"), 1);
+    ck_assert_int_eq(matches("lib/main.o"), 0);
+    ck_assert_int_eq(matches("doc/main.c"), 0);
+}
+END_TEST
+
+START_TEST(prunes_directories_that_can_never_match)
+{
+    pathglob_add(glob, "src/**/*.c");
+
+    ck_assert_int_eq(may_lead_to_a_match("src/"), 1);
+    ck_assert_int_eq(may_lead_to_a_match("src/a/b/"), 1);
+    ck_assert_int_eq(may_lead_to_a_match("doc/"), 0);
+    ck_assert_int_eq(may_lead_to_a_match("doc/src/"), 0);
+}
+END_TEST
+
+START_TEST(shares_the_states_of_a_common_prefix)
+{
+    pathglob_add(glob, "src/**/*.c");
+    pathglob_add(glob, "src/**/*.h");
+
+    /* root, src, **, *.c, *.h */
+    ck_assert_int_eq(glob->qty, 5);
+}
+END_TEST
+
+START_TEST(knows_if_a_directory_can_contain_a_match)
+{
+    pathglob_add(glob, "src/*.c");
+
+    ck_assert_int_eq(pathglob_accepts_child(glob, pathglob_start(glob)), 0);
+    ck_assert_int_eq(pathglob_accepts_child(glob, pathglob_walk(glob, pathglob_start(glob), "src/")), 1);
+}
+END_TEST
+
+START_TEST(rejects_malformed_patterns)
+{
+    ck_assert_int_eq(pathglob_add(glob, ""), -1);
+    ck_assert_int_eq(pathglob_add(glob, "src/{a,b"), -1);
+}
+END_TEST
+
+Suite *pathglob_suite(void)
+{
+    Suite *s = suite_create("pathglob");
+
+    TCase *tc_core = tcase_create("When matching paths against globs");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    tcase_add_test(tc_core, matches_a_file_in_a_directory);
+    tcase_add_test(tc_core, matches_any_number_of_directories_with_globstar);
+    tcase_add_test(tc_core, expands_the_alternatives);
+    tcase_add_test(tc_core, prunes_directories_that_can_never_match);
+    tcase_add_test(tc_core, shares_the_states_of_a_common_prefix);
+    tcase_add_test(tc_core, knows_if_a_directory_can_contain_a_match);
+    tcase_add_test(tc_core, rejects_malformed_patterns);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s = pathglob_suite();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
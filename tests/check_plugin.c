@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <check.h>
+#include <sys/inotify.h>
+
+#include "../src/plugin.h"
+
+/* helper functions */
+char library[512];
+void *sample = NULL;
+
+/* calls a function of the sample plugin */
+const char *seen()
+{
+    const char *(*function)(void);
+    *(void **)(&function) = dlsym(sample, "sample_seen");
+    return function();
+}
+
+int counter(const char *name)
+{
+    int (*function)(void);
+    *(void **)(&function) = dlsym(sample, name);
+    return function();
+}
+/* end of helper functions */
+
+void setup(void)
+{
+    ck_assert_ptr_ne(getcwd(library, sizeof(library) - 32), NULL);
+    strcat(library, "/plugin_sample.so");
+
+    sample = dlopen(library, RTLD_NOW);
+    ck_assert_ptr_ne(sample, NULL);
+}
+
+void teardown(void)
+{
+    plugin_unload();
+    dlclose(sample);
+}
+
+START_TEST(gives_the_events_in_batches)
+{
+    ck_assert_int_eq(plugin_load(library, "/home/cwatch/", NULL), 0);
+    ck_assert_int_eq(plugin_enabled(), 1);
+
+    plugin_add(1, IN_CREATE, "create", "/home/cwatch/", "report_2024.txt", "2024", 4);
+    plugin_add(2, IN_DELETE | IN_ISDIR, "delete", "/home/cwatch/", "old", NULL, 0);
+    ck_assert_int_eq(counter("sample_batches"), 0);
+
+    ck_assert_int_eq(plugin_flush(), 0);
+    ck_assert_int_eq(counter("sample_batches"), 1);
+    ck_assert_str_eq(seen(), "1 0x00000100 create /home/cwatch/report_2024.txt 2024\n"
+                             "2 0x40000200 delete /home/cwatch/old -\n");
+
+    /* an empty batch is not given */
+    ck_assert_int_eq(plugin_flush(), 0);
+    ck_assert_int_eq(counter("sample_batches"), 1);
+
+    plugin_unload();
+    ck_assert_int_eq(counter("sample_finished"), 1);
+}
+END_TEST
+
+START_TEST(refuses_a_plugin_of_another_abi)
+{
+    ck_assert_int_eq(plugin_load(library, "/home/cwatch/", "old-abi"), -1);
+    ck_assert_ptr_ne(strstr(plugin_error(), "ABI"), NULL);
+    ck_assert_int_eq(plugin_enabled(), 0);
+
+    ck_assert_int_eq(plugin_load(library, "/home/cwatch/", "refuse"), -1);
+    ck_assert_int_eq(plugin_load("/nonexistent/plugin.so", "/home/cwatch/", NULL), -1);
+}
+END_TEST
+
+START_TEST(disables_a_plugin_that_fails)
+{
+    ck_assert_int_eq(plugin_load(library, "/home/cwatch/", "fail"), 0);
+
+    plugin_add(1, IN_CREATE, "create", "/home/cwatch/", "file", NULL, 0);
+    ck_assert_int_eq(plugin_flush(), -1);
+    ck_assert_int_eq(plugin_enabled(), 0);
+    ck_assert_str_eq(plugin_error(), "the plugin failed");
+    ck_assert_int_eq(counter("sample_finished"), 1);
+
+    /* the events are not given anymore */
+    plugin_add(2, IN_CREATE, "create", "/home/cwatch/", "file", NULL, 0);
+    ck_assert_int_eq(plugin_flush(), 0);
+    ck_assert_int_eq(counter("sample_batches"), 1);
+}
+END_TEST
+
+Suite *plugin_suite(void)
+{
+    Suite *s = suite_create("plugin");
+
+    TCase *tc_core = tcase_create("When the events are handled by a plugin");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    tcase_add_test(tc_core, gives_the_events_in_batches);
+    tcase_add_test(tc_core, refuses_a_plugin_of_another_abi);
+    tcase_add_test(tc_core, disables_a_plugin_that_fails);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s = plugin_suite();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
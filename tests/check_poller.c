@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <check.h>
+#include <sys/inotify.h>
+
+#include "../src/poller.h"
+
+bstring events;
+
+void setup(void)
+{
+    events = bfromcstr("");
+}
+
+void teardown(void)
+{
+    bdestroy(events);
+}
+
+/* helper functions */
+POLL_ENTRY entry(char *name, ino_t ino, off_t size, time_t mtime, int is_dir)
+{
+    POLL_ENTRY entry;
+
+    entry.name = name;
+    entry.ino = ino;
+    entry.size = size;
+    entry.mtime.tv_sec = entry.ctime.tv_sec = mtime;
+    entry.mtime.tv_nsec = entry.ctime.tv_nsec = 0;
+    entry.is_dir = is_dir;
+
+    return entry;
+}
+
+struct inotify_event *event_at(int index)
+{
+    int offset = 0;
+    struct inotify_event *event = (struct inotify_event *)events->data;
+
+    while (index-- > 0)
+    {
+        offset += sizeof(struct inotify_event) + event->len;
+        event = (struct inotify_event *)(events->data + offset);
+    }
+
+    return event;
+}
+/* end of helper functions */
+
+START_TEST(appends_an_aligned_inotify_event)
+{
+    poller_append_event(events, 42, IN_CREATE, 0, "file");
+
+    ck_assert_int_eq(blength(events), sizeof(struct inotify_event) + 16);
+    ck_assert_int_eq(event_at(0)->wd, 42);
+    ck_assert_int_eq(event_at(0)->mask, IN_CREATE);
+    ck_assert_str_eq(event_at(0)->name, "file");
+}
+END_TEST
+
+START_TEST(reports_created_and_deleted_entries)
+{
+    POLL_ENTRY old[] = {entry("a", 1, 0, 0, 0), entry("b", 2, 0, 0, 1)};
+    POLL_ENTRY new[] = {entry("b", 2, 0, 0, 1), entry("c", 3, 0, 0, 0)};
+
+    int qty = poller_diff(old, 2, new, 2, 1, IN_ALL_EVENTS, events);
+
+    ck_assert_int_eq(qty, 2);
+    ck_assert_int_eq(event_at(0)->mask, IN_DELETE);
+    ck_assert_str_eq(event_at(0)->name, "a");
+    ck_assert_int_eq(event_at(1)->mask, IN_CREATE);
+    ck_assert_str_eq(event_at(1)->name, "c");
+}
+END_TEST
+
+START_TEST(reports_modified_files)
+{
+    POLL_ENTRY old[] = {entry("a", 1, 10, 100, 0)};
+    POLL_ENTRY new[] = {entry("a", 1, 20, 200, 0)};
+
+    ck_assert_int_eq(poller_diff(old, 1, new, 1, 1, IN_ALL_EVENTS, events), 1);
+    ck_assert_int_eq(event_at(0)->mask, IN_MODIFY);
+}
+END_TEST
+
+START_TEST(reports_a_replaced_directory_as_deleted_and_created)
+{
+    POLL_ENTRY old[] = {entry("dir", 1, 0, 0, 1)};
+    POLL_ENTRY new[] = {entry("dir", 2, 0, 0, 1)};
+
+    ck_assert_int_eq(poller_diff(old, 1, new, 1, 1, IN_ALL_EVENTS, events), 2);
+    ck_assert_int_eq(event_at(0)->mask, IN_DELETE | IN_ISDIR);
+    ck_assert_int_eq(event_at(1)->mask, IN_CREATE | IN_ISDIR);
+}
+END_TEST
+
+START_TEST(reports_only_the_requested_events)
+{
+    POLL_ENTRY old[] = {entry("a", 1, 10, 100, 0)};
+    POLL_ENTRY new[] = {entry("a", 1, 20, 200, 0), entry("b", 2, 0, 0, 0)};
+
+    ck_assert_int_eq(poller_diff(old, 1, new, 2, 1, IN_CREATE, events), 1);
+    ck_assert_int_eq(event_at(0)->mask, IN_CREATE);
+}
+END_TEST
+
+START_TEST(reports_a_renamed_entry_as_moved)
+{
+    POLL_ENTRY old[] = {entry("a", 1, 0, 0, 0)};
+    POLL_ENTRY new[] = {entry("b", 1, 0, 0, 0)};
+
+    ck_assert_int_eq(poller_diff(old, 1, new, 1, 1, IN_ALL_EVENTS, events), 2);
+    ck_assert_int_eq(event_at(0)->mask, IN_MOVED_FROM);
+    ck_assert_str_eq(event_at(0)->name, "a");
+    ck_assert_int_eq(event_at(1)->mask, IN_MOVED_TO);
+    ck_assert_str_eq(event_at(1)->name, "b");
+    ck_assert_int_ne(event_at(0)->cookie, 0);
+    ck_assert_int_eq(event_at(0)->cookie, event_at(1)->cookie);
+}
+END_TEST
+
+START_TEST(refreshes_the_known_entries_of_a_directory)
+{
+    char path[] = "/tmp/check_poller_XXXXXX";
+    char file[64];
+    POLL_ENTRY *old = NULL, *new = NULL;
+
+    ck_assert_ptr_ne(mkdtemp(path), NULL);
+    snprintf(file, sizeof(file), "%s/file", path);
+
+    FILE *stream = fopen(file, "w");
+    fclose(stream);
+
+    ck_assert_int_eq(poller_snapshot(path, &old), 1);
+
+    stream = fopen(file, "w");
+    fputs("changed", stream);
+    fclose(stream);
+
+    ck_assert_int_eq(poller_refresh(path, old, 1, &new), 1);
+    ck_assert_ptr_eq(new[0].name, old[0].name);
+    ck_assert_int_eq(new[0].size, 7);
+
+    unlink(file);
+    ck_assert_int_eq(poller_refresh(path, old, 1, &new), -1);
+
+    rmdir(path);
+    poller_free_snapshot(old, 1);
+}
+END_TEST
+
+Suite *poller_suite(void)
+{
+    Suite *s = suite_create("poller");
+
+    TCase *tc_core = tcase_create("When comparing snapshots of a directory");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    tcase_add_test(tc_core, appends_an_aligned_inotify_event);
+    tcase_add_test(tc_core, reports_created_and_deleted_entries);
+    tcase_add_test(tc_core, reports_modified_files);
+    tcase_add_test(tc_core, reports_a_replaced_directory_as_deleted_and_created);
+    tcase_add_test(tc_core, reports_only_the_requested_events);
+    tcase_add_test(tc_core, reports_a_renamed_entry_as_moved);
+    tcase_add_test(tc_core, refreshes_the_known_entries_of_a_directory);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s = poller_suite();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <check.h>
+#include <sys/inotify.h>
+
+#include "../src/rollup.h"
+
+/* helper functions */
+char prefix[64];
+
+char *prefix_of(const char *path)
+{
+    ck_assert_int_eq(rollup_prefix_of(path, prefix, sizeof(prefix)), 0);
+    return prefix;
+}
+
+/* writes the records released as "<prefix>:<mask>:<count>" */
+char released[256];
+
+void release()
+{
+    ROLLUP_RECORD *record;
+
+    released[0] = '\0';
+    Queue *records = rollup_release();
+    while ((record = (ROLLUP_RECORD *)queue_dequeue(records)))
+    {
+        sprintf(released + strlen(released), "%s:%x:%lu ", record->prefix, record->mask, record->count);
+        rollup_free(record);
+    }
+    queue_free(records);
+}
+/* end of helper functions */
+
+void teardown(void)
+{
+    rollup_stop();
+}
+
+START_TEST(rolls_up_into_the_ancestor_at_the_depth)
+{
+    ck_assert_int_ne(rollup_start(2, ROLLUP_DEFAULT_WINDOW_MS), -1);
+
+    ck_assert_str_eq(prefix_of("services/foo/src/main.c"), "services/foo/");
+    ck_assert_str_eq(prefix_of("services/foo/"), "services/foo/");
+    ck_assert_str_eq(prefix_of("services/foo"), "services/");
+    ck_assert_str_eq(prefix_of("README.md"), "");
+
+    /* the buffer is too short */
+    ck_assert_int_eq(rollup_prefix_of("services/foo/src/main.c", prefix, 8), -1);
+}
+END_TEST
+
+START_TEST(rolls_up_into_the_longest_prefix)
+{
+    ck_assert_int_eq(rollup_add_prefix("services"), 0);
+    ck_assert_int_eq(rollup_add_prefix("services/foo/"), 0);
+    ck_assert_int_ne(rollup_start(-1, ROLLUP_DEFAULT_WINDOW_MS), -1);
+
+    ck_assert_str_eq(prefix_of("services/foo/src/main.c"), "services/foo/");
+    ck_assert_str_eq(prefix_of("services/bar/main.c"), "services/");
+    ck_assert_str_eq(prefix_of("servicesfoo/main.c"), "");
+    ck_assert_str_eq(prefix_of("docs/index.md"), "");
+}
+END_TEST
+
+START_TEST(rolls_up_into_the_root_prefix_before_the_depth)
+{
+    ck_assert_int_eq(rollup_add_prefix("/"), 0);
+    ck_assert_int_eq(rollup_add_prefix("services/foo"), 0);
+    ck_assert_int_ne(rollup_start(2, ROLLUP_DEFAULT_WINDOW_MS), -1);
+
+    ck_assert_str_eq(prefix_of("services/foo/src/main.c"), "services/foo/");
+    ck_assert_str_eq(prefix_of("docs/api/index.md"), "");
+}
+END_TEST
+
+START_TEST(releases_a_record_per_prefix)
+{
+    ck_assert_int_ne(rollup_start(1, 100), -1);
+    struct pollfd pfd = {rollup_descriptor(), POLLIN, 0};
+
+    ck_assert_int_eq(rollup_event("b/one", IN_CREATE), 0);
+    ck_assert_int_eq(rollup_event("a/deep/two", IN_MODIFY), 0);
+    ck_assert_int_eq(rollup_event("b/one", IN_MODIFY), 0);
+    ck_assert_int_eq(rollup_event("b/three", IN_DELETE), 0);
+    ck_assert_int_eq(rollup_pending(), 2);
+
+    /* the window is over */
+    ck_assert_int_eq(poll(&pfd, 1, 2000), 1);
+    release();
+    ck_assert_str_eq(released, "b/:302:3 a/:2:1 ");
+    ck_assert_int_eq(rollup_pending(), 0);
+
+    /* the next window starts with the next event */
+    ck_assert_int_eq(poll(&pfd, 1, 0), 0);
+    ck_assert_int_eq(rollup_event("a/two", IN_MODIFY), 0);
+    ck_assert_int_eq(poll(&pfd, 1, 2000), 1);
+    release();
+    ck_assert_str_eq(released, "a/:2:1 ");
+}
+END_TEST
+
+Suite *rollup_suite(void)
+{
+    Suite *s = suite_create("rollup");
+
+    TCase *tc_core = tcase_create("When the events are rolled up");
+    tcase_add_checked_fixture(tc_core, NULL, teardown);
+
+    tcase_add_test(tc_core, rolls_up_into_the_ancestor_at_the_depth);
+    tcase_add_test(tc_core, rolls_up_into_the_longest_prefix);
+    tcase_add_test(tc_core, rolls_up_into_the_root_prefix_before_the_depth);
+    tcase_add_test(tc_core, releases_a_record_per_prefix);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s = rollup_suite();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <check.h>
+
+#include "../src/shard.h"
+
+void setup(void)
+{
+}
+
+void teardown(void)
+{
+}
+
+START_TEST(assigns_a_whole_subtree_to_the_same_shard)
+{
+    int shard = shard_of("/home/cwatch/", "/home/cwatch/src/", 8);
+
+    ck_assert_int_eq(shard_of("/home/cwatch/", "/home/cwatch/src/a/", 8), shard);
+    ck_assert_int_eq(shard_of("/home/cwatch/", "/home/cwatch/src/a/b/", 8), shard);
+}
+END_TEST
+
+START_TEST(assigns_the_watched_directory_to_the_first_shard)
+{
+    ck_assert_int_eq(shard_of("/home/cwatch/", "/home/cwatch/", 8), 0);
+}
+END_TEST
+
+START_TEST(assigns_a_shard_to_directories_outside_the_tree)
+{
+    int shard = shard_of("/home/cwatch/", "/opt/linked/", 8);
+
+    ck_assert(shard >= 0 && shard < 8);
+}
+END_TEST
+
+START_TEST(merges_the_events_of_the_shards)
+{
+    char path[] = "/tmp/check_shard_XXXXXX";
+    char file[64];
+    char buffer[4096];
+
+    ck_assert_ptr_ne(mkdtemp(path), NULL);
+
+    int fd = shards_start("/tmp/", 4, NULL);
+    ck_assert_int_ne(fd, -1);
+
+    int wd = shard_add_watch(fd, path, IN_CREATE);
+    ck_assert_int_ne(wd, -1);
+
+    /* a directory keeps its descriptor, unique across the shards */
+    ck_assert_int_eq(shard_add_watch(fd, path, IN_CREATE), wd);
+    int other = shard_add_watch(fd, "/tmp/", IN_CREATE);
+    ck_assert_int_ne(other, -1);
+    ck_assert_int_ne(other, wd);
+    ck_assert_int_eq(shard_rm_watch(fd, other), 0);
+    ck_assert_int_eq(shard_rm_watch(fd, other), -1);
+
+    snprintf(file, sizeof(file), "%s/file", path);
+    fclose(fopen(file, "w"));
+
+    ck_assert(read(fd, buffer, sizeof(buffer)) > 0);
+    ck_assert_int_eq(((struct inotify_event *)buffer)->wd, wd);
+    ck_assert_str_eq(((struct inotify_event *)buffer)->name, "file");
+
+    ck_assert_int_eq(shard_rm_watch(fd, wd), 0);
+
+    unlink(file);
+    rmdir(path);
+}
+END_TEST
+
+Suite *shard_suite(void)
+{
+    Suite *s = suite_create("shard");
+
+    TCase *tc_core = tcase_create("When spreading the watches across many inotify instances");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    tcase_add_test(tc_core, assigns_a_whole_subtree_to_the_same_shard);
+    tcase_add_test(tc_core, assigns_the_watched_directory_to_the_first_shard);
+    tcase_add_test(tc_core, assigns_a_shard_to_directories_outside_the_tree);
+    tcase_add_test(tc_core, merges_the_events_of_the_shards);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s = shard_suite();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <check.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+
+#include "../src/shmring.h"
+
+/* helper functions */
+void publish(uint64_t from, uint64_t to, const char *name)
+{
+    for (; from <= to; ++from)
+        shmring_publish(from, IN_CREATE, 0, "/home/cwatch/", name);
+}
+
+void *publish_later(void *arg)
+{
+    usleep(50000);
+    publish(1, 1, "file");
+    shmring_flush();
+    return NULL;
+}
+/* end of helper functions */
+
+char directory[64];
+char socket_path[96];
+char command[128];
+SHMRING_READER reader;
+
+void setup(void)
+{
+    snprintf(directory, sizeof(directory), "/tmp/check_shmring_XXXXXX");
+    ck_assert_ptr_ne(mkdtemp(directory), NULL);
+    snprintf(socket_path, sizeof(socket_path), "%s/socket", directory);
+
+    ck_assert_int_eq(shmring_start(socket_path, SHMRING_MIN_SIZE), 0);
+    ck_assert_int_eq(shmring_attach(shmring_descriptor(), &reader), 0);
+}
+
+void teardown(void)
+{
+    shmring_detach(&reader);
+    shmring_stop();
+
+    snprintf(command, sizeof(command), "rm -rf %s", directory);
+    ck_assert_int_eq(system(command), 0);
+}
+
+START_TEST(gives_the_events_once_they_are_published)
+{
+    const SHMRING_RECORD *record;
+
+    shmring_publish(1, IN_CREATE, 0, "/home/cwatch/", "file");
+    shmring_publish(2, IN_MOVED_FROM, 7, "/home/cwatch/", "");
+    ck_assert_int_eq(shmring_next(&reader, &record), SHMRING_EMPTY);
+
+    shmring_flush();
+
+    ck_assert_int_eq(shmring_next(&reader, &record), SHMRING_READ);
+    ck_assert_uint_eq(record->sequence, 1);
+    ck_assert_uint_eq(record->mask, IN_CREATE);
+    ck_assert_uint_eq(record->path_len, 17);
+    ck_assert_str_eq(record->path, "/home/cwatch/file");
+    ck_assert_int_eq(shmring_valid(&reader), 1);
+
+    ck_assert_int_eq(shmring_next(&reader, &record), SHMRING_READ);
+    ck_assert_uint_eq(record->sequence, 2);
+    ck_assert_uint_eq(record->cookie, 7);
+    ck_assert_str_eq(record->path, "/home/cwatch/");
+
+    ck_assert_int_eq(shmring_next(&reader, &record), SHMRING_EMPTY);
+}
+END_TEST
+
+START_TEST(wraps_around_the_end_of_the_data)
+{
+    const SHMRING_RECORD *record;
+    uint64_t sequence = 0;
+    uint64_t expected = 1;
+
+    /* more than ten times the size, read at each flush */
+    while (sequence < 50000)
+    {
+        publish(sequence + 1, sequence + 100, "a_file_with_a_long_enough_name");
+        sequence += 100;
+        shmring_flush();
+
+        while (shmring_next(&reader, &record) == SHMRING_READ)
+        {
+            ck_assert_uint_eq(record->sequence, expected++);
+            ck_assert_str_eq(record->path, "/home/cwatch/a_file_with_a_long_enough_name");
+            ck_assert_int_eq(shmring_valid(&reader), 1);
+        }
+    }
+
+    ck_assert_uint_eq(expected, 50001);
+}
+END_TEST
+
+START_TEST(tells_a_reader_that_it_has_been_lapped)
+{
+    const SHMRING_RECORD *record;
+
+    publish(1, 1, "file");
+    shmring_flush();
+    ck_assert_int_eq(shmring_next(&reader, &record), SHMRING_READ);
+
+    /* the record read is overwritten while it is used */
+    publish(2, 10000, "file");
+    shmring_flush();
+    ck_assert_int_eq(shmring_valid(&reader), 0);
+
+    ck_assert_int_eq(shmring_next(&reader, &record), SHMRING_LAPPED);
+    ck_assert_int_eq(shmring_next(&reader, &record), SHMRING_EMPTY);
+
+    /* then it goes on from the last event */
+    publish(10001, 10001, "file");
+    shmring_flush();
+    ck_assert_int_eq(shmring_next(&reader, &record), SHMRING_READ);
+    ck_assert_uint_eq(record->sequence, 10001);
+}
+END_TEST
+
+START_TEST(wakes_up_the_waiting_readers)
+{
+    pthread_t writer;
+
+    ck_assert_int_eq(shmring_wait(&reader, 10), 0);
+
+    ck_assert_int_eq(pthread_create(&writer, NULL, publish_later, NULL), 0);
+    ck_assert_int_eq(shmring_wait(&reader, 5000), 1);
+    pthread_join(writer, NULL);
+}
+END_TEST
+
+START_TEST(gives_a_read_only_ring_through_the_socket)
+{
+    SHMRING_READER remote;
+    const SHMRING_RECORD *record;
+
+    int fd = shmring_receive(socket_path);
+    ck_assert_int_ne(fd, -1);
+    ck_assert_int_eq(shmring_attach(fd, &remote), 0);
+
+    ck_assert_ptr_eq(mmap(NULL, remote.mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0), MAP_FAILED);
+    close(fd);
+
+    publish(1, 1, "file");
+    shmring_flush();
+    ck_assert_int_eq(shmring_wait(&remote, 1000), 1);
+    ck_assert_int_eq(shmring_next(&remote, &record), SHMRING_READ);
+    ck_assert_str_eq(record->path, "/home/cwatch/file");
+
+    shmring_detach(&remote);
+}
+END_TEST
+
+Suite *shmring_suite(void)
+{
+    Suite *s = suite_create("shmring");
+
+    TCase *tc_core = tcase_create("When the events are read from shared memory");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    tcase_add_test(tc_core, gives_the_events_once_they_are_published);
+    tcase_add_test(tc_core, wraps_around_the_end_of_the_data);
+    tcase_add_test(tc_core, tells_a_reader_that_it_has_been_lapped);
+    tcase_add_test(tc_core, wakes_up_the_waiting_readers);
+    tcase_add_test(tc_core, gives_a_read_only_ring_through_the_socket);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s = shmring_suite();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
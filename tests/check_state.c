@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <check.h>
+#include <sys/stat.h>
+
+#include "../src/state.h"
+
+/* helper functions */
+char root[64];
+char file[96];
+char command[256];
+
+void make_tree(const char *paths)
+{
+    snprintf(command, sizeof(command), "cd %s && mkdir -p %s", root, paths);
+    ck_assert_int_eq(system(command), 0);
+}
+
+/* saves a directory record for each path, relative to root */
+void save(const char **paths, int qty)
+{
+    bstring records = bfromcstr("");
+    char path[256];
+    int i;
+
+    for (i = 0; i < qty; ++i)
+    {
+        snprintf(path, sizeof(path), "%s%s", root, paths[i]);
+        ck_assert_int_eq(state_append(records, path, (path[strlen(path) - 1] == '/') ? DT_DIR : DT_LNK, 0), 0);
+    }
+
+    ck_assert_int_eq(state_save(file, records, qty, STATE_OPTIONS_INIT), 0);
+    bdestroy(records);
+}
+
+/* makes the directories old enough to trust their mtime */
+void age(const char *relative)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s%s", root, relative);
+    snprintf(command, sizeof(command), "touch -d '-1 minute' %s", path);
+    ck_assert_int_eq(system(command), 0);
+}
+/* end of helper functions */
+
+void setup(void)
+{
+    snprintf(root, sizeof(root), "/tmp/check_state_XXXXXX");
+    ck_assert_ptr_ne(mkdtemp(root), NULL);
+    strcat(root, "/");
+    snprintf(file, sizeof(file), "%sstate", root);
+}
+
+void teardown(void)
+{
+    snprintf(command, sizeof(command), "rm -rf %s", root);
+    ck_assert_int_eq(system(command), 0);
+}
+
+START_TEST(restores_the_saved_records)
+{
+    const char *paths[] = {"", "b/", "a/", "a/link"};
+    char path[256];
+
+    make_tree("a b");
+    save(paths, 4);
+
+    STATE_SNAPSHOT *snapshot = state_load(file, STATE_OPTIONS_INIT);
+    ck_assert_ptr_ne(snapshot, NULL);
+    ck_assert_int_eq(snapshot->qty, 4);
+
+    snprintf(path, sizeof(path), "%sa/link", root);
+    ck_assert_ptr_ne(state_find(snapshot, path), NULL);
+    ck_assert_int_eq(state_find(snapshot, path)->type, DT_LNK);
+
+    snprintf(path, sizeof(path), "%sc/", root);
+    ck_assert_ptr_eq(state_find(snapshot, path), NULL);
+
+    state_free(snapshot);
+}
+END_TEST
+
+START_TEST(lists_only_the_entries_of_a_directory)
+{
+    const char *paths[] = {"", "a/", "a/b/", "a/b/c/", "a-b/", "a/link", "d/"};
+    char name[NAME_MAX + 1];
+    unsigned char type;
+    int cursor = -1;
+    int qty = 0;
+
+    make_tree("a/b/c a-b d");
+    save(paths, 7);
+
+    STATE_SNAPSHOT *snapshot = state_load(file, STATE_OPTIONS_INIT);
+    ck_assert_ptr_ne(snapshot, NULL);
+
+    while (state_next_entry(snapshot, root, &cursor, name, &type))
+    {
+        ck_assert(strcmp(name, "a") == 0 || strcmp(name, "a-b") == 0 || strcmp(name, "d") == 0);
+        ck_assert_int_eq(type, DT_DIR);
+        ++qty;
+    }
+    ck_assert_int_eq(qty, 3);
+
+    char path[256];
+    snprintf(path, sizeof(path), "%sa/", root);
+    cursor = -1;
+    qty = 0;
+    while (state_next_entry(snapshot, path, &cursor, name, &type))
+        ++qty;
+    ck_assert_int_eq(qty, 2);
+
+    state_free(snapshot);
+}
+END_TEST
+
+START_TEST(trusts_only_the_directories_not_changed)
+{
+    const char *paths[] = {"", "a/", "b/"};
+    char path[256];
+    struct stat st;
+
+    make_tree("a b");
+    age("a");
+    save(paths, 3);
+
+    STATE_SNAPSHOT *snapshot = state_load(file, STATE_OPTIONS_INIT);
+    ck_assert_ptr_ne(snapshot, NULL);
+
+    /* changed in the last second */
+    snprintf(path, sizeof(path), "%sb/", root);
+    ck_assert_int_eq(stat(path, &st), 0);
+    ck_assert_int_eq(state_unchanged(snapshot, path, &st), 0);
+
+    snprintf(path, sizeof(path), "%sa/", root);
+    ck_assert_int_eq(stat(path, &st), 0);
+    ck_assert_int_eq(state_unchanged(snapshot, path, &st), 1);
+
+    make_tree("a/new");
+    ck_assert_int_eq(stat(path, &st), 0);
+    ck_assert_int_eq(state_unchanged(snapshot, path, &st), 0);
+
+    state_free(snapshot);
+}
+END_TEST
+
+START_TEST(does_not_restore_a_corrupted_state)
+{
+    const char *paths[] = {"", "a/"};
+
+    make_tree("a");
+    save(paths, 2);
+
+    ck_assert_int_eq(truncate(file, sizeof(STATE_HEADER) + sizeof(STATE_RECORD) + 4), 0);
+    ck_assert_ptr_eq(state_load(file, STATE_OPTIONS_INIT), NULL);
+
+    ck_assert_int_eq(unlink(file), 0);
+    ck_assert_ptr_eq(state_load(file, STATE_OPTIONS_INIT), NULL);
+}
+END_TEST
+
+START_TEST(does_not_restore_a_state_of_other_options)
+{
+    const char *paths[] = {"", "a/"};
+
+    make_tree("a");
+    save(paths, 2);
+
+    uint64_t options = state_hash(STATE_OPTIONS_INIT, "-x", "a");
+    ck_assert_ptr_eq(state_load(file, options), NULL);
+
+    /* the value is hashed with its option */
+    ck_assert(state_hash(STATE_OPTIONS_INIT, "-x", "ab") != state_hash(STATE_OPTIONS_INIT, "-xa", "b"));
+}
+END_TEST
+
+Suite *state_suite(void)
+{
+    Suite *s = suite_create("state");
+
+    TCase *tc_core = tcase_create("When restarting from a saved state");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    tcase_add_test(tc_core, restores_the_saved_records);
+    tcase_add_test(tc_core, lists_only_the_entries_of_a_directory);
+    tcase_add_test(tc_core, trusts_only_the_directories_not_changed);
+    tcase_add_test(tc_core, does_not_restore_a_corrupted_state);
+    tcase_add_test(tc_core, does_not_restore_a_state_of_other_options);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s = state_suite();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <check.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "../src/subscribe.h"
+
+/* helper functions */
+uint32_t events_of(const char *list)
+{
+    if (strcmp(list, "create") == 0)
+        return IN_CREATE;
+    if (strcmp(list, "delete") == 0)
+        return IN_DELETE;
+    if (strcmp(list, "create,delete") == 0)
+        return IN_CREATE | IN_DELETE;
+    return 0;
+}
+
+void release(SUBSCRIBER *subscriber)
+{
+    free(subscriber->prefix);
+    if (subscriber->include != NULL)
+        pathglob_free(subscriber->include);
+    if (subscriber->exclude != NULL)
+    {
+        regfree(subscriber->exclude);
+        free(subscriber->exclude);
+    }
+    free(subscriber);
+}
+
+SUBSCRIBER *parse(const char *request, const char **error)
+{
+    SUBSCRIBER *subscriber = (SUBSCRIBER *)calloc(1, sizeof(SUBSCRIBER));
+    *error = subscribe_parse(subscriber, request);
+    return subscriber;
+}
+
+char socket_path[96];
+
+/* connects and subscribes, returns the descriptor */
+int subscribe(const char *request)
+{
+    struct sockaddr_un address;
+    struct timeval timeout = {5, 0};
+    char answer[8];
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ck_assert_int_eq(connect(fd, (struct sockaddr *)&address, sizeof(address)), 0);
+    ck_assert_int_eq(write(fd, request, strlen(request)), strlen(request));
+
+    ck_assert_int_eq(read(fd, answer, 3), 3);
+    answer[3] = '\0';
+    ck_assert_str_eq(answer, "OK\n");
+
+    return fd;
+}
+
+/* reads the given number of lines */
+char lines[4096];
+
+char *read_lines(int fd, int qty)
+{
+    size_t length = 0;
+    ssize_t bytes;
+
+    while (qty > 0 && (bytes = read(fd, lines + length, 1)) == 1)
+    {
+        if (lines[length++] == '\n')
+            --qty;
+    }
+    lines[length] = '\0';
+
+    return lines;
+}
+/* end of helper functions */
+
+char directory[64];
+char command[128];
+
+void setup(void)
+{
+    snprintf(directory, sizeof(directory), "/tmp/check_subscribe_XXXXXX");
+    ck_assert_ptr_ne(mkdtemp(directory), NULL);
+    snprintf(socket_path, sizeof(socket_path), "%s/socket", directory);
+
+    ck_assert_int_eq(subscribe_start(socket_path, "/home/cwatch/", events_of), 0);
+}
+
+void teardown(void)
+{
+    subscribe_stop();
+
+    snprintf(command, sizeof(command), "rm -rf %s", directory);
+    ck_assert_int_eq(system(command), 0);
+}
+
+START_TEST(parses_the_filters_of_a_request)
+{
+    const char *error;
+
+    SUBSCRIBER *subscriber = parse("SUBSCRIBE events=create prefix=src/ include=**/*.c exclude=/test .*", &error);
+    ck_assert_ptr_eq(error, NULL);
+    ck_assert_uint_eq(subscriber->mask, IN_CREATE);
+    ck_assert_str_eq(subscriber->prefix, "/home/cwatch/src/");
+    ck_assert_ptr_ne(subscriber->include, NULL);
+    ck_assert_ptr_ne(subscriber->exclude, NULL);
+    release(subscriber);
+
+    subscriber = parse("SUBSCRIBE", &error);
+    ck_assert_ptr_eq(error, NULL);
+    ck_assert_uint_eq(subscriber->mask, UINT32_MAX);
+    ck_assert_ptr_eq(subscriber->prefix, NULL);
+    release(subscriber);
+
+    subscriber = parse("SUBSCRIBE prefix=/var/", &error);
+    ck_assert_str_eq(subscriber->prefix, "/var/");
+    release(subscriber);
+}
+END_TEST
+
+START_TEST(refuses_a_malformed_request)
+{
+    const char *error;
+
+    release(parse("SINCE 10", &error));
+    ck_assert_ptr_ne(error, NULL);
+
+    release(parse("SUBSCRIBEX", &error));
+    ck_assert_ptr_ne(error, NULL);
+
+    release(parse("SUBSCRIBE events=explode", &error));
+    ck_assert_str_eq(error, "unrecognized events");
+
+    release(parse("SUBSCRIBE colour=blue", &error));
+    ck_assert_str_eq(error, "unrecognized filter");
+
+    release(parse("SUBSCRIBE exclude=(", &error));
+    ck_assert_str_eq(error, "malformed exclude regex");
+}
+END_TEST
+
+START_TEST(filters_the_events_of_a_subscriber)
+{
+    const char *error;
+    SUBSCRIBER *subscriber = parse("SUBSCRIBE events=create,delete prefix=src/ include=**/*.c exclude=_test\\.c$", &error);
+    ck_assert_ptr_eq(error, NULL);
+
+    ck_assert_int_eq(subscribe_wants(subscriber, IN_CREATE, "/home/cwatch/src/main.c"), 1);
+    ck_assert_int_eq(subscribe_wants(subscriber, IN_DELETE, "/home/cwatch/src/lib/list.c"), 1);
+    ck_assert_int_eq(subscribe_wants(subscriber, IN_MODIFY, "/home/cwatch/src/main.c"), 0);
+    ck_assert_int_eq(subscribe_wants(subscriber, IN_CREATE, "/home/cwatch/doc/main.c"), 0);
+    ck_assert_int_eq(subscribe_wants(subscriber, IN_CREATE, "/home/cwatch/src/main.h"), 0);
+    ck_assert_int_eq(subscribe_wants(subscriber, IN_CREATE, "/home/cwatch/src/main_test.c"), 0);
+
+    release(subscriber);
+}
+END_TEST
+
+START_TEST(streams_the_events_to_the_subscribers)
+{
+    int all = subscribe("SUBSCRIBE\n");
+    int created = subscribe("SUBSCRIBE events=create prefix=src/\n");
+    ck_assert_int_eq(subscribe_clients(), 2);
+
+    subscribe_publish(1, IN_CREATE, 0, "/home/cwatch/src/", "main.c");
+    subscribe_publish(2, IN_DELETE, 0, "/home/cwatch/src/", "main.o");
+    subscribe_publish(3, IN_CREATE, 0, "/home/cwatch/doc/", "new\nline");
+    subscribe_flush();
+    subscribe_publish(4, IN_CREATE, 0, "/home/cwatch/src/", "list.c");
+    subscribe_flush();
+
+    ck_assert_str_eq(read_lines(all, 4), "1 0x00000100 0 /home/cwatch/src/main.c\n"
+                                         "2 0x00000200 0 /home/cwatch/src/main.o\n"
+                                         "3 0x00000100 0 /home/cwatch/doc/new\\nline\n"
+                                         "4 0x00000100 0 /home/cwatch/src/list.c\n");
+    ck_assert_str_eq(read_lines(created, 2), "1 0x00000100 0 /home/cwatch/src/main.c\n"
+                                             "4 0x00000100 0 /home/cwatch/src/list.c\n");
+
+    close(all);
+    close(created);
+}
+END_TEST
+
+START_TEST(drops_a_subscriber_that_falls_behind)
+{
+    int slow = subscribe("SUBSCRIBE\n");
+    int fast = subscribe("SUBSCRIBE events=delete\n");
+
+    int i, j;
+    for (i = 0; i < 200; ++i)
+    {
+        for (j = 0; j < 1000; ++j)
+            subscribe_publish(i * 1000 + j + 1, IN_CREATE, 0, "/home/cwatch/", "file");
+        subscribe_flush();
+    }
+
+    for (i = 0; i < 500 && subscribe_clients() > 1; ++i)
+        usleep(10000);
+    ck_assert_int_eq(subscribe_clients(), 1);
+
+    /* the other subscriber is still served */
+    subscribe_publish(200001, IN_DELETE, 0, "/home/cwatch/", "file");
+    subscribe_flush();
+    ck_assert_str_eq(read_lines(fast, 1), "200001 0x00000200 0 /home/cwatch/file\n");
+
+    close(slow);
+    close(fast);
+}
+END_TEST
+
+Suite *subscribe_suite(void)
+{
+    Suite *s = suite_create("subscribe");
+
+    TCase *tc_core = tcase_create("When consumers subscribe to the events");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    tcase_add_test(tc_core, parses_the_filters_of_a_request);
+    tcase_add_test(tc_core, refuses_a_malformed_request);
+    tcase_add_test(tc_core, filters_the_events_of_a_subscriber);
+    tcase_add_test(tc_core, streams_the_events_to_the_subscribers);
+    tcase_add_test(tc_core, drops_a_subscriber_that_falls_behind);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s = subscribe_suite();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "cwatch_plugin.h"
+
+/* a plugin for check_plugin. The argument chooses how it behaves:
+ * record (the default), fail, refuse or old-abi
+ */
+static char mode[16];
+static char seen[4096];
+static int batches = 0;
+static int finished = 0;
+
+static int batch(const CWATCH_PLUGIN_EVENT *events, int qty)
+{
+    ++batches;
+
+    if (strcmp(mode, "fail") == 0)
+        return -1;
+
+    int i;
+    for (i = 0; i < qty; ++i)
+        snprintf(seen + strlen(seen), sizeof(seen) - strlen(seen), "%llu 0x%08x %s %s%s %s\n",
+                 (unsigned long long)events[i].sequence, events[i].mask, events[i].event,
+                 events[i].path, events[i].name, (events[i].capture != NULL) ? events[i].capture : "-");
+
+    return 0;
+}
+
+static void fini(void)
+{
+    ++finished;
+}
+
+int cwatch_plugin_init(uint32_t abi, const char *root, const char *argument, CWATCH_PLUGIN *plugin)
+{
+    snprintf(mode, sizeof(mode), "%s", (argument != NULL) ? argument : "record");
+    seen[0] = '\0';
+    batches = finished = 0;
+
+    if (strcmp(mode, "refuse") == 0)
+        return -1;
+
+    plugin->abi = (strcmp(mode, "old-abi") == 0) ? abi + 1 : CWATCH_PLUGIN_ABI;
+    plugin->batch = batch;
+    plugin->fini = fini;
+
+    return 0;
+}
+
+const char *sample_seen(void)
+{
+    return seen;
+}
+
+int sample_batches(void)
+{
+    return batches;
+}
+
+int sample_finished(void)
+{
+    return finished;
+}
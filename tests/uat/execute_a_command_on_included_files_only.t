@@ -0,0 +1,21 @@
+#!/bin/sh
+
+test_description="cwatch execute a command only on files matching the include globs"
+
+. ./libtest/util.sh
+. ./libtest/sharness.sh
+
+test_expect_success "touch a file only when an included file is created" '
+        mkdir -p box/src/module box/doc &&
+        cwatch -d "box" -r -i "src/**/*.{c,h}" -c "touch expected" -e create &&
+        sleep 0.5 &&
+        touch box/doc/excluded.c &&
+        touch box/src/module/excluded.o &&
+        sleep 1 &&
+        [ ! -e expected ] &&
+        touch box/src/module/included.c &&
+        sleep 1 &&
+        kill_cwatch &&
+        [ -e expected ]
+    '
+test_done
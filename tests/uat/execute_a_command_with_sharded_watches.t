@@ -0,0 +1,17 @@
+#!/bin/sh
+
+test_description="cwatch spreads the watches across many inotify instances"
+
+. ./libtest/util.sh
+. ./libtest/sharness.sh
+
+test_expect_success "touch a file on create event inside any subtree" '
+        mkdir -p box/one box/two box/three &&
+        cwatch -d "box" -r --shards 3 -c "touch expected" -e create &&
+        sleep 0.5 &&
+        touch box/three/actual &&
+        sleep 0.5 &&
+        kill_cwatch &&
+        [ -e expected ]
+    '
+test_done
@@ -0,0 +1,21 @@
+#!/bin/sh
+
+test_description="cwatch appends the events reported to a binary journal"
+
+. ./libtest/util.sh
+. ./libtest/sharness.sh
+
+test_expect_success "write the events into a segment of the journal" '
+        mkdir box &&
+        cwatch -d "box" --journal journal -c "touch expected" -e create &&
+        sleep 0.5 &&
+        touch box/a box/b &&
+        sleep 0.5 &&
+        kill_cwatch &&
+        sleep 0.5 &&
+        [ -f expected ] &&
+        [ $(ls journal/*.cwj | wc -l) -eq 1 ] &&
+        grep -q "box/a" journal/*.cwj &&
+        grep -q "box/b" journal/*.cwj
+    '
+test_done
@@ -0,0 +1,17 @@
+#!/bin/sh
+
+test_description="cwatch polls the directories beyond the watch budget"
+
+. ./libtest/util.sh
+. ./libtest/sharness.sh
+
+test_expect_success "touch a file on create event inside a polled directory" '
+        mkdir -p box/polled &&
+        cwatch -d "box" -r --max-watches 1 --poll-interval 1 -c "touch expected" -e create &&
+        sleep 0.5 &&
+        touch box/polled/actual &&
+        sleep 2 &&
+        kill_cwatch &&
+        [ -e expected ]
+    '
+test_done
@@ -0,0 +1,28 @@
+#!/bin/sh
+
+test_description="cwatch reports the events of the poll backend"
+
+. ./libtest/util.sh
+. ./libtest/sharness.sh
+
+test_expect_success "touch a file on create event with the poll backend" '
+        mkdir -p box/sub &&
+        cwatch -d "box" -r --backend poll --poll-interval 1 -c "touch expected" -e create &&
+        sleep 0.5 &&
+        touch box/sub/actual &&
+        sleep 2 &&
+        kill_cwatch &&
+        [ -e expected ]
+    '
+
+test_expect_success "touch a file on moved_to event with the poll backend" '
+        mkdir -p box &&
+        touch box/before &&
+        cwatch -d "box" --backend poll --poll-interval 1 -c "touch moved" -e moved_to &&
+        sleep 0.5 &&
+        mv box/before box/after &&
+        sleep 2 &&
+        kill_cwatch &&
+        [ -e moved ]
+    '
+test_done
@@ -0,0 +1,29 @@
+#!/bin/sh
+
+test_description="cwatch reports once each entry of a directory tree created at once"
+
+. ./libtest/util.sh
+. ./libtest/sharness.sh
+
+test_expect_success "report a create event for each entry of a new tree" '
+        mkdir box &&
+        cwatch -d "box" -r -c "sh -c \"echo created >> created.log\"" -e create &&
+        sleep 0.5 &&
+        mkdir -p box/a/b/c && touch box/a/b/c/f &&
+        sleep 1 &&
+        kill_cwatch &&
+        [ $(wc -l < created.log) -eq 4 ]
+    '
+
+test_expect_success "watch the directories of a new tree" '
+        rm -f created.log &&
+        cwatch -d "box" -r -c "sh -c \"echo created >> created.log\"" -e create &&
+        sleep 0.5 &&
+        mkdir -p box/x/y/z &&
+        sleep 0.5 &&
+        touch box/x/y/z/g &&
+        sleep 0.5 &&
+        kill_cwatch &&
+        [ $(wc -l < created.log) -eq 4 ]
+    '
+test_done
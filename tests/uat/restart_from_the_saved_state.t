@@ -0,0 +1,35 @@
+#!/bin/sh
+
+test_description="cwatch saves the watched directories and restarts from them"
+
+. ./libtest/util.sh
+. ./libtest/sharness.sh
+
+test_expect_success "save the state on exit" '
+        mkdir -p box/a/x box/c &&
+        cwatch -d "box" -r --state-file state -c "touch expected" -e create &&
+        sleep 0.5 &&
+        kill_cwatch &&
+        sleep 0.5 &&
+        [ -f state ]
+    '
+
+test_expect_success "report the directories created and deleted while not running" '
+        mkdir box/b &&
+        rmdir box/a/x &&
+        cwatch -d "box" -r --state-file state --state-changes -c "sh -c \"echo changed >> changes.log\"" -e create,delete &&
+        sleep 0.5 &&
+        kill_cwatch &&
+        [ $(wc -l < changes.log) -eq 2 ]
+    '
+
+test_expect_success "watch the directories restored from the state" '
+        sleep 1.5 &&
+        cwatch -d "box" -r --state-file state -c "touch expected" -e create &&
+        sleep 0.5 &&
+        touch box/c/file &&
+        sleep 0.5 &&
+        kill_cwatch &&
+        [ -f expected ]
+    '
+test_done
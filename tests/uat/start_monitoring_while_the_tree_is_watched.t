@@ -0,0 +1,29 @@
+#!/bin/sh
+
+test_description="cwatch starts monitoring at once and signals when the whole tree is watched"
+
+. ./libtest/util.sh
+. ./libtest/sharness.sh
+
+test_expect_success "write the time to ready once the whole tree is watched" '
+        mkdir box &&
+        for i in 1 2 3 4 5 6 7 8; do mkdir -p box/$i/a/b/c; done &&
+        cwatch -d "box" -r --progressive --ready-file ready -c "touch expected" -e create &&
+        sleep 1 &&
+        [ -f ready ] &&
+        [ $(cat ready) -ge 0 ] &&
+        touch box/8/a/b/c/deep &&
+        sleep 0.5 &&
+        kill_cwatch &&
+        [ -f expected ]
+    '
+
+test_expect_success "replace the ready file of a previous run" '
+        echo stale > ready &&
+        cwatch -d "box" -r --ready-file ready -c "touch expected" -e create &&
+        sleep 0.5 &&
+        [ $(cat ready) -ge 0 ] &&
+        [ ! -f ready.tmp ] &&
+        kill_cwatch
+    '
+test_done
@@ -0,0 +1,20 @@
+#!/bin/sh
+
+test_description="cwatch watches in background the directories of a tree moved in"
+
+. ./libtest/util.sh
+. ./libtest/sharness.sh
+
+test_expect_success "execute the command for a file deep in a tree moved in" '
+        mkdir box outside &&
+        for i in 1 2 3 4 5 6 7 8; do mkdir -p outside/tree/$i/a/b/c; done &&
+        cwatch -d "box" -r -c "touch expected" -e create &&
+        sleep 0.5 &&
+        mv outside/tree box/ &&
+        sleep 1 &&
+        touch box/tree/8/a/b/c/deep &&
+        sleep 0.5 &&
+        kill_cwatch &&
+        [ -f expected ]
+    '
+test_done
@@ -0,0 +1,19 @@
+#!/bin/sh
+
+test_description="cwatch keeps the tree up to date through the priority lane"
+
+. ./libtest/util.sh
+. ./libtest/sharness.sh
+
+test_expect_success "touch a file on modify event inside a new directory" '
+        mkdir -p box &&
+        cwatch -d "box" -r --priority-lane -c "touch expected" -e modify &&
+        sleep 0.5 &&
+        mkdir box/new &&
+        sleep 0.5 &&
+        echo "content" > box/new/actual &&
+        sleep 0.5 &&
+        kill_cwatch &&
+        [ -e expected ]
+    '
+test_done
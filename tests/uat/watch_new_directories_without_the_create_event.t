@@ -0,0 +1,20 @@
+#!/bin/sh
+
+test_description="cwatch watches new directories even if the create event is not requested"
+
+. ./libtest/util.sh
+. ./libtest/sharness.sh
+
+test_expect_success "touch a file on modify event inside a new directory" '
+        mkdir box &&
+        cwatch -d "box" -r -c "touch expected" -e modify &&
+        sleep 0.5 &&
+        mkdir box/new &&
+        sleep 0.5 &&
+        [ ! -e expected ] &&
+        echo "modified" > box/new/actual &&
+        sleep 1 &&
+        kill_cwatch &&
+        [ -e expected ]
+    '
+test_done